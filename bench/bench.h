@@ -0,0 +1,50 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  Benchmark Helpers
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Returns a monotonic timestamp in seconds
+static inline double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Parses the iteration count from argv[1], falling back to def
+static inline long bench_iterations(int argc, char **argv, long def) {
+    if (argc > 1)
+        return atol(argv[1]);
+    return def;
+}
+
+static inline void bench_report(const char *name, long ops, double secs) {
+    printf("%-40s %10ld ops %8.3f s %12.0f ops/s\n", name, ops, secs,
+           ops / secs);
+}
+
+#endif /* BENCH_H_ */
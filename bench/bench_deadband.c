@@ -0,0 +1,138 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  Deadband Filter Benchmark
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+/*
+ * Simulates a day of slowly drifting, noisy temperature sensors sampled once
+ * a second and counts how many samples a deadband derived from the sensors'
+ * resolution lets through. Checks that a sensor that stops changing is still
+ * published once per heartbeat, and measures the rate of
+ * mio_deadband_check().
+ */
+
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <mio.h>
+#include "bench.h"
+
+#define NODE "3f2504e0-4f89-11d3-9a0c-0305e82c3301"
+#define KEYS 10
+#define SAMPLES 86400 // One day at 1 Hz per transducer
+#define RESOLUTION "0.1"
+#define NOISE 0.05 // Peak sample noise, half the resolution
+#define SWING 3.0 // Peak daily temperature swing
+#define HEARTBEAT_MS 20
+#define QUIET_MS 200
+
+static const char *names[KEYS] = { "t0", "t1", "t2", "t3", "t4", "t5", "t6",
+                                   "t7", "t8", "t9"
+                                 };
+
+static double noise(double peak) {
+    return peak * (2.0 * rand() / RAND_MAX - 1.0);
+}
+
+int main(int argc, char **argv) {
+    long i, n = bench_iterations(argc, argv, 1000000);
+    mio_meta_t *meta = mio_meta_new();
+    mio_transducer_meta_t *t_meta;
+    mio_data_t *data;
+    mio_deadband_stats_t stats;
+    mio_deadband_t *deadband;
+    double temp[KEYS], t;
+    uint64_t start;
+    char value[32];
+    int k, s, published = 0;
+
+    for (k = KEYS - 1; k >= 0; k--) {
+        t_meta = mio_transducer_meta_new();
+        t_meta->name = strdup(names[k]);
+        t_meta->resolution = strdup(RESOLUTION);
+        t_meta->next = meta->transducers;
+        meta->transducers = t_meta;
+        temp[k] = 20 + k;
+    }
+
+    // Samples go through mio_deadband_data_filter() as an application would
+    // before publishing them
+    deadband = mio_deadband_new(0, 0);
+    if (mio_deadband_meta_apply(deadband, NODE, meta) != KEYS) {
+        fprintf(stderr, "meta not applied\n");
+        return 1;
+    }
+    srand(1);
+    for (s = 0; s < SAMPLES; s++) {
+        data = mio_data_new();
+        data->event = strdup(NODE);
+        for (k = 0; k < KEYS; k++) {
+            // Follows the time of day plus a slow random walk
+            temp[k] += noise(0.002);
+            snprintf(value, sizeof(value), "%.3f", temp[k]
+                     + SWING * sin(2 * M_PI * s / SAMPLES) + noise(NOISE));
+            mio_data_transducer_data_add(data, MIO_TRANSDUCER_DATA,
+                                         (char*) names[k], value, "");
+        }
+        published += mio_deadband_data_filter(deadband, data);
+        mio_data_free(data);
+    }
+    mio_deadband_stats(deadband, &stats);
+    printf("%-40s %10d samples, %d published (%.1fx fewer)\n",
+           "drifting sensors, deadband " RESOLUTION, SAMPLES * KEYS,
+           published, (double) SAMPLES * KEYS / published);
+    if (stats.passed != published
+            || stats.passed + stats.suppressed != SAMPLES * KEYS) {
+        fprintf(stderr, "samples miscounted\n");
+        return 1;
+    }
+    mio_deadband_free(deadband);
+
+    // A sensor stuck at one value is published once per heartbeat
+    deadband = mio_deadband_new(0, HEARTBEAT_MS);
+    start = time_monotonic();
+    while (time_monotonic() - start < QUIET_MS) {
+        mio_deadband_check(deadband, NODE, names[0], "21.5");
+        usleep(1000);
+    }
+    mio_deadband_stats(deadband, &stats);
+    printf("%-40s %10llu published, %llu heartbeats in %d ms\n",
+           "stuck sensor, heartbeat 20 ms", (unsigned long long) stats.passed,
+           (unsigned long long) stats.heartbeats, QUIET_MS);
+    if (stats.heartbeats < QUIET_MS / HEARTBEAT_MS / 2
+            || stats.heartbeats > QUIET_MS / HEARTBEAT_MS) {
+        fprintf(stderr, "heartbeat missed\n");
+        return 1;
+    }
+    mio_deadband_free(deadband);
+
+    deadband = mio_deadband_new(0, 0);
+    mio_deadband_meta_apply(deadband, NODE, meta);
+    t = bench_now();
+    for (i = 0; i < n; i++)
+        mio_deadband_check(deadband, NODE, names[i % KEYS],
+                           i & 1 ? "21.53" : "21.48");
+    bench_report("mio_deadband_check", n, bench_now() - t);
+    mio_deadband_free(deadband);
+
+    mio_meta_free(meta);
+    return 0;
+}
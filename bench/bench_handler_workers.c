@@ -0,0 +1,244 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  Handler Worker Benchmark
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+/*
+ * Measures how many received stanzas per second are decoded with the handlers
+ * running in the event loop thread and with 1 to N handler workers, see
+ * mio_handler_workers_start(). History responses of 100 items answer
+ * in-flight requests through the IQ dispatch and complete them, pubsub events
+ * of 32 transducers go to mio_pubsub_data_receive_many() through the pubsub
+ * handler, with the stream decoder of mio_pubsub_data_listen_start() turned
+ * off so that they reach the workers. Besides the
+ * throughput, the CPU time the event loop thread spends parsing and
+ * dispatching is reported per stanza, which is all it does once workers
+ * decode.
+ *
+ *   ./bench_handler_workers [stanzas] [max workers]
+ */
+
+#include <string.h>
+#include <mio.h>
+#include "bench.h"
+
+#define BATCH 32
+#define HISTORY_ITEMS 100
+#define EVENT_TRANSDUCERS 32
+
+static char stream_open[] =
+    "<stream:stream xmlns='jabber:client' "
+    "xmlns:stream='http://etherx.jabber.org/streams' id='bench' "
+    "from='example.com' version='1.0'>";
+
+// Names are unique within a response, a repeated name replaces the transducer
+static char transducer_xml[] =
+    "<transducerData name='t%d_%d' value='21.5' timestamp='2014-01-01T00:00:00.000000-0500'/>";
+
+static long completed, completed_ok;
+
+static void open_ignore(xmpp_conn_t * const conn) {
+}
+
+static void history_complete(mio_conn_t *conn, mio_response_t *response,
+                             int status, void *userdata) {
+    mio_data_t *data;
+
+    if (status == MIO_OK && response->response_type == MIO_RESPONSE_PACKET) {
+        data = ((mio_packet_t*) response->response)->payload;
+        if (data->num_transducers == HISTORY_ITEMS * 4)
+            __atomic_add_fetch(&completed_ok, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_add_fetch(&completed, 1, __ATOMIC_RELAXED);
+    mio_response_free(response);
+}
+
+// Appends the items of a history response or the transducers of an event
+static char *body_new(int items, int transducers) {
+    char *body = malloc(items * (64 + transducers * 96) + 1), *p = body;
+    int i, j;
+
+    for (i = 0; i < items; i++) {
+        p += sprintf(p, "<item id='3f2504e0-4f89-11d3-9a0c-%012d'>", i);
+        for (j = 0; j < transducers; j++)
+            p += sprintf(p, transducer_xml, i, j);
+        p += sprintf(p, "</item>");
+    }
+    return body;
+}
+
+// CPU time of the calling thread, unlike wall time it does not count the
+// time workers sharing a core take from the event loop thread
+static double thread_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *what, int workers, long n, double secs,
+                   double loop_secs) {
+    char name[64];
+
+    snprintf(name, sizeof(name), "%s, %d workers", what, workers);
+    bench_report(name, n, secs);
+    printf("%-40s %10.1f us/stanza of event loop CPU time\n", "",
+           loop_secs * 1e6 / n);
+}
+
+// Sends n history requests and feeds their responses, returns nonzero if any
+// did not complete with all items decoded
+static int run_history(mio_conn_t *conn, const char *body, int workers, long n) {
+    int len = strlen(body) + 512, i, off;
+    char *batch = malloc(BATCH * len);
+    mio_request_t *request;
+    mio_response_t *response;
+    double t, loop_secs = 0, t_feed;
+    long sent;
+
+    completed = completed_ok = 0;
+    t = bench_now();
+    for (sent = 0; sent < n; sent += BATCH) {
+        for (i = off = 0; i < BATCH; i++) {
+            // Slots are released by the completions, wait for one like
+            // mio_send_async() does
+            request = _mio_request_acquire(conn, 1);
+            response = mio_response_new();
+            request->handler = (mio_handler) mio_handler_item_recent_get;
+            request->handler_type = MIO_HANDLER_ID;
+            request->response = response;
+            request->completion = history_complete;
+            request->completion_userdata = NULL;
+            request->deadline = time_monotonic() + 1000 * MIO_REQUEST_TIMEOUT_S;
+            strcpy(response->id, request->id);
+            _mio_request_start(conn, request);
+            off += sprintf(batch + off, "<iq type='result' id='%s' "
+                           "from='pubsub.example.com' to='bench@example.com'>"
+                           "<pubsub xmlns='http://jabber.org/protocol/pubsub'>"
+                           "<items node='3f2504e0-4f89-11d3-9a0c-0305e82c3301'>"
+                           "%s</items></pubsub></iq>", request->id, body);
+        }
+        t_feed = thread_now();
+        parser_feed(conn->xmpp_conn->parser, batch, off);
+        loop_secs += thread_now() - t_feed;
+    }
+    mio_handler_workers_drain(conn);
+    report("history responses", workers, n, bench_now() - t, loop_secs);
+    free(batch);
+
+    if (completed_ok != n) {
+        fprintf(stderr, "%ld of %ld requests completed, %ld decoded\n",
+                completed, n, completed_ok);
+        return 1;
+    }
+    return 0;
+}
+
+static long receive(mio_conn_t *conn) {
+    mio_response_t *responses[BATCH];
+    mio_data_t *data;
+    long ok = 0;
+    int j, got;
+
+    while ((got = mio_pubsub_data_receive_many(conn, responses, BATCH, 0)) > 0) {
+        for (j = 0; j < got; j++) {
+            data = ((mio_packet_t*) responses[j]->response)->payload;
+            if (data->num_transducers == EVENT_TRANSDUCERS)
+                ok++;
+            mio_pubsub_data_response_release(conn, responses[j]);
+        }
+    }
+    return ok;
+}
+
+// Feeds n pubsub events and receives them, returns nonzero if any event was
+// lost or not fully decoded
+static int run_events(mio_conn_t *conn, const char *body, int workers, long n) {
+    int len, i;
+    char *event, *batch;
+    double t, loop_secs = 0, t_feed;
+    long fed, ok = 0;
+
+    event = malloc(strlen(body) + 512);
+    len = sprintf(event, "<message from='pubsub.example.com' "
+                  "to='bench@example.com' id='bench'>"
+                  "<event xmlns='http://jabber.org/protocol/pubsub#event'>"
+                  "<items node='3f2504e0-4f89-11d3-9a0c-0305e82c3301'>"
+                  "%s</items></event></message>", body);
+    batch = malloc(BATCH * len);
+    for (i = 0; i < BATCH; i++)
+        memcpy(batch + i * len, event, len);
+
+    t = bench_now();
+    for (fed = 0; fed < n; fed += BATCH) {
+        t_feed = thread_now();
+        parser_feed(conn->xmpp_conn->parser, batch, BATCH * len);
+        loop_secs += thread_now() - t_feed;
+        ok += receive(conn);
+    }
+    mio_handler_workers_drain(conn);
+    ok += receive(conn);
+    report("pubsub events", workers, n, bench_now() - t, loop_secs);
+    free(batch);
+    free(event);
+
+    if (ok != n) {
+        fprintf(stderr, "%ld of %ld events decoded\n", ok, n);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    long n = bench_iterations(argc, argv, 20000) / BATCH * BATCH;
+    int max_workers = argc > 2 ? atoi(argv[2]) : 4, workers, ret = 0;
+    mio_conn_t *conn = mio_conn_new(MIO_LEVEL_ERROR);
+    char *history = body_new(HISTORY_ITEMS, 4);
+    char *event = body_new(1, EVENT_TRANSDUCERS);
+
+    xmpp_conn_set_jid(conn->xmpp_conn, "bench@example.com");
+    conn->xmpp_conn->authenticated = 1;
+    conn->xmpp_conn->state = XMPP_STATE_CONNECTED;
+    conn->xmpp_conn->open_handler = open_ignore;
+    parser_feed(conn->xmpp_conn->parser, stream_open, strlen(stream_open));
+    xmpp_handler_add(conn->xmpp_conn, mio_handler_iq_dispatch, NULL, "iq",
+                     NULL, conn);
+    if (mio_pubsub_data_listen_start(conn) != MIO_OK)
+        return 1;
+    xmpp_conn_set_stream_decoder(conn->xmpp_conn, NULL, NULL);
+
+    // 0 workers runs the handlers in the event loop thread
+    for (workers = 0; workers <= max_workers && ret == 0;
+            workers = workers ? workers * 2 : 1) {
+        if (workers > 0 && mio_handler_workers_start(conn, workers) != MIO_OK)
+            return 1;
+        ret |= run_history(conn, history, workers, n / 4 / BATCH * BATCH);
+        ret |= run_events(conn, event, workers, n);
+        mio_handler_workers_stop(conn);
+    }
+
+    mio_pubsub_data_listen_stop(conn);
+    conn->xmpp_conn->state = XMPP_STATE_DISCONNECTED;
+    conn->xmpp_conn->authenticated = 0;
+    mio_conn_free(conn);
+    free(history);
+    free(event);
+    return ret;
+}
@@ -0,0 +1,139 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  Publish Template Benchmark
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+/*
+ * Simulates a link that writes fewer publishes per window than are produced
+ * and compares the send queue with and without a coalescer. Without one the
+ * queue grows by every stale sample, with one it holds at most one sample per
+ * transducer. Also measures the rate at which mio_coalescer_publish() accepts
+ * samples.
+ */
+
+#include <string.h>
+#include <mio.h>
+#include "bench.h"
+
+#define NODE "3f2504e0-4f89-11d3-9a0c-0305e82c3301"
+#define VALUE "21.5"
+#define TIMESTAMP "2014-01-01T00:00:00.000000-0500"
+#define KEYS 10
+#define PER_WINDOW 10 // Samples per transducer and window
+#define WRITES 5 // Items the link writes per window
+#define WINDOWS 200
+#define WINDOW_MS 100
+
+static const char *names[KEYS] = { "t0", "t1", "t2", "t3", "t4", "t5", "t6",
+                                   "t7", "t8", "t9"
+                                 };
+
+// Stands in for the event loop writing up to n items of the send queue
+static void link_write(xmpp_conn_t *xmpp_conn, int n) {
+    xmpp_send_queue_t *sq;
+
+    while (n-- > 0 && (sq = xmpp_conn->send_queue_head) != NULL) {
+        xmpp_conn->send_queue_head = sq->next;
+        if (xmpp_conn->send_queue_head == NULL)
+            xmpp_conn->send_queue_tail = NULL;
+        xmpp_conn->send_queue_len--;
+        xmpp_conn->send_queue_done++;
+        conn_send_queue_item_release(xmpp_conn, sq);
+    }
+}
+
+static void link_drain(xmpp_conn_t *xmpp_conn) {
+    link_write(xmpp_conn, xmpp_conn->send_queue_len);
+}
+
+static void run(mio_conn_t *conn, mio_template_t **tmpls,
+                mio_coalescer_t *coalescer) {
+    xmpp_ctx_t *ctx = conn->xmpp_conn->ctx;
+    const char *values[2] = { VALUE, TIMESTAMP };
+    int w, i, k, max_len = 0;
+
+    for (w = 0; w < WINDOWS; w++) {
+        for (i = 0; i < PER_WINDOW; i++)
+            for (k = 0; k < KEYS; k++) {
+                if (coalescer != NULL)
+                    mio_coalescer_publish(coalescer, NODE, names[k],
+                                          MIO_TRANSDUCER_DATA, VALUE, TIMESTAMP);
+                else
+                    mio_template_send_nonblocking(conn, tmpls[k], values);
+            }
+        // One window of the event loop
+        ctx->now += WINDOW_MS;
+        _mio_send_queue_splice(conn);
+        timer_wheel_run(ctx, ctx->now);
+        link_write(conn->xmpp_conn, WRITES);
+        if (conn->xmpp_conn->send_queue_len > max_len)
+            max_len = conn->xmpp_conn->send_queue_len;
+    }
+    printf("%-40s %10d samples, send queue peaks at %d items\n",
+           coalescer != NULL ? "slow link (coalesced)" : "slow link (queued)",
+           WINDOWS * PER_WINDOW * KEYS, max_len);
+    link_drain(conn->xmpp_conn);
+}
+
+int main(int argc, char **argv) {
+    long i, n = bench_iterations(argc, argv, 1000000);
+    mio_conn_t *conn = mio_conn_new(MIO_LEVEL_ERROR);
+    mio_template_t *tmpls[KEYS];
+    mio_coalesce_stats_t stats;
+    mio_coalescer_t *coalescer;
+    double t;
+    int k;
+
+    xmpp_conn_set_jid(conn->xmpp_conn, "bench@example.com");
+    conn->xmpp_conn->authenticated = 1;
+    conn->xmpp_conn->state = XMPP_STATE_CONNECTED;
+    conn->xmpp_conn->ctx->now = time_monotonic();
+    for (k = 0; k < KEYS; k++)
+        tmpls[k] = mio_transducer_data_template_new(conn, NODE, names[k],
+                   MIO_TRANSDUCER_DATA);
+
+    run(conn, tmpls, NULL);
+
+    coalescer = mio_coalescer_new(conn, WINDOW_MS);
+    run(conn, tmpls, coalescer);
+    mio_coalescer_stats(coalescer, &stats);
+    printf("%-40s %10llu sent, %llu elided\n", "coalescer",
+           (unsigned long long) stats.sent, (unsigned long long) stats.elided);
+    if (stats.sent + stats.elided != stats.samples
+            || conn->xmpp_conn->send_queue_len != 0) {
+        fprintf(stderr, "samples lost\n");
+        return 1;
+    }
+
+    t = bench_now();
+    for (i = 0; i < n; i++)
+        mio_coalescer_publish(coalescer, NODE, names[i % KEYS],
+                              MIO_TRANSDUCER_DATA, VALUE, TIMESTAMP);
+    bench_report("mio_coalescer_publish", n, bench_now() - t);
+
+    mio_coalescer_free(coalescer);
+    for (k = 0; k < KEYS; k++)
+        mio_template_free(tmpls[k]);
+    conn->xmpp_conn->state = XMPP_STATE_DISCONNECTED;
+    conn->xmpp_conn->authenticated = 0;
+    mio_conn_free(conn);
+    return 0;
+}
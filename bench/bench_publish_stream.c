@@ -0,0 +1,139 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  Publish Template Benchmark
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+/*
+ * Measures publishes/sec that are sent and acknowledged when the server's
+ * replies are matched through the request table and decoded by
+ * mio_handler_error(), as mio_publish_data_template_async() does, against a
+ * publish stream that matches them by stanza id alone. The request table caps
+ * the asynchronous path at MIO_MAX_OPEN_REQUESTS outstanding publishes, the
+ * stream runs with its default window. Replies are fed straight to the iq
+ * dispatcher, so no server is needed.
+ */
+
+#include <string.h>
+#include <mio.h>
+#include "bench.h"
+
+#define NODE "3f2504e0-4f89-11d3-9a0c-0305e82c3301"
+#define NAME "temperature"
+#define VALUE "21.5"
+#define TIMESTAMP "2014-01-01T00:00:00.000000-0500"
+
+static long completed;
+
+static void complete(mio_conn_t *conn, mio_response_t *response, int status,
+                     void *userdata) {
+    if (status == MIO_OK && response->response_type == MIO_RESPONSE_OK)
+        completed++;
+    mio_response_free(response);
+}
+
+// Stands in for the event loop writing the queued publishes to the socket
+static void drain(mio_conn_t *conn) {
+    xmpp_ctx_t *ctx = conn->xmpp_conn->ctx;
+    xmpp_send_queue_t *item, *next;
+
+    item = __atomic_exchange_n(&conn->send_inbox, NULL, __ATOMIC_ACQUIRE);
+    for (; item != NULL; item = next) {
+        next = item->next;
+        xmpp_free(ctx, item->data);
+        xmpp_free(ctx, item);
+    }
+}
+
+static void ack(mio_conn_t *conn, xmpp_stanza_t *result, const char *id) {
+    xmpp_stanza_set_id(result, id);
+    mio_handler_iq_dispatch(conn->xmpp_conn, result, conn);
+}
+
+int main(int argc, char **argv) {
+    long i, j, n = bench_iterations(argc, argv, 200000);
+    mio_conn_t *conn = mio_conn_new(MIO_LEVEL_ERROR);
+    xmpp_ctx_t *ctx = conn->xmpp_conn->ctx;
+    const char *values[2] = { VALUE, TIMESTAMP };
+    mio_publish_stream_stats_t stats;
+    mio_publish_stream_t *stream;
+    mio_template_t *tmpl;
+    xmpp_stanza_t *result;
+    long batch;
+    char id[37];
+    double t;
+
+    xmpp_conn_set_jid(conn->xmpp_conn, "bench@example.com");
+    conn->xmpp_conn->authenticated = 1;
+    tmpl = mio_transducer_data_template_new(conn, NODE, NAME,
+                                            MIO_TRANSDUCER_DATA);
+    result = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(result, "iq");
+    xmpp_stanza_set_type(result, "result");
+
+    // Requests are answered in the order they were sent, which takes the
+    // slots off the free list in reverse
+    batch = MIO_MAX_OPEN_REQUESTS;
+    t = bench_now();
+    for (i = 0; i < n; i += batch) {
+        mio_request_t *sent[MIO_MAX_OPEN_REQUESTS];
+        for (j = 0; j < batch && i + j < n; j++) {
+            sent[j] = &conn->requests[(uint32_t) conn->requests_free - 1];
+            mio_template_send_async(conn, tmpl, values,
+                                    (mio_handler) mio_handler_error, complete, NULL, 0);
+        }
+        drain(conn);
+        for (j = 0; j < batch && i + j < n; j++)
+            ack(conn, result, sent[j]->id);
+    }
+    bench_report("publish + ack (request table)", n, bench_now() - t);
+    if (completed != n) {
+        fprintf(stderr, "%ld of %ld publishes completed\n", completed, n);
+        return 1;
+    }
+
+    stream = mio_publish_stream_new(conn, 0, 0, NULL, NULL);
+    batch = MIO_PUBLISH_STREAM_DEFAULT_WINDOW;
+    t = bench_now();
+    for (i = 0; i < n; i += batch) {
+        for (j = 0; j < batch && i + j < n; j++)
+            mio_publish_stream_template_send(stream, tmpl, values);
+        drain(conn);
+        for (j = 0; j < batch && i + j < n; j++) {
+            snprintf(id, sizeof(id), "mps%x-%lx", stream->id, i + j);
+            ack(conn, result, id);
+        }
+    }
+    bench_report("publish + ack (publish stream)", n, bench_now() - t);
+    mio_publish_stream_stats(stream, &stats);
+    if (stats.sent != n || stats.acked != n || stats.outstanding != 0) {
+        fprintf(stderr, "stream sent %llu, acked %llu, %u outstanding\n",
+                (unsigned long long) stats.sent,
+                (unsigned long long) stats.acked, stats.outstanding);
+        return 1;
+    }
+
+    mio_publish_stream_free(stream);
+    xmpp_stanza_release(result);
+    mio_template_free(tmpl);
+    conn->xmpp_conn->authenticated = 0;
+    mio_conn_free(conn);
+    return 0;
+}
@@ -0,0 +1,101 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  Publish Template Benchmark
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+/*
+ * Measures publish stanzas/sec produced for a single transducer sample.
+ * Compares building the item and publish iq trees and rendering them, as
+ * mio_publish_data() does, against filling a template compiled with
+ * mio_transducer_data_template_new().
+ */
+
+#include <string.h>
+#include <mio.h>
+#include "bench.h"
+
+#define NODE "3f2504e0-4f89-11d3-9a0c-0305e82c3301"
+#define NAME "temperature"
+#define VALUE "21.5"
+#define TIMESTAMP "2014-01-01T00:00:00.000000-0500"
+
+static void tree_render(mio_conn_t *conn, const char *id, char **buf,
+                        size_t *len) {
+    mio_transducer_data_t transducer;
+    mio_stanza_t *item, *iq;
+
+    memset(&transducer, 0, sizeof(transducer));
+    transducer.type = MIO_TRANSDUCER_DATA;
+    transducer.name = NAME;
+    transducer.value = VALUE;
+    transducer.timestamp = TIMESTAMP;
+
+    item = mio_transducer_data_to_item(conn, &transducer);
+    iq = _mio_item_publish_stanza_new(conn, item, NODE);
+    xmpp_stanza_set_id(iq->xmpp_stanza, id);
+    xmpp_stanza_to_text(iq->xmpp_stanza, buf, len);
+    mio_stanza_free(iq);
+    mio_stanza_free(item);
+}
+
+int main(int argc, char **argv) {
+    long i, n = bench_iterations(argc, argv, 200000);
+    mio_conn_t *conn = mio_conn_new(MIO_LEVEL_ERROR);
+    xmpp_ctx_t *ctx = conn->xmpp_conn->ctx;
+    const char *values[2] = { VALUE, TIMESTAMP };
+    const char *id = "3f2504e0-4f89-11d3-9a0c-0305e82c3302";
+    mio_template_t *tmpl;
+    char *buf, *expected;
+    size_t len, expected_len;
+    double t;
+
+    xmpp_conn_set_jid(conn->xmpp_conn, "bench@example.com");
+    tmpl = mio_transducer_data_template_new(conn, NODE, NAME,
+                                            MIO_TRANSDUCER_DATA);
+
+    // The template must produce the same bytes as the tree
+    tree_render(conn, id, &expected, &expected_len);
+    _mio_template_fill(conn, tmpl, id, values, &buf, &len);
+    if (len != expected_len || memcmp(buf, expected, len) != 0) {
+        fprintf(stderr, "template differs from tree\n%s\n%s\n", expected, buf);
+        return 1;
+    }
+    xmpp_free(ctx, buf);
+    xmpp_free(ctx, expected);
+
+    t = bench_now();
+    for (i = 0; i < n; i++) {
+        tree_render(conn, id, &buf, &len);
+        xmpp_free(ctx, buf);
+    }
+    bench_report("publish stanza (tree + render)", n, bench_now() - t);
+
+    t = bench_now();
+    for (i = 0; i < n; i++) {
+        _mio_template_fill(conn, tmpl, id, values, &buf, &len);
+        xmpp_free(ctx, buf);
+    }
+    bench_report("publish stanza (template fill)", n, bench_now() - t);
+
+    mio_template_free(tmpl);
+    mio_conn_free(conn);
+    return 0;
+}
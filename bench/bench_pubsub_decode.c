@@ -0,0 +1,108 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  Pubsub Event Decode Benchmark
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+/*
+ * Measures stanzas/sec for decoding a pubsub #event item into a mio_data_t.
+ * Compares re-serializing the stanza and re-parsing it with expat against
+ * walking the already parsed stanza tree with mio_xml_parse().
+ */
+
+#include <string.h>
+#include <mio.h>
+#include "bench.h"
+
+static char event_xml[] =
+    "<message from='pubsub.example.com' to='bench@example.com' id='bench'>"
+    "<event xmlns='http://jabber.org/protocol/pubsub#event'>"
+    "<items node='3f2504e0-4f89-11d3-9a0c-0305e82c3301'>"
+    "<item id='3f2504e0-4f89-11d3-9a0c-0305e82c3302'>"
+    "<transducerData name='temperature' value='21.5' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "<transducerData name='humidity' value='40.25' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "<transducerData name='light' value='312' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "<transducerData name='occupancy' value='1' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "</item></items></event></message>";
+
+static mio_response_t *decode_response_new(void) {
+    mio_response_t *response = mio_response_new();
+    mio_packet_t *packet = mio_packet_new();
+    mio_packet_payload_add(packet, (void*) mio_data_new(), MIO_PACKET_DATA);
+    response->response = packet;
+    return response;
+}
+
+// Decode path used before the tree walk: render to text and re-parse
+static int decode_reparse(mio_conn_t *conn, mio_stanza_t *stanza,
+                          mio_xml_parser_data_t *xml_data) {
+    XML_Parser p;
+    char *buf;
+    size_t buflen;
+    int err = MIO_OK;
+
+    xmpp_stanza_to_text(stanza->xmpp_stanza, &buf, &buflen);
+    p = XML_ParserCreate(NULL);
+    XML_SetElementHandler(p, mio_XMLstart_pubsub_data_receive, endElement);
+    XML_SetUserData(p, xml_data);
+    if (XML_Parse(p, buf, buflen, 1) == XML_STATUS_ERROR)
+        err = MIO_ERROR_XML_PARSING;
+    XML_ParserFree(p);
+    xmpp_free(conn->xmpp_conn->ctx, buf);
+    free(xml_data);
+    return err;
+}
+
+int main(int argc, char **argv) {
+    long i, n = bench_iterations(argc, argv, 200000);
+    mio_conn_t *conn = mio_conn_new(MIO_LEVEL_ERROR);
+    mio_parser_t *parser = mio_parser_new(conn);
+    mio_stanza_t *stanza = mio_parse(parser, event_xml);
+    mio_response_t *response;
+    mio_xml_parser_data_t *xml_data;
+    double t;
+
+    t = bench_now();
+    for (i = 0; i < n; i++) {
+        response = decode_response_new();
+        xml_data = mio_xml_parser_data_new();
+        xml_data->response = response;
+        if (decode_reparse(conn, stanza, xml_data) != MIO_OK)
+            return 1;
+        mio_response_free(response);
+    }
+    bench_report("pubsub event decode (render+expat)", n, bench_now() - t);
+
+    t = bench_now();
+    for (i = 0; i < n; i++) {
+        response = decode_response_new();
+        xml_data = mio_xml_parser_data_new();
+        xml_data->response = response;
+        if (mio_xml_parse(conn, stanza, xml_data,
+                          mio_XMLstart_pubsub_data_receive, NULL) != MIO_OK)
+            return 1;
+        mio_response_free(response);
+    }
+    bench_report("pubsub event decode (tree walk)", n, bench_now() - t);
+
+    mio_stanza_free(stanza);
+    mio_parser_free(parser);
+    return 0;
+}
@@ -0,0 +1,194 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  Pubsub Lanes Benchmark
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+/*
+ * Measures events/sec delivered to 1 to N consumer threads, and how many
+ * events of a node reached a consumer before an earlier event of the same
+ * node. Compares N threads calling mio_pubsub_data_receive_many() on the
+ * shared RX queue against the per-node lanes of mio_pubsub_data_lanes_start().
+ * Events are spread over 64 nodes, each carries its sequence number within
+ * its node.
+ *
+ *   ./bench_pubsub_lanes [events] [max threads]
+ */
+
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <mio.h>
+#include "bench.h"
+
+#define BATCH 64
+#define NODES 64
+
+static char stream_open[] =
+    "<stream:stream xmlns='jabber:client' "
+    "xmlns:stream='http://etherx.jabber.org/streams' id='bench' "
+    "from='example.com' version='1.0'>";
+
+static char event_xml[] =
+    "<message from='pubsub.example.com' to='bench@example.com' id='bench'>"
+    "<event xmlns='http://jabber.org/protocol/pubsub#event'>"
+    "<items node='node%05d'><item id='item'>"
+    "<transducerData name='sequence' value='%ld' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "<transducerData name='temperature' value='21.5' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "</item></items></event></message>";
+
+static long last_seq[NODES], received, reordered;
+static int done;
+
+static void open_ignore(xmpp_conn_t * const conn) {
+}
+
+// Checks that the event is the newest of its node seen so far
+static void consume(mio_response_t *response) {
+    mio_data_t *data = ((mio_packet_t*) response->response)->payload;
+    long seq = atol(data->transducers->value), prev;
+    int node = atoi(data->event + 4);
+
+    prev = __atomic_exchange_n(&last_seq[node], seq, __ATOMIC_ACQ_REL);
+    if (prev > seq)
+        __atomic_add_fetch(&reordered, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&received, 1, __ATOMIC_RELAXED);
+}
+
+static void *queue_consumer(void *arg) {
+    mio_conn_t *conn = arg;
+    mio_response_t *responses[BATCH];
+    int i, got;
+
+    while (!__atomic_load_n(&done, __ATOMIC_ACQUIRE)) {
+        got = mio_pubsub_data_receive_many(conn, responses, BATCH, 10);
+        for (i = 0; i < got; i++) {
+            consume(responses[i]);
+            mio_pubsub_data_response_release(conn, responses[i]);
+        }
+    }
+    return NULL;
+}
+
+static void lane_consumer(mio_conn_t *conn, mio_response_t *response,
+                          void *userdata) {
+    consume(response);
+}
+
+// Responses waiting for a consumer in either mode
+static unsigned int backlog(mio_conn_t *conn) {
+    mio_pubsub_rx_stats_t rx;
+    mio_pubsub_lanes_stats_t lanes;
+
+    mio_pubsub_data_rx_queue_stats(conn, &rx);
+    mio_pubsub_data_lanes_stats(conn, &lanes);
+    return rx.length + lanes.pending;
+}
+
+// Feeds n events round robin over the nodes, holding back while half of the
+// RX queue's capacity is in use so that nothing is dropped
+static void feed(mio_conn_t *conn, long n) {
+    char *batch = malloc(BATCH * (sizeof(event_xml) + 32));
+    long i, seq[NODES];
+    int j, len;
+
+    memset(seq, 0, sizeof(seq));
+    for (i = 0; i < n; i += BATCH) {
+        for (j = len = 0; j < BATCH; j++)
+            len += sprintf(batch + len, event_xml, (int) ((i + j) % NODES),
+                           ++seq[(i + j) % NODES]);
+        while (backlog(conn) > MIO_PUBSUB_RX_QUEUE_DEFAULT_LEN / 2)
+            sched_yield();
+        parser_feed(conn->xmpp_conn->parser, batch, len);
+    }
+    free(batch);
+}
+
+static int run(mio_conn_t *conn, int threads, int lanes, long n) {
+    pthread_t tids[64];
+    mio_pubsub_lanes_stats_t stats;
+    char name[64];
+    double t;
+    int i;
+
+    memset(last_seq, 0, sizeof(last_seq));
+    received = reordered = 0;
+    done = 0;
+    memset(&stats, 0, sizeof(stats));
+
+    t = bench_now();
+    if (lanes) {
+        if (mio_pubsub_data_lanes_start(conn, threads, 0, lane_consumer, NULL)
+                != MIO_OK)
+            return 1;
+    } else {
+        for (i = 0; i < threads; i++)
+            pthread_create(&tids[i], NULL, queue_consumer, conn);
+    }
+    feed(conn, n);
+    if (lanes) {
+        while (__atomic_load_n(&received, __ATOMIC_ACQUIRE) < n)
+            sched_yield();
+        mio_pubsub_data_lanes_stats(conn, &stats);
+        mio_pubsub_data_lanes_stop(conn);
+    } else {
+        while (__atomic_load_n(&received, __ATOMIC_ACQUIRE) < n)
+            sched_yield();
+        __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+        for (i = 0; i < threads; i++)
+            pthread_join(tids[i], NULL);
+    }
+    t = bench_now() - t;
+
+    snprintf(name, sizeof(name), "%s, %d threads",
+             lanes ? "per-node lanes" : "shared queue", threads);
+    bench_report(name, n, t);
+    printf("%-40s %10ld reordered %8llu steals\n", "", reordered,
+           (unsigned long long) stats.steals);
+    // Lanes must never deliver a node out of order
+    return lanes && reordered != 0;
+}
+
+int main(int argc, char **argv) {
+    long n = bench_iterations(argc, argv, 200000) / BATCH * BATCH;
+    int max_threads = argc > 2 ? atoi(argv[2]) : 8, threads, ret = 0;
+    mio_conn_t *conn = mio_conn_new(MIO_LEVEL_ERROR);
+
+    if (max_threads > 64)
+        max_threads = 64;
+    xmpp_conn_set_jid(conn->xmpp_conn, "bench@example.com");
+    conn->xmpp_conn->authenticated = 1;
+    conn->xmpp_conn->state = XMPP_STATE_CONNECTED;
+    conn->xmpp_conn->open_handler = open_ignore;
+    parser_feed(conn->xmpp_conn->parser, stream_open, strlen(stream_open));
+    if (mio_pubsub_data_listen_start(conn) != MIO_OK)
+        return 1;
+
+    for (threads = 1; threads <= max_threads; threads *= 2) {
+        ret |= run(conn, threads, 0, n);
+        ret |= run(conn, threads, 1, n);
+    }
+
+    mio_pubsub_data_listen_stop(conn);
+    conn->xmpp_conn->state = XMPP_STATE_DISCONNECTED;
+    conn->xmpp_conn->authenticated = 0;
+    mio_conn_free(conn);
+    return ret;
+}
@@ -0,0 +1,98 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  Pubsub Receive Benchmark
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+/*
+ * Measures how fast a consumer drains the pubsub RX queue. The queue is
+ * filled up front so that only the consumer side is timed. Compares taking
+ * one response per call and freeing it against taking batches of up to 64 the
+ * way mio_pubsub_data_receive_many() does and releasing them to the response
+ * pool.
+ */
+
+#include <string.h>
+#include <mio.h>
+#include "bench.h"
+
+#define BATCH 64
+
+static void fill(mio_conn_t *conn, long count) {
+    mio_response_t *response;
+    long i;
+
+    for (i = 0; i < count; i++) {
+        response = _mio_response_pool_get(conn);
+        response->response_type = MIO_RESPONSE_PACKET;
+        response->response = mio_packet_new();
+        _mio_pubsub_rx_queue_enqueue(conn, response);
+    }
+}
+
+static void run(mio_conn_t *conn, long count, int batch) {
+    mio_response_t *responses[BATCH];
+    double start;
+    long received = 0;
+    int i, n;
+
+    fill(conn, count);
+    start = bench_now();
+    while (received < count) {
+        if (batch) {
+            n = _mio_pubsub_rx_queue_dequeue_many(conn, responses, BATCH);
+            if (n == 0)
+                break;
+            for (i = 0; i < n; i++)
+                _mio_response_pool_put(conn, responses[i]);
+        } else {
+            if (_mio_pubsub_rx_queue_dequeue_timed(conn, 0, &responses[0])
+                    != MIO_OK)
+                break;
+            n = 1;
+            mio_response_free(responses[0]);
+        }
+        received += n;
+    }
+    bench_report(batch ? "batch of 64, pooled responses" :
+                 "one per call, freed responses", received,
+                 bench_now() - start);
+}
+
+int main(int argc, char **argv) {
+    long count = bench_iterations(argc, argv, 1 << 20);
+    mio_conn_t *conn;
+
+    conn = mio_conn_new(MIO_LEVEL_ERROR);
+    if (mio_pubsub_data_rx_queue_configure(conn, count,
+                                           MIO_RX_OVERFLOW_DROP_NEWEST)
+            != MIO_OK) {
+        fprintf(stderr, "could not size the queue for %ld responses\n", count);
+        return 1;
+    }
+    conn->pubsub_rx_listening = 1;
+
+    run(conn, count, 0);
+    run(conn, count, 1);
+
+    conn->pubsub_rx_listening = 0;
+    mio_conn_free(conn);
+    return 0;
+}
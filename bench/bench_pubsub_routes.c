@@ -0,0 +1,207 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  Pubsub Routes Benchmark
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+/*
+ * Measures events/sec dispatched to per-node application state for a gateway
+ * subscribed to 50000 nodes. Compares polling the RX queue with
+ * mio_pubsub_data_receive_many() and looking the node up in an application
+ * hash table against callbacks registered with mio_pubsub_on_node(), with
+ * mio_pubsub_on_prefix() and with the catch-all. Every node must receive
+ * each of its events exactly once.
+ *
+ *   ./bench_pubsub_routes [events] [nodes]
+ */
+
+#include <string.h>
+#include <mio.h>
+#include "bench.h"
+
+#define BATCH 64
+#define PREFIX_LEN 7
+
+static char stream_open[] =
+    "<stream:stream xmlns='jabber:client' "
+    "xmlns:stream='http://etherx.jabber.org/streams' id='bench' "
+    "from='example.com' version='1.0'>";
+
+static char event_xml[] =
+    "<message from='pubsub.example.com' to='bench@example.com' id='bench'>"
+    "<event xmlns='http://jabber.org/protocol/pubsub#event'>"
+    "<items node='node%05d'><item id='item'>"
+    "<transducerData name='temperature' value='21.5' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "</item></items></event></message>";
+
+// Room for a rendered event
+#define EVENT_SIZE (sizeof(event_xml) + 16)
+
+// Application state of a node
+typedef struct {
+    char name[16];
+    long received;
+    UT_hash_handle hh;
+} node_state_t;
+
+static node_state_t *states, *table;
+static int n_nodes;
+
+static void open_ignore(xmpp_conn_t * const conn) {
+}
+
+static void on_node(mio_conn_t *conn, mio_response_t *response,
+                    void *userdata) {
+    ((node_state_t*) userdata)->received++;
+}
+
+// Prefix and catch-all callbacks still find the node themselves
+static void on_many(mio_conn_t *conn, mio_response_t *response,
+                    void *userdata) {
+    mio_data_t *data = ((mio_packet_t*) response->response)->payload;
+
+    states[atoi(data->event + 4)].received++;
+}
+
+// What an application does without callbacks
+static void drain(mio_conn_t *conn) {
+    mio_response_t *responses[BATCH];
+    mio_data_t *data;
+    node_state_t *state;
+    int i, got;
+
+    while ((got = mio_pubsub_data_receive_many(conn, responses, BATCH, 0))
+            > 0) {
+        for (i = 0; i < got; i++) {
+            data = ((mio_packet_t*) responses[i]->response)->payload;
+            HASH_FIND_STR(table, data->event, state);
+            if (state != NULL)
+                state->received++;
+            mio_pubsub_data_response_release(conn, responses[i]);
+        }
+    }
+}
+
+static void route(mio_conn_t *conn, int mode, mio_pubsub_node_callback cb) {
+    char prefix[PREFIX_LEN + 1];
+    int i;
+
+    if (mode == 1) {
+        for (i = 0; i < n_nodes; i++)
+            mio_pubsub_on_node(conn, states[i].name, cb, cb ? &states[i] : NULL);
+    } else if (mode == 2) {
+        for (i = 0; i < n_nodes; i += 100) {
+            memcpy(prefix, states[i].name, PREFIX_LEN);
+            prefix[PREFIX_LEN] = '\0';
+            mio_pubsub_on_prefix(conn, prefix, cb, NULL);
+        }
+    } else if (mode == 3) {
+        mio_pubsub_on_node(conn, NULL, cb, NULL);
+    }
+}
+
+static int run(mio_conn_t *conn, int mode, char *events, int *lens, long n) {
+    static const char *names[] = { "RX queue + application table",
+                                   "mio_pubsub_on_node()", "mio_pubsub_on_prefix()",
+                                   "catch-all"
+                                 };
+    mio_pubsub_rx_stats_t before, after;
+    double t;
+    long i, expected;
+    int j, bad = 0;
+
+    for (j = 0; j < n_nodes; j++)
+        states[j].received = 0;
+    t = bench_now();
+    route(conn, mode, mode == 1 ? on_node : on_many);
+    t = bench_now() - t;
+    if (mode != 0)
+        printf("%-40s %10.1f ms to register\n", names[mode], t * 1e3);
+
+    mio_pubsub_data_rx_queue_stats(conn, &before);
+    t = bench_now();
+    for (i = 0; i < n / BATCH; i++) {
+        parser_feed(conn->xmpp_conn->parser, events + i * BATCH
+                    * EVENT_SIZE, lens[i]);
+        if (mode == 0)
+            drain(conn);
+    }
+    t = bench_now() - t;
+    mio_pubsub_data_rx_queue_stats(conn, &after);
+    bench_report(names[mode], n, t);
+    route(conn, mode, NULL);
+
+    for (j = 0; j < n_nodes; j++) {
+        expected = n / n_nodes + (j < n % n_nodes);
+        bad += states[j].received != expected;
+    }
+    printf("%-40s %10llu routed %8d nodes miscounted\n", "",
+           (unsigned long long) (after.routed - before.routed), bad);
+    return bad != 0
+           || (after.routed - before.routed) != (mode == 0 ? 0 : n);
+}
+
+int main(int argc, char **argv) {
+    long n = bench_iterations(argc, argv, 500000) / BATCH * BATCH, i;
+    mio_conn_t *conn = mio_conn_new(MIO_LEVEL_ERROR);
+    node_state_t *state;
+    char *events;
+    int *lens, mode, ret = 0, j;
+
+    n_nodes = argc > 2 ? atoi(argv[2]) : 50000;
+    if (n_nodes < 1 || n_nodes > 100000)
+        n_nodes = 50000;
+    states = calloc(n_nodes, sizeof(node_state_t));
+    for (j = 0; j < n_nodes; j++) {
+        state = &states[j];
+        sprintf(state->name, "node%05d", j);
+        HASH_ADD_STR(table, name, state);
+    }
+    // Render all events up front, round robin over the nodes
+    events = malloc(n / BATCH * BATCH * EVENT_SIZE);
+    lens = malloc(n / BATCH * sizeof(int));
+    for (i = 0; i < n / BATCH; i++) {
+        lens[i] = 0;
+        for (j = 0; j < BATCH; j++)
+            lens[i] += sprintf(events + i * BATCH * EVENT_SIZE
+                               + lens[i], event_xml, (int) ((i * BATCH + j) % n_nodes));
+    }
+
+    xmpp_conn_set_jid(conn->xmpp_conn, "bench@example.com");
+    conn->xmpp_conn->authenticated = 1;
+    conn->xmpp_conn->state = XMPP_STATE_CONNECTED;
+    conn->xmpp_conn->open_handler = open_ignore;
+    parser_feed(conn->xmpp_conn->parser, stream_open, strlen(stream_open));
+    if (mio_pubsub_data_listen_start(conn) != MIO_OK)
+        return 1;
+
+    for (mode = 0; mode < 4; mode++)
+        ret |= run(conn, mode, events, lens, n);
+
+    mio_pubsub_data_listen_stop(conn);
+    conn->xmpp_conn->state = XMPP_STATE_DISCONNECTED;
+    conn->xmpp_conn->authenticated = 0;
+    mio_conn_free(conn);
+    HASH_CLEAR(hh, table);
+    free(states);
+    free(events);
+    free(lens);
+    return ret;
+}
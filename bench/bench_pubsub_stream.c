@@ -0,0 +1,122 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  Pubsub Stream Decode Benchmark
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+/*
+ * Measures events/sec from socket bytes to responses handed out by
+ * mio_pubsub_data_receive_many(). Compares building the stanza tree and
+ * decoding it in the pubsub handler against decoding the event while it is
+ * parsed with the stream decoder installed by mio_pubsub_data_listen_start().
+ * The tree path includes rendering each stanza for the RECV debug log, as the
+ * connection does for every stanza it dispatches.
+ */
+
+#include <string.h>
+#include <mio.h>
+#include "bench.h"
+
+#define BATCH 64
+
+static char stream_open[] =
+    "<stream:stream xmlns='jabber:client' "
+    "xmlns:stream='http://etherx.jabber.org/streams' id='bench' "
+    "from='example.com' version='1.0'>";
+
+static char event_xml[] =
+    "<message from='pubsub.example.com' to='bench@example.com' id='bench'>"
+    "<event xmlns='http://jabber.org/protocol/pubsub#event'>"
+    "<items node='3f2504e0-4f89-11d3-9a0c-0305e82c3301'>"
+    "<item id='3f2504e0-4f89-11d3-9a0c-0305e82c3302'>"
+    "<transducerData name='temperature' value='21.5' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "<transducerData name='humidity' value='40.25' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "<transducerData name='light' value='312' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "<transducerData name='occupancy' value='1' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "</item></items></event></message>";
+
+static void open_ignore(xmpp_conn_t * const conn) {
+}
+
+// Feeds n events in batches and drains them, returns the number of responses
+// that carried all transducers
+static long run(mio_conn_t *conn, char *batch, int batch_len, long n) {
+    mio_response_t *responses[BATCH];
+    mio_data_t *data;
+    long i, ok = 0;
+    int j, got;
+
+    for (i = 0; i < n; i += BATCH) {
+        parser_feed(conn->xmpp_conn->parser, batch, batch_len);
+        got = mio_pubsub_data_receive_many(conn, responses, BATCH, 0);
+        for (j = 0; j < got; j++) {
+            data = ((mio_packet_t*) responses[j]->response)->payload;
+            if (data->num_transducers == 4)
+                ok++;
+            mio_pubsub_data_response_release(conn, responses[j]);
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    long n = bench_iterations(argc, argv, 200000) / BATCH * BATCH, ok;
+    mio_conn_t *conn = mio_conn_new(MIO_LEVEL_ERROR);
+    int i, len = strlen(event_xml);
+    char *batch = malloc(BATCH * len);
+    double t;
+
+    for (i = 0; i < BATCH; i++)
+        memcpy(batch + i * len, event_xml, len);
+    xmpp_conn_set_jid(conn->xmpp_conn, "bench@example.com");
+    conn->xmpp_conn->authenticated = 1;
+    conn->xmpp_conn->state = XMPP_STATE_CONNECTED;
+    conn->xmpp_conn->open_handler = open_ignore;
+    parser_feed(conn->xmpp_conn->parser, stream_open, strlen(stream_open));
+    if (mio_pubsub_data_listen_start(conn) != MIO_OK)
+        return 1;
+
+    xmpp_conn_set_stream_decoder(conn->xmpp_conn, NULL, NULL);
+    t = bench_now();
+    ok = run(conn, batch, BATCH * len, n);
+    bench_report("socket to response (stanza tree)", n, bench_now() - t);
+    if (ok != n) {
+        fprintf(stderr, "%ld of %ld events decoded\n", ok, n);
+        return 1;
+    }
+
+    mio_pubsub_data_listen_stop(conn);
+    if (mio_pubsub_data_listen_start(conn) != MIO_OK)
+        return 1;
+    t = bench_now();
+    ok = run(conn, batch, BATCH * len, n);
+    bench_report("socket to response (stream decoder)", n, bench_now() - t);
+    if (ok != n) {
+        fprintf(stderr, "%ld of %ld events decoded\n", ok, n);
+        return 1;
+    }
+
+    mio_pubsub_data_listen_stop(conn);
+    conn->xmpp_conn->state = XMPP_STATE_DISCONNECTED;
+    conn->xmpp_conn->authenticated = 0;
+    mio_conn_free(conn);
+    free(batch);
+    return 0;
+}
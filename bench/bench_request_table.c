@@ -0,0 +1,140 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  Request Table Benchmark
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+/*
+ * Measures request add/lookup/complete cycles per second with 1 to 8 threads.
+ * Compares the previous scheme, which allocated a request with its own
+ * mutex and condition, unparsed a UUID and kept it in a uthash table behind
+ * a rwlock, against the preallocated slot table with generation tagged ids.
+ */
+
+#include <string.h>
+#include <pthread.h>
+#include <uuid/uuid.h>
+#include <mio.h>
+#include <uthash.h>
+#include "bench.h"
+
+typedef struct legacy_request {
+    char id[37];
+    pthread_cond_t cond;
+    pthread_mutex_t mutex;
+    UT_hash_handle hh;
+} legacy_request_t;
+
+typedef struct {
+    mio_conn_t *conn;
+    legacy_request_t *table;
+    pthread_rwlock_t lock;
+    long per_thread;
+    int slab;
+} bench_state_t;
+
+static void *legacy_worker(void *arg) {
+    bench_state_t *state = arg;
+    legacy_request_t *request, *found;
+    uuid_t uuid;
+    long i;
+
+    for (i = 0; i < state->per_thread; i++) {
+        request = calloc(1, sizeof(legacy_request_t));
+        pthread_cond_init(&request->cond, NULL);
+        pthread_mutex_init(&request->mutex, NULL);
+        uuid_generate(uuid);
+        uuid_unparse(uuid, request->id);
+
+        pthread_rwlock_wrlock(&state->lock);
+        HASH_ADD_STR(state->table, id, request);
+        pthread_rwlock_unlock(&state->lock);
+
+        pthread_rwlock_rdlock(&state->lock);
+        HASH_FIND_STR(state->table, request->id, found);
+        pthread_rwlock_unlock(&state->lock);
+
+        pthread_rwlock_wrlock(&state->lock);
+        HASH_DEL(state->table, found);
+        pthread_rwlock_unlock(&state->lock);
+        pthread_cond_destroy(&found->cond);
+        pthread_mutex_destroy(&found->mutex);
+        free(found);
+    }
+    return NULL;
+}
+
+static void *slab_worker(void *arg) {
+    bench_state_t *state = arg;
+    mio_request_t *request, *found;
+    long i;
+
+    for (i = 0; i < state->per_thread; i++) {
+        request = _mio_request_acquire(state->conn, 1);
+        _mio_request_start(state->conn, request);
+        found = _mio_request_get(state->conn, request->id);
+        if (found != request) {
+            fprintf(stderr, "lookup of %s failed\n", request->id);
+            exit(1);
+        }
+        _mio_request_complete(state->conn, found, MIO_OK);
+    }
+    return NULL;
+}
+
+static void run(bench_state_t *state, int threads, long iterations) {
+    pthread_t tids[8];
+    char name[64];
+    double start;
+    int i;
+
+    state->per_thread = iterations / threads;
+    start = bench_now();
+    for (i = 0; i < threads; i++)
+        pthread_create(&tids[i], NULL, state->slab ? slab_worker : legacy_worker,
+                       state);
+    for (i = 0; i < threads; i++)
+        pthread_join(tids[i], NULL);
+    snprintf(name, sizeof(name), "%s %d threads",
+             state->slab ? "slab table" : "uuid+uthash+rwlock", threads);
+    bench_report(name, state->per_thread * threads, bench_now() - start);
+}
+
+int main(int argc, char **argv) {
+    long iterations = bench_iterations(argc, argv, 200000);
+    int threads[] = { 1, 2, 4, 8 };
+    bench_state_t state;
+    int i;
+
+    memset(&state, 0, sizeof(state));
+    state.conn = mio_conn_new(MIO_LEVEL_ERROR);
+    pthread_rwlock_init(&state.lock, NULL);
+
+    for (i = 0; i < 4; i++) {
+        state.slab = 0;
+        run(&state, threads[i], iterations);
+        state.slab = 1;
+        run(&state, threads[i], iterations);
+    }
+
+    pthread_rwlock_destroy(&state.lock);
+    mio_conn_free(state.conn);
+    return 0;
+}
@@ -0,0 +1,182 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  Send Queue Contention Benchmark
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+/*
+ * Measures stanzas/sec handed to the event loop by 1 to 32 producer threads.
+ * Compares taking the event loop mutex and copying into the send queue
+ * against pushing onto the lock-free inbox that the loop splices each tick.
+ * The connection writes into a socketpair that is drained by a reader thread.
+ * Reports the rate at which producers get rid of their stanzas, the rate
+ * at which the stanzas reach the socket and the number of write calls the
+ * event loop needed to flush them.
+ */
+
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <mio.h>
+#include "bench.h"
+
+static const char stanza[] =
+    "<iq type='set' to='pubsub.example.com' id='3f2504e0-4f89-11d3-9a0c-0305e82c3301'>"
+    "<pubsub xmlns='http://jabber.org/protocol/pubsub'>"
+    "<publish node='3f2504e0-4f89-11d3-9a0c-0305e82c3302'><item>"
+    "<transducerData name='temperature' value='21.5' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "</item></publish></pubsub></iq>";
+
+typedef struct {
+    mio_conn_t *conn;
+    int sock;
+    long expected;
+    long received;
+    int locked;
+    long per_thread;
+} bench_state_t;
+
+static void conn_handler(xmpp_conn_t * const conn,
+                         const xmpp_conn_event_t event, const int error,
+                         xmpp_stream_error_t * const stream_error, void * const userdata) {
+    fprintf(stderr, "unexpected connection event %d\n", event);
+    exit(1);
+}
+
+// Mirrors _mio_run
+static void *loop_thread(void *arg) {
+    mio_conn_t *conn = ((bench_state_t*) arg)->conn;
+    xmpp_ctx_t *ctx = conn->xmpp_conn->ctx;
+
+    while (ctx->loop_status == XMPP_LOOP_RUNNING) {
+        pthread_mutex_lock(&conn->event_loop_mutex);
+        _mio_send_queue_splice(conn);
+        xmpp_run_once(ctx, MIO_EVENT_LOOP_TIMEOUT);
+        pthread_mutex_unlock(&conn->event_loop_mutex);
+
+        pthread_mutex_lock(&conn->send_request_mutex);
+        while (conn->event_loop_waiters > 0)
+            pthread_cond_wait(&conn->send_request_cond,
+                              &conn->send_request_mutex);
+        pthread_mutex_unlock(&conn->send_request_mutex);
+    }
+    return NULL;
+}
+
+static void *reader_thread(void *arg) {
+    bench_state_t *state = (bench_state_t*) arg;
+    char buf[65536];
+    ssize_t n;
+
+    while (state->received < state->expected) {
+        n = read(state->sock, buf, sizeof(buf));
+        if (n <= 0)
+            break;
+        state->received += n;
+    }
+    return NULL;
+}
+
+static void *producer_thread(void *arg) {
+    bench_state_t *state = (bench_state_t*) arg;
+    mio_conn_t *conn = state->conn;
+    xmpp_ctx_t *ctx = conn->xmpp_conn->ctx;
+    size_t len = sizeof(stanza) - 1;
+    char *buf;
+    long i;
+
+    for (i = 0; i < state->per_thread; i++) {
+        // Stands in for the buffer returned by xmpp_stanza_to_text()
+        buf = xmpp_alloc(ctx, len);
+        memcpy(buf, stanza, len);
+        if (state->locked) {
+            _mio_event_loop_lock(conn);
+            xmpp_send_raw(conn->xmpp_conn, buf, len);
+            _mio_event_loop_unlock(conn);
+            xmpp_free(ctx, buf);
+        } else
+            _mio_send_queue_push(conn, buf, len);
+    }
+    return NULL;
+}
+
+static void run(int locked, int n_threads, long per_thread) {
+    bench_state_t state;
+    pthread_t loop, reader, producers[32];
+    int sv[2], i;
+    double t, t_producers;
+    char name[64];
+
+    memset(&state, 0, sizeof(state));
+    state.conn = mio_conn_new(MIO_LEVEL_ERROR);
+    socketpair(AF_UNIX, SOCK_STREAM, 0, sv);
+    fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+    state.conn->xmpp_conn->sock = sv[0];
+    state.conn->xmpp_conn->state = XMPP_STATE_CONNECTED;
+    state.conn->xmpp_conn->conn_handler = conn_handler;
+    state.sock = sv[1];
+    state.locked = locked;
+    state.per_thread = per_thread;
+    state.expected = (long) n_threads * per_thread * (sizeof(stanza) - 1);
+
+    state.conn->xmpp_conn->ctx->loop_status = XMPP_LOOP_RUNNING;
+    pthread_create(&loop, NULL, loop_thread, &state);
+    pthread_create(&reader, NULL, reader_thread, &state);
+
+    t = bench_now();
+    for (i = 0; i < n_threads; i++)
+        pthread_create(&producers[i], NULL, producer_thread, &state);
+    for (i = 0; i < n_threads; i++)
+        pthread_join(producers[i], NULL);
+    t_producers = bench_now() - t;
+    pthread_join(reader, NULL);
+    t = bench_now() - t;
+
+    xmpp_stop(state.conn->xmpp_conn->ctx);
+    pthread_join(loop, NULL);
+
+    snprintf(name, sizeof(name), "%s, %2d threads, enqueue",
+             locked ? "mutex" : "inbox", n_threads);
+    bench_report(name, n_threads * per_thread, t_producers);
+    snprintf(name, sizeof(name), "%s, %2d threads, on the wire",
+             locked ? "mutex" : "inbox", n_threads);
+    bench_report(name, n_threads * per_thread, t);
+    printf("%-40s %10.1f write calls per 10k stanzas\n", "",
+           state.conn->xmpp_conn->send_calls * 10000.0
+           / (n_threads * per_thread));
+
+    state.conn->xmpp_conn->state = XMPP_STATE_DISCONNECTED;
+    event_conn_unwatch(state.conn->xmpp_conn);
+    close(sv[0]);
+    close(sv[1]);
+}
+
+int main(int argc, char **argv) {
+    long n = bench_iterations(argc, argv, 320000);
+    int threads;
+
+    for (threads = 1; threads <= 32; threads *= 2) {
+        run(1, threads, n / threads);
+        run(0, threads, n / threads);
+    }
+    return 0;
+}
@@ -0,0 +1,132 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  Stanza parse benchmark
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+/*
+ * Measures events/sec for parsing a pubsub #event from a string and decoding
+ * it into a mio_data_t. Compares creating an expat parser for every event
+ * against the connection's parser pool used by mio_stanza_parse(). Then feeds
+ * truncated and malformed documents through the pool and checks that they
+ * are rejected without growing the heap.
+ */
+
+#include <malloc.h>
+#include <string.h>
+#include <mio.h>
+#include "bench.h"
+
+static char event_xml[] =
+    "<message from='pubsub.example.com' to='bench@example.com' id='bench'>"
+    "<event xmlns='http://jabber.org/protocol/pubsub#event'>"
+    "<items node='3f2504e0-4f89-11d3-9a0c-0305e82c3301'>"
+    "<item id='3f2504e0-4f89-11d3-9a0c-0305e82c3302'>"
+    "<transducerData name='temperature' value='21.5' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "<transducerData name='humidity' value='40.25' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "<transducerData name='light' value='312' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "<transducerData name='occupancy' value='1' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "</item></items></event></message>";
+
+static const char *bad_xml[] = {
+    // Cut off inside a child
+    "<message><event xmlns='http://jabber.org/protocol/pubsub#event'><items node='a'>",
+    // Mismatched end tag below the root
+    "<message><event><items></event></message>",
+    // Garbage after the root
+    "<message/><message/>",
+    "not xml at all",
+    "",
+};
+
+static int decode(mio_conn_t *conn, mio_stanza_t *stanza) {
+    mio_response_t *response = mio_response_new();
+    mio_packet_t *packet = mio_packet_new();
+    mio_xml_parser_data_t *xml_data = mio_xml_parser_data_new();
+    int err;
+
+    mio_packet_payload_add(packet, (void*) mio_data_new(), MIO_PACKET_DATA);
+    response->response = packet;
+    xml_data->response = response;
+    err = mio_xml_parse(conn, stanza, xml_data,
+                        mio_XMLstart_pubsub_data_receive, NULL);
+    mio_response_free(response);
+    mio_stanza_free(stanza);
+    return err;
+}
+
+// Previous pattern: a fresh expat parser for every string
+static mio_stanza_t *parse_unpooled(mio_conn_t *conn, const char *xml) {
+    mio_parser_t *parser = mio_parser_new(conn);
+    mio_stanza_t *stanza = mio_parse(parser, (char*) xml);
+    mio_parser_free(parser);
+    return stanza;
+}
+
+static int run(mio_conn_t *conn, const char *name,
+               mio_stanza_t *(*parse)(mio_conn_t*, const char*), long n) {
+    mio_stanza_t *stanza;
+    double t;
+    long i;
+
+    t = bench_now();
+    for (i = 0; i < n; i++) {
+        stanza = parse(conn, event_xml);
+        if (stanza == NULL || decode(conn, stanza) != MIO_OK)
+            return 1;
+    }
+    bench_report(name, n, bench_now() - t);
+    return 0;
+}
+
+static int run_malformed(mio_conn_t *conn, long n) {
+    size_t nbad = sizeof(bad_xml) / sizeof(bad_xml[0]);
+    size_t heap = 0;
+    long i;
+
+    for (i = 0; i < n; i++) {
+        if (mio_stanza_parse(conn, bad_xml[i % nbad]) != NULL) {
+            fprintf(stderr, "accepted malformed XML: %s\n", bad_xml[i % nbad]);
+            return 1;
+        }
+        // A good document must still parse on a parser that just failed
+        if (i % nbad == nbad - 1) {
+            mio_stanza_free(mio_stanza_parse(conn, event_xml));
+            if (i == (long) nbad * 10 - 1)
+                heap = mallinfo2().uordblks;
+        }
+    }
+    printf("%-40s %10ld docs, heap %zu -> %zu bytes\n", "malformed XML (pooled)",
+           n, heap, mallinfo2().uordblks);
+    return mallinfo2().uordblks > heap;
+}
+
+int main(int argc, char **argv) {
+    long n = bench_iterations(argc, argv, 200000);
+    mio_conn_t *conn = mio_conn_new(MIO_LEVEL_ERROR);
+    int err = 0;
+
+    err |= run(conn, "parse+decode (parser per event)", parse_unpooled, n);
+    err |= run(conn, "parse+decode (pooled parser)", mio_stanza_parse, n);
+    err |= run_malformed(conn, n);
+
+    mio_conn_free(conn);
+    return err;
+}
@@ -0,0 +1,256 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  Stanza Render Benchmark
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+/*
+ * Measures stanzas/sec for rendering typical publish, meta and node
+ * configuration stanzas to text. Compares the previous renderer, which
+ * formatted with xmpp_snprintf into a 1 KB buffer, allocated a copy of every
+ * escaped attribute value and rendered everything again if the buffer was too
+ * small, against the single pass renderer of xmpp_stanza_to_text().
+ */
+
+#include <string.h>
+#include <mio.h>
+#include <hash.h>
+#include "bench.h"
+
+static char publish_xml[] =
+    "<iq type='set' to='pubsub.example.com' id='3f2504e0-4f89-11d3-9a0c-0305e82c3301'>"
+    "<pubsub xmlns='http://jabber.org/protocol/pubsub'>"
+    "<publish node='3f2504e0-4f89-11d3-9a0c-0305e82c3302'>"
+    "<item id='_bench'><data>"
+    "<transducerData name='temperature' value='21.5' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "<transducerData name='humidity' value='40.25' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "<transducerData name='light' value='312' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "<transducerData name='occupancy' value='1' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "</data></item></publish></pubsub></iq>";
+
+static char meta_xml[] =
+    "<iq type='set' to='pubsub.example.com' id='3f2504e0-4f89-11d3-9a0c-0305e82c3303'>"
+    "<pubsub xmlns='http://jabber.org/protocol/pubsub'>"
+    "<publish node='3f2504e0-4f89-11d3-9a0c-0305e82c3304'>"
+    "<item id='meta'><meta>"
+    "<device name='Office &quot;A&quot; sensor' type='indoor weather' "
+    "timestamp='2014-01-01T00:00:00.000000-0500' info='Temperature &amp; humidity &lt;&gt; logger'>"
+    "<geoloc><lat>40.4433</lat><lon>-79.9436</lon><alt>300</alt>"
+    "<building>Collaborative Innovation Center</building><room>2nd floor</room></geoloc>"
+    "<property name='manufacturer' value='Example &amp; Sons'/>"
+    "<property name='serial' value='00-11-22-33'/>"
+    "<transducer name='temperature' type='temperature' unit='celsius' minValue='-40' "
+    "maxValue='85' resolution='0.1' precision='1' accuracy='0.5' interface='i2c'/>"
+    "<transducer name='humidity' type='humidity' unit='percent' minValue='0' "
+    "maxValue='100' resolution='0.1' precision='1' accuracy='2' interface='i2c'/>"
+    "</device></meta></item></publish></pubsub></iq>";
+
+static char config_xml[] =
+    "<iq type='set' to='pubsub.example.com' id='3f2504e0-4f89-11d3-9a0c-0305e82c3305'>"
+    "<pubsub xmlns='http://jabber.org/protocol/pubsub#owner'>"
+    "<configure node='3f2504e0-4f89-11d3-9a0c-0305e82c3306'>"
+    "<x xmlns='jabber:x:data' type='submit'>"
+    "<field var='FORM_TYPE' type='hidden'><value>http://jabber.org/protocol/pubsub#node_config</value></field>"
+    "<field var='pubsub#title'><value>Office sensor</value></field>"
+    "<field var='pubsub#collection'><value>3f2504e0-4f89-11d3-9a0c-0305e82c3307</value></field>"
+    "<field var='pubsub#node_type'><value>leaf</value></field>"
+    "<field var='pubsub#max_items'><value>1</value></field>"
+    "<field var='pubsub#persist_items'><value>1</value></field>"
+    "<field var='pubsub#publish_model'><value>publishers</value></field>"
+    "</x></configure></pubsub></iq>";
+
+/* The previous renderer, kept for comparison */
+
+static char *legacy_escape_xml(xmpp_ctx_t * const ctx, char *text) {
+    size_t len = 0;
+    char *src, *dst, *buf;
+
+    for (src = text; *src != '\0'; src++) {
+        switch (*src) {
+        case '<':
+        case '>':
+            len += 4;
+            break;
+        case '&':
+            len += 5;
+            break;
+        case '"':
+            len += 6;
+            break;
+        default:
+            len++;
+        }
+    }
+    if ((buf = xmpp_alloc(ctx, (len + 1) * sizeof(char))) == NULL)
+        return NULL;
+    dst = buf;
+    for (src = text; *src != '\0'; src++) {
+        switch (*src) {
+        case '<':
+            strcpy(dst, "&lt;");
+            dst += 4;
+            break;
+        case '>':
+            strcpy(dst, "&gt;");
+            dst += 4;
+            break;
+        case '&':
+            strcpy(dst, "&amp;");
+            dst += 5;
+            break;
+        case '"':
+            strcpy(dst, "&quot;");
+            dst += 6;
+            break;
+        default:
+            *dst++ = *src;
+        }
+    }
+    *dst = '\0';
+    return buf;
+}
+
+static void legacy_update(int *written, const int length, const int lastwrite,
+                          size_t *left, char **ptr) {
+    *written += lastwrite;
+    if (*written > length) {
+        *left = 0;
+        *ptr = NULL;
+    } else {
+        *left -= lastwrite;
+        *ptr = &(*ptr)[lastwrite];
+    }
+}
+
+static int legacy_render(xmpp_stanza_t *stanza, char * const buf,
+                         size_t const buflen) {
+    char *ptr = buf, *tmp;
+    size_t left = buflen;
+    int ret, written = 0;
+    xmpp_stanza_t *child;
+    hash_iterator_t *iter;
+    const char *key;
+
+    if (stanza->type == XMPP_STANZA_TEXT) {
+        tmp = legacy_escape_xml(stanza->ctx, stanza->data);
+        ret = xmpp_snprintf(ptr, left, "%s", tmp);
+        xmpp_free(stanza->ctx, tmp);
+        legacy_update(&written, buflen, ret, &left, &ptr);
+        return written;
+    }
+
+    ret = xmpp_snprintf(ptr, left, "<%s", stanza->data);
+    legacy_update(&written, buflen, ret, &left, &ptr);
+    if (stanza->attributes && hash_num_keys(stanza->attributes) > 0) {
+        iter = hash_iter_new(stanza->attributes);
+        while ((key = hash_iter_next(iter))) {
+            tmp = legacy_escape_xml(stanza->ctx,
+                                    (char *) hash_get(stanza->attributes, key));
+            ret = xmpp_snprintf(ptr, left, " %s=\"%s\"", key, tmp);
+            xmpp_free(stanza->ctx, tmp);
+            legacy_update(&written, buflen, ret, &left, &ptr);
+        }
+        hash_iter_release(iter);
+    }
+    if (!stanza->children) {
+        ret = xmpp_snprintf(ptr, left, "/>");
+        legacy_update(&written, buflen, ret, &left, &ptr);
+    } else {
+        ret = xmpp_snprintf(ptr, left, ">");
+        legacy_update(&written, buflen, ret, &left, &ptr);
+        for (child = stanza->children; child; child = child->next) {
+            ret = legacy_render(child, ptr, left);
+            legacy_update(&written, buflen, ret, &left, &ptr);
+        }
+        ret = xmpp_snprintf(ptr, left, "</%s>", stanza->data);
+        legacy_update(&written, buflen, ret, &left, &ptr);
+    }
+    return written;
+}
+
+static int legacy_to_text(xmpp_stanza_t *stanza, char **buf, size_t *buflen) {
+    size_t length = 1024;
+    char *buffer;
+    int ret;
+
+    buffer = xmpp_alloc(stanza->ctx, length);
+    ret = legacy_render(stanza, buffer, length);
+    if (ret > length - 1) {
+        length = ret + 1;
+        buffer = xmpp_realloc(stanza->ctx, buffer, length);
+        ret = legacy_render(stanza, buffer, length);
+    }
+    buffer[length - 1] = 0;
+    *buf = buffer;
+    *buflen = ret;
+    return 0;
+}
+
+static void run(mio_conn_t *conn, const char *name, char *xml, long n) {
+    // A parser takes a single document
+    mio_parser_t *parser = mio_parser_new(conn);
+    mio_stanza_t *stanza = mio_parse(parser, xml);
+    xmpp_ctx_t *ctx = conn->xmpp_conn->ctx;
+    char label[64], *buf, *legacy;
+    size_t len, legacy_len;
+    double t;
+    long i;
+
+    // Both renderers must produce the same bytes
+    xmpp_stanza_to_text(stanza->xmpp_stanza, &buf, &len);
+    legacy_to_text(stanza->xmpp_stanza, &legacy, &legacy_len);
+    if (len != legacy_len || memcmp(buf, legacy, len) != 0) {
+        fprintf(stderr, "%s: renderers disagree\n%s\n%s\n", name, legacy, buf);
+        exit(1);
+    }
+    xmpp_free(ctx, buf);
+    xmpp_free(ctx, legacy);
+
+    t = bench_now();
+    for (i = 0; i < n; i++) {
+        legacy_to_text(stanza->xmpp_stanza, &buf, &len);
+        xmpp_free(ctx, buf);
+    }
+    snprintf(label, sizeof(label), "%s %zu B (snprintf)", name, len);
+    bench_report(label, n, bench_now() - t);
+
+    t = bench_now();
+    for (i = 0; i < n; i++) {
+        xmpp_stanza_to_text(stanza->xmpp_stanza, &buf, &len);
+        xmpp_free(ctx, buf);
+    }
+    snprintf(label, sizeof(label), "%s %zu B (single pass)", name, len);
+    bench_report(label, n, bench_now() - t);
+
+    mio_stanza_free(stanza);
+    mio_parser_free(parser);
+}
+
+int main(int argc, char **argv) {
+    long n = bench_iterations(argc, argv, 200000);
+    mio_conn_t *conn = mio_conn_new(MIO_LEVEL_ERROR);
+
+    run(conn, "publish", publish_xml, n);
+    run(conn, "meta", meta_xml, n);
+    run(conn, "node config", config_xml, n);
+
+    mio_conn_free(conn);
+    return 0;
+}
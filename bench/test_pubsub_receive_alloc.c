@@ -0,0 +1,154 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  Pubsub Receive Allocation Test
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+/*
+ * Counts heap allocations on the pubsub receive path, from the handler that
+ * decodes an event to the application releasing the response after
+ * mio_pubsub_data_receive_many(). Once the response pool and the arenas of
+ * its responses are warm, receiving an event must not allocate at all. The
+ * stanza is parsed once up front, allocations of the XML stream parser are
+ * not part of this path. Run by "make check".
+ */
+
+#include <string.h>
+#include <mio.h>
+#include "bench.h"
+
+#define BATCH 64
+#define WARMUP_ROUNDS 4
+#define ROUNDS 1000
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static int counting;
+static long allocs;
+
+// Counting wrappers that take the place of the libc allocator
+void *malloc(size_t size) {
+    if (counting)
+        __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    if (counting)
+        __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    if (counting)
+        __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+static char event_xml[] =
+    "<message from='pubsub.example.com' to='test@example.com' id='test'>"
+    "<event xmlns='http://jabber.org/protocol/pubsub#event'>"
+    "<items node='3f2504e0-4f89-11d3-9a0c-0305e82c3301'>"
+    "<item id='3f2504e0-4f89-11d3-9a0c-0305e82c3302'>"
+    "<transducerData name='temperature' value='21.5' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "<transducerData name='humidity' value='40.25' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "<transducerData name='light' value='312' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "<transducerData name='occupancy' value='1' timestamp='2014-01-01T00:00:00.000000-0500'/>"
+    "</item></items></event></message>";
+
+// Receives one batch of events the way an application would, returns the
+// number of responses that carried all transducers
+static int round_trip(mio_conn_t *conn, mio_stanza_t *stanza) {
+    mio_response_t *responses[BATCH];
+    mio_packet_t *packet;
+    mio_data_t *data;
+    int i, n, ok = 0;
+
+    for (i = 0; i < BATCH; i++)
+        mio_handler_pubsub_data_receive(conn, stanza, NULL, NULL);
+    n = mio_pubsub_data_receive_many(conn, responses, BATCH, 0);
+    for (i = 0; i < n; i++) {
+        packet = (mio_packet_t*) responses[i]->response;
+        data = (mio_data_t*) packet->payload;
+        if (responses[i]->response_type == MIO_RESPONSE_PACKET
+                && data->num_transducers == 4
+                && strcmp(data->transducers->next->value, "40.25") == 0)
+            ok++;
+        mio_pubsub_data_response_release(conn, responses[i]);
+    }
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    mio_conn_t *conn = mio_conn_new(MIO_LEVEL_ERROR);
+    mio_parser_t *parser = mio_parser_new(conn);
+    mio_stanza_t *stanza = mio_parse(parser, event_xml);
+    mio_response_t *response;
+    long warmup, steady, single;
+    int r, ok = 0;
+
+    conn->xmpp_conn->authenticated = 1;
+    conn->pubsub_rx_request = _mio_request_new();
+    conn->pubsub_rx_listening = 1;
+
+    counting = 1;
+    for (r = 0; r < WARMUP_ROUNDS; r++)
+        ok += round_trip(conn, stanza);
+    warmup = allocs;
+    allocs = 0;
+    for (r = 0; r < ROUNDS; r++)
+        ok += round_trip(conn, stanza);
+    steady = allocs;
+
+    // mio_pubsub_data_receive() hands the arena to a response the
+    // application frees, so it allocates a new one per event
+    allocs = 0;
+    mio_handler_pubsub_data_receive(conn, stanza, NULL, NULL);
+    response = mio_response_new();
+    mio_pubsub_data_receive(conn, response);
+    mio_response_free(response);
+    single = allocs;
+    counting = 0;
+
+    printf("%-40s %10ld allocations in %d events\n", "warm-up",
+           warmup, WARMUP_ROUNDS * BATCH);
+    printf("%-40s %10ld allocations in %d events\n", "receive_many + release",
+           steady, ROUNDS * BATCH);
+    printf("%-40s %10ld allocations in 1 event\n", "receive + free", single);
+
+    conn->pubsub_rx_listening = 0;
+    conn->xmpp_conn->authenticated = 0;
+    mio_stanza_free(stanza);
+    mio_parser_free(parser);
+    mio_conn_free(conn);
+
+    if (ok != (WARMUP_ROUNDS + ROUNDS) * BATCH) {
+        fprintf(stderr, "%d of %d events decoded\n", ok,
+                (WARMUP_ROUNDS + ROUNDS) * BATCH);
+        return 1;
+    }
+    if (steady != 0) {
+        fprintf(stderr, "receive path allocated after warm-up\n");
+        return 1;
+    }
+    return 0;
+}
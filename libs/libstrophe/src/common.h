@@ -32,6 +32,7 @@
 #include "hash.h"
 #include "util.h"
 #include "parser.h"
+#include "timer.h"
 
 /** run-time context **/
 
@@ -49,9 +50,28 @@ typedef struct _xmpp_connlist_t {
 struct _xmpp_ctx_t {
     const xmpp_mem_t *mem;
     const xmpp_log_t *log;
+    /* messages below this level are dropped before they are formatted */
+    xmpp_log_level_t log_level;
 
     xmpp_loop_status_t loop_status;
     xmpp_connlist_t *connlist;
+
+    /* event notification backend, see xmpp_ctx_set_event_backend() */
+    xmpp_event_backend_t event_backend;
+    int epoll_fd;
+
+    /* eventfd or self-pipe used by xmpp_ctx_wakeup(), the read end is
+     * watched by the event loop */
+    int wakeup_rfd;
+    int wakeup_wfd;
+
+    /* timers, and the monotonic time in ms read once per loop iteration */
+    xmpp_timer_wheel_t timers;
+    uint64_t now;
+
+    /* size of the last stanza rendered by xmpp_stanza_to_text(), the
+     * first guess for the size of the next one */
+    size_t render_hint;
 };
 
 
@@ -67,6 +87,17 @@ void xmpp_log(const xmpp_ctx_t * const ctx,
 	      const char * const fmt, 
 	      va_list ap);
 
+/* log handlers of the default and asynchronous loggers, their userdata
+ * points to the filter level */
+void xmpp_default_logger(void * const userdata,
+			 const xmpp_log_level_t level,
+			 const char * const area,
+			 const char * const msg);
+void async_log_handler(void * const userdata,
+		       const xmpp_log_level_t level,
+		       const char * const area,
+		       const char * const msg);
+
 /* wrappers for xmpp_log at specific levels */
 void xmpp_error(const xmpp_ctx_t * const ctx,
 		const char * const area,
@@ -114,32 +145,45 @@ struct _xmpp_send_queue_t {
     xmpp_send_queue_t *next;
 };
 
+/* stanza handlers are indexed by which of the name, type and ns filters
+ * they set, the shape, and the values of those filters */
+#define HANDLER_SHAPE_NAME 0x1
+#define HANDLER_SHAPE_TYPE 0x2
+#define HANDLER_SHAPE_NS 0x4
+#define HANDLER_SHAPES 8
+
 typedef struct _xmpp_handlist_t xmpp_handlist_t;
+typedef struct _xmpp_handler_bucket_t xmpp_handler_bucket_t;
 struct _xmpp_handlist_t {
     /* common members */
     int user_handler;
     void *handler;
     void *userdata;
-    int enabled; /* handlers are added disabled and enabled after the
-		  * handler chain is processed to prevent stanzas from
-		  * getting processed by newly added handlers */
+    /* stanza handlers added while the stanza of this dispatch epoch is
+     * processed are not called for it, see handler_fire_stanza() */
+    unsigned long epoch;
     xmpp_handlist_t *next;
 
     union {
 	/* timed handlers */
 	struct {
 	    unsigned long period;
-	    uint64_t last_stamp;
+	    xmpp_timer_t timer;
+	    xmpp_conn_t *conn;
 	};
 	/* id handlers */
 	struct {
 	    char *id;
 	};
-	/* normal handlers */
+	/* normal handlers, next links all of them in the order they were
+	 * added, pprev is NULL once the handler is deleted */
 	struct {
-	    char *ns;
-	    char *name;
-	    char *type;
+	    xmpp_handlist_t **pprev;
+	    /* bucket of handlers with the same filters */
+	    xmpp_handler_bucket_t *bucket;
+	    xmpp_handlist_t *bucket_next;
+	    xmpp_handlist_t **bucket_pprev;
+	    unsigned long seq;
 	};
     };
 };
@@ -162,6 +206,12 @@ struct _xmpp_conn_t {
     sock_t sock;
     tls_t *tls;
 
+    /* socket and events currently registered with the event backend */
+    sock_t watched_sock;
+    unsigned int watched_events;
+    /* set by xmpp_conn_set_read_paused() */
+    int read_paused;
+
     int tls_support;
     int tls_disabled;
     int tls_failed; /* set when tls fails, so we don't try again */
@@ -188,6 +238,21 @@ struct _xmpp_conn_t {
     int send_queue_len;
     xmpp_send_queue_t *send_queue_head;
     xmpp_send_queue_t *send_queue_tail;
+    /* sent items kept for reuse by conn_send_queue_item_new() */
+    xmpp_send_queue_t *send_queue_free;
+    int send_queue_free_len;
+    /* number of items that have left the front of the send queue.  an
+     * item appended as number send_queue_done + send_queue_len - 1 is
+     * still queued while send_queue_done is not past that number */
+    uint64_t send_queue_done;
+    /* small items copied into one TLS record, written before the queue */
+    char *send_coalesce;
+    size_t send_coalesce_len;
+    size_t send_coalesce_written;
+    /* number of items at the front of the send queue in the buffer */
+    int send_coalesce_items;
+    /* number of socket or TLS write calls made to flush the send queue */
+    unsigned long send_calls;
 
     /* xml parser */
     int reset_parser;
@@ -212,6 +277,15 @@ struct _xmpp_conn_t {
     xmpp_handlist_t *timed_handlers;
     hash_t *id_handlers;
     xmpp_handlist_t *handlers;
+    xmpp_handlist_t **handlers_tail;
+    /* stanza handlers by filters, see handler.c */
+    hash_t *handler_index;
+    int handler_shapes[HANDLER_SHAPES];
+    unsigned long handler_seq;
+    unsigned long handler_epoch;
+    int handler_dispatching;
+    /* handlers deleted while stanzas are dispatched, freed afterwards */
+    xmpp_handlist_t *handlers_deleted;
 };
 
 void conn_disconnect(xmpp_conn_t * const conn);
@@ -219,6 +293,20 @@ void conn_disconnect_clean(xmpp_conn_t * const conn);
 void conn_open_stream(xmpp_conn_t * const conn);
 void conn_prepare_reset(xmpp_conn_t * const conn, xmpp_open_handler handler);
 void conn_parser_reset(xmpp_conn_t * const conn);
+void conn_send_queue_add(xmpp_conn_t * const conn, char * const data,
+			 const size_t len);
+int conn_send_queue_replace(xmpp_conn_t * const conn,
+			    xmpp_send_queue_t * const item, const uint64_t pos,
+			    char * const data, const size_t len);
+void conn_send_queue_consume(xmpp_conn_t * const conn, size_t n);
+xmpp_send_queue_t *conn_send_queue_item_new(xmpp_conn_t * const conn);
+void conn_send_queue_item_release(xmpp_conn_t * const conn,
+				  xmpp_send_queue_t * const item);
+
+/* event backend management */
+void event_conn_unwatch(xmpp_conn_t * const conn);
+void event_ctx_init(xmpp_ctx_t * const ctx);
+void event_ctx_cleanup(xmpp_ctx_t * const ctx);
 
 
 typedef enum {
@@ -246,7 +334,6 @@ struct _xmpp_stanza_t {
 /* handler management */
 void handler_fire_stanza(xmpp_conn_t * const conn,
 			 xmpp_stanza_t * const stanza);
-uint64_t handler_fire_timed(xmpp_ctx_t * const ctx);
 void handler_reset_timed(xmpp_conn_t *conn, int user_only);
 void handler_add_timed(xmpp_conn_t * const conn,
 		       xmpp_timed_handler handler,
@@ -262,6 +349,8 @@ void handler_add(xmpp_conn_t * const conn,
 		 const char * const name,
 		 const char * const type,
 		 void * const userdata);
+void handler_release_all(xmpp_conn_t * const conn);
+void handler_move(xmpp_conn_t * const from, xmpp_conn_t * const to);
 
 /* utility functions */
 void disconnect_mem_error(xmpp_conn_t * const conn);
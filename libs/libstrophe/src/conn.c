@@ -35,6 +35,12 @@
  */
 #define DEFAULT_SEND_QUEUE_MAX 64
 #endif
+#ifndef SEND_QUEUE_FREE_MAX
+/** @def SEND_QUEUE_FREE_MAX
+ *  The maximum number of sent queue items kept per connection for reuse.
+ */
+#define SEND_QUEUE_FREE_MAX 64
+#endif
 #ifndef DISCONNECT_TIMEOUT
 /** @def DISCONNECT_TIMEOUT 
  *  The time to wait (in milliseconds) for graceful disconnection to
@@ -83,6 +89,9 @@ xmpp_conn_t *xmpp_conn_new(xmpp_ctx_t * const ctx)
         conn->state = XMPP_STATE_DISCONNECTED;
 	conn->sock = -1;
 	conn->tls = NULL;
+	conn->watched_sock = -1;
+	conn->watched_events = 0;
+	conn->read_paused = 0;
 	conn->timeout_stamp = 0;
 	conn->error = 0;
 	conn->stream_error = NULL;
@@ -93,6 +102,14 @@ xmpp_conn_t *xmpp_conn_new(xmpp_ctx_t * const ctx)
 	conn->send_queue_len = 0;
 	conn->send_queue_head = NULL;
 	conn->send_queue_tail = NULL;
+	conn->send_queue_free = NULL;
+	conn->send_queue_free_len = 0;
+	conn->send_queue_done = 0;
+	conn->send_coalesce = NULL;
+	conn->send_coalesce_len = 0;
+	conn->send_coalesce_written = 0;
+	conn->send_coalesce_items = 0;
+	conn->send_calls = 0;
 
 	/* default timeouts */
 	conn->connect_timeout = CONNECT_TIMEOUT;
@@ -132,6 +149,13 @@ xmpp_conn_t *xmpp_conn_new(xmpp_ctx_t * const ctx)
 	/* we own (and will free) the hash values */
 	conn->id_handlers = hash_new(conn->ctx, 32, NULL);
 	conn->handlers = NULL;
+	conn->handlers_tail = &conn->handlers;
+	conn->handler_index = NULL;
+	memset(conn->handler_shapes, 0, sizeof(conn->handler_shapes));
+	conn->handler_seq = 0;
+	conn->handler_epoch = 0;
+	conn->handler_dispatching = 0;
+	conn->handlers_deleted = NULL;
 
 	/* give the caller a reference to connection */
 	conn->ref = 1;
@@ -189,6 +213,7 @@ int xmpp_conn_release(xmpp_conn_t * const conn)
     xmpp_ctx_t *ctx;
     xmpp_connlist_t *item, *prev;
     xmpp_handlist_t *hlitem, *thli;
+    xmpp_send_queue_t *sqitem;
     hash_iterator_t *iter;
     const char *key;
     int released = 0;
@@ -198,6 +223,8 @@ int xmpp_conn_release(xmpp_conn_t * const conn)
     else {
 	ctx = conn->ctx;
 
+	event_conn_unwatch(conn);
+
 	/* remove connection from context's connlist */
 	if (ctx->connlist->conn == conn) {
 	    item = ctx->connlist;
@@ -229,6 +256,7 @@ int xmpp_conn_release(xmpp_conn_t * const conn)
 	    thli = hlitem;
 	    hlitem = hlitem->next;
 
+	    xmpp_timer_del(ctx, &thli->timer);
 	    xmpp_free(ctx, thli);
 	}
 
@@ -248,16 +276,7 @@ int xmpp_conn_release(xmpp_conn_t * const conn)
 	hash_iter_release(iter);
 	hash_release(conn->id_handlers);
 
-	hlitem = conn->handlers;
-	while (hlitem) {
-	    thli = hlitem;
-	    hlitem = hlitem->next;
-
-	    if (thli->ns) xmpp_free(ctx, thli->ns);
-	    if (thli->name) xmpp_free(ctx, thli->name);
-	    if (thli->type) xmpp_free(ctx, thli->type);
-	    xmpp_free(ctx, thli);
-	}
+	handler_release_all(conn);
 
 	if (conn->stream_error) {
 	    xmpp_stanza_release(conn->stream_error->stanza);
@@ -268,6 +287,20 @@ int xmpp_conn_release(xmpp_conn_t * const conn)
 
         parser_free(conn->parser);
 	
+	/* unsent and recycled send queue items */
+	while (conn->send_queue_head) {
+	    sqitem = conn->send_queue_head;
+	    conn->send_queue_head = sqitem->next;
+	    xmpp_free(ctx, sqitem->data);
+	    xmpp_free(ctx, sqitem);
+	}
+	while (conn->send_queue_free) {
+	    sqitem = conn->send_queue_free;
+	    conn->send_queue_free = sqitem->next;
+	    xmpp_free(ctx, sqitem);
+	}
+	if (conn->send_coalesce) xmpp_free(ctx, conn->send_coalesce);
+
 	if (conn->domain) xmpp_free(ctx, conn->domain);
 	if (conn->jid) xmpp_free(ctx, conn->jid);
     if (conn->bound_jid) xmpp_free(ctx, conn->bound_jid);
@@ -357,6 +390,45 @@ void xmpp_conn_set_pass(xmpp_conn_t * const conn, const char * const pass)
     conn->pass = xmpp_strdup(conn->ctx, pass);
 }
 
+/** Stop or resume reading from the connection's socket.
+ *  While reading is paused the event loop does not process incoming data,
+ *  so that the server's and the kernel's flow control hold back further
+ *  stanzas until the application caught up.  Queued data is still sent.
+ *  Must not be called concurrently with the event loop.
+ *
+ *  @param conn a Strophe connection object
+ *  @param paused TRUE to stop reading, FALSE to resume
+ *
+ *  @ingroup Connections
+ */
+void xmpp_conn_set_read_paused(xmpp_conn_t * const conn, const int paused)
+{
+    conn->read_paused = paused;
+}
+
+/** Install a decoder for children of received stanzas.
+ *  A child of a toplevel stanza that the decoder's probe accepts is not
+ *  built into the stanza but passed element by element to the decoder
+ *  while it is parsed.  Once such a stanza ends it goes to the decoder
+ *  instead of the stanza handlers, all other stanzas are handled as usual.
+ *  A decoder installed or removed while a stanza is being streamed takes
+ *  effect after that stanza.  Must not be called concurrently with the
+ *  event loop.
+ *
+ *  @param conn a Strophe connection object
+ *  @param decoder the decoder callbacks, copied, or NULL to remove the
+ *         decoder
+ *  @param userdata an opaque pointer passed to the callbacks
+ *
+ *  @ingroup Handlers
+ */
+void xmpp_conn_set_stream_decoder(xmpp_conn_t * const conn,
+				  const xmpp_stream_decoder_t * const decoder,
+				  void * const userdata)
+{
+    parser_set_decoder(conn->parser, decoder, userdata);
+}
+
 /** Get the strophe context that the connection is associated with.
 *  @param conn a Strophe connection object
 * 
@@ -436,7 +508,7 @@ int xmpp_connect_client(xmpp_conn_t * const conn,
      * from within the event loop */
 
     conn->state = XMPP_STATE_CONNECTING;
-    conn->timeout_stamp = time_stamp();
+    conn->timeout_stamp = time_monotonic();
     xmpp_debug(conn->ctx, "xmpp", "attempting to connect to %s", connectdomain);
 
     return 0;
@@ -471,6 +543,22 @@ void conn_disconnect(xmpp_conn_t * const conn)
 	tls_free(conn->tls);
 	conn->tls = NULL;
     }
+    /* a partially written TLS record can't be continued on a new stream.
+     * its stanzas are still queued, drop the ones that were written and
+     * keep the rest for the next stream */
+    if (conn->send_coalesce_len) {
+	conn_send_queue_consume(conn, conn->send_coalesce_written);
+	conn->send_coalesce_items = 0;
+	conn->send_coalesce_len = 0;
+	conn->send_coalesce_written = 0;
+    }
+    /* neither can a partially written stanza */
+    if (conn->send_queue_head && conn->send_queue_head->written) {
+	xmpp_debug(conn->ctx, "xmpp", "Dropping partially sent stanza.");
+	conn_send_queue_consume(conn, conn->send_queue_head->len -
+				conn->send_queue_head->written);
+    }
+    event_conn_unwatch(conn);
     sock_close(conn->sock);
 
     /* fire off connection handler */
@@ -590,20 +678,38 @@ void xmpp_send_raw_string(xmpp_conn_t * const conn,
 void xmpp_send_raw(xmpp_conn_t * const conn,
 		   const char * const data, const size_t len)
 {
-    xmpp_send_queue_t *item;
+    char *copy;
 
     if (conn->state != XMPP_STATE_CONNECTED) return;
 
-    /* create send queue item for queue */
-    item = xmpp_alloc(conn->ctx, sizeof(xmpp_send_queue_t));
-    if (!item) return;
+    copy = xmpp_alloc(conn->ctx, len);
+    if (!copy) return;
+    memcpy(copy, data, len);
+    conn_send_queue_add(conn, copy, len);
+}
 
-    item->data = xmpp_alloc(conn->ctx, len);
-    if (!item->data) {
-	xmpp_free(conn->ctx, item);
+/** Append a buffer to the send queue without copying it.
+ *  The send queue takes ownership of data, which must have been allocated
+ *  with xmpp_alloc() and is freed once it has been written or the
+ *  connection is cleaned up.
+ *
+ *  @param conn a Strophe connection object
+ *  @param data a buffer of raw bytes
+ *  @param len the length of the data in the buffer
+ */
+void conn_send_queue_add(xmpp_conn_t * const conn, char * const data,
+			 const size_t len)
+{
+    xmpp_send_queue_t *item;
+
+    /* create send queue item for queue */
+    item = conn_send_queue_item_new(conn);
+    if (!item) {
+	xmpp_free(conn->ctx, data);
 	return;
     }
-    memcpy(item->data, data, len);
+
+    item->data = data;
     item->len = len;
     item->next = NULL;
     item->written = 0;
@@ -621,6 +727,119 @@ void xmpp_send_raw(xmpp_conn_t * const conn,
     conn->send_queue_len++;
 }
 
+/** Replace the data of a queued item before any of it is written.
+ *  This lets a newer buffer take the place of a superseded one without
+ *  growing the send queue.  The item at the front of the queue is never
+ *  replaced, since a failed TLS write has to be retried with the same
+ *  buffer.
+ *
+ *  @param conn a Strophe connection object
+ *  @param item the item, taken from send_queue_tail right after it was
+ *         appended
+ *  @param pos the number of the item, send_queue_done + send_queue_len - 1
+ *         right after it was appended
+ *  @param data a buffer allocated with xmpp_alloc()
+ *  @param len the length of the data in the buffer
+ *
+ *  @return TRUE if the queue took ownership of data and freed the old
+ *          buffer, FALSE if the item is already being written or gone
+ */
+int conn_send_queue_replace(xmpp_conn_t * const conn,
+			    xmpp_send_queue_t * const item, const uint64_t pos,
+			    char * const data, const size_t len)
+{
+    /* items leave the queue in order, so the item is gone once pos has
+     * been counted as done and the pointer may have been reused.  items
+     * copied into the coalesce buffer are already being written */
+    if (conn->send_queue_done + conn->send_coalesce_items >= pos ||
+	item == conn->send_queue_head || item->written != 0)
+	return 0;
+
+    xmpp_free(conn->ctx, item->data);
+    item->data = data;
+    item->len = len;
+    return 1;
+}
+
+/** Drop written bytes from the front of the send queue.
+ *  The items that are now completely written are released.
+ *
+ *  @param conn a Strophe connection object
+ *  @param n the number of bytes written from the front of the queue
+ */
+void conn_send_queue_consume(xmpp_conn_t * const conn, size_t n)
+{
+    xmpp_send_queue_t *sq;
+    size_t towrite;
+
+    while ((sq = conn->send_queue_head)) {
+	towrite = sq->len - sq->written;
+	if (n < towrite) {
+	    sq->written += n;
+	    break;
+	}
+	n -= towrite;
+
+	/* pop the top item, if we've sent everything update the tail */
+	conn->send_queue_head = sq->next;
+	if (!conn->send_queue_head) conn->send_queue_tail = NULL;
+	conn->send_queue_len--;
+	conn->send_queue_done++;
+	conn_send_queue_item_release(conn, sq);
+    }
+}
+
+/** Get a send queue item, reusing one released by the event loop
+ *  when possible.  The item is not linked into the send queue.
+ *
+ *  @param conn a Strophe connection object
+ *
+ *  @return a send queue item or NULL on allocation failure
+ */
+xmpp_send_queue_t *conn_send_queue_item_new(xmpp_conn_t * const conn)
+{
+    xmpp_send_queue_t *item;
+
+    item = conn->send_queue_free;
+    if (item) {
+	conn->send_queue_free = item->next;
+	conn->send_queue_free_len--;
+    } else {
+	item = xmpp_alloc(conn->ctx, sizeof(xmpp_send_queue_t));
+	if (!item) return NULL;
+    }
+
+    item->data = NULL;
+    item->len = 0;
+    item->written = 0;
+    item->next = NULL;
+
+    return item;
+}
+
+/** Release a send queue item that is no longer linked into the queue.
+ *  The item's data is freed and the item is kept for reuse up to
+ *  SEND_QUEUE_FREE_MAX items.
+ *
+ *  @param conn a Strophe connection object
+ *  @param item the item to release
+ */
+void conn_send_queue_item_release(xmpp_conn_t * const conn,
+				  xmpp_send_queue_t * const item)
+{
+    if (item->data) xmpp_free(conn->ctx, item->data);
+
+    if (conn->send_queue_free_len >= SEND_QUEUE_FREE_MAX) {
+	xmpp_free(conn->ctx, item);
+	return;
+    }
+
+    item->data = NULL;
+    item->next = conn->send_queue_free;
+    conn->send_queue_free = item;
+    conn->send_queue_free_len++;
+}
+
 /** Send an XML stanza to the XMPP server.
  *  This is the main way to send data to the XMPP server.  The function will
  *  terminate without action if the connection state is not CONNECTED.
@@ -639,9 +858,9 @@ void xmpp_send(xmpp_conn_t * const conn,
 
     if (conn->state == XMPP_STATE_CONNECTED) {
 	if ((ret = xmpp_stanza_to_text(stanza, &buf, &len)) == 0) {
-	    xmpp_send_raw(conn, buf, len);
 	    xmpp_debug(conn->ctx, "conn", "SENT: %s", buf);
-	    xmpp_free(conn->ctx, buf);
+	    /* the send queue takes the rendered buffer as it is */
+	    conn_send_queue_add(conn, buf, len);
 	}
     }
 }
@@ -764,7 +983,9 @@ static void _handle_stream_stanza(xmpp_stanza_t *stanza,
     char *buf;
     size_t len;
 
-    if (xmpp_stanza_to_text(stanza, &buf, &len) == 0) {
+    /* rendering costs more than parsing, skip it if nobody reads it */
+    if (conn->ctx->log_level <= XMPP_LEVEL_DEBUG &&
+	xmpp_stanza_to_text(stanza, &buf, &len) == 0) {
         xmpp_debug(conn->ctx, "xmpp", "RECV: %s", buf);
         xmpp_free(conn->ctx, buf);
     }
@@ -187,6 +187,16 @@ xmpp_log_t *xmpp_get_default_logger(xmpp_log_level_t level)
 
 static xmpp_log_t xmpp_default_log = { NULL, NULL };
 
+/* the filter level of the loggers that come with the library, custom
+ * loggers get every message unless xmpp_ctx_set_log_level() is called */
+static xmpp_log_level_t _log_filter_level(const xmpp_log_t * const log)
+{
+    if (log->handler == xmpp_default_logger ||
+	log->handler == async_log_handler)
+	return *(xmpp_log_level_t *)log->userdata;
+    return XMPP_LEVEL_DEBUG;
+}
+
 /* convenience functions for accessing the context */
 
 /** Allocate memory in a Strophe context.
@@ -252,6 +262,10 @@ void xmpp_log(const xmpp_ctx_t * const ctx,
     char *buf;
     va_list copy;
 
+    /* don't pay for formatting messages nobody will see */
+    if (level < ctx->log_level || !ctx->log->handler)
+	return;
+
     buf = smbuf;
     va_copy(copy, ap);
     ret = xmpp_vsnprintf(buf, 1023, fmt, ap);
@@ -265,8 +279,10 @@ void xmpp_log(const xmpp_ctx_t * const ctx,
 	}
 	oldret = ret;
 	ret = xmpp_vsnprintf(buf, ret + 1, fmt, copy);
+	va_end(copy);
 	if (ret > oldret) {
 	    xmpp_error(ctx, "log", "Unexpected error");
+	    xmpp_free(ctx, buf);
 	    return;
 	}
     } else {
@@ -403,9 +419,16 @@ xmpp_ctx_t *xmpp_ctx_new(const xmpp_mem_t * const mem,
 	    ctx->log = &xmpp_default_log;
 	else
 	    ctx->log = log;
+	ctx->log_level = _log_filter_level(ctx->log);
 
 	ctx->connlist = NULL;
 	ctx->loop_status = XMPP_LOOP_NOTSTARTED;
+	ctx->event_backend = XMPP_EVENT_SELECT;
+	ctx->epoll_fd = -1;
+	ctx->render_hint = 0;
+	ctx->now = time_monotonic();
+	timer_wheel_init(&ctx->timers, ctx->now);
+	event_ctx_init(ctx);
     }
 
     return ctx;
@@ -419,7 +442,25 @@ xmpp_ctx_t *xmpp_ctx_new(const xmpp_mem_t * const mem,
  */
 void xmpp_ctx_free(xmpp_ctx_t * const ctx)
 {
+    event_ctx_cleanup(ctx);
     /* mem and log are owned by their suppliers */
     xmpp_free(ctx, ctx); /* pull the hole in after us */
 }
 
+/** Set the lowest level that is logged.
+ *  Messages below this level are dropped by xmpp_log() before they are
+ *  formatted, so that debug logging costs nothing while it is disabled.
+ *  The default and asynchronous loggers set this from their filter level,
+ *  custom loggers start at XMPP_LEVEL_DEBUG.
+ *
+ *  @param ctx a Strophe context object
+ *  @param level the lowest level to pass to the log handler
+ *
+ *  @ingroup Context
+ */
+void xmpp_ctx_set_log_level(xmpp_ctx_t * const ctx,
+			    const xmpp_log_level_t level)
+{
+    ctx->log_level = level;
+}
+
@@ -36,10 +36,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 
 #ifndef _WIN32
 #include <sys/select.h>
 #include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
 #else
 #include <winsock2.h>
 #define ETIMEDOUT WSAETIMEDOUT
@@ -59,128 +68,471 @@
 #define DEFAULT_TIMEOUT 1
 #endif
 
-/** Run the event loop once.
- *  This function will run send any data that has been queued by
- *  xmpp_send and related functions and run through the Strophe even
- *  loop a single time, and will not wait more than timeout
- *  milliseconds for events.  This is provided to support integration
- *  with event loops outside the library, and if used, should be
- *  called regularly to achieve low latency event handling.
+#ifndef EVENT_EPOLL_MAX_EVENTS
+/** @def EVENT_EPOLL_MAX_EVENTS
+ *  The maximum number of epoll events handled per loop iteration.
+ *  Sockets that stay ready are reported again on the next iteration.
+ */
+#define EVENT_EPOLL_MAX_EVENTS 256
+#endif
+
+#ifndef EVENT_IOV_MAX
+/** @def EVENT_IOV_MAX
+ *  The maximum number of send queue items written by one gather write,
+ *  limited by the system's IOV_MAX.
+ */
+#if defined(IOV_MAX) && IOV_MAX < 1024
+#define EVENT_IOV_MAX IOV_MAX
+#else
+#define EVENT_IOV_MAX 1024
+#endif
+#endif
+
+#ifndef TLS_COALESCE_SIZE
+/** @def TLS_COALESCE_SIZE
+ *  The size of the buffer small send queue items are copied into before
+ *  being written through TLS, which is the maximum TLS record payload.
+ */
+#define TLS_COALESCE_SIZE 16384
+#endif
+
+/** Set the event notification backend used by xmpp_run_once.
+ *  This must be called right after the context is created, before any
+ *  connection objects are made from it.  The select() backend is the
+ *  default.  The epoll() backend registers each socket once and only
+ *  updates the registration when the events a connection waits for
+ *  change, which keeps the per-tick cost independent of the number of
+ *  idle connections.
  *
  *  @param ctx a Strophe context object
- *  @param timeout time to wait for events in milliseconds
+ *  @param backend the event backend to use
+ *
+ *  @return 0 on success, XMPP_EINVOP if connections already exist or
+ *      the backend is not supported on this platform, XMPP_EMEM if the
+ *      backend could not be initialized
  *
  *  @ingroup EventLoop
  */
-void xmpp_run_once(xmpp_ctx_t *ctx, const unsigned long timeout)
+int xmpp_ctx_set_event_backend(xmpp_ctx_t * const ctx,
+			       const xmpp_event_backend_t backend)
 {
-    xmpp_connlist_t *connitem;
-    xmpp_conn_t *conn;
-    fd_set rfds, wfds;
-    sock_t max = 0;
-    int ret;
-    struct timeval tv;
-    xmpp_send_queue_t *sq, *tsq;
-    int towrite;
-    char buf[4096];
-    uint64_t next;
-    long usec;
-    int tls_read_bytes = 0;
+    if (ctx->connlist) return XMPP_EINVOP;
+    if (backend == ctx->event_backend) return 0;
 
-    if (ctx->loop_status == XMPP_LOOP_QUIT) return;
-    ctx->loop_status = XMPP_LOOP_RUNNING;
+    if (backend == XMPP_EVENT_SELECT) {
+#ifdef HAVE_SYS_EPOLL_H
+	if (ctx->epoll_fd >= 0) close(ctx->epoll_fd);
+#endif
+	ctx->epoll_fd = -1;
+	ctx->event_backend = XMPP_EVENT_SELECT;
+	return 0;
+    }
 
-    /* send queued data */
-    connitem = ctx->connlist;
-    while (connitem) {
-	conn = connitem->conn;
-	if (conn->state != XMPP_STATE_CONNECTED) {
-	    connitem = connitem->next;
-	    continue;
+#ifdef HAVE_SYS_EPOLL_H
+    if (backend == XMPP_EVENT_EPOLL) {
+	struct epoll_event ev;
+
+	ctx->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (ctx->epoll_fd < 0) {
+	    xmpp_error(ctx, "event", "epoll_create1 failed: %d", errno);
+	    return XMPP_EMEM;
 	}
 
-	/* if we're running tls, there may be some remaining data waiting to
-	 * be sent, so push that out */
-	if (conn->tls) {
-	    ret = tls_clear_pending_write(conn->tls);
+	/* the wakeup descriptor is the only entry without a connection */
+	if (ctx->wakeup_rfd >= 0) {
+	    memset(&ev, 0, sizeof(ev));
+	    ev.events = EPOLLIN;
+	    ev.data.ptr = NULL;
+	    epoll_ctl(ctx->epoll_fd, EPOLL_CTL_ADD, ctx->wakeup_rfd, &ev);
+	}
+	ctx->event_backend = XMPP_EVENT_EPOLL;
+	return 0;
+    }
+#endif
+
+    return XMPP_EINVOP;
+}
+
+/** Create the wakeup descriptor of a new context.
+ *  An eventfd is used where available, a non-blocking pipe otherwise.
+ *  If neither can be created xmpp_ctx_wakeup() fails and the event
+ *  loop simply runs until its timeout.
+ *
+ *  @param ctx a Strophe context object
+ */
+void event_ctx_init(xmpp_ctx_t * const ctx)
+{
+#ifndef _WIN32
+    int fds[2];
+#endif
+
+    ctx->wakeup_rfd = -1;
+    ctx->wakeup_wfd = -1;
+
+#ifdef HAVE_SYS_EVENTFD_H
+    ctx->wakeup_rfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (ctx->wakeup_rfd >= 0) {
+	ctx->wakeup_wfd = ctx->wakeup_rfd;
+	return;
+    }
+#endif
+#ifndef _WIN32
+    if (pipe(fds) == 0) {
+	fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+	fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	ctx->wakeup_rfd = fds[0];
+	ctx->wakeup_wfd = fds[1];
+    }
+#endif
+}
+
+/** Release any resources held by the context's event backend.
+ *
+ *  @param ctx a Strophe context object
+ */
+void event_ctx_cleanup(xmpp_ctx_t * const ctx)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (ctx->epoll_fd >= 0) close(ctx->epoll_fd);
+#endif
+    ctx->epoll_fd = -1;
+    ctx->event_backend = XMPP_EVENT_SELECT;
+
+#ifndef _WIN32
+    if (ctx->wakeup_wfd >= 0 && ctx->wakeup_wfd != ctx->wakeup_rfd)
+	close(ctx->wakeup_wfd);
+    if (ctx->wakeup_rfd >= 0) close(ctx->wakeup_rfd);
+#endif
+    ctx->wakeup_rfd = -1;
+    ctx->wakeup_wfd = -1;
+}
+
+/** Wake up the event loop.
+ *  Makes a concurrent or the next xmpp_run_once() call return from its
+ *  wait right away instead of blocking until socket activity, a timed
+ *  handler or its timeout.  This is the only event loop function that
+ *  may be called from other threads while the loop is running.
+ *
+ *  @param ctx a Strophe context object
+ *
+ *  @return 0 on success or XMPP_EINVOP if the context has no wakeup
+ *      descriptor
+ *
+ *  @ingroup EventLoop
+ */
+int xmpp_ctx_wakeup(xmpp_ctx_t * const ctx)
+{
+#ifndef _WIN32
+    uint64_t one = 1;
+    ssize_t ret;
+
+    if (ctx->wakeup_wfd < 0) return XMPP_EINVOP;
+
+    /* a full pipe or saturated counter already means a pending wakeup */
+    if (ctx->wakeup_wfd == ctx->wakeup_rfd)
+	ret = write(ctx->wakeup_wfd, &one, sizeof(one));
+    else
+	ret = write(ctx->wakeup_wfd, "", 1);
+    (void)ret;
+
+    return 0;
+#else
+    return XMPP_EINVOP;
+#endif
+}
+
+/* consume all pending wakeups */
+static void _ctx_drain_wakeup(xmpp_ctx_t * const ctx)
+{
+#ifndef _WIN32
+    char buf[64];
+
+    while (read(ctx->wakeup_rfd, buf, sizeof(buf)) > 0)
+	;
+#endif
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+/* update the epoll registration of a connection's socket so that it
+ * waits for exactly the given events, issuing a syscall only when the
+ * registration actually changes */
+static void _conn_watch(xmpp_conn_t * const conn, const unsigned int events)
+{
+    xmpp_ctx_t *ctx = conn->ctx;
+    struct epoll_event ev;
+    int op;
+
+    if (conn->watched_sock == conn->sock && conn->watched_events == events)
+	return;
+
+    if (conn->watched_sock != -1 && conn->watched_sock != conn->sock)
+	event_conn_unwatch(conn);
+
+    if (events == 0) {
+	event_conn_unwatch(conn);
+	return;
+    }
+
+    op = (conn->watched_sock == -1) ? EPOLL_CTL_ADD : EPOLL_CTL_MOD;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = conn;
+    if (epoll_ctl(ctx->epoll_fd, op, conn->sock, &ev) < 0) {
+	xmpp_error(ctx, "event", "epoll_ctl failed on socket %d: %d",
+		   conn->sock, errno);
+	return;
+    }
+
+    conn->watched_sock = conn->sock;
+    conn->watched_events = events;
+}
+#endif
 
-	    if (ret < 0 && !tls_is_recoverable(tls_error(conn->tls))) {
-		/* an error occured */
-		xmpp_debug(ctx, "xmpp", "Send error occured, disconnecting.");
-		conn->error = ECONNABORTED;
+/** Remove a connection's socket from the event backend.
+ *  This must be called before the socket is closed, since a closed
+ *  descriptor number may be reused by the next connection.
+ *
+ *  @param conn a Strophe connection object
+ */
+void event_conn_unwatch(xmpp_conn_t * const conn)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_event ev;
+
+    if (conn->watched_sock != -1 && conn->ctx->epoll_fd >= 0) {
+	memset(&ev, 0, sizeof(ev));
+	epoll_ctl(conn->ctx->epoll_fd, EPOLL_CTL_DEL, conn->watched_sock, &ev);
+    }
+#endif
+    conn->watched_sock = -1;
+    conn->watched_events = 0;
+}
+
+/* disconnect a connection whose connect attempt has been pending for
+ * longer than its connect timeout, returns TRUE if it timed out */
+static int _conn_connect_timed_out(xmpp_conn_t * const conn)
+{
+    if (time_elapsed(conn->timeout_stamp, conn->ctx->now) <=
+	conn->connect_timeout)
+	return 0;
+
+    conn->error = ETIMEDOUT;
+    xmpp_info(conn->ctx, "xmpp", "Connection attempt timed out.");
+    conn_disconnect(conn);
+    return 1;
+}
+
+/* the socket of a connecting connection became writable */
+static void _conn_handle_connect(xmpp_conn_t * const conn)
+{
+    /* check for error */
+    if (sock_connect_error(conn->sock) != 0) {
+	/* connection failed */
+	xmpp_debug(conn->ctx, "xmpp", "connection failed");
+	conn_disconnect(conn);
+	return;
+    }
+
+    conn->state = XMPP_STATE_CONNECTED;
+    xmpp_debug(conn->ctx, "xmpp", "connection successful");
+
+    /* send stream init */
+    conn_open_stream(conn);
+}
+
+/* the socket of a connected connection is readable or has buffered
+ * TLS data, read one chunk and feed it to the parser */
+static void _conn_handle_read(xmpp_conn_t * const conn)
+{
+    xmpp_ctx_t *ctx = conn->ctx;
+    char buf[4096];
+    int ret;
+
+    if (conn->tls) {
+	ret = tls_read(conn->tls, buf, 4096);
+    } else {
+	ret = sock_read(conn->sock, buf, 4096);
+    }
+
+    if (ret > 0) {
+	ret = parser_feed(conn->parser, buf, ret);
+	if (!ret) {
+	    /* parse error, we need to shut down */
+	    /* FIXME */
+	    xmpp_debug(ctx, "xmpp", "parse error, disconnecting");
+	    conn_disconnect(conn);
+	}
+    } else {
+	if (conn->tls) {
+	    if (!tls_is_recoverable(tls_error(conn->tls)))
+	    {
+		xmpp_debug(ctx, "xmpp", "Unrecoverable TLS error, %d.", tls_error(conn->tls));
+		conn->error = tls_error(conn->tls);
 		conn_disconnect(conn);
 	    }
+	} else {
+	    /* return of 0 means socket closed by server */
+	    xmpp_debug(ctx, "xmpp", "Socket closed by remote host.");
+	    conn->error = ECONNRESET;
+	    conn_disconnect(conn);
 	}
+    }
+}
 
-	/* write all data from the send queue to the socket */
-	sq = conn->send_queue_head;
-	while (sq) {
-	    towrite = sq->len - sq->written;
-
-	    if (conn->tls) {
-		ret = tls_write(conn->tls, &sq->data[sq->written], towrite);
-
-		if (ret < 0 && !tls_is_recoverable(tls_error(conn->tls))) {
-		    /* an error occured */
-		    conn->error = tls_error(conn->tls);
-		    break;
-		} else if (ret < towrite) {
-		    /* not all data could be sent now */
-		    if (ret >= 0) sq->written += ret;
-		    break;
-		}
-
-	    } else {
-		ret = sock_write(conn->sock, &sq->data[sq->written], towrite);
-
-		if (ret < 0 && !sock_is_recoverable(sock_error())) {
-		    /* an error occured */
-		    conn->error = sock_error();
-		    break;
-		} else if (ret < towrite) {
-		    /* not all data could be sent now */
-		    if (ret >= 0) sq->written += ret;
-		    break;
-		}
-	    }
+/* write the send queue to a plain socket, gathering up to EVENT_IOV_MAX
+ * items into each call */
+static void _conn_flush_sock(xmpp_conn_t * const conn)
+{
+    struct iovec iov[EVENT_IOV_MAX];
+    xmpp_send_queue_t *sq;
+    size_t total;
+    int n, ret;
+
+    while (conn->send_queue_head) {
+	total = 0;
+	n = 0;
+	for (sq = conn->send_queue_head; sq && n < EVENT_IOV_MAX;
+	     sq = sq->next) {
+	    iov[n].iov_base = &sq->data[sq->written];
+	    iov[n].iov_len = sq->len - sq->written;
+	    total += iov[n].iov_len;
+	    n++;
+	}
+
+	ret = sock_writev(conn->sock, iov, n);
+	conn->send_calls++;
+	if (ret < 0) {
+	    /* an error occured */
+	    if (!sock_is_recoverable(sock_error()))
+		conn->error = sock_error();
+	    return;
+	}
+
+	conn_send_queue_consume(conn, ret);
 
-	    /* all data for this queue item written, delete and move on */
-	    xmpp_free(ctx, sq->data);
-	    tsq = sq;
-	    sq = sq->next;
-	    xmpp_free(ctx, tsq);
+	/* not all data could be sent now */
+	if ((size_t)ret < total) return;
+    }
+}
+
+/* copy whole queue items into the coalesce buffer while they fit.  the
+ * items stay queued until the buffer has been written, so that a
+ * disconnect does not lose them */
+static void _conn_coalesce(xmpp_conn_t * const conn)
+{
+    xmpp_send_queue_t *sq;
+    size_t towrite;
+
+    if (!conn->send_coalesce) {
+	conn->send_coalesce = xmpp_alloc(conn->ctx, TLS_COALESCE_SIZE);
+	if (!conn->send_coalesce) return;
+    }
+
+    for (sq = conn->send_queue_head; sq; sq = sq->next) {
+	towrite = sq->len - sq->written;
+	if (conn->send_coalesce_len + towrite > TLS_COALESCE_SIZE) break;
+
+	memcpy(&conn->send_coalesce[conn->send_coalesce_len],
+	       &sq->data[sq->written], towrite);
+	conn->send_coalesce_len += towrite;
+	conn->send_coalesce_items++;
+    }
+}
 
-	    /* pop the top item */
-	    conn->send_queue_head = sq;
-	    /* if we've sent everything update the tail */
-	    if (!sq) conn->send_queue_tail = NULL;
+/* write the send queue through TLS.  small items are coalesced into one
+ * record sized buffer so that they go out as a single record; items too
+ * large for the buffer are written directly.  after a failed write the
+ * same buffer is retried, as TLS requires. */
+static void _conn_flush_tls(xmpp_conn_t * const conn)
+{
+    const char *buf;
+    size_t towrite;
+    int direct, ret;
+
+    /* if we're running tls, there may be some remaining data waiting to
+     * be sent, so push that out */
+    ret = tls_clear_pending_write(conn->tls);
+    if (ret < 0 && !tls_is_recoverable(tls_error(conn->tls))) {
+	/* an error occured */
+	conn->error = tls_error(conn->tls);
+	return;
+    }
+
+    for (;;) {
+	if (conn->send_coalesce_len == 0) _conn_coalesce(conn);
+
+	direct = (conn->send_coalesce_len == 0);
+	if (!direct) {
+	    buf = &conn->send_coalesce[conn->send_coalesce_written];
+	    towrite = conn->send_coalesce_len - conn->send_coalesce_written;
+	} else if (conn->send_queue_head) {
+	    buf = &conn->send_queue_head->data[conn->send_queue_head->written];
+	    towrite = conn->send_queue_head->len -
+		conn->send_queue_head->written;
+	} else {
+	    return;
 	}
 
-	/* tear down connection on error */
-	if (conn->error) {
-	    /* FIXME: need to tear down send queues and random other things
-	     * maybe this should be abstracted */
-	    xmpp_debug(ctx, "xmpp", "Send error occured, disconnecting.");
-	    conn->error = ECONNABORTED;
-	    conn_disconnect(conn);
+	ret = tls_write(conn->tls, buf, towrite);
+	conn->send_calls++;
+	if (ret <= 0) {
+	    /* an error occured */
+	    if (!tls_is_recoverable(tls_error(conn->tls)))
+		conn->error = tls_error(conn->tls);
+	    return;
 	}
-	
-	connitem = connitem->next;
-    }
 
-    /* reset parsers if needed */
-    for (connitem = ctx->connlist; connitem; connitem = connitem->next) {
-	if (connitem->conn->reset_parser)
-	    conn_parser_reset(connitem->conn);
+	if (direct) {
+	    conn_send_queue_consume(conn, ret);
+	} else {
+	    conn->send_coalesce_written += ret;
+	    if (conn->send_coalesce_written == conn->send_coalesce_len) {
+		conn_send_queue_consume(conn, conn->send_coalesce_len);
+		conn->send_coalesce_items = 0;
+		conn->send_coalesce_len = 0;
+		conn->send_coalesce_written = 0;
+	    }
+	}
+
+	/* not all data could be sent now */
+	if ((size_t)ret < towrite) return;
     }
+}
 
+/* write all data from the send queue to the socket and tear down the
+ * connection on error */
+static void _conn_flush_send_queue(xmpp_conn_t * const conn)
+{
+    if (conn->tls)
+	_conn_flush_tls(conn);
+    else
+	_conn_flush_sock(conn);
+
+    /* tear down connection on error */
+    if (conn->error) {
+	/* FIXME: need to tear down send queues and random other things
+	 * maybe this should be abstracted */
+	xmpp_debug(conn->ctx, "xmpp", "Send error occured, disconnecting.");
+	conn->error = ECONNABORTED;
+	conn_disconnect(conn);
+    }
+}
 
-    /* fire any ready timed handlers, then
-       make sure we don't wait past the time when timed handlers need 
-       to be called */
-    next = handler_fire_timed(ctx);
+/* wait for and process socket events with select() */
+static void _event_wait_select(xmpp_ctx_t *ctx, const unsigned long timeout)
+{
+    xmpp_connlist_t *connitem;
+    xmpp_conn_t *conn;
+    fd_set rfds, wfds;
+    sock_t max = 0;
+    int ret;
+    struct timeval tv;
+    long usec;
+    int tls_read_bytes = 0;
 
-    usec = ((next < timeout) ? next : timeout) * 1000;
+    usec = timeout * 1000;
     tv.tv_sec = usec / 1000000;
     tv.tv_usec = usec % 1000000;
 
@@ -198,17 +550,16 @@ void xmpp_run_once(xmpp_ctx_t *ctx, const unsigned long timeout)
 	    /* connection will give us write or error events */
 	    
 	    /* make sure the timeout hasn't expired */
-	    if (time_elapsed(conn->timeout_stamp, time_stamp()) <= 
-		conn->connect_timeout)
+	    if (!_conn_connect_timed_out(conn))
 		FD_SET(conn->sock, &wfds);
-	    else {
-		conn->error = ETIMEDOUT;
-		xmpp_info(ctx, "xmpp", "Connection attempt timed out.");
-		conn_disconnect(conn);
-	    }
 	    break;
 	case XMPP_STATE_CONNECTED:
-	    FD_SET(conn->sock, &rfds);
+	    if (!conn->read_paused)
+		FD_SET(conn->sock, &rfds);
+	    /* only wait for writability while data is still queued, the
+	     * queue is flushed on the next run */
+	    if (conn->send_queue_head || conn->send_coalesce_len)
+		FD_SET(conn->sock, &wfds);
 	    break;
 	case XMPP_STATE_DISCONNECTED:
 	    /* do nothing */
@@ -217,7 +568,7 @@ void xmpp_run_once(xmpp_ctx_t *ctx, const unsigned long timeout)
 	}
 	
 	/* Check if there is something in the SSL buffer. */
-	if (conn->tls) {
+	if (conn->tls && !conn->read_paused) {
 	    tls_read_bytes += tls_pending(conn->tls);
 	}
 	
@@ -226,8 +577,18 @@ void xmpp_run_once(xmpp_ctx_t *ctx, const unsigned long timeout)
 	connitem = connitem->next;
     }
 
-    /* check for events */
+    if (ctx->wakeup_rfd >= 0) {
+	FD_SET(ctx->wakeup_rfd, &rfds);
+	if (ctx->wakeup_rfd > max) max = ctx->wakeup_rfd;
+    }
+
+    /* check for events, don't block if TLS already has data buffered */
+    if (tls_read_bytes) {
+	tv.tv_sec = 0;
+	tv.tv_usec = 0;
+    }
     ret = select(max + 1, &rfds,  &wfds, NULL, &tv);
+    ctx->now = time_monotonic();
 
     /* select errored */
     if (ret < 0) {
@@ -240,6 +601,9 @@ void xmpp_run_once(xmpp_ctx_t *ctx, const unsigned long timeout)
     /* no events happened */
     if (ret == 0 && tls_read_bytes == 0) return;
 
+    if (ctx->wakeup_rfd >= 0 && FD_ISSET(ctx->wakeup_rfd, &rfds))
+	_ctx_drain_wakeup(ctx);
+
     /* process events */
     connitem = ctx->connlist;
     while (connitem) {
@@ -247,71 +611,173 @@ void xmpp_run_once(xmpp_ctx_t *ctx, const unsigned long timeout)
 
 	switch (conn->state) {
 	case XMPP_STATE_CONNECTING:
-	    if (FD_ISSET(conn->sock, &wfds)) {
-		/* connection complete */
-
-		/* check for error */
-		if (sock_connect_error(conn->sock) != 0) {
-		    /* connection failed */
-		    xmpp_debug(ctx, "xmpp", "connection failed");
-		    conn_disconnect(conn);
-		    break;
-		}
-
-		conn->state = XMPP_STATE_CONNECTED;
-		xmpp_debug(ctx, "xmpp", "connection successful");
-
-		
-		/* send stream init */
-		conn_open_stream(conn);
-	    }
+	    if (FD_ISSET(conn->sock, &wfds))
+		_conn_handle_connect(conn);
+	    break;
+	case XMPP_STATE_CONNECTED:
+	    if (FD_ISSET(conn->sock, &rfds) ||
+		(conn->tls && !conn->read_paused && tls_pending(conn->tls)))
+		_conn_handle_read(conn);
+	    break;
+	case XMPP_STATE_DISCONNECTED:
+	    /* do nothing */
+	default:
+	    break;
+	}
 
+	connitem = connitem->next;
+    }
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+/* wait for and process socket events with epoll() */
+static void _event_wait_epoll(xmpp_ctx_t *ctx, const unsigned long timeout)
+{
+    xmpp_connlist_t *connitem;
+    xmpp_conn_t *conn;
+    struct epoll_event events[EVENT_EPOLL_MAX_EVENTS];
+    unsigned int watch;
+    int i, ret;
+    int tls_read_bytes = 0;
+
+    /* bring registrations up to date; this is a no-op for connections
+     * whose state and send queue did not change since the last tick */
+    for (connitem = ctx->connlist; connitem; connitem = connitem->next) {
+	conn = connitem->conn;
+	watch = 0;
+
+	switch (conn->state) {
+	case XMPP_STATE_CONNECTING:
+	    if (!_conn_connect_timed_out(conn))
+		watch = EPOLLOUT;
 	    break;
 	case XMPP_STATE_CONNECTED:
-	    if (FD_ISSET(conn->sock, &rfds) || (conn->tls && tls_pending(conn->tls))) {
-		if (conn->tls) {
-		    ret = tls_read(conn->tls, buf, 4096);
-		} else {
-		    ret = sock_read(conn->sock, buf, 4096);
-		}
-
-		if (ret > 0) {
-		    ret = parser_feed(conn->parser, buf, ret);
-		    if (!ret) {
-			/* parse error, we need to shut down */
-			/* FIXME */
-			xmpp_debug(ctx, "xmpp", "parse error, disconnecting");
-			conn_disconnect(conn);
-		    }
-		} else {
-		    if (conn->tls) {
-			if (!tls_is_recoverable(tls_error(conn->tls)))
-			{
-			    xmpp_debug(ctx, "xmpp", "Unrecoverable TLS error, %d.", tls_error(conn->tls));
-			    conn->error = tls_error(conn->tls);
-			    conn_disconnect(conn);
-			}
-		    } else {
-			/* return of 0 means socket closed by server */
-			xmpp_debug(ctx, "xmpp", "Socket closed by remote host.");
-			conn->error = ECONNRESET;
-			conn_disconnect(conn);
-		    }
-		}
-	    }
+	    /* only wait for writability while data is still queued */
+	    watch = conn->read_paused ? 0 : EPOLLIN;
+	    if (conn->send_queue_head || conn->send_coalesce_len)
+		watch |= EPOLLOUT;
+	    break;
+	case XMPP_STATE_DISCONNECTED:
+	    /* do nothing */
+	default:
+	    break;
+	}
+	_conn_watch(conn, watch);
+
+	/* Check if there is something in the SSL buffer. */
+	if (conn->tls && !conn->read_paused) {
+	    tls_read_bytes += tls_pending(conn->tls);
+	}
+    }
+
+    /* check for events, don't block if TLS already has data buffered */
+    ret = epoll_wait(ctx->epoll_fd, events, EVENT_EPOLL_MAX_EVENTS,
+		     tls_read_bytes ? 0 : (int)timeout);
+    ctx->now = time_monotonic();
+
+    /* epoll errored */
+    if (ret < 0) {
+	if (!sock_is_recoverable(sock_error()))
+	    xmpp_error(ctx, "xmpp", "event watcher internal error %d", 
+		       sock_error());
+	return;
+    }
+
+    /* no events happened */
+    if (ret == 0 && tls_read_bytes == 0) return;
 
+    /* process events */
+    for (i = 0; i < ret; i++) {
+	conn = (xmpp_conn_t *)events[i].data.ptr;
+	if (!conn) {
+	    _ctx_drain_wakeup(ctx);
+	    continue;
+	}
+
+	switch (conn->state) {
+	case XMPP_STATE_CONNECTING:
+	    if (events[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+		_conn_handle_connect(conn);
+	    break;
+	case XMPP_STATE_CONNECTED:
+	    if (!conn->read_paused &&
+		(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)))
+		_conn_handle_read(conn);
 	    break;
 	case XMPP_STATE_DISCONNECTED:
 	    /* do nothing */
 	default:
 	    break;
 	}
+    }
 
-	connitem = connitem->next;
+    /* drain records already decrypted by TLS, the socket itself may
+     * not signal readability for them */
+    if (tls_read_bytes == 0) return;
+    for (connitem = ctx->connlist; connitem; connitem = connitem->next) {
+	conn = connitem->conn;
+	if (conn->state == XMPP_STATE_CONNECTED && conn->tls &&
+	    !conn->read_paused && tls_pending(conn->tls))
+	    _conn_handle_read(conn);
     }
+}
+#endif
 
-    /* fire any ready handlers */
-    handler_fire_timed(ctx);
+/** Run the event loop once.
+ *  This function will run send any data that has been queued by
+ *  xmpp_send and related functions and run through the Strophe even
+ *  loop a single time, and will not wait more than timeout
+ *  milliseconds for events.  This is provided to support integration
+ *  with event loops outside the library, and if used, should be
+ *  called regularly to achieve low latency event handling.
+ *
+ *  @param ctx a Strophe context object
+ *  @param timeout time to wait for events in milliseconds
+ *
+ *  @ingroup EventLoop
+ */
+void xmpp_run_once(xmpp_ctx_t *ctx, const unsigned long timeout)
+{
+    xmpp_connlist_t *connitem;
+    xmpp_conn_t *conn;
+    uint64_t next;
+
+    if (ctx->loop_status == XMPP_LOOP_QUIT) return;
+    ctx->loop_status = XMPP_LOOP_RUNNING;
+
+    /* send queued data */
+    for (connitem = ctx->connlist; connitem; connitem = connitem->next) {
+	conn = connitem->conn;
+	if (conn->state != XMPP_STATE_CONNECTED) continue;
+
+	_conn_flush_send_queue(conn);
+    }
+
+    /* reset parsers if needed */
+    for (connitem = ctx->connlist; connitem; connitem = connitem->next) {
+	if (connitem->conn->reset_parser)
+	    conn_parser_reset(connitem->conn);
+    }
+
+
+    /* fire any expired timers, then make sure we don't wait past the
+       time when the next one is due.  the clock is read once here and
+       once when the wait returns, timers and handlers use ctx->now */
+    ctx->now = time_monotonic();
+    timer_wheel_run(ctx, ctx->now);
+    next = timer_wheel_next(&ctx->timers, ctx->now);
+
+    next = (next < timeout) ? next : timeout;
+
+#ifdef HAVE_SYS_EPOLL_H
+    if (ctx->event_backend == XMPP_EVENT_EPOLL)
+	_event_wait_epoll(ctx, next);
+    else
+#endif
+	_event_wait_select(ctx, next);
+
+    /* fire any timers that expired during the wait */
+    timer_wheel_run(ctx, ctx->now);
 }
 
 /** Start the event loop.
@@ -348,4 +814,7 @@ void xmpp_stop(xmpp_ctx_t *ctx)
 
     if (ctx->loop_status == XMPP_LOOP_RUNNING)
 	ctx->loop_status = XMPP_LOOP_QUIT;
+
+    /* don't let a blocked xmpp_run_once() sleep through the stop */
+    xmpp_ctx_wakeup(ctx);
 }
@@ -32,6 +32,180 @@
 #include "strophe.h"
 #include "common.h"
 
+/* Stanza handlers are kept in buckets of handlers with the same filters.
+ * A bucket is found by a key made of the handler's shape, i.e. which of
+ * the name, type and ns filters are set, and the values of those filters.
+ * A stanza is dispatched by looking up the buckets of every shape in use
+ * with the stanza's name, type and each distinct namespace of the stanza
+ * and its immediate children, then calling the handlers found in the order
+ * they were added. */
+
+/* initial size of the bucket index */
+#define HANDLER_INDEX_SIZE 64
+/* size of the stack buffers used while dispatching a stanza */
+#define HANDLER_KEY_SIZE 256
+#define HANDLER_MAX_NS 8
+#define HANDLER_MAX_MATCHES 32
+
+struct _xmpp_handler_bucket_t {
+    char *key;
+    int shape;
+    xmpp_handlist_t *head;
+    xmpp_handlist_t **tail;
+};
+
+/* handlers and namespaces found for a stanza, the arrays start out on the
+ * stack and are allocated once they outgrow it */
+typedef struct {
+    xmpp_handlist_t **items;
+    int num_items;
+    int max_items;
+    const char **ns;
+    int num_ns;
+    int max_ns;
+    xmpp_handlist_t *items_buf[HANDLER_MAX_MATCHES];
+    const char *ns_buf[HANDLER_MAX_NS];
+} _dispatch_t;
+
+static void _bucket_free(const xmpp_ctx_t * const ctx, void *p)
+{
+    xmpp_handler_bucket_t *bucket = (xmpp_handler_bucket_t *)p;
+
+    xmpp_free(ctx, bucket->key);
+    xmpp_free(ctx, bucket);
+}
+
+/* build the index key of a shape from the filters it uses.  returns buf
+ * if the key fits, an allocated key that has to be freed otherwise and
+ * NULL if allocation failed.  fields are separated by 0x1f, which is not
+ * allowed in XML names or attribute values */
+static char *_handler_key(const xmpp_ctx_t * const ctx,
+			  char * const buf, const size_t size,
+			  const int shape,
+			  const char * const name,
+			  const char * const type,
+			  const char * const ns)
+{
+    size_t nlen, tlen, slen, len;
+    char *key, *p;
+
+    nlen = shape & HANDLER_SHAPE_NAME ? strlen(name) : 0;
+    tlen = shape & HANDLER_SHAPE_TYPE ? strlen(type) : 0;
+    slen = shape & HANDLER_SHAPE_NS ? strlen(ns) : 0;
+    len = nlen + tlen + slen + 4;
+
+    key = len <= size ? buf : xmpp_alloc(ctx, len);
+    if (!key) return NULL;
+
+    p = key;
+    *p++ = '0' + shape;
+    memcpy(p, name, nlen);
+    p += nlen;
+    *p++ = '\x1f';
+    memcpy(p, type, tlen);
+    p += tlen;
+    *p++ = '\x1f';
+    memcpy(p, ns, slen);
+    p += slen;
+    *p = '\0';
+
+    return key;
+}
+
+/* grow one of the dispatch arrays, returns 0 on memory errors */
+static int _dispatch_grow(const xmpp_ctx_t * const ctx, void **array,
+			  void * const stack, int * const max,
+			  const size_t elem)
+{
+    void *grown;
+
+    grown = xmpp_alloc(ctx, *max * 2 * elem);
+    if (!grown) return 0;
+    memcpy(grown, *array, *max * elem);
+    if (*array != stack) xmpp_free(ctx, *array);
+    *array = grown;
+    *max *= 2;
+
+    return 1;
+}
+
+/* collect the namespaces of a stanza and its immediate children */
+static void _dispatch_add_ns(const xmpp_ctx_t * const ctx,
+			     _dispatch_t * const d, const char * const ns)
+{
+    int i;
+
+    if (!ns) return;
+    for (i = 0; i < d->num_ns; i++)
+	if (strcmp(d->ns[i], ns) == 0) return;
+    if (d->num_ns == d->max_ns &&
+	!_dispatch_grow(ctx, (void **)&d->ns, d->ns_buf, &d->max_ns,
+			sizeof(*d->ns)))
+	return;
+    d->ns[d->num_ns++] = ns;
+}
+
+/* collect the handlers of a bucket that may be called for the stanza */
+static void _dispatch_add_bucket(xmpp_conn_t * const conn,
+				 _dispatch_t * const d,
+				 const int shape,
+				 const char * const name,
+				 const char * const type,
+				 const char * const ns,
+				 const unsigned long epoch)
+{
+    xmpp_handler_bucket_t *bucket;
+    xmpp_handlist_t *item;
+    char buf[HANDLER_KEY_SIZE], *key;
+
+    key = _handler_key(conn->ctx, buf, sizeof(buf), shape, name, type, ns);
+    if (!key) return;
+    bucket = (xmpp_handler_bucket_t *)hash_get(conn->handler_index, key);
+    if (key != buf) xmpp_free(conn->ctx, key);
+    if (!bucket) return;
+
+    for (item = bucket->head; item; item = item->bucket_next) {
+	/* skip newly added handlers */
+	if (item->epoch >= epoch) continue;
+	if (d->num_items == d->max_items &&
+	    !_dispatch_grow(conn->ctx, (void **)&d->items, d->items_buf,
+			    &d->max_items, sizeof(*d->items)))
+	    return;
+	d->items[d->num_items++] = item;
+    }
+}
+
+/* unlink a stanza handler.  handlers deleted while stanzas are dispatched
+ * are freed once the dispatch is done as it may still refer to them */
+static void _handler_remove(xmpp_conn_t * const conn,
+			    xmpp_handlist_t * const item)
+{
+    xmpp_handler_bucket_t *bucket = item->bucket;
+
+    *item->pprev = item->next;
+    if (item->next)
+	item->next->pprev = item->pprev;
+    else
+	conn->handlers_tail = item->pprev;
+    item->pprev = NULL;
+
+    *item->bucket_pprev = item->bucket_next;
+    if (item->bucket_next)
+	item->bucket_next->bucket_pprev = item->bucket_pprev;
+    else
+	bucket->tail = item->bucket_pprev;
+    conn->handler_shapes[bucket->shape]--;
+    if (!bucket->head)
+	hash_drop(conn->handler_index, bucket->key);
+    item->bucket = NULL;
+
+    if (conn->handler_dispatching) {
+	item->next = conn->handlers_deleted;
+	conn->handlers_deleted = item;
+    } else
+	xmpp_free(conn->ctx, item);
+}
+
 /** Fire off all stanza handlers that match.
  *  This function is called internally by the event loop whenever stanzas
  *  are received from the XMPP server.
@@ -43,7 +217,11 @@ void handler_fire_stanza(xmpp_conn_t * const conn,
 			 xmpp_stanza_t * const stanza)
 {
     xmpp_handlist_t *item, *prev;
-    char *id, *ns, *name, *type;
+    xmpp_stanza_t *child;
+    char *id, *name, *type;
+    _dispatch_t d;
+    unsigned long epoch;
+    int shape, i, j;
     
     /* call id handlers */
     id = xmpp_stanza_get_id(stanza);
@@ -77,126 +255,186 @@ void handler_fire_stanza(xmpp_conn_t * const conn,
     }
     
     /* call handlers */
-    ns = xmpp_stanza_get_ns(stanza);
+    if (!conn->handlers) return;
+
     name = xmpp_stanza_get_name(stanza);
     type = xmpp_stanza_get_type(stanza);
-    
-    /* enable all added handlers */
-    for (item = conn->handlers; item; item = item->next)
-	item->enabled = 1;
 
-    prev = NULL;
-    item = conn->handlers;
-    while (item) {
-	/* skip newly added handlers */
-	if (!item->enabled) {
-	    prev = item;
-	    item = item->next;
-	    continue;
-	}
+    d.items = d.items_buf;
+    d.num_items = 0;
+    d.max_items = HANDLER_MAX_MATCHES;
+    d.ns = d.ns_buf;
+    d.num_ns = 0;
+    d.max_ns = HANDLER_MAX_NS;
+
+    /* the namespace filter matches the stanza or any of its immediate
+     * children, look at each distinct namespace once */
+    for (shape = HANDLER_SHAPE_NS; shape < HANDLER_SHAPES; shape++)
+	if ((shape & HANDLER_SHAPE_NS) && conn->handler_shapes[shape])
+	    break;
+    if (shape < HANDLER_SHAPES) {
+	_dispatch_add_ns(conn->ctx, &d, xmpp_stanza_get_ns(stanza));
+	for (child = stanza->children; child; child = child->next)
+	    _dispatch_add_ns(conn->ctx, &d, xmpp_stanza_get_ns(child));
+    }
+
+    /* handlers added from here on are called from the next stanza on */
+    epoch = ++conn->handler_epoch;
+
+    for (shape = 0; shape < HANDLER_SHAPES; shape++) {
+	if (!conn->handler_shapes[shape]) continue;
+	if ((shape & HANDLER_SHAPE_NAME) && !name) continue;
+	if ((shape & HANDLER_SHAPE_TYPE) && !type) continue;
+	if (shape & HANDLER_SHAPE_NS) {
+	    for (i = 0; i < d.num_ns; i++)
+		_dispatch_add_bucket(conn, &d, shape, name, type, d.ns[i],
+				     epoch);
+	} else
+	    _dispatch_add_bucket(conn, &d, shape, name, type, NULL, epoch);
+    }
+
+    /* call handlers in the order they were added, each bucket is sorted
+     * already */
+    for (i = 1; i < d.num_items; i++) {
+	item = d.items[i];
+	for (j = i; j > 0 && d.items[j - 1]->seq > item->seq; j--)
+	    d.items[j] = d.items[j - 1];
+	d.items[j] = item;
+    }
+
+    conn->handler_dispatching++;
+    for (i = 0; i < d.num_items; i++) {
+	item = d.items[i];
+
+	/* deleted by a handler called before */
+	if (!item->pprev) continue;
 
 	/* don't call user handlers until authentication succeeds */
-	if (item->user_handler && !conn->authenticated) {
-	    prev = item;
-	    item = item->next;
-	    continue;
-	}
+	if (item->user_handler && !conn->authenticated) continue;
 
-	if ((!item->ns || (ns && strcmp(ns, item->ns) == 0) ||
-	     xmpp_stanza_get_child_by_ns(stanza, item->ns)) &&
-	    (!item->name || (name && strcmp(name, item->name) == 0)) &&
-	    (!item->type || (type && strcmp(type, item->type) == 0)))
-	    if (!((xmpp_handler)(item->handler))(conn, stanza, item->userdata)) {
-		/* handler is one-shot, so delete it */
-		if (prev)
-		    prev->next = item->next;
-		else
-		    conn->handlers = item->next;
-                if (item->ns) xmpp_free(conn->ctx, item->ns);
-                if (item->name) xmpp_free(conn->ctx, item->name);
-                if (item->type) xmpp_free(conn->ctx, item->type);
-		xmpp_free(conn->ctx, item);
-		item = NULL;
-	    }
-	
-	if (item) {
-	    prev = item;
-	    item = item->next;
-	} else if (prev)
-	    item = prev->next;
-	else
-	    item = conn->handlers;
+	if (!((xmpp_handler)(item->handler))(conn, stanza, item->userdata) &&
+	    item->pprev)
+	    /* handler is one-shot, so delete it */
+	    _handler_remove(conn, item);
+    }
+    if (--conn->handler_dispatching == 0) {
+	while ((item = conn->handlers_deleted) != NULL) {
+	    conn->handlers_deleted = item->next;
+	    xmpp_free(conn->ctx, item);
+	}
     }
+
+    if (d.items != d.items_buf) xmpp_free(conn->ctx, d.items);
+    if (d.ns != d.ns_buf) xmpp_free(conn->ctx, d.ns);
 }
 
-/** Fire off all timed handlers that are ready.
- *  This function is called internally by the event loop.
- *
- *  @param ctx a Strophe context object
+/** Free all stanza handlers.
+ *  This function is called internally when a connection is released.
  *
- *  @return the time in milliseconds until the next handler will be ready
+ *  @param conn a Strophe connection object
  */
-uint64_t handler_fire_timed(xmpp_ctx_t * const ctx)
+void handler_release_all(xmpp_conn_t * const conn)
 {
-    xmpp_connlist_t *connitem;
-    xmpp_handlist_t *handitem, *temp;
-    int ret, fired;
-    uint64_t elapsed, min;
-
-    min = (uint64_t)(-1);
-
-    connitem = ctx->connlist;
-    while (connitem) {
-	if (connitem->conn->state != XMPP_STATE_CONNECTED) {
-	    connitem = connitem->next;
-	    continue;
-	}
-	
-	/* enable all handlers that were added */
-	for (handitem = connitem->conn->timed_handlers; handitem;
-	     handitem = handitem->next)
-	    handitem->enabled = 1;
-
-	handitem = connitem->conn->timed_handlers;
-	while (handitem) {
-	    /* skip newly added handlers */
-	    if (!handitem->enabled) {
-		handitem = handitem->next;
-		continue;
-	    }
+    xmpp_handlist_t *item;
 
-	    /* only fire user handlers after authentication */
-	    if (handitem->user_handler && !connitem->conn->authenticated) {
-		handitem = handitem->next;
-		continue;
-	    }
+    while ((item = conn->handlers) != NULL) {
+	conn->handlers = item->next;
+	xmpp_free(conn->ctx, item);
+    }
+    conn->handlers_tail = &conn->handlers;
+    while ((item = conn->handlers_deleted) != NULL) {
+	conn->handlers_deleted = item->next;
+	xmpp_free(conn->ctx, item);
+    }
+    if (conn->handler_index) {
+	hash_release(conn->handler_index);
+	conn->handler_index = NULL;
+    }
+    memset(conn->handler_shapes, 0, sizeof(conn->handler_shapes));
+}
 
-	    fired = 0;
-	    elapsed = time_elapsed(handitem->last_stamp, time_stamp());
-	    if (elapsed >= handitem->period) {
-		/* fire! */
-		fired = 1;
-		handitem->last_stamp = time_stamp();
-		ret = ((xmpp_timed_handler)handitem->handler)(connitem->conn, handitem->userdata);
-	    } else if (min > (handitem->period - elapsed))
-		min = handitem->period - elapsed;
-		
-	    temp = handitem;
-	    handitem = handitem->next;
-
-	    /* delete handler if it returned false */
-	    if (fired && !ret)
-		xmpp_timed_handler_delete(connitem->conn, temp->handler);
-	}
+/** Move all handlers from one connection to another.
+ *  This function is called when a connection is replaced by a new one
+ *  while reconnecting.  The stanza handlers of the new connection are
+ *  released first, the old connection is left without handlers and can
+ *  still be released.
+ *
+ *  @param from the Strophe connection object the handlers are taken from
+ *  @param to the Strophe connection object the handlers are moved to
+ */
+void handler_move(xmpp_conn_t * const from, xmpp_conn_t * const to)
+{
+    xmpp_handlist_t *item;
+    hash_t *id_handlers;
+
+    handler_release_all(to);
+
+    to->timed_handlers = from->timed_handlers;
+    for (item = to->timed_handlers; item; item = item->next)
+	item->conn = to;
+    /* swap the id handler tables, the old one of to is empty */
+    id_handlers = to->id_handlers;
+    to->id_handlers = from->id_handlers;
+    from->id_handlers = id_handlers;
+
+    /* the list links back into the connection it heads */
+    to->handlers = from->handlers;
+    if (to->handlers) {
+	to->handlers->pprev = &to->handlers;
+	to->handlers_tail = from->handlers_tail;
+    } else
+	to->handlers_tail = &to->handlers;
+    to->handlers_deleted = from->handlers_deleted;
+    to->handler_index = from->handler_index;
+    memcpy(to->handler_shapes, from->handler_shapes,
+	   sizeof(to->handler_shapes));
+    to->handler_seq = from->handler_seq;
+    to->handler_epoch = from->handler_epoch;
+
+    from->timed_handlers = NULL;
+    from->handlers = NULL;
+    from->handlers_tail = &from->handlers;
+    from->handlers_deleted = NULL;
+    from->handler_index = NULL;
+    memset(from->handler_shapes, 0, sizeof(from->handler_shapes));
+}
 
-	connitem = connitem->next;
+/* timer callback of a timed handler */
+static void _timed_handler_fire(xmpp_ctx_t * const ctx,
+				xmpp_timer_t * const timer)
+{
+    xmpp_handlist_t *handitem = (xmpp_handlist_t *)timer->userdata;
+    xmpp_handlist_t *item;
+    xmpp_conn_t *conn = handitem->conn;
+    void *handler = handitem->handler;
+    int ret;
+
+    /* only fire on connected connections and user handlers only after
+     * authentication, check again one period later otherwise */
+    if (conn->state != XMPP_STATE_CONNECTED ||
+	(handitem->user_handler && !conn->authenticated)) {
+	xmpp_timer_add(ctx, timer, ctx->now + handitem->period);
+	return;
     }
 
-    return min;
+    ret = ((xmpp_timed_handler)handler)(conn, handitem->userdata);
+
+    /* the handler may have deleted itself */
+    for (item = conn->timed_handlers; item; item = item->next)
+	if (item == handitem) break;
+    if (!item) return;
+
+    /* delete handler if it returned false, otherwise it is due
+     * again one period from now */
+    if (!ret)
+	xmpp_timed_handler_delete(conn, (xmpp_timed_handler)handler);
+    else if (!xmpp_timer_pending(timer))
+	xmpp_timer_add(ctx, timer, ctx->now + handitem->period);
 }
 
 /** Reset all timed handlers.
  *  This function is called internally when a connection is successful.
+ *  Reset handlers are due one period from now.
  *
  *  @param conn a Strophe connection object
  *  @param user_only whether to reset all handlers or only user ones
@@ -204,11 +442,14 @@ uint64_t handler_fire_timed(xmpp_ctx_t * const ctx)
 void handler_reset_timed(xmpp_conn_t *conn, int user_only)
 {
     xmpp_handlist_t *handitem;
+    /* called from the event loop, use its clock like the timers do */
+    uint64_t now = xmpp_ctx_now(conn->ctx);
 
     handitem = conn->timed_handlers;
     while (handitem) {
 	if ((user_only && handitem->user_handler) || !user_only)
-	    handitem->last_stamp = time_stamp();
+	    xmpp_timer_add(conn->ctx, &handitem->timer,
+			   now + handitem->period);
 	
 	handitem = handitem->next;
     }
@@ -236,11 +477,15 @@ static void _timed_handler_add(xmpp_conn_t * const conn,
     item->user_handler = user_handler;
     item->handler = (void *)handler;
     item->userdata = userdata;
-    item->enabled = 0;
+    item->epoch = 0;
     item->next = NULL;
 
     item->period = period;
-    item->last_stamp = time_stamp();
+    item->conn = conn;
+    xmpp_timer_init(&item->timer, _timed_handler_fire, item);
+    /* handlers may be added from other threads while the event loop waits
+     * and xmpp_ctx_now() is behind, read the clock */
+    xmpp_timer_add(conn->ctx, &item->timer, time_monotonic() + period);
 
     /* append item to list */
     if (!conn->timed_handlers)
@@ -282,6 +527,7 @@ void xmpp_timed_handler_delete(xmpp_conn_t * const conn,
 	else
 	    conn->timed_handlers = item->next;
 	
+	xmpp_timer_del(conn->ctx, &item->timer);
 	xmpp_free(conn->ctx, item);
     }
 }
@@ -309,7 +555,7 @@ static void _id_handler_add(xmpp_conn_t * const conn,
     item->user_handler = user_handler;
     item->handler = (void *)handler;
     item->userdata = userdata;
-    item->enabled = 0;
+    item->epoch = 0;
     item->next = NULL;
 
     item->id = xmpp_strdup(conn->ctx, id);
@@ -375,64 +621,82 @@ static void _handler_add(xmpp_conn_t * const conn,
 			 const char * const type,
 			 void * const userdata, int user_handler)
 {
-    xmpp_handlist_t *item, *tail;
+    xmpp_handlist_t *item;
+    xmpp_handler_bucket_t *bucket;
+    char buf[HANDLER_KEY_SIZE], *key;
+    int shape;
 
     /* check if handler already in list */
     for (item = conn->handlers; item; item = item->next) {
-	if (item->handler == (void *)handler)
+	if (item->handler == (void *)handler && item->userdata == userdata)
 	    break;
     }
     if (item) return;
 
+    if (!conn->handler_index) {
+	conn->handler_index = hash_new(conn->ctx, HANDLER_INDEX_SIZE,
+				       _bucket_free);
+	if (!conn->handler_index) return;
+    }
+
+    shape = (name ? HANDLER_SHAPE_NAME : 0) |
+	(type ? HANDLER_SHAPE_TYPE : 0) | (ns ? HANDLER_SHAPE_NS : 0);
+    key = _handler_key(conn->ctx, buf, sizeof(buf), shape, name, type, ns);
+    if (!key) return;
+
+    /* find or create the bucket */
+    bucket = (xmpp_handler_bucket_t *)hash_get(conn->handler_index, key);
+    if (!bucket) {
+	bucket = xmpp_alloc(conn->ctx, sizeof(xmpp_handler_bucket_t));
+	if (!bucket) goto out;
+	bucket->shape = shape;
+	bucket->head = NULL;
+	bucket->tail = &bucket->head;
+	bucket->key = xmpp_strdup(conn->ctx, key);
+	if (!bucket->key) {
+	    xmpp_free(conn->ctx, bucket);
+	    goto out;
+	}
+	if (hash_add(conn->handler_index, key, bucket) < 0) {
+	    _bucket_free(conn->ctx, bucket);
+	    goto out;
+	}
+    }
+
     /* build new item */
     item = (xmpp_handlist_t *)xmpp_alloc(conn->ctx, sizeof(xmpp_handlist_t));
-    if (!item) return;
+    if (!item) {
+	if (!bucket->head)
+	    hash_drop(conn->handler_index, key);
+	goto out;
+    }
 
     item->user_handler = user_handler;
     item->handler = (void *)handler;
     item->userdata = userdata;
-    item->enabled = 0;
-    item->next = NULL;
-    
-    if (ns) {
-	item->ns = xmpp_strdup(conn->ctx, ns);
-	if (!item->ns) {
-	    xmpp_free(conn->ctx, item);
-	    return;
-	}
-    } else
-	item->ns = NULL;
-    if (name) {
-	item->name = xmpp_strdup(conn->ctx, name);
-	if (!item->name) {
-	    if (item->ns) xmpp_free(conn->ctx, item->ns);
-	    xmpp_free(conn->ctx, item);
-	    return;
-	}
-    } else
-	item->name = NULL;
-    if (type) {
-	item->type = xmpp_strdup(conn->ctx, type);
-	if (!item->type) {
-	    if (item->ns) xmpp_free(conn->ctx, item->ns);
-	    if (item->name) xmpp_free(conn->ctx, item->name);
-	    xmpp_free(conn->ctx, item);
-	}
-    } else
-	item->type = NULL;
+    item->epoch = conn->handler_epoch;
+    item->seq = conn->handler_seq++;
 
-    /* append to list */
-    if (!conn->handlers)
-	conn->handlers = item;
-    else {
-	tail = conn->handlers;
-	while (tail->next) 
-	    tail = tail->next;
-	tail->next = item;
-    }
+    /* append to list and bucket */
+    item->next = NULL;
+    item->pprev = conn->handlers_tail;
+    *conn->handlers_tail = item;
+    conn->handlers_tail = &item->next;
+
+    item->bucket = bucket;
+    item->bucket_next = NULL;
+    item->bucket_pprev = bucket->tail;
+    *bucket->tail = item;
+    bucket->tail = &item->bucket_next;
+    conn->handler_shapes[shape]++;
+
+out:
+    if (key != buf) xmpp_free(conn->ctx, key);
 }
 
 /** Delete a stanza handler.
+ *  All instances of the handler are deleted, whatever userdata they were
+ *  added with.
  *
  *  @param conn a Strophe connection object
  *  @param handler a function pointer to a stanza handler
@@ -442,30 +706,12 @@ static void _handler_add(xmpp_conn_t * const conn,
 void xmpp_handler_delete(xmpp_conn_t * const conn,
 			 xmpp_handler handler)
 {
-    xmpp_handlist_t *prev, *item;
-
-    if (!conn->handlers) return;
+    xmpp_handlist_t *item, *next;
 
-    prev = NULL;
-    item = conn->handlers;
-    while (item) {
+    for (item = conn->handlers; item; item = next) {
+	next = item->next;
 	if (item->handler == (void *)handler)
-	    break;
-	
-	prev = item;
-	item = item->next;
-    }
-
-    if (item) {
-	if (prev)
-	    prev->next = item->next;
-	else
-	    conn->handlers = item->next;
-
-	if (item->ns) xmpp_free(conn->ctx, item->ns);
-	if (item->name) xmpp_free(conn->ctx, item->name);
-	if (item->type) xmpp_free(conn->ctx, item->type);
-	xmpp_free(conn->ctx, item);
+	    _handler_remove(conn, item);
     }
 }
 
@@ -561,6 +807,9 @@ void handler_add_id(xmpp_conn_t * const conn,
  *  handle specific &lt;iq/&gt; stanzas based on the &lt;query/&gt;
  *  child namespace.
  *
+ *  A handler function can be added more than once with different userdata.
+ *  Handlers are called in the order they were added.
+ *
  *  If the handler function returns true, it will be kept, and if it
  *  returns false, it will be deleted from the list of handlers.
  *
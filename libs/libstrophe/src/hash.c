@@ -19,54 +19,237 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <stdint.h>
+#else
+#include "ostypes.h"
+#endif
+
 #include "strophe.h"
 #include "common.h"
 #include "hash.h"
 
+/* Open addressing with linear probing.  Each slot caches the 64 bit hash
+ * of its entry so that probing only touches the slot array, the key is
+ * stored in the same allocation as the entry and stays put when the table
+ * grows.  Deleting shifts the following entries of the probe sequence
+ * back, so there are no tombstones.  The table doubles once it is three
+ * quarters full. */
+
+#define HASH_MIN_SIZE 4
+
 /* private types */
 typedef struct _hashentry_t hashentry_t;
 
 struct _hashentry_t {
-    hashentry_t *next;
-    char *key;
     void *value;
+    size_t len;
+    char key[1];
 };
 
+typedef struct _hashslot_t {
+    uint64_t hash;
+    hashentry_t *entry;
+} hashslot_t;
+
 struct _hash_t {
     unsigned int ref;
     xmpp_ctx_t *ctx;
     hash_free_func free;
     int length;
     int num_keys;
-    hashentry_t **entries;
+    uint64_t seed;
+    hashslot_t *slots;
 };
 
 struct _hash_iterator_t {
     unsigned int ref;
     hash_t *table;
-    hashentry_t *entry;
     int index;
 };
-   
+
+/* wyhash, a fast hash with good distribution on short keys */
+#define _WYP0 0xa0761d6478bd642fULL
+#define _WYP1 0xe7037ed1a0b428dbULL
+#define _WYP2 0x8ebc6af09c88c6e3ULL
+#define _WYP3 0x589965cc75374cc3ULL
+
+/* 64x64 bit multiply, returns the low half in a and the high half in b */
+static void _wymum(uint64_t * const a, uint64_t * const b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t)*a * *b;
+
+    *a = (uint64_t)r;
+    *b = (uint64_t)(r >> 64);
+#else
+    uint64_t ha = *a >> 32, hb = *b >> 32;
+    uint64_t la = *a & 0xffffffff, lb = *b & 0xffffffff;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), lo;
+    uint64_t c = t < rl;
+
+    lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static uint64_t _wymix(uint64_t a, uint64_t b)
+{
+    _wymum(&a, &b);
+    return a ^ b;
+}
+
+static uint64_t _wyr8(const unsigned char * const p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static uint64_t _wyr4(const unsigned char * const p)
+{
+    unsigned int v;
+
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint64_t _hash_key(const hash_t * const table, const char * const key,
+			  const size_t len)
+{
+    const unsigned char *p = (const unsigned char *)key;
+    uint64_t seed = table->seed, a, b, see1, see2;
+    size_t i = len;
+
+    if (len <= 16) {
+	if (len >= 4) {
+	    a = (_wyr4(p) << 32) | _wyr4(p + ((len >> 3) << 2));
+	    b = (_wyr4(p + len - 4) << 32) |
+		_wyr4(p + len - 4 - ((len >> 3) << 2));
+	} else if (len > 0) {
+	    a = ((uint64_t)p[0] << 16) | ((uint64_t)p[len >> 1] << 8) |
+		p[len - 1];
+	    b = 0;
+	} else
+	    a = b = 0;
+    } else {
+	if (i > 48) {
+	    see1 = see2 = seed;
+	    do {
+		seed = _wymix(_wyr8(p) ^ _WYP1, _wyr8(p + 8) ^ seed);
+		see1 = _wymix(_wyr8(p + 16) ^ _WYP2, _wyr8(p + 24) ^ see1);
+		see2 = _wymix(_wyr8(p + 32) ^ _WYP3, _wyr8(p + 40) ^ see2);
+		p += 48;
+		i -= 48;
+	    } while (i > 48);
+	    seed ^= see1 ^ see2;
+	}
+	while (i > 16) {
+	    seed = _wymix(_wyr8(p) ^ _WYP1, _wyr8(p + 8) ^ seed);
+	    p += 16;
+	    i -= 16;
+	}
+	a = _wyr8(p + i - 16);
+	b = _wyr8(p + i - 8);
+    }
+
+    a ^= _WYP1;
+    b ^= seed;
+    _wymum(&a, &b);
+    return _wymix(a ^ _WYP0 ^ len, b ^ _WYP1);
+}
+
+/* find the slot of a key, or the empty slot ending its probe sequence */
+static hashslot_t *_hash_find(const hash_t * const table,
+			      const char * const key, const size_t len,
+			      const uint64_t hash)
+{
+    const unsigned int mask = table->length - 1;
+    unsigned int i = (unsigned int)hash & mask;
+    hashslot_t *slot;
+
+    for (;;) {
+	slot = &table->slots[i];
+	if (!slot->entry) return slot;
+	if (slot->hash == hash && slot->entry->len == len &&
+	    memcmp(slot->entry->key, key, len) == 0)
+	    return slot;
+	i = (i + 1) & mask;
+    }
+}
+
+/* move all entries to a slot array of twice the size */
+static int _hash_grow(hash_t * const table)
+{
+    hashslot_t *old = table->slots, *slot;
+    int old_length = table->length, i;
+    unsigned int mask, j;
+
+    slot = xmpp_alloc(table->ctx, 2 * old_length * sizeof(hashslot_t));
+    if (!slot) return -1;
+    memset(slot, 0, 2 * old_length * sizeof(hashslot_t));
+    table->slots = slot;
+    table->length = 2 * old_length;
+
+    mask = table->length - 1;
+    for (i = 0; i < old_length; i++) {
+	if (!old[i].entry) continue;
+	j = (unsigned int)old[i].hash & mask;
+	while (table->slots[j].entry)
+	    j = (j + 1) & mask;
+	table->slots[j] = old[i];
+    }
+    xmpp_free(table->ctx, old);
+
+    return 0;
+}
+
 /** allocate and initialize a new hash table */
 hash_t *hash_new(xmpp_ctx_t * const ctx, const int size,
 		 hash_free_func free)
+{
+    hash_t *result;
+
+    result = hash_new_seeded(ctx, size, free, 0);
+    /* vary the hash between tables and runs so that colliding keys
+     * can't be prepared in advance */
+    if (result != NULL)
+	result->seed = _wymix((uint64_t)(size_t)result ^ _WYP0,
+			      (uint64_t)(size_t)&result ^ _WYP2);
+
+    return result;
+}
+
+/** allocate and initialize a new hash table with a fixed seed */
+hash_t *hash_new_seeded(xmpp_ctx_t * const ctx, const int size,
+			hash_free_func free, const uint64_t seed)
 {
     hash_t *result = NULL;
+    int length;
+
+    /* the slot count is a power of two, size keys fit without growing */
+    length = HASH_MIN_SIZE;
+    while (length < size + size / 3)
+	length *= 2;
 
     result = xmpp_alloc(ctx, sizeof(hash_t));
     if (result != NULL) {
-	result->entries = xmpp_alloc(ctx, size * sizeof(hashentry_t *));
-	if (result->entries == NULL) {
+	result->slots = xmpp_alloc(ctx, length * sizeof(hashslot_t));
+	if (result->slots == NULL) {
 	    xmpp_free(ctx, result);
 	    return NULL;
 	}
-	memset(result->entries, 0, size * sizeof(hashentry_t *));
-	result->length = size;
+	memset(result->slots, 0, length * sizeof(hashslot_t));
+	result->length = length;
 
 	result->ctx = ctx;
 	result->free = free;
 	result->num_keys = 0;
+	result->seed = seed;
 	/* give the caller a reference */
 	result->ref = 1;
     }
@@ -85,127 +268,107 @@ hash_t *hash_clone(hash_t * const table)
 void hash_release(hash_t * const table)
 {
     xmpp_ctx_t *ctx = table->ctx;
-    hashentry_t *entry, *next;
+    hashentry_t *entry;
     int i;
     
     if (table->ref > 1)
 	table->ref--;
     else {
 	for (i = 0; i < table->length; i++) {
-	    entry = table->entries[i];
-	    while (entry != NULL) {
-		next = entry->next;
-		xmpp_free(ctx, entry->key);
-		if (table->free) table->free(ctx, entry->value);
-		xmpp_free(ctx, entry);
-		entry = next;
-	    }
+	    entry = table->slots[i].entry;
+	    if (entry == NULL) continue;
+	    if (table->free) table->free(ctx, entry->value);
+	    xmpp_free(ctx, entry);
 	}
-	xmpp_free(ctx, table->entries);
+	xmpp_free(ctx, table->slots);
 	xmpp_free(ctx, table);
     }
 }
 
-/** hash a key for our table lookup */
-static int _hash_key(hash_t *table, const char *key)
-{
-   int hash = 0;
-   int shift = 0;
-   const char *c = key;
-
-   while (*c != '\0') {
-	/* assume 32 bit ints */
-	hash ^= ((int)*c++ << shift);
-	shift += 8;
-	if (shift > 24) shift = 0;
-   }
-
-   return hash % table->length;
-}
-
 /** add a key, value pair to a hash table.
  *  each key can appear only once; the value of any
  *  identical key will be replaced
  */
 int hash_add(hash_t *table, const char * const key, void *data)
 {
-   xmpp_ctx_t *ctx = table->ctx;
-   hashentry_t *entry = NULL;
-   int index = _hash_key(table, key);
-
-   /* drop existing entry, if any */
-   hash_drop(table, key);
-
-   /* allocate and fill a new entry */
-   entry = xmpp_alloc(ctx, sizeof(hashentry_t));
-   if (!entry) return -1;
-   entry->key = xmpp_strdup(ctx, key);
-   if (!entry->key) {
-       xmpp_free(ctx, entry);
-       return -1;
-   }
-   entry->value = data;
-   /* insert ourselves in the linked list */
-   /* TODO: this leaks duplicate keys */
-   entry->next = table->entries[index];
-   table->entries[index] = entry;
-   table->num_keys++;
-
-   return 0;
+    xmpp_ctx_t *ctx = table->ctx;
+    hashentry_t *entry;
+    hashslot_t *slot;
+    size_t len = strlen(key);
+    uint64_t hash = _hash_key(table, key, len);
+
+    /* replace the value of an existing entry */
+    slot = _hash_find(table, key, len, hash);
+    if (slot->entry) {
+	if (table->free) table->free(ctx, slot->entry->value);
+	slot->entry->value = data;
+	return 0;
+    }
+
+    if (4 * (table->num_keys + 1) > 3 * table->length) {
+	if (_hash_grow(table)) return -1;
+	slot = _hash_find(table, key, len, hash);
+    }
+
+    /* allocate and fill a new entry */
+    entry = xmpp_alloc(ctx, sizeof(hashentry_t) + len);
+    if (!entry) return -1;
+    memcpy(entry->key, key, len + 1);
+    entry->len = len;
+    entry->value = data;
+
+    slot->hash = hash;
+    slot->entry = entry;
+    table->num_keys++;
+
+    return 0;
 }
 
 /** look up a key in a hash table */
 void *hash_get(hash_t *table, const char *key)
 {
-   hashentry_t *entry;
-   int index = _hash_key(table, key);
-   void *result = NULL;
-
-   /* look up the hash entry */
-   entry = table->entries[index];
-   while (entry != NULL) {
-	/* traverse the linked list looking for the key */
-	if (!strcmp(key, entry->key)) {
-	  /* match */
-	  result = entry->value;
-	  return result;
-	}
-	entry = entry->next;
-   }
-   /* no match */
-   return result;
+    size_t len = strlen(key);
+    hashslot_t *slot;
+
+    slot = _hash_find(table, key, len, _hash_key(table, key, len));
+    return slot->entry ? slot->entry->value : NULL;
 }
 
 /** delete a key from a hash table */
 int hash_drop(hash_t *table, const char *key)
 {
-   xmpp_ctx_t *ctx = table->ctx;
-   hashentry_t *entry, *prev;
-   int index = _hash_key(table, key);
-
-   /* look up the hash entry */
-   entry = table->entries[index];
-   prev = NULL;
-   while (entry != NULL) {
-	/* traverse the linked list looking for the key */
-	if (!strcmp(key, entry->key)) {
-	  /* match, remove the entry */
-	  xmpp_free(ctx, entry->key);
-	  if (table->free) table->free(ctx, entry->value);
-	  if (prev == NULL) {
-	    table->entries[index] = entry->next;
-	  } else {
-	    prev->next = entry->next;
-	  }
-	  xmpp_free(ctx, entry);
-	  table->num_keys--;
-	  return 0;
+    xmpp_ctx_t *ctx = table->ctx;
+    const unsigned int mask = table->length - 1;
+    size_t len = strlen(key);
+    hashslot_t *slot;
+    hashentry_t *entry;
+    unsigned int i, j, home;
+
+    slot = _hash_find(table, key, len, _hash_key(table, key, len));
+    entry = slot->entry;
+    if (!entry) return -1;
+
+    /* shift following entries of the probe sequence back into the hole
+     * unless that would move them before their home slot */
+    i = (unsigned int)(slot - table->slots);
+    j = i;
+    for (;;) {
+	j = (j + 1) & mask;
+	if (!table->slots[j].entry) break;
+	home = (unsigned int)table->slots[j].hash & mask;
+	if (((j - home) & mask) >= ((j - i) & mask)) {
+	    table->slots[i] = table->slots[j];
+	    i = j;
 	}
-	prev = entry;
-	entry = entry->next;
-   }
-   /* no match */
-   return -1;
+    }
+    table->slots[i].entry = NULL;
+    table->num_keys--;
+
+    /* free last, key may belong to the entry or its value */
+    if (table->free) table->free(ctx, entry->value);
+    xmpp_free(ctx, entry);
+
+    return 0;
 }
 
 int hash_num_keys(hash_t *table)
@@ -223,7 +386,6 @@ hash_iterator_t *hash_iter_new(hash_t *table)
     if (iter != NULL) {
 	iter->ref = 1;
 	iter->table = hash_clone(table);
-	iter->entry = NULL;
 	iter->index = -1;
     }
 
@@ -249,30 +411,35 @@ void hash_iter_release(hash_iterator_t *iter)
 const char * hash_iter_next(hash_iterator_t *iter)
 {
     hash_t *table = iter->table;
-    hashentry_t *entry = iter->entry;
     int i = iter->index + 1;
 
     /* advance until we find the next entry */
-    if (entry != NULL) entry = entry->next;
-    if (entry == NULL) {
-	/* we're off the end of list, search for a new entry */
-	while (i < iter->table->length) {
-	    entry = table->entries[i];
-	    if (entry != NULL) {
-		iter->index = i;
-		break;
-	    }
-	    i++;
-	}
-    }
+    while (i < table->length && table->slots[i].entry == NULL)
+	i++;
+    iter->index = i;
 
-    if ((entry == NULL) || (i >= table->length)) {
+    if (i >= table->length) {
 	/* no more keys! */
 	return NULL;
     }
 
-    /* remember our current match */
-    iter->entry = entry;
-    return entry->key;
+    return table->slots[i].entry->key;
 }
 
+/** call func for every key, value pair in a table without allocating.
+    stops at and returns the first non-zero value returned by func */
+int hash_walk(hash_t * const table, hash_walk_func func,
+	      void * const userdata)
+{
+    hashentry_t *entry;
+    int i, ret;
+
+    for (i = 0; i < table->length; i++) {
+	entry = table->slots[i].entry;
+	if (!entry) continue;
+	ret = func(entry->key, entry->value, userdata);
+	if (ret) return ret;
+    }
+
+    return 0;
+}
@@ -27,6 +27,11 @@ typedef void (*hash_free_func)(const xmpp_ctx_t * const ctx, void *p);
 hash_t *hash_new(xmpp_ctx_t * const ctx, const int size,
 		 hash_free_func free);
 
+/** allocate and initialize a new hash table with a fixed seed, tables
+ *  with the same seed that are filled alike iterate in the same order */
+hash_t *hash_new_seeded(xmpp_ctx_t * const ctx, const int size,
+			hash_free_func free, const uint64_t seed);
+
 /** allocate a new reference to an existing hash table */
 hash_t *hash_clone(hash_t * const table);
 
@@ -61,4 +66,11 @@ void hash_iter_release(hash_iterator_t *iter);
     the returned key should not be freed */
 const char * hash_iter_next(hash_iterator_t *iter);
 
+/** call func for every key, value pair in a table without allocating.
+    stops at and returns the first non-zero value returned by func */
+typedef int (*hash_walk_func)(const char * const key, void * const value,
+			      void * const userdata);
+int hash_walk(hash_t * const table, hash_walk_func func,
+	      void * const userdata);
+
 #endif /* __LIBXMPPP_HASH_H__ */
@@ -0,0 +1,453 @@
+/* log.c
+** strophe XMPP client library -- asynchronous logger
+**
+** Copyright (C) 2005-2009 Collecta, Inc.
+**
+**  This software is provided AS-IS with no warranty, either express
+**  or implied.
+**
+**  This software is distributed under license and may not be copied,
+**  modified or distributed except as expressly authorized under the
+**  terms of the license contained in the file LICENSE.txt in this
+**  distribution.
+*/
+
+/** @file
+ *  Asynchronous logger.
+ *
+ *  Log messages are copied as binary records into a bounded ring of
+ *  fixed size cells and written out by a background thread, so that a
+ *  thread logging never blocks on the output.  A record takes one or more
+ *  consecutive cells, which a writer claims with a single compare and swap
+ *  on the tail.  Every cell carries a sequence number telling whether it
+ *  is free, written or drained for the current lap of the ring.  When the
+ *  ring is full the message is dropped and counted.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#else
+#include "ostypes.h"
+#endif
+
+#include "strophe.h"
+#include "common.h"
+
+#define ASYNC_LOG_CELL_SIZE 128
+#define ASYNC_LOG_CELL_DATA (ASYNC_LOG_CELL_SIZE - sizeof(uint64_t))
+/* longer messages are truncated to fit this many cells */
+#define ASYNC_LOG_MAX_CELLS 64
+#define ASYNC_LOG_OUT_SIZE (4 * ASYNC_LOG_MAX_CELLS * ASYNC_LOG_CELL_DATA)
+
+typedef struct {
+    uint64_t seq;
+    char data[ASYNC_LOG_CELL_DATA];
+} _async_log_cell_t;
+
+/* start of every record, followed by the area and the message */
+typedef struct {
+    uint32_t len;
+    uint16_t cells;
+    uint8_t level;
+    uint8_t area_len;
+    uint8_t truncated;
+} _async_log_record_t;
+
+/* userdata of the loggers, the filter level must come first, see
+ * _log_filter_level() in ctx.c */
+typedef struct {
+    xmpp_log_level_t level;
+    xmpp_async_log_t *alog;
+} _async_log_filter_t;
+
+struct _xmpp_async_log_t {
+    _async_log_cell_t *cells;
+    uint64_t mask;
+    int fd;
+
+    char pad0[64];
+    uint64_t tail;
+    char pad1[64];
+    uint64_t head;
+    char pad2[64];
+
+    uint64_t dropped;
+    int stop;
+    int sleeping;
+    _async_log_filter_t filters[4];
+    xmpp_log_t loggers[4];
+
+#ifndef _WIN32
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+#endif
+};
+
+static const char * const _async_log_level_name[4] =
+    {"DEBUG", "INFO", "WARN", "ERROR"};
+
+#ifndef _WIN32
+
+/* copy n bytes into the cells of the record at pos, starting at *off
+ * bytes into the record */
+static void _async_log_copy_in(xmpp_async_log_t * const alog,
+			       const uint64_t pos, size_t * const off,
+			       const void * const src, size_t n)
+{
+    const char *p = src;
+    _async_log_cell_t *cell;
+    size_t chunk;
+
+    while (n) {
+	cell = &alog->cells[(pos + *off / ASYNC_LOG_CELL_DATA) & alog->mask];
+	chunk = ASYNC_LOG_CELL_DATA - *off % ASYNC_LOG_CELL_DATA;
+	if (chunk > n) chunk = n;
+	memcpy(cell->data + *off % ASYNC_LOG_CELL_DATA, p, chunk);
+	p += chunk;
+	n -= chunk;
+	*off += chunk;
+    }
+}
+
+static void _async_log_copy_out(const xmpp_async_log_t * const alog,
+				const uint64_t pos, size_t * const off,
+				void * const dst, size_t n)
+{
+    char *p = dst;
+    const _async_log_cell_t *cell;
+    size_t chunk;
+
+    while (n) {
+	cell = &alog->cells[(pos + *off / ASYNC_LOG_CELL_DATA) & alog->mask];
+	chunk = ASYNC_LOG_CELL_DATA - *off % ASYNC_LOG_CELL_DATA;
+	if (chunk > n) chunk = n;
+	memcpy(p, cell->data + *off % ASYNC_LOG_CELL_DATA, chunk);
+	p += chunk;
+	n -= chunk;
+	*off += chunk;
+    }
+}
+
+static void _async_log_flush(xmpp_async_log_t * const alog,
+			     const char *buf, size_t len)
+{
+    ssize_t ret;
+
+    while (len) {
+	ret = write(alog->fd, buf, len);
+	if (ret < 0) {
+	    if (errno == EINTR) continue;
+	    return;
+	}
+	buf += ret;
+	len -= ret;
+    }
+}
+
+/* format the record at the head of the ring into out as
+ * "area LEVEL message\n" and free its cells */
+static size_t _async_log_drain_record(xmpp_async_log_t * const alog,
+				      char * const out)
+{
+    _async_log_record_t rec;
+    const char *name;
+    size_t off = 0, used, msg_len;
+    uint64_t pos = alog->head;
+    int i;
+
+    _async_log_copy_out(alog, pos, &off, &rec, sizeof(rec));
+    _async_log_copy_out(alog, pos, &off, out, rec.area_len);
+    used = rec.area_len;
+    out[used++] = ' ';
+    name = _async_log_level_name[rec.level & 3];
+    memcpy(out + used, name, strlen(name));
+    used += strlen(name);
+    out[used++] = ' ';
+    msg_len = rec.len - rec.area_len;
+    _async_log_copy_out(alog, pos, &off, out + used, msg_len);
+    used += msg_len;
+    if (rec.truncated) {
+	memcpy(out + used, "...", 3);
+	used += 3;
+    }
+    out[used++] = '\n';
+
+    for (i = 0; i < rec.cells; i++)
+	__atomic_store_n(&alog->cells[(pos + i) & alog->mask].seq,
+			 pos + i + alog->mask + 1, __ATOMIC_RELEASE);
+    alog->head = pos + rec.cells;
+
+    return used;
+}
+
+static int _async_log_ready(const xmpp_async_log_t * const alog)
+{
+    return __atomic_load_n(&alog->cells[alog->head & alog->mask].seq,
+			   __ATOMIC_ACQUIRE) == alog->head + 1;
+}
+
+/* background thread, writes out records in batches and sleeps while the
+ * ring is empty */
+static void *_async_log_thread(void *arg)
+{
+    xmpp_async_log_t *alog = arg;
+    char *out;
+    size_t used = 0;
+
+    out = malloc(ASYNC_LOG_OUT_SIZE);
+    if (!out) return NULL;
+
+    for (;;) {
+	if (_async_log_ready(alog)) {
+	    if (used > ASYNC_LOG_OUT_SIZE / 2) {
+		_async_log_flush(alog, out, used);
+		used = 0;
+	    }
+	    used += _async_log_drain_record(alog, out + used);
+	    continue;
+	}
+	if (used) {
+	    _async_log_flush(alog, out, used);
+	    used = 0;
+	    continue;
+	}
+	if (__atomic_load_n(&alog->stop, __ATOMIC_ACQUIRE)) break;
+
+	pthread_mutex_lock(&alog->mutex);
+	__atomic_store_n(&alog->sleeping, 1, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (!_async_log_ready(alog) &&
+	    !__atomic_load_n(&alog->stop, __ATOMIC_ACQUIRE))
+	    pthread_cond_wait(&alog->cond, &alog->mutex);
+	__atomic_store_n(&alog->sleeping, 0, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&alog->mutex);
+    }
+
+    free(out);
+    return NULL;
+}
+
+static void _async_log_wake(xmpp_async_log_t * const alog)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&alog->sleeping, __ATOMIC_RELAXED)) {
+	pthread_mutex_lock(&alog->mutex);
+	pthread_cond_signal(&alog->cond);
+	pthread_mutex_unlock(&alog->mutex);
+    }
+}
+
+#endif /* !_WIN32 */
+
+/** Create an asynchronous logger.
+ *  Messages passed to the logger are copied into a ring of size bytes and
+ *  written to fd by a background thread in the format of the default
+ *  logger.  Logging never blocks, messages that don't fit into the ring
+ *  are dropped and counted, see xmpp_async_log_dropped().  Messages longer
+ *  than about 7 KB are truncated.  The logger is not available on Windows.
+ *
+ *  @param size the size of the ring in bytes, rounded up to a power of two
+ *  @param fd the file descriptor to write to, e.g. 2 for stderr
+ *
+ *  @return a new asynchronous logger or NULL on an error
+ *
+ *  @ingroup Context
+ */
+xmpp_async_log_t *xmpp_async_log_new(const size_t size, const int fd)
+{
+#ifndef _WIN32
+    xmpp_async_log_t *alog;
+    uint64_t count, i;
+
+    /* room for at least two records of the maximum size */
+    count = 2 * ASYNC_LOG_MAX_CELLS;
+    while (count * ASYNC_LOG_CELL_SIZE < size) count <<= 1;
+
+    alog = calloc(1, sizeof(*alog));
+    if (!alog) return NULL;
+    alog->cells = malloc(count * sizeof(_async_log_cell_t));
+    if (!alog->cells) {
+	free(alog);
+	return NULL;
+    }
+    for (i = 0; i < count; i++)
+	alog->cells[i].seq = i;
+    alog->mask = count - 1;
+    alog->fd = fd;
+
+    for (i = 0; i < 4; i++) {
+	alog->filters[i].level = (xmpp_log_level_t)i;
+	alog->filters[i].alog = alog;
+	alog->loggers[i].handler = async_log_handler;
+	alog->loggers[i].userdata = &alog->filters[i];
+    }
+
+    pthread_mutex_init(&alog->mutex, NULL);
+    pthread_cond_init(&alog->cond, NULL);
+    if (pthread_create(&alog->thread, NULL, _async_log_thread, alog) != 0) {
+	pthread_cond_destroy(&alog->cond);
+	pthread_mutex_destroy(&alog->mutex);
+	free(alog->cells);
+	free(alog);
+	return NULL;
+    }
+
+    return alog;
+#else
+    return NULL;
+#endif
+}
+
+/** Free an asynchronous logger.
+ *  Messages still in the ring are written out before the background
+ *  thread exits.  Contexts using the logger must have been freed.
+ *
+ *  @param alog an asynchronous logger
+ *
+ *  @ingroup Context
+ */
+void xmpp_async_log_free(xmpp_async_log_t * const alog)
+{
+#ifndef _WIN32
+    __atomic_store_n(&alog->stop, 1, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&alog->mutex);
+    pthread_cond_signal(&alog->cond);
+    pthread_mutex_unlock(&alog->mutex);
+    pthread_join(alog->thread, NULL);
+
+    pthread_cond_destroy(&alog->cond);
+    pthread_mutex_destroy(&alog->mutex);
+    free(alog->cells);
+    free(alog);
+#endif
+}
+
+/** Get a logger writing to an asynchronous logger.
+ *  Like xmpp_get_default_logger(), only messages where level is greater
+ *  than or equal to the filter level will be logged.
+ *
+ *  @param alog an asynchronous logger
+ *  @param level the filter level
+ *
+ *  @return the log structure for the given level, it is owned by alog
+ *
+ *  @ingroup Context
+ */
+xmpp_log_t *xmpp_async_log_get_logger(xmpp_async_log_t * const alog,
+				      xmpp_log_level_t level)
+{
+    /* clamp to the known range */
+    if (level > XMPP_LEVEL_ERROR) level = XMPP_LEVEL_ERROR;
+    if (level < XMPP_LEVEL_DEBUG) level = XMPP_LEVEL_DEBUG;
+
+    return &alog->loggers[level];
+}
+
+/** Queue a log message on an asynchronous logger.
+ *  This function is safe to call from any thread and never blocks.
+ *
+ *  @param alog an asynchronous logger
+ *  @param level the level to log at
+ *  @param area the area the log message is for
+ *  @param msg the log message
+ *
+ *  @ingroup Context
+ */
+void xmpp_async_log_write(xmpp_async_log_t * const alog,
+			  const xmpp_log_level_t level,
+			  const char * const area,
+			  const char * const msg)
+{
+#ifndef _WIN32
+    _async_log_record_t rec;
+    size_t area_len, msg_len, room, off;
+    uint64_t pos, seq = 0;
+    int cells, i;
+
+    area_len = strlen(area);
+    if (area_len > 255) area_len = 255;
+    msg_len = strlen(msg);
+
+    memset(&rec, 0, sizeof(rec));
+    room = ASYNC_LOG_MAX_CELLS * ASYNC_LOG_CELL_DATA - sizeof(rec) - area_len;
+    if (msg_len > room) {
+	msg_len = room;
+	rec.truncated = 1;
+    }
+    cells = (sizeof(rec) + area_len + msg_len + ASYNC_LOG_CELL_DATA - 1) /
+	ASYNC_LOG_CELL_DATA;
+
+    /* claim all cells of the record at once, they are free for this lap
+     * if their sequence equals their position */
+    pos = __atomic_load_n(&alog->tail, __ATOMIC_RELAXED);
+    for (;;) {
+	for (i = 0; i < cells; i++) {
+	    seq = __atomic_load_n(&alog->cells[(pos + i) & alog->mask].seq,
+				  __ATOMIC_ACQUIRE);
+	    if (seq != pos + i) break;
+	}
+	if (i == cells) {
+	    if (__atomic_compare_exchange_n(&alog->tail, &pos, pos + cells,
+					    1, __ATOMIC_RELAXED,
+					    __ATOMIC_RELAXED))
+		break;
+	} else if ((int64_t)(seq - (pos + i)) < 0) {
+	    /* not drained yet, the ring is full */
+	    __atomic_add_fetch(&alog->dropped, 1, __ATOMIC_RELAXED);
+	    return;
+	} else {
+	    pos = __atomic_load_n(&alog->tail, __ATOMIC_RELAXED);
+	}
+    }
+
+    rec.len = area_len + msg_len;
+    rec.cells = cells;
+    rec.level = level;
+    rec.area_len = area_len;
+    off = 0;
+    _async_log_copy_in(alog, pos, &off, &rec, sizeof(rec));
+    _async_log_copy_in(alog, pos, &off, area, area_len);
+    _async_log_copy_in(alog, pos, &off, msg, msg_len);
+
+    /* the first cell goes last, once the thread sees it the whole record
+     * is there */
+    for (i = cells - 1; i >= 0; i--)
+	__atomic_store_n(&alog->cells[(pos + i) & alog->mask].seq,
+			 pos + i + 1, __ATOMIC_RELEASE);
+
+    _async_log_wake(alog);
+#endif
+}
+
+/** Get the number of messages dropped because the ring was full.
+ *
+ *  @param alog an asynchronous logger
+ *
+ *  @return the number of dropped messages
+ *
+ *  @ingroup Context
+ */
+uint64_t xmpp_async_log_dropped(const xmpp_async_log_t * const alog)
+{
+    return __atomic_load_n(&alog->dropped, __ATOMIC_RELAXED);
+}
+
+/* log handler of the loggers returned by xmpp_async_log_get_logger() */
+void async_log_handler(void * const userdata,
+		       const xmpp_log_level_t level,
+		       const char * const area,
+		       const char * const msg)
+{
+    _async_log_filter_t *filter = userdata;
+
+    if (level >= filter->level)
+	xmpp_async_log_write(filter->alog, level, area, msg);
+}
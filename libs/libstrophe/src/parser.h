@@ -39,5 +39,8 @@ parser_t *parser_new(xmpp_ctx_t *ctx,
 void parser_free(parser_t * const parser);
 int parser_reset(parser_t *parser);
 int parser_feed(parser_t *parser, char *chunk, int len);
+void parser_set_decoder(parser_t *parser,
+			const xmpp_stream_decoder_t * const decoder,
+			void * const userdata);
 
 #endif /* __LIBSTROPHE_PARSER_H__ */
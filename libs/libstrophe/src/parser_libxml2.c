@@ -37,8 +37,30 @@ struct _parser_t {
     void *userdata;
     int depth;
     xmpp_stanza_t *stanza;
+
+    /* stream decoder, the next one takes over once no stanza is streamed */
+    xmpp_stream_decoder_t decoder;
+    void *decoder_userdata;
+    int has_decoder;
+    xmpp_stream_decoder_t next_decoder;
+    void *next_decoder_userdata;
+    int has_next_decoder;
+    int decoder_pending;
+    /* depth of the child being streamed, 0 if none */
+    int streaming;
+    /* the current toplevel stanza has a streamed child */
+    int streamed;
 };
 
+static void _apply_decoder(parser_t *parser)
+{
+    if (!parser->decoder_pending) return;
+    parser->decoder = parser->next_decoder;
+    parser->decoder_userdata = parser->next_decoder_userdata;
+    parser->has_decoder = parser->has_next_decoder;
+    parser->decoder_pending = 0;
+}
+
 static void _set_attributes(xmpp_stanza_t *stanza, const xmlChar **attrs)
 {
     int i;
@@ -56,6 +78,13 @@ static void _start_element(void *userdata,
     parser_t *parser = (parser_t *)userdata;
     xmpp_stanza_t *child;
 
+    if (parser->streaming) {
+	parser->decoder.start(parser->decoder_userdata, (char *)name,
+			      (const char **)attrs);
+	parser->depth++;
+	return;
+    }
+
     if (parser->depth == 0) {
         /* notify the owner */
         if (parser->startcb)
@@ -75,6 +104,15 @@ static void _start_element(void *userdata,
 	    }
 	    xmpp_stanza_set_name(parser->stanza, (char *)name);
 	    _set_attributes(parser->stanza, attrs);
+	} else if (parser->depth == 2 && parser->has_decoder &&
+		   parser->decoder.probe(parser->stanza, (char *)name,
+					 (const char **)attrs,
+					 parser->decoder_userdata)) {
+	    /* the decoder takes the child, nothing is built for it */
+	    parser->streaming = parser->depth;
+	    parser->streamed = 1;
+	    parser->decoder.start(parser->decoder_userdata, (char *)name,
+				  (const char **)attrs);
 	} else {
 	    /* starting a child of conn->stanza */
 	    child = xmpp_stanza_new(parser->ctx);
@@ -104,6 +142,13 @@ static void _end_element(void *userdata, const xmlChar *name)
 
     parser->depth--;
 
+    if (parser->streaming) {
+	parser->decoder.end(parser->decoder_userdata, (char *)name);
+	if (parser->depth == parser->streaming)
+	    parser->streaming = 0;
+	return;
+    }
+
     if (parser->depth == 0) {
         /* notify owner */
         if (parser->endcb)
@@ -113,11 +158,16 @@ static void _end_element(void *userdata, const xmlChar *name)
 	    /* we're finishing a child stanza, so set current to the parent */
 	    parser->stanza = parser->stanza->parent;
 	} else {
-            if (parser->stanzacb)
+	    if (parser->streamed) {
+		parser->streamed = 0;
+		parser->decoder.stanza(parser->stanza,
+				       parser->decoder_userdata);
+	    } else if (parser->stanzacb)
                 parser->stanzacb(parser->stanza,
                                  parser->userdata);
             xmpp_stanza_release(parser->stanza);
             parser->stanza = NULL;
+	    _apply_decoder(parser);
 	}
     }
 }
@@ -127,6 +177,13 @@ static void _characters(void *userdata, const xmlChar *chr, int len)
     parser_t *parser = (parser_t *)userdata;
     xmpp_stanza_t *stanza;
 
+    if (parser->streaming) {
+	if (parser->decoder.characters)
+	    parser->decoder.characters(parser->decoder_userdata,
+				       (char *)chr, len);
+	return;
+    }
+
     /* skip unimportant whitespace, etc */
     if (parser->depth < 2) return;
 
@@ -165,6 +222,10 @@ parser_t *parser_new(xmpp_ctx_t *ctx,
         parser->userdata = userdata;
         parser->depth = 0;
         parser->stanza = NULL;
+        parser->has_decoder = 0;
+        parser->decoder_pending = 0;
+        parser->streaming = 0;
+        parser->streamed = 0;
 
         parser_reset(parser);
     }
@@ -189,6 +250,13 @@ int parser_reset(parser_t *parser)
     if (parser->stanza) 
 	xmpp_stanza_release(parser->stanza);
 
+    /* let the decoder drop what it decoded of a cut off stanza */
+    if (parser->streamed)
+	parser->decoder.stanza(NULL, parser->decoder_userdata);
+    parser->streaming = 0;
+    parser->streamed = 0;
+    _apply_decoder(parser);
+
     parser->xmlctx = xmlCreatePushParserCtxt(&parser->handlers, 
                                              parser, NULL, 0, NULL);
     if (!parser->xmlctx) return 0;
@@ -210,3 +278,16 @@ int parser_feed(parser_t *parser, char *chunk, int len)
         return 0;
     }
 }
+
+/* install a stream decoder, see xmpp_conn_set_stream_decoder() */
+void parser_set_decoder(parser_t *parser,
+			const xmpp_stream_decoder_t * const decoder,
+			void * const userdata)
+{
+    if (decoder)
+	parser->next_decoder = *decoder;
+    parser->next_decoder_userdata = userdata;
+    parser->has_next_decoder = decoder != NULL;
+    parser->decoder_pending = 1;
+    if (!parser->streamed) _apply_decoder(parser);
+}
@@ -154,6 +154,24 @@ int sock_write(const sock_t sock, const void * const buff, const size_t len)
     return send(sock, buff, len, 0);
 }
 
+/* gather write, returns the number of bytes written which may end in the
+ * middle of any of the buffers */
+int sock_writev(const sock_t sock, const struct iovec * const iov,
+		const int iovcnt)
+{
+#ifndef _WIN32
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = (struct iovec *)iov;
+    msg.msg_iovlen = iovcnt;
+    return sendmsg(sock, &msg, 0);
+#else
+    /* a short write is always allowed */
+    return iovcnt ? sock_write(sock, iov[0].iov_base, iov[0].iov_len) : 0;
+#endif
+}
+
 int sock_is_recoverable(const int error)
 {
 #ifdef _WIN32
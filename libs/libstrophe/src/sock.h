@@ -22,10 +22,15 @@
 #include <stdio.h>
 
 #ifndef _WIN32
+#include <sys/uio.h>
 typedef int sock_t;
 #else
 #include <winsock2.h>
 typedef SOCKET sock_t;
+struct iovec {
+    void *iov_base;
+    size_t iov_len;
+};
 #endif
 
 void sock_initialize(void);
@@ -40,6 +45,8 @@ int sock_set_blocking(const sock_t sock);
 int sock_set_nonblocking(const sock_t sock);
 int sock_read(const sock_t sock, void * const buff, const size_t len);
 int sock_write(const sock_t sock, const void * const buff, const size_t len);
+int sock_writev(const sock_t sock, const struct iovec * const iov,
+		const int iovcnt);
 int sock_is_recoverable(const int error);
 /* checks for an error after connect, return 0 if connect successful */
 int sock_connect_error(const sock_t sock);
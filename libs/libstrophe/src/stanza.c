@@ -22,6 +22,10 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "strophe.h"
 #include "common.h"
 #include "hash.h"
@@ -30,6 +34,10 @@
 #define inline __inline
 #endif
 
+/* attributes are rendered in the iteration order of their table, a fixed
+ * seed keeps that order the same in every run, see xmpp_stanza_to_text() */
+#define STANZA_ATTRIBUTES_SEED 0x5354414e5a41ULL
+
 /** Create a stanza object.
  *  This function allocates and initializes and blank stanza object.
  *  The stanza will have a reference count of one, so the caller does not
@@ -63,6 +71,8 @@ xmpp_stanza_t *xmpp_stanza_new(xmpp_ctx_t *ctx)
 
 /** Clone a stanza object.
  *  This function increments the reference count of the stanza object.
+ *  References may be taken and released from several threads, which
+ *  allows handing a received stanza to another thread without copying it.
  *  
  *  @param stanza a Strophe stanza object
  *
@@ -72,7 +82,11 @@ xmpp_stanza_t *xmpp_stanza_new(xmpp_ctx_t *ctx)
  */
 xmpp_stanza_t *xmpp_stanza_clone(xmpp_stanza_t * const stanza)
 {
+#ifdef __GNUC__
+    __atomic_add_fetch(&stanza->ref, 1, __ATOMIC_RELAXED);
+#else
     stanza->ref++;
+#endif
 
     return stanza;
 }
@@ -107,7 +121,8 @@ xmpp_stanza_t *xmpp_stanza_copy(const xmpp_stanza_t * const stanza)
     }
 
     if (stanza->attributes) {
-	copy->attributes = hash_new(stanza->ctx, 8, xmpp_free);
+	copy->attributes = hash_new_seeded(stanza->ctx, 8, xmpp_free,
+					   STANZA_ATTRIBUTES_SEED);
 	if (!copy->attributes) goto copy_error;
 	iter = hash_iter_new(stanza->attributes);
 	if (!iter) { printf("DEBUG HERE\n"); goto copy_error; }
@@ -159,10 +174,12 @@ int xmpp_stanza_release(xmpp_stanza_t * const stanza)
     int released = 0;
     xmpp_stanza_t *child, *tchild;
 
-    /* release stanza */
-    if (stanza->ref > 1)
-	stanza->ref--;
-    else {
+    /* release stanza, the last reference frees it */
+#ifdef __GNUC__
+    if (__atomic_sub_fetch(&stanza->ref, 1, __ATOMIC_ACQ_REL) == 0) {
+#else
+    if (--stanza->ref == 0) {
+#endif
 	/* release all children */
 	child = stanza->children;
 	while (child) {
@@ -206,171 +223,185 @@ int xmpp_stanza_is_tag(xmpp_stanza_t * const stanza)
     return (stanza && stanza->type == XMPP_STANZA_TAG);
 }
 
-/* Escape a string with for use in a XML text node or attribute. Assumes that
- * the input string is encoded in UTF-8. On sucess, returns a pointer to a
- * buffer with the resulting data which must be xmpp_free()'d by the caller.
- * On failure, returns NULL.
- */
+/* Stanzas are rendered in a single pass into a buffer that doubles in
+ * size when it runs out of room.  The first guess for its size is the
+ * size of the previously rendered stanza of the context. */
+typedef struct {
+    xmpp_ctx_t *ctx;
+    char *buf;
+    size_t len;
+    size_t size;
+} _render_buf_t;
 
-static char *_escape_xml(xmpp_ctx_t * const ctx, char *text)
+/* make room for n more bytes and the terminating NUL */
+static int _render_reserve(_render_buf_t * const rb, const size_t n)
 {
-    size_t len = 0;
-    char *src;
-    char *dst;
-    char *buf;
-    for (src = text; *src != '\0'; src++) {
-        switch (*src) {
-            case '<':   /* "&lt;" */
-            case '>':   /* "&gt;" */
-                len += 4;
-                break;
-            case '&':   /* "&amp;" */
-                len += 5;
-                break;
-            case '"':
-                len += 6; /*"&quot;" */
-                break;
-            default:
-                len++;
-        }
-    }
-    if ((buf = xmpp_alloc(ctx, (len+1) * sizeof(char))) == NULL)
-        return NULL;    /* Error */
-    dst = buf;
-    for (src = text; *src != '\0'; src++) {
-        switch (*src) {
-            case '<':
-                strcpy(dst, "&lt;");
-                dst += 4;
-                break;
-            case '>':
-                strcpy(dst, "&gt;");
-                dst += 4;
-                break;
-            case '&':
-                strcpy(dst, "&amp;");
-                dst += 5;
-                break;
-            case '"':
-                strcpy(dst, "&quot;");
-                dst += 6;
-                break;
-            default:
-                *dst = *src;
-                dst++;
-        }
+    size_t size;
+    char *tmp;
+
+    if (rb->len + n < rb->size) return XMPP_EOK;
+
+    size = rb->size * 2;
+    while (rb->len + n >= size) size *= 2;
+    tmp = xmpp_realloc(rb->ctx, rb->buf, size);
+    if (!tmp) return XMPP_EMEM;
+    rb->buf = tmp;
+    rb->size = size;
+
+    return XMPP_EOK;
+}
+
+static int _render_append(_render_buf_t * const rb,
+			  const char * const s, const size_t n)
+{
+    if (_render_reserve(rb, n) != XMPP_EOK) return XMPP_EMEM;
+    memcpy(rb->buf + rb->len, s, n);
+    rb->len += n;
+
+    return XMPP_EOK;
+}
+
+/* return a pointer to the first '<', '>', '&', '"' or the terminating NUL
+ * of a string */
+static const char *_escape_scan(const char *s)
+{
+#ifdef __SSE2__
+    const __m128i lt = _mm_set1_epi8('<'), gt = _mm_set1_epi8('>');
+    const __m128i amp = _mm_set1_epi8('&'), quot = _mm_set1_epi8('"');
+    const __m128i nul = _mm_setzero_si128();
+    __m128i v;
+    int mask;
+
+    /* go byte by byte up to a 16 byte boundary, aligned loads never cross
+     * into the next page so reading past the NUL is safe */
+    for (; (uintptr_t)s & 15; s++)
+	if (*s == '<' || *s == '>' || *s == '&' || *s == '"' || *s == '\0')
+	    return s;
+
+    for (;; s += 16) {
+	v = _mm_load_si128((const __m128i *)s);
+	mask = _mm_movemask_epi8(
+	    _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, lt),
+				      _mm_cmpeq_epi8(v, gt)),
+			 _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, amp),
+						   _mm_cmpeq_epi8(v, quot)),
+				      _mm_cmpeq_epi8(v, nul))));
+	if (mask) return s + __builtin_ctz(mask);
     }
-    *dst = '\0';
-    return buf;
+#else
+    return s + strcspn(s, "<>&\"");
+#endif
 }
 
-/* small helper function */
-static inline void _render_update(int *written, const int length,
-			   const int lastwrite,
-			   size_t *left, char **ptr)
+/* Append a string escaped for use in a XML text node or attribute. Assumes
+ * that the input string is encoded in UTF-8.  Runs without special
+ * characters are copied in one go. */
+static int _render_escaped(_render_buf_t * const rb, const char *text)
 {
-    *written += lastwrite;
+    const char *end;
+    int ret;
 
-    if (*written > length) {
-	*left = 0;
-	*ptr = NULL;
-    } else {
-	*left -= lastwrite;
-	*ptr = &(*ptr)[lastwrite];
+    for (;;) {
+	end = _escape_scan(text);
+	if (end > text) {
+	    ret = _render_append(rb, text, end - text);
+	    if (ret != XMPP_EOK) return ret;
+	}
+	switch (*end) {
+	    case '<':
+		ret = _render_append(rb, "&lt;", 4);
+		break;
+	    case '>':
+		ret = _render_append(rb, "&gt;", 4);
+		break;
+	    case '&':
+		ret = _render_append(rb, "&amp;", 5);
+		break;
+	    case '"':
+		ret = _render_append(rb, "&quot;", 6);
+		break;
+	    default:
+		return XMPP_EOK;
+	}
+	if (ret != XMPP_EOK) return ret;
+	text = end + 1;
     }
 }
 
-/* always returns number of bytes written or that would have been
- * written if the buffer was large enough
- * return values < 0 indicate some error occured,
- * and return values > buflen indicate buffer was not large enough
- */
-static int _render_stanza_recursive(xmpp_stanza_t *stanza,
-			     char * const buf, size_t const buflen)
+static int _render_attribute(const char * const key, void * const value,
+			     void * const userdata)
 {
-    char *ptr = buf;
-    size_t left = buflen;
-    int ret, written;
-    xmpp_stanza_t *child;
-    hash_iterator_t *iter;
-    const char *key;
-    char *tmp;
+    _render_buf_t *rb = (_render_buf_t *)userdata;
+    size_t len = strlen(key);
+
+    if (_render_reserve(rb, len + 4) != XMPP_EOK) return XMPP_EMEM;
+    rb->buf[rb->len++] = ' ';
+    memcpy(rb->buf + rb->len, key, len);
+    rb->len += len;
+    rb->buf[rb->len++] = '=';
+    rb->buf[rb->len++] = '"';
+    if (_render_escaped(rb, (const char *)value) != XMPP_EOK)
+	return XMPP_EMEM;
+
+    return _render_append(rb, "\"", 1);
+}
 
-    written = 0;
+static int _render_stanza(_render_buf_t * const rb,
+			  xmpp_stanza_t * const stanza)
+{
+    xmpp_stanza_t *child;
+    size_t len;
+    int ret;
 
     if (stanza->type == XMPP_STANZA_UNKNOWN) return XMPP_EINVOP;
+    if (!stanza->data) return XMPP_EINVOP;
 
-    if (stanza->type == XMPP_STANZA_TEXT) {
-	if (!stanza->data) return XMPP_EINVOP;
-
-	tmp = _escape_xml(stanza->ctx, stanza->data);
-	if (tmp == NULL) return XMPP_EMEM;
-	ret = xmpp_snprintf(ptr, left, "%s", tmp);
-	xmpp_free(stanza->ctx, tmp);
-	if (ret < 0) return XMPP_EMEM;
-	_render_update(&written, buflen, ret, &left, &ptr);
-    } else { /* stanza->type == XMPP_STANZA_TAG */
-	if (!stanza->data) return XMPP_EINVOP;
-
-	/* write begining of tag and attributes */
-	ret = xmpp_snprintf(ptr, left, "<%s", stanza->data);
-	if (ret < 0) return XMPP_EMEM;
-	_render_update(&written, buflen, ret, &left, &ptr);
-
-	if (stanza->attributes && hash_num_keys(stanza->attributes) > 0) {
-	    iter = hash_iter_new(stanza->attributes);
-	    while ((key = hash_iter_next(iter))) {
-		tmp = _escape_xml(stanza->ctx,
-		    (char *)hash_get(stanza->attributes, key));
-		if (tmp == NULL) return XMPP_EMEM;
-		ret = xmpp_snprintf(ptr, left, " %s=\"%s\"", key, tmp);
-		xmpp_free(stanza->ctx, tmp);
-		if (ret < 0) return XMPP_EMEM;
-		_render_update(&written, buflen, ret, &left, &ptr);
-	    }
-	    hash_iter_release(iter);
-	}
+    if (stanza->type == XMPP_STANZA_TEXT)
+	return _render_escaped(rb, stanza->data);
 
-	if (!stanza->children) {
-	    /* write end if singleton tag */
-	    ret = xmpp_snprintf(ptr, left, "/>");
-	    if (ret < 0) return XMPP_EMEM;
-	    _render_update(&written, buflen, ret, &left, &ptr);
-	} else {
-	    /* this stanza has child stanzas */
-
-	    /* write end of start tag */
-	    ret = xmpp_snprintf(ptr, left, ">");
-	    if (ret < 0) return XMPP_EMEM;
-	    _render_update(&written, buflen, ret, &left, &ptr);
-	    
-	    /* iterate and recurse over child stanzas */
-	    child = stanza->children;
-	    while (child) {
-		ret = _render_stanza_recursive(child, ptr, left);
-		if (ret < 0) return ret;
+    /* stanza->type == XMPP_STANZA_TAG */
 
-		_render_update(&written, buflen, ret, &left, &ptr);
+    /* write begining of tag and attributes */
+    len = strlen(stanza->data);
+    if (_render_reserve(rb, len + 1) != XMPP_EOK) return XMPP_EMEM;
+    rb->buf[rb->len++] = '<';
+    memcpy(rb->buf + rb->len, stanza->data, len);
+    rb->len += len;
 
-		child = child->next;
-	    }
+    if (stanza->attributes) {
+	ret = hash_walk(stanza->attributes, _render_attribute, rb);
+	if (ret != XMPP_EOK) return ret;
+    }
 
-	    /* write end tag */
-	    ret = xmpp_snprintf(ptr, left, "</%s>", stanza->data);
-	    if (ret < 0) return XMPP_EMEM;
-	    
-	    _render_update(&written, buflen, ret, &left, &ptr);
-	}
+    /* write end if singleton tag */
+    if (!stanza->children) return _render_append(rb, "/>", 2);
+
+    /* write end of start tag and recurse over child stanzas */
+    ret = _render_append(rb, ">", 1);
+    if (ret != XMPP_EOK) return ret;
+    for (child = stanza->children; child; child = child->next) {
+	ret = _render_stanza(rb, child);
+	if (ret != XMPP_EOK) return ret;
     }
 
-    return written;
+    /* write end tag */
+    if (_render_reserve(rb, len + 3) != XMPP_EOK) return XMPP_EMEM;
+    rb->buf[rb->len++] = '<';
+    rb->buf[rb->len++] = '/';
+    memcpy(rb->buf + rb->len, stanza->data, len);
+    rb->len += len;
+    rb->buf[rb->len++] = '>';
+
+    return XMPP_EOK;
 }
 
 /** Render a stanza object to text.
  *  This function renders a given stanza object, along with its
  *  children, to text.  The text is returned in an allocated,
- *  null-terminated buffer.  It starts by allocating a 1024 byte buffer
- *  and reallocates more memory if that is not large enough.
+ *  null-terminated buffer that the caller owns, e.g. to hand it to the
+ *  send queue without a copy.  The stanza is rendered in a single pass
+ *  into a buffer sized after the previous stanza rendered in the same
+ *  context, which grows as needed.
  *
  *  @param stanza a Strophe stanza object
  *  @param buf a reference to a string pointer
@@ -385,41 +416,32 @@ int  xmpp_stanza_to_text(xmpp_stanza_t *stanza,
 			 char ** const buf,
 			 size_t * const buflen)
 {
-    char *buffer, *tmp;
-    size_t length;
+    xmpp_ctx_t *ctx = stanza->ctx;
+    _render_buf_t rb;
     int ret;
 
-    /* allocate a default sized buffer and attempt to render */
-    length = 1024;
-    buffer = xmpp_alloc(stanza->ctx, length);
-    if (!buffer) {
-	*buf = NULL;
-	*buflen = 0;
-	return XMPP_EMEM;
-    }
-
-    ret = _render_stanza_recursive(stanza, buffer, length);
-    if (ret < 0) return ret;
-
-    if (ret > length - 1) {
-	tmp = xmpp_realloc(stanza->ctx, buffer, ret + 1);
-	if (!tmp) {
-	    xmpp_free(stanza->ctx, buffer);
-	    *buf = NULL;
-	    *buflen = 0;
-	    return XMPP_EMEM;
-	}
-	length = ret + 1;
-	buffer = tmp;
-
-	ret = _render_stanza_recursive(stanza, buffer, length);
-	if (ret > length - 1) return XMPP_EMEM;
+    *buf = NULL;
+    *buflen = 0;
+
+    /* other threads may render in the same context, the hint is only a
+     * guess so a stale value is fine */
+    rb.ctx = ctx;
+    rb.len = 0;
+    rb.size = __atomic_load_n(&ctx->render_hint, __ATOMIC_RELAXED) + 64;
+    if (rb.size < 256) rb.size = 256;
+    rb.buf = xmpp_alloc(ctx, rb.size);
+    if (!rb.buf) return XMPP_EMEM;
+
+    ret = _render_stanza(&rb, stanza);
+    if (ret != XMPP_EOK) {
+	xmpp_free(ctx, rb.buf);
+	return ret;
     }
-    
-    buffer[length - 1] = 0;
+    rb.buf[rb.len] = '\0';
+    __atomic_store_n(&ctx->render_hint, rb.len, __ATOMIC_RELAXED);
 
-    *buf = buffer;
-    *buflen = ret;
+    *buf = rb.buf;
+    *buflen = rb.len;
 
     return XMPP_EOK;
 }
@@ -480,6 +502,24 @@ int xmpp_stanza_get_attribute_count(xmpp_stanza_t * const stanza)
     return hash_num_keys(stanza->attributes);
 }
 
+/* collects attribute pairs for xmpp_stanza_get_attributes() */
+typedef struct {
+    const char **attr;
+    int len;
+    int num;
+} _attribute_list_t;
+
+static int _list_attribute(const char * const key, void * const value,
+			   void * const userdata)
+{
+    _attribute_list_t *list = (_attribute_list_t *)userdata;
+
+    list->attr[list->num++] = key;
+    if (list->num == list->len) return 1;
+    list->attr[list->num++] = value;
+    return list->num == list->len;
+}
+
 /** Get all attributes for a stanza object.
  *  This function populates the array with attributes from the stanza.  The
  *  attr array will be in the format:  attr[i] = attribute name, 
@@ -497,32 +537,18 @@ int xmpp_stanza_get_attribute_count(xmpp_stanza_t * const stanza)
 int xmpp_stanza_get_attributes(xmpp_stanza_t * const stanza,
 			       const char **attr, int attrlen)
 {
-    hash_iterator_t *iter;
-    const char *key;
-    int num = 0;
+    _attribute_list_t list;
 
     if (stanza->attributes == NULL) {
 	return 0;
     }
 
-    iter = hash_iter_new(stanza->attributes);
-    while ((key = hash_iter_next(iter)) != NULL && attrlen) {
-	attr[num++] = key;
-	attrlen--;
-	if (attrlen == 0) {
-	    hash_iter_release(iter);
-	    return num;
-	}
-	attr[num++] = hash_get(stanza->attributes, key);
-	attrlen--;
-	if (attrlen == 0) {
-	    hash_iter_release(iter);
-	    return num;
-	}
-    }
-
-    hash_iter_release(iter);
-    return num;
+    list.attr = attr;
+    list.len = attrlen;
+    list.num = 0;
+    if (attrlen > 0)
+	hash_walk(stanza->attributes, _list_attribute, &list);
+    return list.num;
 }
 
 /** Set an attribute for a stanza object.
@@ -544,7 +570,8 @@ int xmpp_stanza_set_attribute(xmpp_stanza_t * const stanza,
     if (stanza->type != XMPP_STANZA_TAG) return XMPP_EINVOP;
 
     if (!stanza->attributes) {
-	stanza->attributes = hash_new(stanza->ctx, 8, xmpp_free);
+	stanza->attributes = hash_new_seeded(stanza->ctx, 8, xmpp_free,
+					     STANZA_ATTRIBUTES_SEED);
 	if (!stanza->attributes) return XMPP_EMEM;
     }
 
@@ -0,0 +1,312 @@
+/* timer.c
+** strophe XMPP client library -- hierarchical timer wheel
+**
+** Copyright (C) 2005-2009 Collecta, Inc.
+**
+**  This software is provided AS-IS with no warranty, either express
+**  or implied.
+**
+**  This software is distributed under license and may not be copied,
+**  modified or distributed except as expressly authorized under the
+**  terms of the license contained in the file LICENSE.txt in this
+**  distribution.
+*/
+
+/** @file
+ *  Hierarchical timer wheel.
+ *
+ *  Timers of a context are filed into a wheel of TIMER_WHEEL_LEVELS levels
+ *  with TIMER_WHEEL_SIZE slots each.  A timer expiring less than 64 ms
+ *  from now sits in the level 0 slot of its millisecond, timers further out
+ *  sit in the higher level slot covering their expiry and move down one or
+ *  more levels whenever the wheel enters that slot.  Adding, deleting and
+ *  firing a timer is O(1), each timer is moved down at most
+ *  TIMER_WHEEL_LEVELS - 1 times.
+ */
+
+/** @defgroup Timers Timers
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <stdint.h>
+#else
+#include "ostypes.h"
+#endif
+
+#include "strophe.h"
+#include "common.h"
+
+/* index of the lowest set bit, x must not be 0 */
+static int _lowest_bit(uint64_t x)
+{
+#ifdef __GNUC__
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+
+    while (!(x & 1)) {
+	x >>= 1;
+	n++;
+    }
+    return n;
+#endif
+}
+
+/* rotate x right by n bits, 0 <= n < 64 */
+static uint64_t _rotate_right(const uint64_t x, const int n)
+{
+    return n ? (x >> n) | (x << (64 - n)) : x;
+}
+
+static void _timer_link(xmpp_timer_t ** const head, xmpp_timer_t * const timer)
+{
+    timer->next = *head;
+    if (timer->next) timer->next->pprev = &timer->next;
+    timer->pprev = head;
+    *head = timer;
+}
+
+static void _timer_unlink(xmpp_timer_t * const timer)
+{
+    *timer->pprev = timer->next;
+    if (timer->next) timer->next->pprev = timer->pprev;
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+/* file a timer into the slot covering its expiry */
+static void _timer_file(xmpp_timer_wheel_t * const wheel,
+			xmpp_timer_t * const timer)
+{
+    uint64_t when, delta;
+    int level, idx;
+
+    /* expired timers fire on the next tick */
+    when = timer->expires < wheel->next ? wheel->next : timer->expires;
+    delta = when - wheel->next;
+
+    level = 0;
+    while (level < TIMER_WHEEL_LEVELS - 1 &&
+	   delta >= (uint64_t)1 << (TIMER_WHEEL_BITS * (level + 1)))
+	level++;
+    /* park timers beyond the last level at its far end */
+    if (delta >= (uint64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS))
+	when = wheel->next +
+	    ((uint64_t)1 << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1;
+
+    idx = (when >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+    _timer_link(&wheel->slots[level][idx], timer);
+    wheel->occupied[level] |= (uint64_t)1 << idx;
+}
+
+/* take all timers out of a slot, the returned list is linked through
+ * its own head so that timers on it can still be deleted */
+static void _timer_slot_take(xmpp_timer_wheel_t * const wheel,
+			     const int level, const int idx,
+			     xmpp_timer_t ** const list)
+{
+    *list = wheel->slots[level][idx];
+    if (*list) (*list)->pprev = list;
+    wheel->slots[level][idx] = NULL;
+    wheel->occupied[level] &= ~((uint64_t)1 << idx);
+}
+
+/* move the timers of the higher level slots that the wheel is entering
+ * down to the lower levels */
+static void _timer_cascade(xmpp_timer_wheel_t * const wheel)
+{
+    xmpp_timer_t *list, *timer;
+    int level, idx;
+
+    for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+	idx = (wheel->next >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+	_timer_slot_take(wheel, level, idx, &list);
+	while ((timer = list) != NULL) {
+	    _timer_unlink(timer);
+	    _timer_file(wheel, timer);
+	}
+	/* only continue if this level wrapped around as well */
+	if (idx) break;
+    }
+}
+
+/** Initialize a timer.
+ *  The timer is not pending until it is added with xmpp_timer_add().
+ *
+ *  @param timer the timer to initialize, usually embedded in another
+ *         structure
+ *  @param cb the function called from the event loop when the timer expires
+ *  @param userdata an opaque pointer stored in the timer
+ *
+ *  @ingroup Timers
+ */
+void xmpp_timer_init(xmpp_timer_t * const timer, xmpp_timer_cb cb,
+		     void * const userdata)
+{
+    memset(timer, 0, sizeof(*timer));
+    timer->cb = cb;
+    timer->userdata = userdata;
+}
+
+/** Schedule a timer.
+ *  A pending timer is rescheduled.  The callback runs from the event loop
+ *  once xmpp_ctx_now() reaches expires.  Timers must not be added or
+ *  deleted concurrently with the event loop.
+ *
+ *  @param ctx a Strophe context object
+ *  @param timer an initialized timer
+ *  @param expires the expiry time in ms on the clock of xmpp_ctx_now()
+ *
+ *  @ingroup Timers
+ */
+void xmpp_timer_add(xmpp_ctx_t * const ctx, xmpp_timer_t * const timer,
+		    const uint64_t expires)
+{
+    if (timer->pprev) xmpp_timer_del(ctx, timer);
+    timer->expires = expires;
+    _timer_file(&ctx->timers, timer);
+}
+
+/** Cancel a timer.
+ *  Deleting a timer that is not pending has no effect.
+ *
+ *  @param ctx a Strophe context object
+ *  @param timer the timer to cancel
+ *
+ *  @ingroup Timers
+ */
+void xmpp_timer_del(xmpp_ctx_t * const ctx, xmpp_timer_t * const timer)
+{
+    xmpp_timer_wheel_t *wheel = &ctx->timers;
+    xmpp_timer_t **head = timer->pprev;
+    ptrdiff_t slot;
+
+    if (!head) return;
+    _timer_unlink(timer);
+
+    /* clear the occupied bit if this emptied a wheel slot */
+    slot = head - &wheel->slots[0][0];
+    if (!*head && slot >= 0 &&
+	slot < TIMER_WHEEL_LEVELS * TIMER_WHEEL_SIZE)
+	wheel->occupied[slot / TIMER_WHEEL_SIZE] &=
+	    ~((uint64_t)1 << (slot % TIMER_WHEEL_SIZE));
+}
+
+/** Check whether a timer is pending.
+ *
+ *  @param timer a timer
+ *
+ *  @return TRUE if the timer is scheduled, FALSE otherwise
+ *
+ *  @ingroup Timers
+ */
+int xmpp_timer_pending(const xmpp_timer_t * const timer)
+{
+    return timer->pprev != NULL;
+}
+
+/** Get the current time of the event loop.
+ *  The monotonic clock is read once before and once after the event loop
+ *  waits for events, timers and handlers run against this cached value.
+ *
+ *  @param ctx a Strophe context object
+ *
+ *  @return the time in ms on the clock used for timer expiry
+ *
+ *  @ingroup Timers
+ */
+uint64_t xmpp_ctx_now(const xmpp_ctx_t * const ctx)
+{
+    return ctx->now;
+}
+
+/** Initialize a timer wheel.
+ *  This function is called internally by xmpp_ctx_new().
+ *
+ *  @param wheel the wheel to initialize
+ *  @param now the current time in ms
+ */
+void timer_wheel_init(xmpp_timer_wheel_t * const wheel, const uint64_t now)
+{
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->next = now;
+}
+
+/** Fire all timers that expired at or before now.
+ *  This function is called internally by the event loop.  Timers are
+ *  fired in order of their tick, timers added by callbacks are filed
+ *  relative to the tick being processed.
+ *
+ *  @param ctx a Strophe context object
+ *  @param now the current time in ms
+ */
+void timer_wheel_run(xmpp_ctx_t * const ctx, const uint64_t now)
+{
+    xmpp_timer_wheel_t *wheel = &ctx->timers;
+    xmpp_timer_t *list, *timer;
+    uint64_t rest, skip;
+    int idx;
+
+    while (wheel->next <= now) {
+	idx = wheel->next & TIMER_WHEEL_MASK;
+	if (idx == 0) _timer_cascade(wheel);
+
+	_timer_slot_take(wheel, 0, idx, &list);
+	wheel->next++;
+	while ((timer = list) != NULL) {
+	    _timer_unlink(timer);
+	    timer->cb(ctx, timer);
+	}
+
+	/* skip empty ticks up to the next occupied slot or the next
+	 * level boundary, where the higher levels have to cascade */
+	idx = wheel->next & TIMER_WHEEL_MASK;
+	if (idx == 0 || wheel->next > now) continue;
+	rest = wheel->occupied[0] >> idx;
+	skip = rest ? _lowest_bit(rest) : TIMER_WHEEL_SIZE - idx;
+	if (skip > now + 1 - wheel->next) skip = now + 1 - wheel->next;
+	wheel->next += skip;
+    }
+}
+
+/** Get the time until the next timer might expire.
+ *  Timers in the higher levels are accounted for by the start of their
+ *  slot, so the result may be earlier than the actual expiry.
+ *
+ *  @param wheel a timer wheel
+ *  @param now the current time in ms
+ *
+ *  @return the time in ms, or (uint64_t)-1 if no timer is pending
+ */
+uint64_t timer_wheel_next(const xmpp_timer_wheel_t * const wheel,
+			  const uint64_t now)
+{
+    uint64_t best = (uint64_t)-1, when, block;
+    int level, shift, cur;
+
+    for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+	if (!wheel->occupied[level]) continue;
+	shift = TIMER_WHEEL_BITS * level;
+	block = wheel->next >> shift;
+	cur = block & TIMER_WHEEL_MASK;
+	if (level == 0) {
+	    when = wheel->next +
+		_lowest_bit(_rotate_right(wheel->occupied[0], cur));
+	} else {
+	    /* the current slot of a higher level has already cascaded,
+	     * anything in it belongs to the next round */
+	    cur = (cur + 1) & TIMER_WHEEL_MASK;
+	    when = (block + 1 +
+		    _lowest_bit(_rotate_right(wheel->occupied[level], cur)))
+		<< shift;
+	}
+	if (when < best) best = when;
+    }
+
+    if (best == (uint64_t)-1) return best;
+    return best <= now ? 0 : best - now;
+}
@@ -0,0 +1,60 @@
+/* timer.h
+** strophe XMPP client library -- hierarchical timer wheel
+**
+** Copyright (C) 2005-2009 Collecta, Inc.
+**
+**  This software is provided AS-IS with no warranty, either express
+**  or implied.
+**
+**  This software is distributed under license and may not be copied,
+**  modified or distributed except as expressly authorized under the
+**  terms of the license contained in the file LICENSE.txt in this
+**  distribution.
+*/
+
+/** @file
+ *  Hierarchical timer wheel.
+ */
+
+#ifndef __LIBSTROPHE_TIMER_H__
+#define __LIBSTROPHE_TIMER_H__
+
+#ifndef _WIN32
+#include <stdint.h>
+#else
+#include "ostypes.h"
+#endif
+
+/* Each level has 64 slots, so that a 64 bit word tells which slots are
+ * occupied.  Level n slots are 64^n ms wide, five levels cover about 12
+ * days, timers further out are parked in the last level and re-filed as
+ * the wheel turns. */
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SIZE (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+#define TIMER_WHEEL_LEVELS 5
+
+struct _xmpp_timer_t {
+    uint64_t expires;
+    xmpp_timer_cb cb;
+    void *userdata;
+
+    /* slot list links, pprev is NULL while the timer is not pending */
+    xmpp_timer_t *next;
+    xmpp_timer_t **pprev;
+};
+
+typedef struct _xmpp_timer_wheel_t {
+    /* next tick in ms that has not been processed yet */
+    uint64_t next;
+    /* bit n is set if slot n of the level is not empty */
+    uint64_t occupied[TIMER_WHEEL_LEVELS];
+    xmpp_timer_t *slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+} xmpp_timer_wheel_t;
+
+void timer_wheel_init(xmpp_timer_wheel_t * const wheel, const uint64_t now);
+void timer_wheel_run(xmpp_ctx_t * const ctx, const uint64_t now);
+uint64_t timer_wheel_next(const xmpp_timer_wheel_t * const wheel,
+			  const uint64_t now);
+
+#endif /* __LIBSTROPHE_TIMER_H__ */
@@ -78,6 +78,25 @@ uint64_t time_stamp(void)
 #endif
 }
 
+/** Return a monotonic time stamp in milliseconds.
+ *  Unlike time_stamp() this clock does not jump when the system time is
+ *  set.  It drives the timer wheel, see xmpp_ctx_now().
+ *
+ *  @return milliseconds since an unspecified starting point
+ */
+uint64_t time_monotonic(void)
+{
+#ifdef _WIN32
+    return timeGetTime();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+#endif
+}
+
 /** Get the time elapsed between two time stamps.
  *  This function returns the time elapsed between t1 and t2 by subtracting
  *  t1 from t2.  If t2 happened before t1, the result will be negative.  This
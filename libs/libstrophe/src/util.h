@@ -27,6 +27,7 @@
 
 /* timing functions */
 uint64_t time_stamp(void);
+uint64_t time_monotonic(void);
 uint64_t time_elapsed(uint64_t t1, uint64_t t2);
 
 #endif /* __LIBSTROPHE_UTIL_H__ */
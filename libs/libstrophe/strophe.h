@@ -24,6 +24,7 @@ extern "C" {
 #endif
 
 #include <stdio.h>
+#include <stdint.h>
 
 /* namespace defines */
 /** @def XMPP_NS_CLIENT
@@ -117,6 +118,12 @@ typedef struct _xmpp_log_t xmpp_log_t;
 /* opaque run time context containing the above hooks */
 typedef struct _xmpp_ctx_t xmpp_ctx_t;
 
+/* event notification backends for the event loop */
+typedef enum {
+    XMPP_EVENT_SELECT,
+    XMPP_EVENT_EPOLL
+} xmpp_event_backend_t;
+
 xmpp_ctx_t *xmpp_ctx_new(const xmpp_mem_t * const mem, 
 			     const xmpp_log_t * const log);
 void xmpp_ctx_free(xmpp_ctx_t * const ctx);
@@ -155,6 +162,24 @@ struct _xmpp_log_t {
 /* return a default logger filtering at a given level */
 xmpp_log_t *xmpp_get_default_logger(xmpp_log_level_t level);
 
+/* drop messages below level before they are formatted */
+void xmpp_ctx_set_log_level(xmpp_ctx_t * const ctx,
+			    const xmpp_log_level_t level);
+
+/* asynchronous logger, messages are copied into a ring buffer and written
+ * out by a background thread */
+typedef struct _xmpp_async_log_t xmpp_async_log_t;
+
+xmpp_async_log_t *xmpp_async_log_new(const size_t size, const int fd);
+void xmpp_async_log_free(xmpp_async_log_t * const alog);
+xmpp_log_t *xmpp_async_log_get_logger(xmpp_async_log_t * const alog,
+				      xmpp_log_level_t level);
+void xmpp_async_log_write(xmpp_async_log_t * const alog,
+			  const xmpp_log_level_t level,
+			  const char * const area,
+			  const char * const msg);
+uint64_t xmpp_async_log_dropped(const xmpp_async_log_t * const alog);
+
 /* connection */
 
 /* opaque connection object */
@@ -216,6 +241,7 @@ const char *xmpp_conn_get_bound_jid(const xmpp_conn_t * const conn);
 void xmpp_conn_set_jid(xmpp_conn_t * const conn, const char * const jid);
 const char *xmpp_conn_get_pass(const xmpp_conn_t * const conn);
 void xmpp_conn_set_pass(xmpp_conn_t * const conn, const char * const pass);
+void xmpp_conn_set_read_paused(xmpp_conn_t * const conn, const int paused);
 xmpp_ctx_t* xmpp_conn_get_context(xmpp_conn_t * const conn);
 void xmpp_conn_disable_tls(xmpp_conn_t * const conn);
 
@@ -252,6 +278,19 @@ void xmpp_timed_handler_add(xmpp_conn_t * const conn,
 void xmpp_timed_handler_delete(xmpp_conn_t * const conn,
 			       xmpp_timed_handler handler);
 
+/* timers, embedded in the caller's structures and fired by the event loop */
+typedef struct _xmpp_timer_t xmpp_timer_t;
+typedef void (*xmpp_timer_cb)(xmpp_ctx_t * const ctx,
+			      xmpp_timer_t * const timer);
+
+void xmpp_timer_init(xmpp_timer_t * const timer, xmpp_timer_cb cb,
+		     void * const userdata);
+void xmpp_timer_add(xmpp_ctx_t * const ctx, xmpp_timer_t * const timer,
+		    const uint64_t expires);
+void xmpp_timer_del(xmpp_ctx_t * const ctx, xmpp_timer_t * const timer);
+int xmpp_timer_pending(const xmpp_timer_t * const timer);
+uint64_t xmpp_ctx_now(const xmpp_ctx_t * const ctx);
+
 
 /* if the handler returns false it is removed */
 typedef int (*xmpp_handler)(xmpp_conn_t * const conn,
@@ -275,6 +314,27 @@ void xmpp_id_handler_delete(xmpp_conn_t * const conn,
 			    xmpp_handler handler,
 			    const char * const id);
 
+/* decodes children of received stanzas while they are parsed instead of
+ * building them into the stanza, see xmpp_conn_set_stream_decoder() */
+typedef struct {
+    /* called for each child of a toplevel stanza, returns nonzero to
+     * stream the child to start, end and characters */
+    int (*probe)(xmpp_stanza_t * const stanza, const char * const name,
+		 const char ** const attrs, void * const userdata);
+    void (*start)(void * const userdata, const char * const name,
+		  const char ** const attrs);
+    void (*end)(void * const userdata, const char * const name);
+    void (*characters)(void * const userdata, const char * const s,
+		       const int len);
+    /* called instead of the stanza handlers once a stanza with a streamed
+     * child ends, or with NULL if the stream was reset before */
+    void (*stanza)(xmpp_stanza_t * const stanza, void * const userdata);
+} xmpp_stream_decoder_t;
+
+void xmpp_conn_set_stream_decoder(xmpp_conn_t * const conn,
+				  const xmpp_stream_decoder_t * const decoder,
+				  void * const userdata);
+
 /*
 void xmpp_register_stanza_handler(conn, stanza, xmlns, type, handler)
 */
@@ -313,6 +373,9 @@ xmpp_stanza_t *xmpp_stanza_get_next(xmpp_stanza_t * const stanza);
 char *xmpp_stanza_get_attribute(xmpp_stanza_t * const stanza,
 				const char * const name);
 char * xmpp_stanza_get_ns(xmpp_stanza_t * const stanza);
+int xmpp_stanza_get_attribute_count(xmpp_stanza_t * const stanza);
+int xmpp_stanza_get_attributes(xmpp_stanza_t * const stanza,
+			       const char **attr, int attrlen);
 /* concatenate all child text nodes.  this function
  * returns a string that must be freed by the caller */
 
@@ -364,6 +427,9 @@ void xmpp_presence_new();
 
 /** event loop **/
 void xmpp_run_once(xmpp_ctx_t *ctx, const unsigned long  timeout);
+int xmpp_ctx_set_event_backend(xmpp_ctx_t * const ctx,
+			       const xmpp_event_backend_t backend);
+int xmpp_ctx_wakeup(xmpp_ctx_t * const ctx);
 void xmpp_run(xmpp_ctx_t *ctx);
 void xmpp_stop(xmpp_ctx_t *ctx);
 
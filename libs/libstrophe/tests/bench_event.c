@@ -0,0 +1,156 @@
+/* bench_event.c
+** libstrophe XMPP client library -- event loop backend benchmark
+**
+** Copyright (C) 2005-2009 Collecta, Inc.
+**
+**  This software is provided AS-IS with no warranty, either express
+**  or implied.
+**
+**  This software is distributed under license and may not be copied,
+**  modified or distributed except as expressly authorized under the
+**  terms of the license contained in the file LICENSE.txt in this
+**  distribution.
+*/
+
+/* Measures xmpp_run_once() iterations per second with 1, 100 and 1000
+ * connected connections of which only one receives traffic, once with
+ * the select() backend and once with the epoll() backend.  Connections
+ * are backed by loopback UDP sockets so that 1000 of them fit below
+ * FD_SETSIZE. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "strophe.h"
+#include "common.h"
+
+#define ITERATIONS 20000
+
+static void _conn_handler(xmpp_conn_t * const conn,
+			  const xmpp_conn_event_t status,
+			  const int error,
+			  xmpp_stream_error_t * const stream_error,
+			  void * const userdata)
+{
+    fprintf(stderr, "unexpected connection event %d (error %d)\n",
+	    status, error);
+    exit(1);
+}
+
+static sock_t _udp_socket(struct sockaddr_in *addr)
+{
+    socklen_t len = sizeof(*addr);
+    sock_t sock;
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) return -1;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(sock, (struct sockaddr *)addr, len) < 0 ||
+	getsockname(sock, (struct sockaddr *)addr, &len) < 0) {
+	close(sock);
+	return -1;
+    }
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+
+    return sock;
+}
+
+static double _now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int _bench(const xmpp_event_backend_t backend, const char *name,
+		  const int nconns, const int iterations)
+{
+    xmpp_ctx_t *ctx;
+    xmpp_conn_t **conns;
+    struct sockaddr_in addr, active;
+    sock_t sender;
+    double start, secs;
+    int i;
+
+    ctx = xmpp_ctx_new(NULL, NULL);
+    if (xmpp_ctx_set_event_backend(ctx, backend) != 0) {
+	printf("%-8s %5d conns: backend unavailable\n", name, nconns);
+	xmpp_ctx_free(ctx);
+	return 0;
+    }
+
+    conns = malloc(nconns * sizeof(*conns));
+    for (i = 0; i < nconns; i++) {
+	conns[i] = xmpp_conn_new(ctx);
+	conns[i]->sock = _udp_socket(&addr);
+	if (conns[i]->sock < 0) {
+	    perror("socket");
+	    return -1;
+	}
+	conns[i]->state = XMPP_STATE_CONNECTED;
+	conns[i]->conn_handler = _conn_handler;
+	if (i == 0) active = addr;
+    }
+    sender = _udp_socket(&addr);
+
+    start = _now();
+    for (i = 0; i < iterations; i++) {
+	/* whitespace is valid before the stream header */
+	sendto(sender, " ", 1, 0, (struct sockaddr *)&active, sizeof(active));
+	xmpp_run_once(ctx, 1);
+    }
+    secs = _now() - start;
+
+    printf("%-8s %5d conns: %8d iterations %8.3f s %10.0f iterations/s\n",
+	   name, nconns, iterations, secs, iterations / secs);
+
+    for (i = 0; i < nconns; i++) {
+	conns[i]->state = XMPP_STATE_DISCONNECTED;
+	event_conn_unwatch(conns[i]);
+	close(conns[i]->sock);
+	xmpp_conn_release(conns[i]);
+    }
+    close(sender);
+    free(conns);
+    xmpp_ctx_free(ctx);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const int sizes[] = { 1, 100, 1000 };
+    struct rlimit rl;
+    int iterations = ITERATIONS;
+    int i;
+
+    if (argc > 1) iterations = atoi(argv[1]);
+
+    /* make room for 1000 sockets */
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+	rl.rlim_cur = rl.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    xmpp_initialize();
+    for (i = 0; i < 3; i++) {
+	if (_bench(XMPP_EVENT_SELECT, "select", sizes[i], iterations) ||
+	    _bench(XMPP_EVENT_EPOLL, "epoll", sizes[i], iterations))
+	    return 1;
+    }
+    xmpp_shutdown();
+
+    return 0;
+}
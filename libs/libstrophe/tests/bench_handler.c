@@ -0,0 +1,189 @@
+/* bench_handler.c
+** libstrophe XMPP client library -- stanza handler dispatch benchmark
+**
+** Copyright (C) 2005-2009 Collecta, Inc.
+**
+**  This software is provided AS-IS with no warranty, either express
+**  or implied.
+**
+**  This software is distributed under license and may not be copied,
+**  modified or distributed except as expressly authorized under the
+**  terms of the license contained in the file LICENSE.txt in this
+**  distribution.
+*/
+
+/* Measures dispatching a pubsub event message to 10, 100 and 1000
+ * registered stanza handlers, most of which filter on other namespaces,
+ * names or types, the way libmio adds handlers.  Compares the linear scan
+ * handler_fire_stanza() used before, kept below, against the handler
+ * index.  Both must call the same handlers. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "strophe.h"
+#include "common.h"
+
+#define STANZAS 200000
+
+static unsigned long _calls;
+
+static int _handler(xmpp_conn_t * const conn, xmpp_stanza_t * const stanza,
+		    void * const userdata)
+{
+    _calls++;
+    return 1;
+}
+
+static double _now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* The previous handler list and its dispatch, kept for comparison */
+typedef struct _linear_t linear_t;
+struct _linear_t {
+    char *ns, *name, *type;
+    int enabled;
+    linear_t *next;
+};
+
+static void _linear_fire(xmpp_conn_t * const conn, linear_t * const list,
+			 xmpp_stanza_t * const stanza)
+{
+    linear_t *item;
+    char *ns, *name, *type;
+
+    ns = xmpp_stanza_get_ns(stanza);
+    name = xmpp_stanza_get_name(stanza);
+    type = xmpp_stanza_get_type(stanza);
+
+    for (item = list; item; item = item->next)
+	item->enabled = 1;
+
+    for (item = list; item; item = item->next) {
+	if (!item->enabled) continue;
+	if ((!item->ns || (ns && strcmp(ns, item->ns) == 0) ||
+	     xmpp_stanza_get_child_by_ns(stanza, item->ns)) &&
+	    (!item->name || (name && strcmp(name, item->name) == 0)) &&
+	    (!item->type || (type && strcmp(type, item->type) == 0)))
+	    _handler(conn, stanza, NULL);
+    }
+}
+
+/* filters of the i-th handler, every 100th one matches the event */
+static void _filters(const int i, char * const ns, const size_t size,
+		     const char **name, const char **type)
+{
+    static const char *names[] = { "message", "iq", "presence" };
+    static const char *types[] = { NULL, "result", "error", "set" };
+
+    if (i % 100 == 0)
+	snprintf(ns, size, "http://jabber.org/protocol/pubsub#event");
+    else
+	snprintf(ns, size, "urn:xmpp:bench:%d", i);
+    *name = names[i % 3];
+    *type = i % 100 == 0 ? NULL : types[i % 4];
+}
+
+static xmpp_stanza_t *_event(xmpp_ctx_t * const ctx)
+{
+    xmpp_stanza_t *msg, *event, *items;
+
+    msg = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(msg, "message");
+    xmpp_stanza_set_attribute(msg, "from", "pubsub.example.com");
+    event = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(event, "event");
+    xmpp_stanza_set_ns(event, "http://jabber.org/protocol/pubsub#event");
+    items = xmpp_stanza_new(ctx);
+    xmpp_stanza_set_name(items, "items");
+    xmpp_stanza_set_attribute(items, "node", "3f2504e0-4f89-11d3-9a0c");
+    xmpp_stanza_add_child(event, items);
+    xmpp_stanza_release(items);
+    xmpp_stanza_add_child(msg, event);
+    xmpp_stanza_release(event);
+
+    return msg;
+}
+
+static int _bench(xmpp_ctx_t * const ctx, const int count)
+{
+    xmpp_conn_t *conn;
+    xmpp_stanza_t *stanza;
+    linear_t *list = NULL, **tail = &list, *item;
+    const char *name, *type;
+    char ns[64];
+    unsigned long linear_calls, indexed_calls;
+    double t0, t_linear, t_indexed;
+    int i;
+
+    conn = xmpp_conn_new(ctx);
+    if (!conn) return 1;
+    conn->authenticated = 1;
+
+    for (i = 0; i < count; i++) {
+	_filters(i, ns, sizeof(ns), &name, &type);
+	xmpp_handler_add(conn, _handler, ns, name, type, (void *)(long)i);
+
+	item = calloc(1, sizeof(*item));
+	item->ns = strdup(ns);
+	item->name = strdup(name);
+	item->type = type ? strdup(type) : NULL;
+	*tail = item;
+	tail = &item->next;
+    }
+    stanza = _event(ctx);
+
+    _calls = 0;
+    t0 = _now();
+    for (i = 0; i < STANZAS; i++)
+	_linear_fire(conn, list, stanza);
+    t_linear = _now() - t0;
+    linear_calls = _calls;
+
+    _calls = 0;
+    t0 = _now();
+    for (i = 0; i < STANZAS; i++)
+	handler_fire_stanza(conn, stanza);
+    t_indexed = _now() - t0;
+    indexed_calls = _calls;
+
+    printf("%5d handlers: linear %8.1f ns  indexed %6.1f ns  "
+	   "(%lu / %lu calls)\n", count,
+	   t_linear * 1e9 / STANZAS, t_indexed * 1e9 / STANZAS,
+	   linear_calls, indexed_calls);
+
+    while ((item = list) != NULL) {
+	list = item->next;
+	free(item->ns);
+	free(item->name);
+	free(item->type);
+	free(item);
+    }
+    xmpp_stanza_release(stanza);
+    xmpp_conn_release(conn);
+
+    return linear_calls != indexed_calls;
+}
+
+int main(int argc, char **argv)
+{
+    xmpp_ctx_t *ctx;
+    int counts[] = { 10, 100, 1000 };
+    int i, ret = 0;
+
+    xmpp_initialize();
+    ctx = xmpp_ctx_new(NULL, NULL);
+    for (i = 0; i < 3; i++)
+	ret |= _bench(ctx, counts[i]);
+    xmpp_ctx_free(ctx);
+    xmpp_shutdown();
+
+    return ret;
+}
@@ -0,0 +1,108 @@
+/* bench_timer.c
+** libstrophe XMPP client library -- timer wheel benchmark
+**
+** Copyright (C) 2005-2009 Collecta, Inc.
+**
+**  This software is provided AS-IS with no warranty, either express
+**  or implied.
+**
+**  This software is distributed under license and may not be copied,
+**  modified or distributed except as expressly authorized under the
+**  terms of the license contained in the file LICENSE.txt in this
+**  distribution.
+*/
+
+/* Measures adding, cancelling and firing 10000 to 1000000 timers with
+ * deadlines spread over the next 30 s, the way request deadlines are used.
+ * Half of the timers are cancelled before they fire, as if the request
+ * had been answered.  Time is simulated, so every timer must fire exactly
+ * at its expiry. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "strophe.h"
+#include "common.h"
+
+#define SPREAD 30000
+
+static uint64_t _fired;
+static uint64_t _late;
+static uint64_t _tick;
+
+static void _timer_cb(xmpp_ctx_t * const ctx, xmpp_timer_t * const timer)
+{
+    _fired++;
+    if (timer->expires != _tick) _late++;
+}
+
+static double _now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int _bench(const int count)
+{
+    xmpp_ctx_t *ctx;
+    xmpp_timer_t *timers;
+    uint64_t start, expected;
+    double t0, t_add, t_del, t_run;
+    int i, ret;
+
+    ctx = xmpp_ctx_new(NULL, NULL);
+    timers = malloc(count * sizeof(*timers));
+    if (!ctx || !timers) return 1;
+    start = ctx->timers.next;
+    srand(count);
+
+    t0 = _now();
+    for (i = 0; i < count; i++) {
+	xmpp_timer_init(&timers[i], _timer_cb, NULL);
+	xmpp_timer_add(ctx, &timers[i], start + 1 + rand() % SPREAD);
+    }
+    t_add = _now() - t0;
+
+    t0 = _now();
+    for (i = 0; i < count; i += 2)
+	xmpp_timer_del(ctx, &timers[i]);
+    t_del = _now() - t0;
+
+    /* step through the spread one millisecond at a time like a busy
+     * event loop would */
+    _fired = _late = 0;
+    t0 = _now();
+    for (_tick = start; _tick <= start + SPREAD; _tick++)
+	timer_wheel_run(ctx, _tick);
+    t_run = _now() - t0;
+
+    expected = count / 2;
+    printf("%8d timers: add %6.1f ns  del %6.1f ns  fire %6.1f ns  "
+	   "(%llu fired, %llu late)\n", count,
+	   t_add * 1e9 / count, t_del * 1e9 / (count - expected),
+	   t_run * 1e9 / expected,
+	   (unsigned long long)_fired, (unsigned long long)_late);
+
+    ret = _fired != expected || _late != 0 ||
+	timer_wheel_next(&ctx->timers, _tick) != (uint64_t)-1;
+    free(timers);
+    xmpp_ctx_free(ctx);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int counts[] = { 10000, 100000, 1000000 };
+    int i, ret = 0;
+
+    xmpp_initialize();
+    for (i = 0; i < 3; i++)
+	ret |= _bench(counts[i]);
+    xmpp_shutdown();
+
+    return ret;
+}
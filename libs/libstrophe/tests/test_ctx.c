@@ -76,6 +76,14 @@ int main(int argc, char **argv)
     ctx = xmpp_ctx_new(&mymem, &mylog);
     xmpp_debug(ctx, "test", "hello");
 
+    /* messages below the context's log level never reach the handler */
+    xmpp_ctx_set_log_level(ctx, XMPP_LEVEL_INFO);
+    xmpp_debug(ctx, "test", "hello");
+    if (log_called != 1) {
+	xmpp_ctx_free(ctx);
+	return 1;
+    }
+
     testptr1 = xmpp_alloc(ctx, 1024);
     if (testptr1 == NULL) {
 	xmpp_ctx_free(ctx);
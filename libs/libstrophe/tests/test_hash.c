@@ -12,6 +12,7 @@
 **  distribution.
 */
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -32,6 +33,132 @@ const char *values[] = {
   "wuzzle", "mug", "canonical", "rosebud", "lottery"
 };
 
+static double _now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* uuid style ids like those of requests in flight */
+static void _make_id(char * const buf, const int i)
+{
+    sprintf(buf, "%08x-%04x-4%03x-a%03x-%012x", i * 2654435761u,
+	    i & 0xffff, i & 0xfff, (i >> 12) & 0xfff, i);
+}
+
+static int _count_key(const char * const key, void * const value,
+		      void * const userdata)
+{
+    (*(int *)userdata)++;
+    return 0;
+}
+
+/* grow a small table to TESTSIZE random keys, then drop every other one */
+static int _test_grow(xmpp_ctx_t *ctx)
+{
+    hash_t *table;
+    char key[TESTSIZE][16];
+    int i, count;
+
+    table = hash_new(ctx, 2, NULL);
+    if (table == NULL) return 1;
+
+    for (i = 0; i < TESTSIZE; i++) {
+	sprintf(key[i], "%d.%d", i, rand());
+	if (hash_add(table, key[i], key[i])) return 1;
+    }
+    if (hash_num_keys(table) != TESTSIZE) return 1;
+    for (i = 0; i < TESTSIZE; i++)
+	if (hash_get(table, key[i]) != key[i]) return 1;
+
+    for (i = 0; i < TESTSIZE; i += 2)
+	if (hash_drop(table, key[i])) return 1;
+    for (i = 0; i < TESTSIZE; i++)
+	if (hash_get(table, key[i]) != (i % 2 ? key[i] : NULL)) return 1;
+    if (hash_drop(table, key[0]) != -1) return 1;
+
+    count = 0;
+    hash_walk(table, _count_key, &count);
+    if (count != TESTSIZE / 2 || hash_num_keys(table) != count) return 1;
+
+    hash_release(table);
+    return 0;
+}
+
+/* throughput of stanza attribute sized tables and of id tables holding
+ * 1000 to 100000 ids */
+static int _bench(xmpp_ctx_t *ctx)
+{
+    static const char *attrs[] = {
+	"xmlns", "type", "id", "from", "to", "name", "value", "timestamp"
+    };
+    const int sizes[] = { 1000, 10000, 100000 };
+    const int rounds = 200000;
+    hash_t *table;
+    char (*ids)[40], (*misses)[40];
+    double t0, t_add, t_get, t_miss, t_drop;
+    int i, j, n;
+
+    t0 = _now();
+    for (i = 0; i < rounds; i++) {
+	table = hash_new(ctx, 8, NULL);
+	if (table == NULL) return 1;
+	for (j = 0; j < 8; j++)
+	    hash_add(table, attrs[j], (void *)attrs[j]);
+	for (j = 0; j < 8; j++)
+	    if (hash_get(table, attrs[j]) != attrs[j]) return 1;
+	hash_release(table);
+    }
+    t_add = _now() - t0;
+    printf("attributes: %6.1f ns per table of 8 (new, add, get, release)\n",
+	   t_add * 1e9 / rounds);
+
+    for (i = 0; i < 3; i++) {
+	n = sizes[i];
+	ids = malloc(n * sizeof(*ids));
+	misses = malloc(n * sizeof(*misses));
+	table = hash_new(ctx, 32, NULL);
+	if (ids == NULL || misses == NULL || table == NULL) return 1;
+	for (j = 0; j < n; j++) {
+	    _make_id(ids[j], j);
+	    _make_id(misses[j], n + j);
+	}
+
+	t0 = _now();
+	for (j = 0; j < n; j++)
+	    hash_add(table, ids[j], ids[j]);
+	t_add = _now() - t0;
+
+	t0 = _now();
+	for (j = 0; j < n; j++)
+	    if (hash_get(table, ids[j]) != ids[j]) return 1;
+	t_get = _now() - t0;
+
+	t0 = _now();
+	for (j = 0; j < n; j++)
+	    if (hash_get(table, misses[j]) != NULL) return 1;
+	t_miss = _now() - t0;
+
+	t0 = _now();
+	for (j = 0; j < n; j++)
+	    hash_drop(table, ids[j]);
+	t_drop = _now() - t0;
+
+	printf("%6d ids: add %6.1f ns  get %6.1f ns  miss %6.1f ns  "
+	       "drop %6.1f ns\n", n, t_add * 1e9 / n, t_get * 1e9 / n,
+	       t_miss * 1e9 / n, t_drop * 1e9 / n);
+
+	if (hash_num_keys(table) != 0) return 1;
+	hash_release(table);
+	free(ids);
+	free(misses);
+    }
+
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     xmpp_ctx_t *ctx;
@@ -134,6 +261,12 @@ int main(int argc, char **argv)
     /* release our clone */
     hash_release(clone);
 
+    /* test growing and dropping many keys */
+    if (_test_grow(ctx)) return 1;
+
+    /* run throughput benchmarks */
+    if (_bench(ctx)) return 1;
+
     /* release our library context */
     xmpp_ctx_free(ctx);
 
@@ -23,11 +23,16 @@
 #ifndef _MIO_H_
 #define _MIO_H_
 #include "mio_connection.h"
+#include "mio_arena.h"
+#include "mio_template.h"
+#include "mio_publish_stream.h"
 #include "mio_packet.h"
 #include "mio_user.h"
 #include "mio_error.h"
 #include "mio_node.h"
 #include "mio_transducer.h"
+#include "mio_coalesce.h"
+#include "mio_deadband.h"
 #include "mio_meta.h"
 #include "mio_affiliations.h"
 #include "mio_collection.h"
@@ -36,4 +41,7 @@
 #include "mio_reference.h"
 #include "mio_schedule.h"
 #include "mio_handlers.h"
+#include "mio_workers.h"
+#include "mio_pubsub_lanes.h"
+#include "mio_pubsub_routes.h"
 #endif
@@ -209,15 +209,51 @@ void _mio_affiliation_add(mio_packet_t *pkt, char *affiliation,
 }
 
 
-int mio_subscribe(mio_conn_t * conn, const char *node,
-                  mio_response_t * response) {
+static int _mio_subscribe(mio_conn_t * conn, const char *node,
+                          mio_response_t * response, mio_completion completion,
+                          void *userdata, unsigned int deadline_ms) {
 
     mio_stanza_t *iq = NULL;
     xmpp_stanza_t *subscribe = NULL;
     int err;
+
+// Check if connection is active
+    if (!conn->xmpp_conn->authenticated) {
+        mio_error(
+            "Cannot process subscribe request since not connected to XMPP server");
+        return MIO_ERROR_DISCONNECTED;
+    }
+
+    iq = mio_pubsub_set_stanza_new(conn, node);
+
+// Create a new subscribe stanza
+    subscribe = xmpp_stanza_new(conn->xmpp_conn->ctx);
+    xmpp_stanza_set_name(subscribe, "subscribe");
+    xmpp_stanza_set_attribute(subscribe, "node", node);
+    xmpp_stanza_set_attribute(subscribe, "jid", conn->xmpp_conn->jid);
+
+// Build xmpp message
+    xmpp_stanza_add_child(iq->xmpp_stanza->children, subscribe);
+
+// Send out the stanza
+    err = _mio_send_blocking_or_async(conn, iq,
+                                      (mio_handler) mio_handler_subscribe,
+                                      response, completion, userdata,
+                                      deadline_ms);
+
+// Release the stanzas
+    xmpp_stanza_release(subscribe);
+    mio_stanza_free(iq);
+
+    return err;
+}
+
+int mio_subscribe(mio_conn_t * conn, const char *node,
+                  mio_response_t * response) {
+    int err;
     mio_packet_t *pkt;
     mio_subscription_t *sub;
-    mio_response_t *subscriptions = mio_response_new();
+    mio_response_t *subscriptions;
 
 // Check if connection is active
     if (!conn->xmpp_conn->authenticated) {
@@ -226,6 +262,7 @@ int mio_subscribe(mio_conn_t * conn, const char *node,
         return MIO_ERROR_DISCONNECTED;
     }
 
+    subscriptions = mio_response_new();
     err = mio_subscriptions_query(conn, NULL, subscriptions);
     if (subscriptions->response_type != MIO_RESPONSE_ERROR) {
         pkt = (mio_packet_t*) subscriptions->response;
@@ -249,39 +286,35 @@ int mio_subscribe(mio_conn_t * conn, const char *node,
         return err;
     }
 
-    iq = mio_pubsub_set_stanza_new(conn, node);
-
-// Create a new subscribe stanza
-    subscribe = xmpp_stanza_new(conn->xmpp_conn->ctx);
-    xmpp_stanza_set_name(subscribe, "subscribe");
-    xmpp_stanza_set_attribute(subscribe, "node", node);
-    xmpp_stanza_set_attribute(subscribe, "jid", conn->xmpp_conn->jid);
-
-// Build xmpp message
-    xmpp_stanza_add_child(iq->xmpp_stanza->children, subscribe);
-
-// Send out the stanza
-    err = mio_send_blocking(conn, iq, (mio_handler) mio_handler_subscribe,
-                            response);
-
-// Release the stanzas
-    xmpp_stanza_release(subscribe);
-    mio_stanza_free(iq);
-
+    err = _mio_subscribe(conn, node, response, NULL, NULL, 0);
     mio_response_free(subscriptions);
     return err;
 }
 
-/** Queries for the subscribers of the event node. Subject to the access
- *      rights of the logged in user.
+/** Subscribes to an event node and calls completion once the response has been
+ *      processed, the deadline passed or the connection dropped, see
+ *      mio_subscribe(). Unlike mio_subscribe(), it does not query the existing
+ *      subscriptions first, so subscribing to a node twice is left to the
+ *      server.
  *
  * @param conn Active MIO connection.
- * @param node The event node uuid to query for subscription information.
- * @param response The response from the XMPP server. Contains subscription
- *      information
+ * @param node The event node id.
+ * @param completion Called with the parsed response, which the completion has to free.
+ * @param userdata Passed to completion.
+ * @param deadline_ms Time in ms after which the request completes with MIO_ERROR_TIMEOUT, 0 for the default.
+ *
+ * @returns MIO_OK if the request was sent, otherwise an error, in which case completion is never called.
  * */
-int mio_subscriptions_query(mio_conn_t *conn, const char *node,
-                            mio_response_t * response) {
+int mio_subscribe_async(mio_conn_t * conn, const char *node,
+                        mio_completion completion, void *userdata,
+                        unsigned int deadline_ms) {
+    return _mio_subscribe(conn, node, NULL, completion, userdata, deadline_ms);
+}
+
+static int _mio_subscriptions_query(mio_conn_t *conn, const char *node,
+                                    mio_response_t * response,
+                                    mio_completion completion, void *userdata,
+                                    unsigned int deadline_ms) {
 
     mio_stanza_t *iq = NULL;
     xmpp_stanza_t *subscriptions = NULL;
@@ -311,8 +344,10 @@ int mio_subscriptions_query(mio_conn_t *conn, const char *node,
     xmpp_stanza_add_child(iq->xmpp_stanza->children, subscriptions);
 
 // Send out the stanza
-    err = mio_send_blocking(conn, iq,
-                            (mio_handler) mio_handler_subscriptions_query, response);
+    err = _mio_send_blocking_or_async(conn, iq,
+                                      (mio_handler) mio_handler_subscriptions_query,
+                                      response, completion, userdata,
+                                      deadline_ms);
 
 // Release unneeded stanzas
     xmpp_stanza_release(subscriptions);
@@ -321,8 +356,44 @@ int mio_subscriptions_query(mio_conn_t *conn, const char *node,
     return err;
 }
 
-int mio_acl_affiliations_query(mio_conn_t *conn, const char *node,
-                               mio_response_t * response) {
+/** Queries for the subscribers of the event node. Subject to the access
+ *      rights of the logged in user.
+ *
+ * @param conn Active MIO connection.
+ * @param node The event node uuid to query for subscription information.
+ * @param response The response from the XMPP server. Contains subscription
+ *      information
+ * */
+int mio_subscriptions_query(mio_conn_t *conn, const char *node,
+                            mio_response_t * response) {
+    return _mio_subscriptions_query(conn, node, response, NULL, NULL, 0);
+}
+
+/** Queries for the subscriptions of the user or the subscribers of an event
+ *      node and calls completion once the response has been processed, the
+ *      deadline passed or the connection dropped, see
+ *      mio_subscriptions_query().
+ *
+ * @param conn Active MIO connection.
+ * @param node The event node uuid to query for subscription information.
+ * @param completion Called with the parsed response, which the completion has to free.
+ * @param userdata Passed to completion.
+ * @param deadline_ms Time in ms after which the request completes with MIO_ERROR_TIMEOUT, 0 for the default.
+ *
+ * @returns MIO_OK if the request was sent, otherwise an error, in which case completion is never called.
+ * */
+int mio_subscriptions_query_async(mio_conn_t *conn, const char *node,
+                                  mio_completion completion, void *userdata,
+                                  unsigned int deadline_ms) {
+    return _mio_subscriptions_query(conn, node, NULL, completion, userdata,
+                                    deadline_ms);
+}
+
+static int _mio_acl_affiliations_query(mio_conn_t *conn, const char *node,
+                                       mio_response_t * response,
+                                       mio_completion completion,
+                                       void *userdata,
+                                       unsigned int deadline_ms) {
 
     mio_stanza_t *iq = NULL;
     xmpp_stanza_t *affiliations = NULL;
@@ -356,8 +427,10 @@ int mio_acl_affiliations_query(mio_conn_t *conn, const char *node,
     xmpp_stanza_add_child(iq->xmpp_stanza->children, affiliations);
 
 // Send out the stanza
-    err = mio_send_blocking(conn, iq,
-                            (mio_handler) mio_handler_acl_affiliations_query, response);
+    err = _mio_send_blocking_or_async(conn, iq,
+                                      (mio_handler) mio_handler_acl_affiliations_query,
+                                      response, completion, userdata,
+                                      deadline_ms);
 
 // Release unneeded stanzas
     xmpp_stanza_release(affiliations);
@@ -366,18 +439,36 @@ int mio_acl_affiliations_query(mio_conn_t *conn, const char *node,
     return err;
 }
 
-/** Sets an event node's affiliation with a specific jid.
+int mio_acl_affiliations_query(mio_conn_t *conn, const char *node,
+                               mio_response_t * response) {
+    return _mio_acl_affiliations_query(conn, node, response, NULL, NULL, 0);
+}
+
+/** Queries for the affiliations of the user or of an event node and calls
+ *      completion once the response has been processed, the deadline passed or
+ *      the connection dropped, see mio_acl_affiliations_query().
  *
  * @param conn Active MIO connection.
- * @param node Event node's UUID which will have its affiliation modified.
- * @param jid The user's jid whose affiliation with node is to change.
- * @param type The type of affiliation the jid should have with the event node
- * @param response [out] Where the response to the affiliation set request is stored.
+ * @param node The event node id.
+ * @param completion Called with the parsed response, which the completion has to free.
+ * @param userdata Passed to completion.
+ * @param deadline_ms Time in ms after which the request completes with MIO_ERROR_TIMEOUT, 0 for the default.
  *
- * @returns SOX_OK on success, MIO_ERROR_DISCONNECTED on disconnection.
+ * @returns MIO_OK if the request was sent, otherwise an error, in which case completion is never called.
  * */
-int mio_acl_affiliation_set(mio_conn_t *conn, const char *node, const char *jid,
-                            mio_affiliation_type_t type, mio_response_t * response) {
+int mio_acl_affiliations_query_async(mio_conn_t *conn, const char *node,
+                                     mio_completion completion, void *userdata,
+                                     unsigned int deadline_ms) {
+    return _mio_acl_affiliations_query(conn, node, NULL, completion, userdata,
+                                       deadline_ms);
+}
+
+static int _mio_acl_affiliation_set(mio_conn_t *conn, const char *node,
+                                    const char *jid,
+                                    mio_affiliation_type_t type,
+                                    mio_response_t * response,
+                                    mio_completion completion, void *userdata,
+                                    unsigned int deadline_ms) {
 
     mio_stanza_t *iq = NULL;
     xmpp_stanza_t *affiliations = NULL, *affiliation = NULL;
@@ -434,8 +525,9 @@ int mio_acl_affiliation_set(mio_conn_t *conn, const char *node, const char *jid,
     xmpp_stanza_add_child(iq->xmpp_stanza->children, affiliations);
 
 // Send out the stanza
-    err = mio_send_blocking(conn, iq, (mio_handler) mio_handler_error,
-                            response);
+    err = _mio_send_blocking_or_async(conn, iq, (mio_handler) mio_handler_error,
+                                      response, completion, userdata,
+                                      deadline_ms);
 
 // Release unneeded stanzas
     xmpp_stanza_release(affiliations);
@@ -445,17 +537,48 @@ int mio_acl_affiliation_set(mio_conn_t *conn, const char *node, const char *jid,
     return err;
 }
 
-/** Unsubscribes a user from a event node. Can usnusbscribe
+/** Sets an event node's affiliation with a specific jid.
  *
  * @param conn Active MIO connection.
- * @param node Event node id to unsubscribe from.
- * @param sub_id Optional subscription id.
- * @param response Response to unsubscribe request.
+ * @param node Event node's UUID which will have its affiliation modified.
+ * @param jid The user's jid whose affiliation with node is to change.
+ * @param type The type of affiliation the jid should have with the event node
+ * @param response [out] Where the response to the affiliation set request is stored.
  *
- * @returns MIO_OK on success, MIO_ERROR_DISCONNECTED when conn disconnected.
+ * @returns SOX_OK on success, MIO_ERROR_DISCONNECTED on disconnection.
  * */
-int mio_unsubscribe(mio_conn_t * conn, const char *node, const char *sub_id,
-                    mio_response_t * response) {
+int mio_acl_affiliation_set(mio_conn_t *conn, const char *node, const char *jid,
+                            mio_affiliation_type_t type, mio_response_t * response) {
+    return _mio_acl_affiliation_set(conn, node, jid, type, response, NULL, NULL,
+                                    0);
+}
+
+/** Sets an event node's affiliation with a specific jid and calls completion
+ *      once the response has been processed, the deadline passed or the
+ *      connection dropped, see mio_acl_affiliation_set().
+ *
+ * @param conn Active MIO connection.
+ * @param node Event node's UUID which will have its affiliation modified.
+ * @param jid The user's jid whose affiliation with node is to change.
+ * @param type The type of affiliation the jid should have with the event node
+ * @param completion Called with the parsed response, which the completion has to free.
+ * @param userdata Passed to completion.
+ * @param deadline_ms Time in ms after which the request completes with MIO_ERROR_TIMEOUT, 0 for the default.
+ *
+ * @returns MIO_OK if the request was sent, otherwise an error, in which case completion is never called.
+ * */
+int mio_acl_affiliation_set_async(mio_conn_t *conn, const char *node,
+                                  const char *jid, mio_affiliation_type_t type,
+                                  mio_completion completion, void *userdata,
+                                  unsigned int deadline_ms) {
+    return _mio_acl_affiliation_set(conn, node, jid, type, NULL, completion,
+                                    userdata, deadline_ms);
+}
+
+static int _mio_unsubscribe(mio_conn_t * conn, const char *node,
+                            const char *sub_id, mio_response_t * response,
+                            mio_completion completion, void *userdata,
+                            unsigned int deadline_ms) {
 
     mio_stanza_t *iq = NULL;
     xmpp_stanza_t *unsubscribe = NULL;
@@ -486,8 +609,9 @@ int mio_unsubscribe(mio_conn_t * conn, const char *node, const char *sub_id,
     xmpp_stanza_add_child(iq->xmpp_stanza->children, unsubscribe);
 
 // Send out the stanza
-    err = mio_send_blocking(conn, iq, (mio_handler) mio_handler_error,
-                            response);
+    err = _mio_send_blocking_or_async(conn, iq, (mio_handler) mio_handler_error,
+                                      response, completion, userdata,
+                                      deadline_ms);
 
 // Release the stanzas
     xmpp_stanza_release(unsubscribe);
@@ -495,6 +619,40 @@ int mio_unsubscribe(mio_conn_t * conn, const char *node, const char *sub_id,
 
     return err;
 }
+
+/** Unsubscribes a user from a event node. Can usnusbscribe
+ *
+ * @param conn Active MIO connection.
+ * @param node Event node id to unsubscribe from.
+ * @param sub_id Optional subscription id.
+ * @param response Response to unsubscribe request.
+ *
+ * @returns MIO_OK on success, MIO_ERROR_DISCONNECTED when conn disconnected.
+ * */
+int mio_unsubscribe(mio_conn_t * conn, const char *node, const char *sub_id,
+                    mio_response_t * response) {
+    return _mio_unsubscribe(conn, node, sub_id, response, NULL, NULL, 0);
+}
+
+/** Unsubscribes from an event node and calls completion once the response has
+ *      been processed, the deadline passed or the connection dropped, see
+ *      mio_unsubscribe().
+ *
+ * @param conn Active MIO connection.
+ * @param node Event node id to unsubscribe from.
+ * @param sub_id Optional subscription id.
+ * @param completion Called with the parsed response, which the completion has to free.
+ * @param userdata Passed to completion.
+ * @param deadline_ms Time in ms after which the request completes with MIO_ERROR_TIMEOUT, 0 for the default.
+ *
+ * @returns MIO_OK if the request was sent, otherwise an error, in which case completion is never called.
+ * */
+int mio_unsubscribe_async(mio_conn_t * conn, const char *node,
+                          const char *sub_id, mio_completion completion,
+                          void *userdata, unsigned int deadline_ms) {
+    return _mio_unsubscribe(conn, node, sub_id, NULL, completion, userdata,
+                            deadline_ms);
+}
 int mio_handler_subscribe(mio_conn_t * const conn, mio_stanza_t * const stanza,
                           mio_response_t *response, void *userdata) {
     mio_stanza_t *stanza_copy;
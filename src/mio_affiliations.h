@@ -70,14 +70,30 @@ void mio_affiliation_add(mio_packet_t *pkt, char *affiliation,
 
 int mio_subscribe(mio_conn_t * conn, const char *node,
                   mio_response_t * response);
+int mio_subscribe_async(mio_conn_t * conn, const char *node,
+                        mio_completion completion, void *userdata,
+                        unsigned int deadline_ms);
 // XMPP functions
 void mio_subscription_add(mio_packet_t *pkt, char *subscription, char *sub_id);
 int mio_subscriptions_query(mio_conn_t *conn, const char *node,
                             mio_response_t * response);
+int mio_subscriptions_query_async(mio_conn_t *conn, const char *node,
+                                  mio_completion completion, void *userdata,
+                                  unsigned int deadline_ms);
 int mio_acl_affiliation_set(mio_conn_t *conn, const char *node, const char *jid,
                             mio_affiliation_type_t type, mio_response_t * response);
+int mio_acl_affiliation_set_async(mio_conn_t *conn, const char *node,
+                                  const char *jid, mio_affiliation_type_t type,
+                                  mio_completion completion, void *userdata,
+                                  unsigned int deadline_ms);
 int mio_acl_affiliations_query(mio_conn_t *conn, const char *node,
                                mio_response_t * response);
+int mio_acl_affiliations_query_async(mio_conn_t *conn, const char *node,
+                                     mio_completion completion, void *userdata,
+                                     unsigned int deadline_ms);
 int mio_unsubscribe(mio_conn_t * conn, const char *node, const char *sub_id,
                     mio_response_t * response);
+int mio_unsubscribe_async(mio_conn_t * conn, const char *node,
+                          const char *sub_id, mio_completion completion,
+                          void *userdata, unsigned int deadline_ms);
 #endif /* defined(____mio_affiliations__) */
@@ -0,0 +1,153 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+
+
+#include <string.h>
+#include <stdlib.h>
+#include "mio_arena.h"
+
+#define _MIO_ARENA_ROUND(size) \
+    (((size) + MIO_ARENA_ALIGN - 1) & ~((size_t) MIO_ARENA_ALIGN - 1))
+#define _MIO_ARENA_HEADER _MIO_ARENA_ROUND(sizeof(mio_arena_chunk_t))
+
+/**
+ * @ingroup Internal
+ * Allocates an empty arena. The first chunk is allocated by the first call
+ * to mio_arena_alloc().
+ *
+ * @returns A newly allocated arena to be freed with mio_arena_free(), or NULL on an error.
+ */
+mio_arena_t *mio_arena_new() {
+    mio_arena_t *arena = malloc(sizeof(mio_arena_t));
+
+    if (arena != NULL)
+        memset(arena, 0, sizeof(mio_arena_t));
+    return arena;
+}
+
+/**
+ * @ingroup Internal
+ * Frees an arena and everything allocated from it.
+ *
+ * @param arena A pointer to the arena to be freed, can be NULL.
+ */
+void mio_arena_free(mio_arena_t *arena) {
+    mio_arena_chunk_t *chunk, *next;
+
+    if (arena == NULL)
+        return;
+    for (chunk = arena->head; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    free(arena);
+}
+
+/**
+ * @ingroup Internal
+ * Releases everything allocated from an arena at once. The arena keeps its
+ * chunks for the allocations that follow.
+ *
+ * @param arena A pointer to the arena to be reset.
+ */
+void mio_arena_reset(mio_arena_t *arena) {
+    arena->curr = arena->head;
+    if (arena->curr != NULL)
+        arena->curr->used = 0;
+}
+
+/**
+ * @ingroup Internal
+ * Allocates memory from an arena. The memory is aligned to MIO_ARENA_ALIGN
+ * and lives until the arena is reset or freed.
+ *
+ * @param arena A pointer to an arena.
+ * @param size The number of bytes to allocate.
+ * @returns A pointer to the memory, or NULL if a new chunk could not be allocated.
+ */
+void *mio_arena_alloc(mio_arena_t *arena, size_t size) {
+    mio_arena_chunk_t *chunk = arena->curr, *last = NULL;
+    void *mem;
+
+    size = _MIO_ARENA_ROUND(size);
+    // Chunks after the current one were filled before the last reset and
+    // are reused from the start
+    while (chunk != NULL && chunk->used + size > chunk->size) {
+        last = chunk;
+        chunk = chunk->next;
+        if (chunk != NULL)
+            chunk->used = 0;
+    }
+
+    if (chunk == NULL) {
+        chunk = malloc(_MIO_ARENA_HEADER + (size > MIO_ARENA_CHUNK_SIZE ?
+                                            size : MIO_ARENA_CHUNK_SIZE));
+        if (chunk == NULL)
+            return NULL;
+        chunk->next = NULL;
+        chunk->size = size > MIO_ARENA_CHUNK_SIZE ? size : MIO_ARENA_CHUNK_SIZE;
+        chunk->used = 0;
+        if (last != NULL)
+            last->next = chunk;
+        else if (arena->head == NULL)
+            arena->head = chunk;
+    }
+
+    arena->curr = chunk;
+    mem = (char*) chunk + _MIO_ARENA_HEADER + chunk->used;
+    chunk->used += size;
+    return mem;
+}
+
+/**
+ * @ingroup Internal
+ * Allocates zeroed memory from an arena, see mio_arena_alloc().
+ *
+ * @param arena A pointer to an arena.
+ * @param size The number of bytes to allocate.
+ * @returns A pointer to the zeroed memory, or NULL on an error.
+ */
+void *mio_arena_calloc(mio_arena_t *arena, size_t size) {
+    void *mem = mio_arena_alloc(arena, size);
+
+    if (mem != NULL)
+        memset(mem, 0, size);
+    return mem;
+}
+
+/**
+ * @ingroup Internal
+ * Copies a string into an arena.
+ *
+ * @param arena A pointer to an arena.
+ * @param s The string to copy.
+ * @returns A pointer to the copy, or NULL on an error.
+ */
+char *mio_arena_strdup(mio_arena_t *arena, const char *s) {
+    size_t len = strlen(s) + 1;
+    char *copy = mio_arena_alloc(arena, len);
+
+    if (copy != NULL)
+        memcpy(copy, s, len);
+    return copy;
+}
@@ -0,0 +1,58 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+
+#ifndef ____mio_arena__
+#define ____mio_arena__
+
+#include <stddef.h>
+#include <mio.h>
+
+// Size of the chunks an arena grows by, larger allocations get a chunk of
+// their own
+#define MIO_ARENA_CHUNK_SIZE 2048
+#define MIO_ARENA_ALIGN 8
+
+typedef struct mio_arena_chunk mio_arena_chunk_t;
+
+struct mio_arena_chunk {
+    mio_arena_chunk_t *next;
+    size_t size; // Usable bytes after the header
+    size_t used;
+};
+
+// Bump allocator whose allocations are all released at once by
+// mio_arena_reset(). The chunks are kept, so an arena that is reset and
+// refilled with data of the same shape does not allocate again.
+struct mio_arena {
+    mio_arena_chunk_t *head;
+    mio_arena_chunk_t *curr; // Chunk allocations are currently served from
+};
+
+mio_arena_t *mio_arena_new();
+void mio_arena_free(mio_arena_t *arena);
+void mio_arena_reset(mio_arena_t *arena);
+void *mio_arena_alloc(mio_arena_t *arena, size_t size);
+void *mio_arena_calloc(mio_arena_t *arena, size_t size);
+char *mio_arena_strdup(mio_arena_t *arena, const char *s);
+
+#endif /* defined(____mio_arena__) */
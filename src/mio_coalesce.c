@@ -0,0 +1,294 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+
+#include <string.h>
+#include <stdlib.h>
+#include "mio_coalesce.h"
+
+extern mio_log_level_t _mio_log_level;
+
+// Puts the samples that piled up during the last window on the send queue,
+// runs in the event loop thread
+static void _mio_coalescer_flush(xmpp_ctx_t * const ctx,
+                                 xmpp_timer_t * const timer) {
+    mio_coalescer_t *coalescer = (mio_coalescer_t*) timer->userdata;
+    xmpp_conn_t *xmpp_conn = coalescer->conn->xmpp_conn;
+    mio_coalesce_entry_t *entry, *next;
+
+    pthread_mutex_lock(&coalescer->mutex);
+    // Samples keep coalescing while there is no connection to send them on
+    if (xmpp_conn->state == XMPP_STATE_CONNECTED) {
+        for (entry = coalescer->dirty; entry != NULL; entry = next) {
+            next = entry->next_dirty;
+            entry->next_dirty = NULL;
+            // The previous sample has not been written yet, take its place
+            if (entry->queued != NULL
+                    && conn_send_queue_replace(xmpp_conn, entry->queued,
+                                               entry->queued_pos, entry->pending, entry->pending_len)) {
+                coalescer->stats.elided++;
+            } else {
+                conn_send_queue_add(xmpp_conn, entry->pending,
+                                    entry->pending_len);
+                entry->queued = NULL;
+                if (xmpp_conn->send_queue_tail != NULL
+                        && xmpp_conn->send_queue_tail->data == entry->pending) {
+                    entry->queued = xmpp_conn->send_queue_tail;
+                    entry->queued_pos = xmpp_conn->send_queue_done
+                                        + xmpp_conn->send_queue_len - 1;
+                }
+                coalescer->stats.sent++;
+            }
+            entry->pending = NULL;
+        }
+        coalescer->dirty = NULL;
+    }
+    pthread_mutex_unlock(&coalescer->mutex);
+
+    xmpp_timer_add(ctx, timer, xmpp_ctx_now(ctx) + coalescer->window_ms);
+}
+
+/**
+ * @ingroup PubSub
+ * Creates a coalescer for transducer samples where only the latest value
+ * matters. Samples published through it are held back until the end of the
+ * current window, and a newer sample of the same node and transducer replaces
+ * the one held back. A sample is also replaced while it is still waiting on
+ * the send queue, so a slow link does not fill the queue with stale values.
+ * Actuation samples are sent right away. Coalesced samples are sent without
+ * waiting for a response. Coalescers must be freed before their connection.
+ *
+ * @param conn A pointer to a mio connection. It does not need to be active.
+ * @param window_ms Time in ms between two flushes of the held back samples, 0 for MIO_COALESCE_DEFAULT_WINDOW_MS.
+ * @returns A newly allocated coalescer to be freed with mio_coalescer_free(), or NULL on an error.
+ */
+mio_coalescer_t *mio_coalescer_new(mio_conn_t *conn, unsigned int window_ms) {
+    mio_coalescer_t *coalescer = malloc(sizeof(mio_coalescer_t));
+
+    if (coalescer == NULL)
+        return NULL;
+    memset(coalescer, 0, sizeof(mio_coalescer_t));
+    coalescer->conn = conn;
+    coalescer->window_ms = window_ms == 0 ?
+                           MIO_COALESCE_DEFAULT_WINDOW_MS : window_ms;
+    pthread_mutex_init(&coalescer->mutex, NULL );
+    xmpp_timer_init(&coalescer->timer, _mio_coalescer_flush, coalescer);
+
+    _mio_event_loop_lock(conn);
+    coalescer->next = conn->coalescers;
+    conn->coalescers = coalescer;
+    xmpp_timer_add(conn->xmpp_conn->ctx, &coalescer->timer,
+                   time_monotonic() + coalescer->window_ms);
+    _mio_event_loop_unlock(conn);
+
+    return coalescer;
+}
+
+/**
+ * @ingroup PubSub
+ * Frees a coalescer. Samples that are still held back are dropped, samples
+ * already on the send queue are sent.
+ *
+ * @param coalescer A pointer to the coalescer to be freed.
+ */
+void mio_coalescer_free(mio_coalescer_t *coalescer) {
+    mio_coalesce_entry_t *entry, *tmp;
+    mio_coalescer_t **c;
+    xmpp_ctx_t *ctx = coalescer->conn->xmpp_conn->ctx;
+
+    _mio_event_loop_lock(coalescer->conn);
+    for (c = &coalescer->conn->coalescers; *c != NULL; c = &(*c)->next) {
+        if (*c == coalescer) {
+            *c = coalescer->next;
+            break;
+        }
+    }
+    xmpp_timer_del(ctx, &coalescer->timer);
+    _mio_event_loop_unlock(coalescer->conn);
+
+    HASH_ITER(key.hh, coalescer->entries, entry, tmp) {
+        HASH_DELETE(key.hh, coalescer->entries, entry);
+        if (entry->pending != NULL)
+            xmpp_free(ctx, entry->pending);
+        mio_template_free(entry->tmpl);
+        free(entry->key.key);
+        free(entry);
+    }
+    pthread_mutex_destroy(&coalescer->mutex);
+    free(coalescer);
+}
+
+// Finds the entry of a node and transducer, creating it if there is none.
+// Must be called with the coalescer's mutex held.
+static mio_coalesce_entry_t *_mio_coalescer_entry_get(
+    mio_coalescer_t *coalescer, const char *node, const char *name,
+    mio_transducer_data_type_t type) {
+    mio_coalesce_entry_t *entry;
+    int created;
+
+    entry = _mio_transducer_key_get((mio_transducer_key_t **) &coalescer->entries,
+                                    node, name, sizeof(mio_coalesce_entry_t), &created);
+    if (entry == NULL || !created)
+        return entry;
+
+    entry->tmpl = mio_transducer_data_template_new(coalescer->conn, node, name,
+                  type);
+    if (entry->tmpl == NULL) {
+        HASH_DELETE(key.hh, coalescer->entries, entry);
+        free(entry->key.key);
+        free(entry);
+        return NULL;
+    }
+    coalescer->stats.keys++;
+    return entry;
+}
+
+/**
+ * @ingroup PubSub
+ * Publishes a transducer sample through a coalescer. Data samples are held
+ * back until the end of the current window and replace the sample of the same
+ * node and transducer that is held back or still waiting on the send queue.
+ * Actuation samples are sent right away.
+ *
+ * @param coalescer A pointer to a coalescer.
+ * @param node The target event node's uuid.
+ * @param name The name of the transducer.
+ * @param type MIO_TRANSDUCER_DATA for sensor data, MIO_TRANSDUCER_SET_DATA for actuation.
+ * @param value The transducer value.
+ * @param timestamp The timestamp of the value.
+ * @returns MIO_OK if the sample was accepted, otherwise an error.
+ */
+int mio_coalescer_publish(mio_coalescer_t *coalescer, const char *node,
+                          const char *name, mio_transducer_data_type_t type,
+                          const char *value, const char *timestamp) {
+    mio_conn_t *conn = coalescer->conn;
+    const char *values[2] = { value, timestamp };
+    mio_coalesce_entry_t *entry;
+    mio_template_t *tmpl;
+    char id[37], *buf;
+    size_t len;
+    int err;
+
+    if (!conn->xmpp_conn->authenticated) {
+        mio_error(
+            "Cannot process publish request since not connected to XMPP server");
+        return MIO_ERROR_DISCONNECTED;
+    }
+
+    // Actuation commands must all arrive, they are not worth a template
+    if (type == MIO_TRANSDUCER_SET_DATA) {
+        __atomic_add_fetch(&coalescer->stats.exempt, 1, __ATOMIC_RELAXED);
+        tmpl = mio_transducer_data_template_new(conn, node, name, type);
+        if (tmpl == NULL)
+            return MIO_ERROR_MALLOC;
+        err = mio_template_send_nonblocking(conn, tmpl, values);
+        mio_template_free(tmpl);
+        return err;
+    }
+
+    // Entries and their templates live as long as the coalescer
+    pthread_mutex_lock(&coalescer->mutex);
+    entry = _mio_coalescer_entry_get(coalescer, node, name, type);
+    pthread_mutex_unlock(&coalescer->mutex);
+    if (entry == NULL)
+        return MIO_ERROR_MALLOC;
+
+    _mio_stanza_id_new(conn, id);
+    err = _mio_template_fill(conn, entry->tmpl, id, values, &buf, &len);
+    if (err != MIO_OK)
+        return err;
+
+    pthread_mutex_lock(&coalescer->mutex);
+    coalescer->stats.samples++;
+    if (entry->pending != NULL) {
+        xmpp_free(conn->xmpp_conn->ctx, entry->pending);
+        coalescer->stats.elided++;
+    } else {
+        entry->next_dirty = coalescer->dirty;
+        coalescer->dirty = entry;
+    }
+    entry->pending = buf;
+    entry->pending_len = len;
+    pthread_mutex_unlock(&coalescer->mutex);
+
+    return MIO_OK;
+}
+
+/**
+ * @ingroup PubSub
+ * Publishes all transducers of a mio data struct through a coalescer, see
+ * mio_coalescer_publish().
+ *
+ * @param coalescer A pointer to a coalescer.
+ * @param data The data to publish, data->event is the target event node.
+ * @returns MIO_OK if all samples were accepted, otherwise the first error.
+ */
+int mio_publish_data_coalesced(mio_coalescer_t *coalescer, mio_data_t *data) {
+    mio_transducer_data_t *t;
+    int err;
+
+    for (t = data->transducers; t != NULL; t = t->next) {
+        err = mio_coalescer_publish(coalescer, data->event, t->name, t->type,
+                                    t->value, t->timestamp);
+        if (err != MIO_OK)
+            return err;
+    }
+    return MIO_OK;
+}
+
+/**
+ * @ingroup PubSub
+ * Reads the counters of a coalescer.
+ *
+ * @param coalescer A pointer to a coalescer.
+ * @param stats Receives the counters.
+ */
+void mio_coalescer_stats(mio_coalescer_t *coalescer,
+                         mio_coalesce_stats_t *stats) {
+    pthread_mutex_lock(&coalescer->mutex);
+    *stats = coalescer->stats;
+    stats->exempt = __atomic_load_n(&coalescer->stats.exempt, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&coalescer->mutex);
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to forget the samples that the coalescers of a connection
+ * put on the send queue, e.g. when the connection drops. They are sent or
+ * dropped with the rest of the send queue and must not be replaced anymore.
+ * Must be called from the event loop thread.
+ *
+ * @param conn A pointer to a mio connection.
+ */
+void _mio_coalescers_reset_all(mio_conn_t *conn) {
+    mio_coalescer_t *coalescer;
+    mio_coalesce_entry_t *entry, *tmp;
+
+    for (coalescer = conn->coalescers; coalescer != NULL;
+            coalescer = coalescer->next) {
+        pthread_mutex_lock(&coalescer->mutex);
+        HASH_ITER(key.hh, coalescer->entries, entry, tmp) {
+            entry->queued = NULL;
+        }
+        pthread_mutex_unlock(&coalescer->mutex);
+    }
+}
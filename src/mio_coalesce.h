@@ -0,0 +1,78 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+
+#ifndef ____mio_coalesce__
+#define ____mio_coalesce__
+
+#include <mio.h>
+
+// Interval in ms at which coalesced samples are queued unless told otherwise
+#define MIO_COALESCE_DEFAULT_WINDOW_MS 100
+
+// Counters of a coalescer, see mio_coalescer_stats()
+typedef struct {
+    uint64_t samples; // Samples handed to the coalescer
+    uint64_t sent; // Samples put on the send queue
+    uint64_t elided; // Samples superseded before they were written
+    uint64_t exempt; // Actuation samples sent without coalescing
+    unsigned int keys; // Distinct (node, transducer) pairs seen
+} mio_coalesce_stats_t;
+
+typedef struct mio_coalesce_entry mio_coalesce_entry_t;
+
+// Latest sample of one (node, transducer) pair
+struct mio_coalesce_entry {
+    mio_transducer_key_t key; // Must be first
+    mio_template_t *tmpl; // Publish template of the transducer
+    // Rendered sample waiting for the next window, NULL if there is none
+    char *pending;
+    size_t pending_len;
+    // Last sample put on the send queue and its position in the queue, see
+    // conn_send_queue_replace(). Only touched by the event loop thread.
+    xmpp_send_queue_t *queued;
+    uint64_t queued_pos;
+    mio_coalesce_entry_t *next_dirty; // Next entry with a pending sample
+};
+
+// Holds back transducer samples so that at most one per (node, transducer)
+// pair waits to be sent, see mio_coalescer_new()
+struct mio_coalescer {
+    mio_conn_t *conn;
+    unsigned int window_ms;
+    pthread_mutex_t mutex; // Protects everything but the timer
+    mio_coalesce_entry_t *entries; // Hash of all entries by key
+    mio_coalesce_entry_t *dirty; // Entries with a pending sample
+    mio_coalesce_stats_t stats;
+    xmpp_timer_t timer; // Queues the pending samples once per window
+    mio_coalescer_t *next; // Next coalescer of the connection
+};
+
+// mio_coalescer_publish() and mio_publish_data_coalesced() are declared in
+// mio_transducer.h
+mio_coalescer_t *mio_coalescer_new(mio_conn_t *conn, unsigned int window_ms);
+void mio_coalescer_free(mio_coalescer_t *coalescer);
+void mio_coalescer_stats(mio_coalescer_t *coalescer,
+                         mio_coalesce_stats_t *stats);
+void _mio_coalescers_reset_all(mio_conn_t *conn);
+
+#endif /* defined(____mio_coalesce__) */
@@ -105,16 +105,12 @@ void _mio_collection_add(mio_packet_t *pkt, char *node, char *name) {
     pkt->num_payloads++;
 }
 
-/** Creates an collection event node.
- *
- * @param conn Active MIO connection.
- * @param node The unique node id of the collection node. Should be UUID.
- * @param name The name of the collection node. Need not be unique.
- *
- * @returns MIO_OK upon success, MIO_ERROR_DISCONNECTED on connection failure.
- * */
-int mio_collection_node_create(mio_conn_t * conn, const char *node,
-                               const char *title, mio_response_t * response) {
+static int _mio_collection_node_create(mio_conn_t * conn, const char *node,
+                                       const char *title,
+                                       mio_response_t * response,
+                                       mio_completion completion,
+                                       void *userdata,
+                                       unsigned int deadline_ms) {
 
     int err;
     xmpp_stanza_t *create = NULL, *curr = NULL, *field_title = NULL, *value =
@@ -154,26 +150,56 @@ int mio_collection_node_create(mio_conn_t * conn, const char *node,
     collection_stanza->xmpp_stanza->children->children = create;
 
 // Send out the stanza
-    err = mio_send_blocking(conn, collection_stanza,
-                            (mio_handler) mio_handler_error, response);
+    err = _mio_send_blocking_or_async(conn, collection_stanza,
+                                      (mio_handler) mio_handler_error, response,
+                                      completion, userdata, deadline_ms);
 
     mio_stanza_free(collection_stanza);
 
     return err;
 }
 
-/** Allows user to configure existing collection node.
+/** Creates an collection event node.
  *
  * @param conn Active MIO connection.
- * @param node The node id of the collection node.
- * @param collection_stanza Stanza describing collection node.
- * @param response Pointer to allocated mio response.
- *      Holds response to configure request.
+ * @param node The unique node id of the collection node. Should be UUID.
+ * @param name The name of the collection node. Need not be unique.
  *
- * @returns MIO_OK on success. MIO_ERROR_DISCONNECTED on connection error.
+ * @returns MIO_OK upon success, MIO_ERROR_DISCONNECTED on connection failure.
  * */
-int mio_collection_node_configure(mio_conn_t * conn, const char *node,
-                                  mio_stanza_t *collection_stanza, mio_response_t * response) {
+int mio_collection_node_create(mio_conn_t * conn, const char *node,
+                               const char *title, mio_response_t * response) {
+    return _mio_collection_node_create(conn, node, title, response, NULL, NULL,
+                                       0);
+}
+
+/** Creates a collection event node and calls completion once the response has
+ *      been processed, the deadline passed or the connection dropped, see
+ *      mio_collection_node_create().
+ *
+ * @param conn Active MIO connection.
+ * @param node The unique node id of the collection node. Should be UUID.
+ * @param title The title of the collection node.
+ * @param completion Called with the parsed response, which the completion has to free.
+ * @param userdata Passed to completion.
+ * @param deadline_ms Time in ms after which the request completes with MIO_ERROR_TIMEOUT, 0 for the default.
+ *
+ * @returns MIO_OK if the request was sent, otherwise an error, in which case completion is never called.
+ * */
+int mio_collection_node_create_async(mio_conn_t * conn, const char *node,
+                                     const char *title,
+                                     mio_completion completion, void *userdata,
+                                     unsigned int deadline_ms) {
+    return _mio_collection_node_create(conn, node, title, NULL, completion,
+                                       userdata, deadline_ms);
+}
+
+static int _mio_collection_node_configure(mio_conn_t * conn, const char *node,
+                                          mio_stanza_t *collection_stanza,
+                                          mio_response_t * response,
+                                          mio_completion completion,
+                                          void *userdata,
+                                          unsigned int deadline_ms) {
 
     xmpp_stanza_t *configure = NULL;
     int err;
@@ -196,24 +222,58 @@ int mio_collection_node_configure(mio_conn_t * conn, const char *node,
     xmpp_stanza_add_child(collection_stanza->xmpp_stanza->children, configure);
 
 // Send out the stanza
-    err = mio_send_blocking(conn, collection_stanza,
-                            (mio_handler) mio_handler_error, response);
+    err = _mio_send_blocking_or_async(conn, collection_stanza,
+                                      (mio_handler) mio_handler_error, response,
+                                      completion, userdata, deadline_ms);
 
     mio_stanza_free(collection_stanza);
 
     return err;
 }
 
-/** Queries collection node for children.
+/** Allows user to configure existing collection node.
  *
  * @param conn Active MIO connection.
- * @param node Node id of the collection node to query.
- * @param response The response packet containing the children of the collection node
+ * @param node The node id of the collection node.
+ * @param collection_stanza Stanza describing collection node.
+ * @param response Pointer to allocated mio response.
+ *      Holds response to configure request.
  *
- * @returns MIO_OK on success, MIO_ERROR_DISCONNECTED on MIO disconnection.
+ * @returns MIO_OK on success. MIO_ERROR_DISCONNECTED on connection error.
  * */
-int mio_collection_children_query(mio_conn_t * conn, const char *node,
-                                  mio_response_t * response) {
+int mio_collection_node_configure(mio_conn_t * conn, const char *node,
+                                  mio_stanza_t *collection_stanza, mio_response_t * response) {
+    return _mio_collection_node_configure(conn, node, collection_stanza,
+                                          response, NULL, NULL, 0);
+}
+
+/** Configures an existing collection node and calls completion once the
+ *      response has been processed, the deadline passed or the connection
+ *      dropped, see mio_collection_node_configure().
+ *
+ * @param conn Active MIO connection.
+ * @param node The node id of the collection node.
+ * @param collection_stanza Stanza describing collection node.
+ * @param completion Called with the parsed response, which the completion has to free.
+ * @param userdata Passed to completion.
+ * @param deadline_ms Time in ms after which the request completes with MIO_ERROR_TIMEOUT, 0 for the default.
+ *
+ * @returns MIO_OK if the request was sent, otherwise an error, in which case completion is never called.
+ * */
+int mio_collection_node_configure_async(mio_conn_t * conn, const char *node,
+                                        mio_stanza_t *collection_stanza,
+                                        mio_completion completion,
+                                        void *userdata,
+                                        unsigned int deadline_ms) {
+    return _mio_collection_node_configure(conn, node, collection_stanza, NULL,
+                                          completion, userdata, deadline_ms);
+}
+
+static int _mio_collection_children_query(mio_conn_t * conn, const char *node,
+                                          mio_response_t * response,
+                                          mio_completion completion,
+                                          void *userdata,
+                                          unsigned int deadline_ms) {
 
     int err;
     xmpp_stanza_t *query = NULL;
@@ -227,24 +287,54 @@ int mio_collection_children_query(mio_conn_t * conn, const char *node,
     xmpp_stanza_add_child(iq->xmpp_stanza, query);
 
 // Send out the stanza
-    err = mio_send_blocking(conn, iq,
-                            (mio_handler) mio_handler_collection_children_query, response);
+    err = _mio_send_blocking_or_async(conn, iq,
+                                      (mio_handler) mio_handler_collection_children_query,
+                                      response, completion, userdata,
+                                      deadline_ms);
 
     mio_stanza_free(iq);
 
     return err;
 }
 
-/** Queries collection node for parents.
+/** Queries collection node for children.
  *
  * @param conn Active MIO connection.
  * @param node Node id of the collection node to query.
- * @param response The response packet containing the parents of the collection node
+ * @param response The response packet containing the children of the collection node
  *
  * @returns MIO_OK on success, MIO_ERROR_DISCONNECTED on MIO disconnection.
  * */
-int mio_collection_parents_query(mio_conn_t * conn, const char *node,
-                                 mio_response_t * response) {
+int mio_collection_children_query(mio_conn_t * conn, const char *node,
+                                  mio_response_t * response) {
+    return _mio_collection_children_query(conn, node, response, NULL, NULL, 0);
+}
+
+/** Queries a collection node for its children and calls completion once the
+ *      response has been processed, the deadline passed or the connection
+ *      dropped, see mio_collection_children_query().
+ *
+ * @param conn Active MIO connection.
+ * @param node Node id of the collection node to query.
+ * @param completion Called with the parsed response, which the completion has to free.
+ * @param userdata Passed to completion.
+ * @param deadline_ms Time in ms after which the request completes with MIO_ERROR_TIMEOUT, 0 for the default.
+ *
+ * @returns MIO_OK if the request was sent, otherwise an error, in which case completion is never called.
+ * */
+int mio_collection_children_query_async(mio_conn_t * conn, const char *node,
+                                        mio_completion completion,
+                                        void *userdata,
+                                        unsigned int deadline_ms) {
+    return _mio_collection_children_query(conn, node, NULL, completion,
+                                          userdata, deadline_ms);
+}
+
+static int _mio_collection_parents_query(mio_conn_t * conn, const char *node,
+                                         mio_response_t * response,
+                                         mio_completion completion,
+                                         void *userdata,
+                                         unsigned int deadline_ms) {
 
     int err;
     xmpp_stanza_t *configure = NULL;
@@ -262,14 +352,49 @@ int mio_collection_parents_query(mio_conn_t * conn, const char *node,
     xmpp_stanza_add_child(iq->xmpp_stanza->children, configure);
 
 // Send out the stanza
-    err = mio_send_blocking(conn, iq,
-                            (mio_handler) mio_handler_collection_parents_query, response);
+    err = _mio_send_blocking_or_async(conn, iq,
+                                      (mio_handler) mio_handler_collection_parents_query,
+                                      response, completion, userdata,
+                                      deadline_ms);
 
     mio_stanza_free(iq);
 
     return err;
 }
 
+/** Queries collection node for parents.
+ *
+ * @param conn Active MIO connection.
+ * @param node Node id of the collection node to query.
+ * @param response The response packet containing the parents of the collection node
+ *
+ * @returns MIO_OK on success, MIO_ERROR_DISCONNECTED on MIO disconnection.
+ * */
+int mio_collection_parents_query(mio_conn_t * conn, const char *node,
+                                 mio_response_t * response) {
+    return _mio_collection_parents_query(conn, node, response, NULL, NULL, 0);
+}
+
+/** Queries a collection node for its parents and calls completion once the
+ *      response has been processed, the deadline passed or the connection
+ *      dropped, see mio_collection_parents_query().
+ *
+ * @param conn Active MIO connection.
+ * @param node Node id of the collection node to query.
+ * @param completion Called with the parsed response, which the completion has to free.
+ * @param userdata Passed to completion.
+ * @param deadline_ms Time in ms after which the request completes with MIO_ERROR_TIMEOUT, 0 for the default.
+ *
+ * @returns MIO_OK if the request was sent, otherwise an error, in which case completion is never called.
+ * */
+int mio_collection_parents_query_async(mio_conn_t * conn, const char *node,
+                                       mio_completion completion,
+                                       void *userdata,
+                                       unsigned int deadline_ms) {
+    return _mio_collection_parents_query(conn, node, NULL, completion, userdata,
+                                         deadline_ms);
+}
+
 /** Adds a child node to a collection nodes stanza
  *
  * @param conn Active MIO connection.
@@ -587,11 +712,11 @@ static void XMLCALL mio_XMLstart_collection_parents_query(void *data,
             if (strcmp(attr_name, "var") == 0) {
                 if (strcmp("pubsub#collection", attr[i + 1]) == 0) {
                     xml_data->payload = (void*) packet;
-                    XML_SetCharacterDataHandler(*xml_data->parser,
-                                                mio_XMLString_collection_query);
+                    mio_xml_parser_data_set_char_handler(xml_data,
+                            mio_XMLString_collection_query);
                 }
             } else
-                XML_SetCharacterDataHandler(*xml_data->parser, NULL );
+                mio_xml_parser_data_set_char_handler(xml_data, NULL );
         }
     } else if (strcmp(element_name, "error") == 0)
         mio_XML_error_handler(element_name, attr, response);
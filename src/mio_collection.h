@@ -42,16 +42,33 @@ void mio_collection_add(mio_packet_t *pkt, char *node, char *name);
 
 int mio_collection_node_create(mio_conn_t * conn, const char *node,
                                const char *name, mio_response_t * response);
+int mio_collection_node_create_async(mio_conn_t * conn, const char *node,
+                                     const char *name,
+                                     mio_completion completion, void *userdata,
+                                     unsigned int deadline_ms);
 int mio_collection_node_configure(mio_conn_t * conn, const char *node,
                                   mio_stanza_t *collection_stanza, mio_response_t * response);
+int mio_collection_node_configure_async(mio_conn_t * conn, const char *node,
+                                        mio_stanza_t *collection_stanza,
+                                        mio_completion completion,
+                                        void *userdata,
+                                        unsigned int deadline_ms);
 int mio_collection_config_child_add(mio_conn_t * conn, const char *child,
                                     mio_stanza_t *collection_stanza);
 int mio_collection_config_parent_add(mio_conn_t * conn, const char *parent,
                                      mio_stanza_t *collection_stanza);
 int mio_collection_children_query(mio_conn_t * conn, const char *node,
                                   mio_response_t * response);
+int mio_collection_children_query_async(mio_conn_t * conn, const char *node,
+                                        mio_completion completion,
+                                        void *userdata,
+                                        unsigned int deadline_ms);
 int mio_collection_parents_query(mio_conn_t * conn, const char *node,
                                  mio_response_t * response);
+int mio_collection_parents_query_async(mio_conn_t * conn, const char *node,
+                                       mio_completion completion,
+                                       void *userdata,
+                                       unsigned int deadline_ms);
 int mio_collection_child_add(mio_conn_t * conn, const char *child,
                              const char *parent, mio_response_t *response);
 int mio_collection_child_remove(mio_conn_t * conn, const char *child,
@@ -24,10 +24,13 @@
 #include <strophe.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/time.h>
+#include <stdarg.h>
 
 #include "mio_connection.h"
 #include "mio_handlers.h"
@@ -45,6 +48,109 @@
 #endif
 
 mio_log_level_t _mio_log_level = MIO_LEVEL_ERROR;
+// Set while logging goes through the asynchronous log ring
+static xmpp_async_log_t *_mio_async_log = NULL;
+
+static const char *_mio_log_level_name[] = { "ERROR", "WARNING", "INFO", "DEBUG" };
+
+static xmpp_log_level_t _mio_xmpp_log_level(mio_log_level_t log_level) {
+    switch (log_level) {
+    case MIO_LEVEL_DEBUG:
+        return XMPP_LEVEL_DEBUG;
+    case MIO_LEVEL_INFO:
+        return XMPP_LEVEL_INFO;
+    case MIO_LEVEL_WARN:
+        return XMPP_LEVEL_WARN;
+    default:
+        return XMPP_LEVEL_ERROR;
+    }
+}
+
+/**
+ * @ingroup Internal
+ * Internal function behind the mio_debug(), mio_info(), mio_warn() and
+ * mio_error() macros, which only call it if the level is enabled. Writes to
+ * stderr, or to the log ring if mio_log_async_start() was called.
+ *
+ * @param level The level of the message.
+ * @param file The source file logging the message.
+ * @param line The line in the source file.
+ * @param func The function logging the message.
+ * @param fmt A printf style format string followed by its arguments.
+ */
+void _mio_log(mio_log_level_t level, const char *file, int line,
+              const char *func, const char *fmt, ...) {
+    xmpp_async_log_t *alog;
+    char buf[1024];
+    va_list ap;
+    int n;
+
+    va_start(ap, fmt);
+    alog = __atomic_load_n(&_mio_async_log, __ATOMIC_ACQUIRE);
+    if (alog == NULL) {
+        flockfile(stderr);
+        fprintf(stderr, "MIO %s: %s:%d:%s(): ", _mio_log_level_name[level],
+                file, line, func);
+        vfprintf(stderr, fmt, ap);
+        fputc('\n', stderr);
+        funlockfile(stderr);
+    } else {
+        n = snprintf(buf, sizeof(buf), "%s:%d:%s(): ", file, line, func);
+        if (n >= 0 && n < (int) sizeof(buf))
+            vsnprintf(buf + n, sizeof(buf) - n, fmt, ap);
+        xmpp_async_log_write(alog, _mio_xmpp_log_level(level), "MIO", buf);
+    }
+    va_end(ap);
+}
+
+/**
+ * @ingroup Connection
+ * Sends log output of mio and of connections created afterwards through a
+ * lock-free ring that a background thread writes to stderr, so that logging
+ * does not stall the event loop or the calling threads on the output. Messages
+ * are dropped if the ring is full. Must be called before mio_conn_new().
+ *
+ * @param size The size of the log ring in bytes, or 0 for
+ * MIO_LOG_ASYNC_DEFAULT_SIZE.
+ * @returns MIO_OK on success, MIO_ERROR_MALLOC if the ring or its thread
+ * could not be created.
+ */
+int mio_log_async_start(size_t size) {
+    xmpp_async_log_t *alog;
+
+    if (_mio_async_log != NULL)
+        return MIO_OK;
+    alog = xmpp_async_log_new(size ? size : MIO_LOG_ASYNC_DEFAULT_SIZE,
+                              STDERR_FILENO);
+    if (alog == NULL)
+        return MIO_ERROR_MALLOC;
+    __atomic_store_n(&_mio_async_log, alog, __ATOMIC_RELEASE);
+    return MIO_OK;
+}
+
+/**
+ * @ingroup Connection
+ * Writes out what is left in the log ring and goes back to logging to stderr
+ * directly. All connections created after mio_log_async_start() must have
+ * been freed.
+ */
+void mio_log_async_stop(void) {
+    xmpp_async_log_t *alog;
+
+    alog = __atomic_exchange_n(&_mio_async_log, NULL, __ATOMIC_ACQ_REL);
+    if (alog == NULL)
+        return;
+    if (xmpp_async_log_dropped(alog) > 0)
+        fprintf(stderr, "MIO WARNING: %llu log messages were dropped\n",
+                (unsigned long long) xmpp_async_log_dropped(alog));
+    xmpp_async_log_free(alog);
+}
+
+// Reconnection backoff timer, runs in the event loop thread
+static void _mio_reconnect_timeout(xmpp_ctx_t * const ctx,
+                                   xmpp_timer_t * const timer) {
+    mio_reconnect((mio_conn_t*) timer->userdata);
+}
 
 /**
  * @ingroup Connection
@@ -68,42 +174,56 @@ mio_conn_t *mio_conn_new(mio_log_level_t log_level) {
     pthread_mutex_init(&conn->send_request_mutex, NULL );
     pthread_mutex_init(&conn->pubsub_rx_queue_mutex, NULL );
     pthread_mutex_init(&conn->conn_mutex, NULL );
+    pthread_mutex_init(&conn->parser_pool_mutex, NULL );
+    pthread_mutex_init(&conn->pubsub_rx_backlog_mutex, NULL );
+    pthread_mutex_init(&conn->response_pool_mutex, NULL );
 //pthread_mutexattr_destroy(&conn_mutex_attr);
     pthread_cond_init(&conn->send_request_cond, NULL );
     pthread_cond_init(&conn->conn_cond, NULL );
-    pthread_rwlock_init(&conn->mio_hash_lock, NULL );
-    TAILQ_INIT(&conn->pubsub_rx_queue);
+    pthread_cond_init(&conn->pubsub_rx_queue_cond, NULL );
+    TAILQ_INIT(&conn->pubsub_rx_backlog);
+    _mio_pubsub_rx_queue_init(conn, MIO_PUBSUB_RX_QUEUE_DEFAULT_LEN);
+    _mio_request_table_init(conn, MIO_MAX_OPEN_REQUESTS);
+    conn->pubsub_routes = _mio_pubsub_routes_new();
+    xmpp_timer_init(&conn->reconnect_timer, _mio_reconnect_timeout, conn);
 
-#ifdef __linux__
-    conn->mio_open_requests = sem_open("mio_open_requests",O_CREAT);
-#endif
-
-    switch (log_level) {
-    case MIO_LEVEL_DEBUG:
-        log = xmpp_get_default_logger(XMPP_LEVEL_DEBUG);
-        break;
-    case MIO_LEVEL_ERROR:
-        log = xmpp_get_default_logger(XMPP_LEVEL_ERROR);
-        break;
-    case MIO_LEVEL_INFO:
-        log = xmpp_get_default_logger(XMPP_LEVEL_INFO);
-        break;
-    case MIO_LEVEL_WARN:
-        log = xmpp_get_default_logger(XMPP_LEVEL_WARN);
-        break;
-    default:
-        log = xmpp_get_default_logger(XMPP_LEVEL_ERROR);
-        break;
-    }
+    if (_mio_async_log != NULL)
+        log = xmpp_async_log_get_logger(_mio_async_log,
+                                        _mio_xmpp_log_level(log_level));
+    else
+        log = xmpp_get_default_logger(_mio_xmpp_log_level(log_level));
 
     _mio_log_level = log_level;
     ctx = xmpp_ctx_new(NULL, log);
+// Use epoll for the event loop where available, otherwise stay with select
+    if (xmpp_ctx_set_event_backend(ctx, XMPP_EVENT_EPOLL) != 0)
+        mio_debug("epoll event backend unavailable, using select");
 // Create a connection
     conn->xmpp_conn = xmpp_conn_new(ctx);
 
     return conn;
 }
 
+/**
+ * @ingroup Internal
+ * Internal function to call mio_reconnect() from the event loop once
+ * MIO_RECONNECTION_TIMEOUT_S have passed, unless MIO_CONNECTION_RETRIES
+ * reconnection attempts have been made. Must be called from the event loop
+ * thread.
+ *
+ * @param conn A pointer to a disconnected mio connection.
+ */
+void _mio_reconnect_schedule(mio_conn_t *conn) {
+    xmpp_ctx_t *ctx = conn->xmpp_conn->ctx;
+
+#ifdef MIO_CONNECTION_RETRIES
+    if (conn->retries >= MIO_CONNECTION_RETRIES)
+        return;
+#endif
+    xmpp_timer_add(ctx, &conn->reconnect_timer,
+                   xmpp_ctx_now(ctx) + 1000 * MIO_RECONNECTION_TIMEOUT_S);
+}
+
 /**
  * @ingroup Connection
  * Frees a mio conn.
@@ -111,7 +231,22 @@ mio_conn_t *mio_conn_new(mio_log_level_t log_level) {
  * @param conn A pointer to the allocated mio conn to be freed.
  * */
 void mio_conn_free(mio_conn_t *conn) {
+    xmpp_send_queue_t *item;
+
+    // Workers may still hold stanzas and handler data
+    mio_handler_workers_stop(conn);
+    mio_pubsub_data_lanes_stop(conn);
     if (conn->xmpp_conn != NULL ) {
+        // Drop anything that was never spliced onto the send queue
+        while (conn->send_inbox != NULL) {
+            item = conn->send_inbox;
+            conn->send_inbox = item->next;
+            xmpp_free(conn->xmpp_conn->ctx, item->data);
+            xmpp_free(conn->xmpp_conn->ctx, item);
+        }
+        // Request and reconnect timers must leave the context's timer wheel
+        _mio_request_table_free(conn);
+        xmpp_timer_del(conn->xmpp_conn->ctx, &conn->reconnect_timer);
         //if(conn->xmpp_conn->ctx != NULL)
         // 	xmpp_ctx_free(conn->xmpp_conn->ctx);
         xmpp_conn_release(conn->xmpp_conn);
@@ -121,6 +256,22 @@ void mio_conn_free(mio_conn_t *conn) {
     pthread_mutex_destroy(&conn->conn_mutex);
     pthread_cond_destroy(&conn->send_request_cond);
     pthread_cond_destroy(&conn->conn_cond);
+    _mio_pubsub_rx_queue_free(conn);
+    _mio_response_pool_free(conn);
+    pthread_mutex_destroy(&conn->pubsub_rx_queue_mutex);
+    pthread_cond_destroy(&conn->pubsub_rx_queue_cond);
+    pthread_mutex_destroy(&conn->pubsub_rx_backlog_mutex);
+    pthread_mutex_destroy(&conn->response_pool_mutex);
+    _mio_request_table_free(conn);
+    if (conn->pubsub_rx_request != NULL)
+        _mio_request_free(conn->pubsub_rx_request);
+    _mio_parser_pool_free(conn);
+    pthread_mutex_destroy(&conn->parser_pool_mutex);
+    _mio_pubsub_routes_free(conn->pubsub_routes);
+    if (conn->pubsub_rx_decode != NULL) {
+        mio_response_free(conn->pubsub_rx_decode->response);
+        free(conn->pubsub_rx_decode);
+    }
     free(conn);
 }
 
@@ -276,56 +427,528 @@ mio_response_t *_mio_response_get(mio_conn_t *conn, char *id) {
 
 /**
  * @ingroup Internal
- * Internal function to enqueue a mio response to the received pubsub queue.
+ * Internal function to hand a rendered stanza to the event loop for sending.
+ * Lock-free and safe to call from any number of threads. The event loop
+ * is only woken up by the push that finds the inbox empty, later pushes are
+ * picked up by the same splice.
  *
  * @param conn A pointer to an active mio connection.
- * @param response A pointer to the mio response to enqueue
+ * @param buf The rendered stanza, allocated with the xmpp context's allocator.
+ * Ownership passes to the send queue.
+ * @param len The length of buf in bytes.
+ * @returns MIO_OK on success, MIO_ERROR_MALLOC if the queue item could not be
+ * allocated.
  */
-void _mio_pubsub_rx_queue_enqueue(mio_conn_t *conn, mio_response_t *response) {
-    mio_response_t *temp = NULL;
+int _mio_send_queue_push(mio_conn_t *conn, char *buf, size_t len) {
+    xmpp_ctx_t *ctx = conn->xmpp_conn->ctx;
+    xmpp_send_queue_t *item, *head;
 
-    if (conn->pubsub_rx_queue_len >= MIO_PUBSUB_RX_QUEUE_MAX_LEN) {
-        mio_warn(
-            "Pubsub RX queue has reached it's maximum length, dropping oldest response");
-        pthread_mutex_lock(&conn->pubsub_rx_queue_mutex);
-        temp = (mio_response_t*) TAILQ_FIRST(&conn->pubsub_rx_queue);
-        TAILQ_REMOVE(&conn->pubsub_rx_queue, temp, responses);
-        TAILQ_INSERT_TAIL(&conn->pubsub_rx_queue, response, responses);
-        pthread_mutex_unlock(&conn->pubsub_rx_queue_mutex);
-    } else {
+    item = xmpp_alloc(ctx, sizeof(xmpp_send_queue_t));
+    if (item == NULL) {
+        xmpp_free(ctx, buf);
+        return MIO_ERROR_MALLOC;
+    }
+    item->data = buf;
+    item->len = len;
+    item->written = 0;
+
+    head = __atomic_load_n(&conn->send_inbox, __ATOMIC_RELAXED);
+    do {
+        item->next = head;
+    } while (!__atomic_compare_exchange_n(&conn->send_inbox, &head, item, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    if (head == NULL)
+        xmpp_ctx_wakeup(ctx);
+    return MIO_OK;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to move everything pushed with _mio_send_queue_push()
+ * onto the xmpp connection's send queue in push order. Must be called by the
+ * event loop thread with the event loop mutex held. Buffers stay in the inbox
+ * while the xmpp connection is not connected.
+ *
+ * @param conn A pointer to an active mio connection.
+ * @returns The number of buffers moved to the send queue.
+ */
+int _mio_send_queue_splice(mio_conn_t *conn) {
+    xmpp_conn_t *xmpp_conn = conn->xmpp_conn;
+    xmpp_send_queue_t *item, *next, *head = NULL, *tail;
+    int n = 0;
+
+    if (xmpp_conn->state != XMPP_STATE_CONNECTED
+            || __atomic_load_n(&conn->send_inbox, __ATOMIC_RELAXED) == NULL)
+        return 0;
+
+    item = __atomic_exchange_n(&conn->send_inbox, NULL, __ATOMIC_ACQUIRE);
+    tail = item;
+// The inbox is LIFO, reverse it to restore push order
+    while (item != NULL) {
+        next = item->next;
+        item->next = head;
+        head = item;
+        item = next;
+        n++;
+    }
+
+    if (xmpp_conn->send_queue_tail == NULL)
+        xmpp_conn->send_queue_head = head;
+    else
+        xmpp_conn->send_queue_tail->next = head;
+    xmpp_conn->send_queue_tail = tail;
+    xmpp_conn->send_queue_len += n;
+
+    return n;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to take the event loop mutex from outside of the event
+ * loop thread. Registers the caller as a waiter and wakes up the event loop
+ * so that it releases the mutex instead of blocking until its next timeout.
+ *
+ * @param conn A pointer to an active mio connection.
+ * @returns 0 on success, otherwise a pthread error code.
+ */
+int _mio_event_loop_lock(mio_conn_t *conn) {
+    int err;
+
+    // Handlers and completions already run with the mutex held
+    if (conn->mio_run_thread != NULL
+            && pthread_equal(*conn->mio_run_thread, pthread_self()))
+        return 0;
+
+    pthread_mutex_lock(&conn->send_request_mutex);
+    conn->event_loop_waiters++;
+    pthread_mutex_unlock(&conn->send_request_mutex);
+
+    xmpp_ctx_wakeup(conn->xmpp_conn->ctx);
+    err = pthread_mutex_lock(&conn->event_loop_mutex);
+    if (err != 0) {
+        pthread_mutex_lock(&conn->send_request_mutex);
+        if (--conn->event_loop_waiters == 0)
+            pthread_cond_broadcast(&conn->send_request_cond);
+        pthread_mutex_unlock(&conn->send_request_mutex);
+    }
+    return err;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to release the event loop mutex taken with
+ * _mio_event_loop_lock(). The event loop resumes once the last waiter is done.
+ *
+ * @param conn A pointer to an active mio connection.
+ */
+void _mio_event_loop_unlock(mio_conn_t *conn) {
+    if (conn->mio_run_thread != NULL
+            && pthread_equal(*conn->mio_run_thread, pthread_self()))
+        return;
+
+    pthread_mutex_unlock(&conn->event_loop_mutex);
+
+    pthread_mutex_lock(&conn->send_request_mutex);
+    conn->event_loop_waiters--;
+    if (conn->event_loop_waiters == 0)
+        pthread_cond_broadcast(&conn->send_request_cond);
+    pthread_mutex_unlock(&conn->send_request_mutex);
+}
+
+// Puts a response on the ring, returns 0 if the ring is full
+static int _mio_rx_ring_push(mio_rx_ring_t *ring, mio_response_t *response) {
+    mio_rx_cell_t *cell;
+    uint64_t pos, seq;
+
+    pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+    for (;;) {
+        cell = &ring->cells[pos & ring->mask];
+        seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        if (seq == pos) {
+            if (__atomic_compare_exchange_n(&ring->tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if ((int64_t) (seq - pos) < 0) {
+            // The cell still holds the response from one lap ago
+            return 0;
+        } else {
+            pos = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+        }
+    }
+    cell->response = response;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// Takes the oldest response off the ring, NULL if the ring is empty
+static mio_response_t *_mio_rx_ring_pop(mio_rx_ring_t *ring) {
+    mio_rx_cell_t *cell;
+    mio_response_t *response;
+    uint64_t pos, seq;
+
+    pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    for (;;) {
+        cell = &ring->cells[pos & ring->mask];
+        seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        if (seq == pos + 1) {
+            if (__atomic_compare_exchange_n(&ring->head, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if ((int64_t) (seq - (pos + 1)) < 0) {
+            return NULL;
+        } else {
+            pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+        }
+    }
+    response = cell->response;
+    __atomic_store_n(&cell->seq, pos + ring->mask + 1, __ATOMIC_RELEASE);
+    return response;
+}
+
+// Takes up to max of the oldest responses off the ring with a single
+// exchange of the head, returns the number taken
+static int _mio_rx_ring_pop_many(mio_rx_ring_t *ring,
+                                 mio_response_t **responses, int max) {
+    mio_rx_cell_t *cell;
+    uint64_t pos;
+    int i, n;
+
+    pos = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    do {
+        // Count the filled cells from the head on, they stay filled until
+        // the consumer that claimed them releases them
+        for (n = 0; n < max; n++) {
+            cell = &ring->cells[(pos + n) & ring->mask];
+            if (__atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) != pos + n + 1)
+                break;
+        }
+        if (n == 0)
+            return 0;
+    } while (!__atomic_compare_exchange_n(&ring->head, &pos, pos + n, 1,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    for (i = 0; i < n; i++) {
+        cell = &ring->cells[(pos + i) & ring->mask];
+        responses[i] = cell->response;
+        __atomic_store_n(&cell->seq, pos + i + ring->mask + 1,
+                         __ATOMIC_RELEASE);
+    }
+    return n;
+}
+
+// Wakes up a thread blocked in _mio_pubsub_rx_queue_dequeue_timed()
+static void _mio_pubsub_rx_queue_signal(mio_conn_t *conn) {
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&conn->pubsub_rx_waiters, __ATOMIC_RELAXED) > 0) {
         pthread_mutex_lock(&conn->pubsub_rx_queue_mutex);
-        TAILQ_INSERT_TAIL(&conn->pubsub_rx_queue, response, responses);
-        conn->pubsub_rx_queue_len++;
+        pthread_cond_signal(&conn->pubsub_rx_queue_cond);
         pthread_mutex_unlock(&conn->pubsub_rx_queue_mutex);
     }
 }
 
 /**
  * @ingroup Internal
- * Internal function to pop a mio response off the received pubsub queue.
+ * Internal function to allocate the received pubsub queue of a mio connection.
+ * Any previous queue must be empty.
+ *
+ * @param conn A pointer to a mio connection.
+ * @param capacity The number of responses the queue holds, rounded up to the
+ * next power of two.
+ * @returns MIO_OK on success, MIO_ERROR_MALLOC if the queue could not be
+ * allocated.
+ */
+int _mio_pubsub_rx_queue_init(mio_conn_t *conn, unsigned int capacity) {
+    mio_rx_cell_t *cells;
+    uint64_t size = 1, i;
+
+    while (size < capacity)
+        size <<= 1;
+    cells = malloc(size * sizeof(mio_rx_cell_t));
+    if (cells == NULL)
+        return MIO_ERROR_MALLOC;
+    for (i = 0; i < size; i++)
+        cells[i].seq = i;
+
+    free(conn->pubsub_rx_ring.cells);
+    conn->pubsub_rx_ring.cells = cells;
+    conn->pubsub_rx_ring.mask = size - 1;
+    conn->pubsub_rx_ring.head = 0;
+    conn->pubsub_rx_ring.tail = 0;
+    conn->pubsub_rx_stats.capacity = size;
+    return MIO_OK;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to free the received pubsub queue of a mio connection and
+ * all responses still on it.
+ *
+ * @param conn A pointer to a mio connection.
+ */
+void _mio_pubsub_rx_queue_free(mio_conn_t *conn) {
+    mio_response_t *response;
+
+    if (conn->pubsub_rx_ring.cells == NULL)
+        return;
+    while ((response = _mio_rx_ring_pop(&conn->pubsub_rx_ring)) != NULL)
+        mio_response_free(response);
+    while ((response = TAILQ_FIRST(&conn->pubsub_rx_backlog)) != NULL) {
+        TAILQ_REMOVE(&conn->pubsub_rx_backlog, response, responses);
+        mio_response_free(response);
+    }
+    free(conn->pubsub_rx_ring.cells);
+    conn->pubsub_rx_ring.cells = NULL;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to enqueue a mio response to the received pubsub queue.
+ * If the queue is full, the connection's mio_rx_overflow_policy_t decides
+ * what happens. Called from the event loop thread or a handler worker.
+ *
+ * @param conn A pointer to an active mio connection.
+ * @param response A pointer to the mio response to enqueue, which is owned by
+ * the queue from then on.
+ */
+void _mio_pubsub_rx_queue_enqueue(mio_conn_t *conn, mio_response_t *response) {
+    mio_response_t *dropped;
+
+    // Responses of nodes with a registered callback skip the queue
+    if (_mio_pubsub_routes_deliver(conn, response))
+        return;
+    pthread_mutex_lock(&conn->pubsub_rx_backlog_mutex);
+    // Consumer threads take the response from its node's lane
+    if (conn->pubsub_lanes != NULL) {
+        _mio_pubsub_lanes_push(conn->pubsub_lanes, response);
+        pthread_mutex_unlock(&conn->pubsub_rx_backlog_mutex);
+        return;
+    }
+    // Keep the order behind responses held back by backpressure
+    if (conn->pubsub_rx_paused) {
+        TAILQ_INSERT_TAIL(&conn->pubsub_rx_backlog, response, responses);
+        pthread_mutex_unlock(&conn->pubsub_rx_backlog_mutex);
+        return;
+    }
+
+    if (!_mio_rx_ring_push(&conn->pubsub_rx_ring, response)) {
+        switch (__atomic_load_n(&conn->pubsub_rx_policy, __ATOMIC_RELAXED)) {
+        case MIO_RX_OVERFLOW_DROP_NEWEST:
+            mio_warn("Pubsub RX queue full, dropping newest response");
+            __atomic_add_fetch(&conn->pubsub_rx_stats.dropped_newest, 1,
+                               __ATOMIC_RELAXED);
+            _mio_response_pool_put(conn, response);
+            pthread_mutex_unlock(&conn->pubsub_rx_backlog_mutex);
+            return;
+        case MIO_RX_OVERFLOW_BACKPRESSURE:
+            mio_warn("Pubsub RX queue full, pausing reads from the server");
+            __atomic_add_fetch(&conn->pubsub_rx_stats.read_pauses, 1,
+                               __ATOMIC_RELAXED);
+            TAILQ_INSERT_TAIL(&conn->pubsub_rx_backlog, response, responses);
+            __atomic_store_n(&conn->pubsub_rx_paused, 1, __ATOMIC_SEQ_CST);
+            xmpp_conn_set_read_paused(conn->xmpp_conn, 1);
+            pthread_mutex_unlock(&conn->pubsub_rx_backlog_mutex);
+            return;
+        case MIO_RX_OVERFLOW_DROP_OLDEST:
+        default:
+            mio_warn("Pubsub RX queue full, dropping oldest response");
+            // Consumers may empty the ring in the meantime, so retry the push
+            do {
+                dropped = _mio_rx_ring_pop(&conn->pubsub_rx_ring);
+                if (dropped != NULL) {
+                    __atomic_add_fetch(&conn->pubsub_rx_stats.dropped_oldest, 1,
+                                       __ATOMIC_RELAXED);
+                    _mio_response_pool_put(conn, dropped);
+                }
+            } while (!_mio_rx_ring_push(&conn->pubsub_rx_ring, response));
+            break;
+        }
+    }
+    pthread_mutex_unlock(&conn->pubsub_rx_backlog_mutex);
+    __atomic_add_fetch(&conn->pubsub_rx_stats.enqueued, 1, __ATOMIC_RELAXED);
+    _mio_pubsub_rx_queue_signal(conn);
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to move responses held back by backpressure onto the
+ * received pubsub queue and to resume reading from the server once the queue
+ * has drained to half its capacity. Must be called from the event loop thread.
+ *
+ * @param conn A pointer to an active mio connection.
+ */
+void _mio_pubsub_rx_queue_refill(mio_conn_t *conn) {
+    mio_response_t *response;
+
+    if (!__atomic_load_n(&conn->pubsub_rx_paused, __ATOMIC_SEQ_CST))
+        return;
+    pthread_mutex_lock(&conn->pubsub_rx_backlog_mutex);
+    // The lanes hold everything, they only have to drain
+    if (conn->pubsub_lanes != NULL) {
+        if (_mio_pubsub_lanes_pending(conn->pubsub_lanes)
+                <= conn->pubsub_rx_stats.capacity / 2) {
+            __atomic_store_n(&conn->pubsub_rx_paused, 0, __ATOMIC_SEQ_CST);
+            xmpp_conn_set_read_paused(conn->xmpp_conn, 0);
+        }
+        pthread_mutex_unlock(&conn->pubsub_rx_backlog_mutex);
+        return;
+    }
+    while ((response = TAILQ_FIRST(&conn->pubsub_rx_backlog)) != NULL) {
+        if (!_mio_rx_ring_push(&conn->pubsub_rx_ring, response)) {
+            pthread_mutex_unlock(&conn->pubsub_rx_backlog_mutex);
+            return;
+        }
+        TAILQ_REMOVE(&conn->pubsub_rx_backlog, response, responses);
+        __atomic_add_fetch(&conn->pubsub_rx_stats.enqueued, 1,
+                           __ATOMIC_RELAXED);
+        _mio_pubsub_rx_queue_signal(conn);
+    }
+    if (_mio_pubsub_rx_queue_len(conn) <= conn->pubsub_rx_stats.capacity / 2) {
+        __atomic_store_n(&conn->pubsub_rx_paused, 0, __ATOMIC_SEQ_CST);
+        xmpp_conn_set_read_paused(conn->xmpp_conn, 0);
+    }
+    pthread_mutex_unlock(&conn->pubsub_rx_backlog_mutex);
+}
+
+// Accounts for n responses taken off the queue and lets the event loop resume
+// reading once half of the queue is free
+static void _mio_pubsub_rx_queue_dequeued(mio_conn_t *conn, int n) {
+    __atomic_add_fetch(&conn->pubsub_rx_stats.dequeued, n, __ATOMIC_RELAXED);
+    if (__atomic_load_n(&conn->pubsub_rx_paused, __ATOMIC_RELAXED)
+            && _mio_pubsub_rx_queue_len(conn)
+            <= conn->pubsub_rx_stats.capacity / 2)
+        xmpp_ctx_wakeup(conn->xmpp_conn->ctx);
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to pop a mio response off the received pubsub queue
+ * without blocking.
  *
  * @param conn A pointer to an active mio connection.
- * @returns A pointer to the mio response that was popped off the received pubsub queue.
+ * @returns A pointer to the mio response that was popped off the received
+ * pubsub queue, or NULL if the queue is empty.
  */
 mio_response_t *_mio_pubsub_rx_queue_dequeue(mio_conn_t *conn) {
-    mio_response_t *response = NULL;
+    mio_response_t *response;
+
+    response = _mio_rx_ring_pop(&conn->pubsub_rx_ring);
+    if (response == NULL)
+        return NULL;
+    _mio_pubsub_rx_queue_dequeued(conn, 1);
+    return response;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to pop up to max_responses mio responses off the received
+ * pubsub queue at once without blocking.
+ *
+ * @param conn A pointer to an active mio connection.
+ * @param responses Array receiving the popped responses, oldest first.
+ * @param max_responses Size of the array.
+ * @returns The number of responses popped, 0 if the queue is empty.
+ */
+int _mio_pubsub_rx_queue_dequeue_many(mio_conn_t *conn,
+                                      mio_response_t **responses, int max_responses) {
+    int n;
+
+    if (max_responses <= 0)
+        return 0;
+    n = _mio_rx_ring_pop_many(&conn->pubsub_rx_ring, responses, max_responses);
+    if (n > 0)
+        _mio_pubsub_rx_queue_dequeued(conn, n);
+    return n;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to pop a mio response off the received pubsub queue,
+ * waiting for one to arrive if the queue is empty.
+ *
+ * @param conn A pointer to an active mio connection.
+ * @param timeout_ms Time in ms to wait at most, negative to wait until a
+ * response arrives or listening stops.
+ * @param response Receives the popped response.
+ * @returns MIO_OK on success, MIO_ERROR_TIMEOUT if no response arrived in
+ * time or MIO_ERROR_NO_RESPONSE if listening was stopped.
+ */
+int _mio_pubsub_rx_queue_dequeue_timed(mio_conn_t *conn, int timeout_ms,
+                                       mio_response_t **response) {
+    struct timespec ts;
+    struct timeval tp;
+    int err = 0;
+
+    *response = _mio_pubsub_rx_queue_dequeue(conn);
+    if (*response != NULL)
+        return MIO_OK;
+    if (timeout_ms == 0)
+        return MIO_ERROR_TIMEOUT;
+
+    if (timeout_ms > 0) {
+        gettimeofday(&tp, NULL);
+        ts.tv_sec = tp.tv_sec + timeout_ms / 1000;
+        ts.tv_nsec = tp.tv_usec * 1000 + (long) (timeout_ms % 1000) * 1000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+    }
+
     pthread_mutex_lock(&conn->pubsub_rx_queue_mutex);
-    if (conn->pubsub_rx_queue_len > 0) {
-        response = TAILQ_FIRST(&conn->pubsub_rx_queue);
-        TAILQ_REMOVE(&conn->pubsub_rx_queue, response, responses);
-        conn->pubsub_rx_queue_len--;
-        pthread_mutex_unlock(&conn->pubsub_rx_queue_mutex);
-        return response;
-    } else {
-        pthread_mutex_unlock(&conn->pubsub_rx_queue_mutex);
-        return NULL ;
+    __atomic_add_fetch(&conn->pubsub_rx_waiters, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    while ((*response = _mio_pubsub_rx_queue_dequeue(conn)) == NULL
+            && conn->pubsub_rx_listening && err != ETIMEDOUT) {
+        if (timeout_ms > 0)
+            err = pthread_cond_timedwait(&conn->pubsub_rx_queue_cond,
+                                         &conn->pubsub_rx_queue_mutex, &ts);
+        else
+            pthread_cond_wait(&conn->pubsub_rx_queue_cond,
+                              &conn->pubsub_rx_queue_mutex);
     }
+    __atomic_sub_fetch(&conn->pubsub_rx_waiters, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&conn->pubsub_rx_queue_mutex);
+
+    if (*response != NULL)
+        return MIO_OK;
+    return err == ETIMEDOUT ? MIO_ERROR_TIMEOUT : MIO_ERROR_NO_RESPONSE;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to wake up all threads waiting for the received pubsub
+ * queue, e.g. after listening stopped.
+ *
+ * @param conn A pointer to an active mio connection.
+ */
+void _mio_pubsub_rx_queue_wake(mio_conn_t *conn) {
+    pthread_mutex_lock(&conn->pubsub_rx_queue_mutex);
+    pthread_cond_broadcast(&conn->pubsub_rx_queue_cond);
+    pthread_mutex_unlock(&conn->pubsub_rx_queue_mutex);
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to get the number of responses on the received pubsub
+ * queue. The result is a snapshot while other threads use the queue.
+ *
+ * @param conn A pointer to a mio connection.
+ * @returns The number of queued responses.
+ */
+unsigned int _mio_pubsub_rx_queue_len(mio_conn_t *conn) {
+    uint64_t head, tail;
+
+    head = __atomic_load_n(&conn->pubsub_rx_ring.head, __ATOMIC_RELAXED);
+    tail = __atomic_load_n(&conn->pubsub_rx_ring.tail, __ATOMIC_RELAXED);
+    return tail > head ? (unsigned int) (tail - head) : 0;
 }
 
 
 /**
  * @ingroup Internal
- * Internal function to allocate an initialize a new mio request
+ * Internal function to allocate an initialize a new mio request that lives
+ * outside of the request table, such as the pubsub listener.
  *
  * @returns A newly allocated and initialized mio request
  */
@@ -339,7 +962,7 @@ mio_request_t *_mio_request_new() {
 
 /**
  * @ingroup Internal
- * Internal function to free an initialized mio request.
+ * Internal function to free a mio request allocated with _mio_request_new().
  *
  * @param request The allocated mio request to be freed.
  */
@@ -349,100 +972,462 @@ void _mio_request_free(mio_request_t *request) {
     free(request);
 }
 
+// Pops a free slot off the request table's free list, NULL if it is empty
+static mio_request_t *_mio_request_pop(mio_conn_t *conn) {
+    uint64_t head, next;
+    uint32_t index;
+
+    head = __atomic_load_n(&conn->requests_free, __ATOMIC_ACQUIRE);
+    do {
+        index = (uint32_t) head;
+        if (index == 0)
+            return NULL;
+        // The tag makes the exchange fail if the slot was popped and pushed
+        // back in the meantime, even if next_free was read in between
+        next = ((head >> 32) + 1) << 32
+               | __atomic_load_n(&conn->requests[index - 1].next_free,
+                                 __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&conn->requests_free, &head, next, 1,
+                                          __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+    return &conn->requests[index - 1];
+}
+
+// Pushes a slot back onto the request table's free list and wakes up a thread
+// waiting for one
+static void _mio_request_push(mio_conn_t *conn, mio_request_t *request) {
+    uint64_t head, next;
+    uint32_t index = request - conn->requests + 1;
+
+    head = __atomic_load_n(&conn->requests_free, __ATOMIC_RELAXED);
+    do {
+        __atomic_store_n(&request->next_free, (uint32_t) head,
+                         __ATOMIC_RELAXED);
+        next = ((head >> 32) + 1) << 32 | index;
+    } while (!__atomic_compare_exchange_n(&conn->requests_free, &head, next, 1,
+                                          __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+    if (__atomic_load_n(&conn->requests_waiters, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&conn->requests_mutex);
+        pthread_cond_signal(&conn->requests_cond);
+        pthread_mutex_unlock(&conn->requests_mutex);
+    }
+}
+
+static int _mio_request_complete_token(mio_conn_t *conn,
+                                       mio_request_t *request, uint32_t token, int status);
+
+// Deadline timer of a request slot, runs in the event loop thread
+static void _mio_request_timeout(xmpp_ctx_t * const ctx,
+                                 xmpp_timer_t * const timer) {
+    mio_conn_t *conn = timer->userdata;
+    mio_request_t *request = (mio_request_t*) ((char*) timer
+                             - offsetof(mio_request_t, timer));
+
+    // A handler worker is decoding the response, look again shortly
+    if (__atomic_load_n(&request->worker_jobs, __ATOMIC_ACQUIRE) > 0) {
+        xmpp_timer_add(ctx, timer,
+                       xmpp_ctx_now(ctx) + MIO_REQUEST_WORKER_RETRY_MS);
+        return;
+    }
+    _mio_request_complete_token(conn, request, request->timer_token,
+                                request->timer_status);
+}
+
+// Queues a request slot for _mio_request_timers_arm() unless it is queued
+// already
+static void _mio_request_arm_push(mio_conn_t *conn, mio_request_t *request) {
+    uint32_t head, index = request - conn->requests + 1;
+
+    if (__atomic_exchange_n(&request->arm_queued, 1, __ATOMIC_ACQ_REL))
+        return;
+    head = __atomic_load_n(&conn->requests_arm, __ATOMIC_RELAXED);
+    do {
+        __atomic_store_n(&request->next_arm, head, __ATOMIC_RELAXED);
+    } while (!__atomic_compare_exchange_n(&conn->requests_arm, &head, index, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
 /**
  * @ingroup Internal
- * Internal function to add a mio request to the request hash table.
+ * Internal function to preallocate the request table of a mio connection.
+ * All slots start out on the free list.
  *
- * @param conn A pointer to an active mio connection to which the request should be added to.
- * @param id A string containing the UUID of the request being added.
- * @param handler A pointer to the mio handler associated with the request.
- * @param handler_type MIO_HANDLER_ID for a handler that is executed when a message matching its ID is received, MIO_HANLDER_TIMED for a handler that is executed based at fixed time intervals.
- * @param response A pointer to an allocated mio response, which will contain the server's response.
- * @param request A pointer to the mio request to be added.
- * @returns MIO_OK on success, otherwise a non-zero integer error number.
+ * @param conn A pointer to the mio connection to set up.
+ * @param capacity The number of slots, at most MIO_MAX_OPEN_REQUESTS_LIMIT.
+ * @returns MIO_OK on success, MIO_ERROR_MALLOC if the table could not be
+ * allocated.
  */
-int _mio_request_add(mio_conn_t *conn, const char *id,
-                     mio_handler handler, mio_handler_type_t handler_type,
-                     mio_response_t *response, mio_request_t *request) {
-    mio_request_t *find_request = NULL;
+int _mio_request_table_init(mio_conn_t *conn, unsigned int capacity) {
+    unsigned int i;
 
-//sem_getvalue is not implemented in OSX
-#ifdef __linux__
-    int sem_value;
-    sem_getvalue(conn->mio_open_requests, &sem_value);
-    mio_debug("Remaining requests: %d", sem_value);
-    if (sem_value <= 0) {
-        mio_error("Cannot add request for id %s, open request table full", id);
-        return MIO_ERROR_TOO_MANY_OPEN_REQUESTS;
+    conn->requests = calloc(capacity, sizeof(mio_request_t));
+    if (conn->requests == NULL)
+        return MIO_ERROR_MALLOC;
+    conn->requests_len = capacity;
+    for (i = 0; i < capacity; i++) {
+        pthread_cond_init(&conn->requests[i].cond, NULL );
+        pthread_mutex_init(&conn->requests[i].mutex, NULL );
+        conn->requests[i].generation = 1;
+        xmpp_timer_init(&conn->requests[i].timer, _mio_request_timeout, conn);
+        conn->requests[i].next_free = i + 2 <= capacity ? i + 2 : 0;
     }
-#endif
-// Check if ID is already in table
-    if (pthread_rwlock_wrlock(&conn->mio_hash_lock) != 0) {
-        mio_error("Can't get hash table rw lock");
-        return MIO_ERROR_RW_LOCK;
-    }
-    HASH_FIND_STR(conn->mio_request_table, id, find_request);
-    if (find_request == NULL ) {
-        if (strcmp(request->id, "") == 0)
-            strcpy(request->id, id);
-        if (response != NULL ) {
-            if (strcmp(request->id, "") == 0)
-                strcpy(response->id, id);
-        }
-        // Add given request to hash table
-        HASH_ADD_STR(conn->mio_request_table, id, request);
-    }
-    pthread_rwlock_unlock(&conn->mio_hash_lock);
-// Update members of struct
-    request->handler = handler;
-    request->handler_type = handler_type;
-    request->response = response;
+    conn->requests_free = 1;
+    pthread_mutex_init(&conn->requests_mutex, NULL );
+    pthread_cond_init(&conn->requests_cond, NULL );
     return MIO_OK;
 }
 
 /**
  * @ingroup Internal
- * Internal function to delete a mio request from the request hash table.
+ * Internal function to free the request table of a mio connection. Pending
+ * requests are dropped without calling their completion.
  *
- * @param conn A pointer to an active mio connection from which the request should be removed from.
- * @param id A string containing the UUID of the request being deleted.
- * @returns MIO_OK on success, otherwise a non-zero integer error number.
+ * @param conn A pointer to the mio connection.
  */
-int _mio_request_delete(mio_conn_t *conn, char *id) {
-    mio_request_t *r;
-    if (pthread_rwlock_wrlock(&conn->mio_hash_lock) != 0) {
-        mio_error("Can't get hash table rw lock");
-        return MIO_ERROR_RW_LOCK;
+void _mio_request_table_free(mio_conn_t *conn) {
+    unsigned int i;
+
+    if (conn->requests == NULL)
+        return;
+    for (i = 0; i < conn->requests_len; i++) {
+        if (conn->xmpp_conn != NULL)
+            xmpp_timer_del(conn->xmpp_conn->ctx, &conn->requests[i].timer);
+        pthread_cond_destroy(&conn->requests[i].cond);
+        pthread_mutex_destroy(&conn->requests[i].mutex);
     }
-    HASH_FIND_STR(conn->mio_request_table, id, r);
-    if (r != NULL ) {
-        HASH_DEL(conn->mio_request_table, r);
-        pthread_rwlock_unlock(&conn->mio_hash_lock);
-        _mio_request_free(r);
-        sem_post(conn->mio_open_requests);
+    free(conn->requests);
+    conn->requests = NULL;
+    conn->requests_len = 0;
+    pthread_mutex_destroy(&conn->requests_mutex);
+    pthread_cond_destroy(&conn->requests_cond);
+}
+
+/**
+ * @ingroup Core
+ * Sets how many requests can be in flight on a mio connection at the same
+ * time, MIO_MAX_OPEN_REQUESTS by default. Once they are, mio_send_async() and
+ * the other asynchronous calls fail with MIO_ERROR_TOO_MANY_OPEN_REQUESTS and
+ * the blocking calls wait for a request to complete. Only call it while no
+ * request is in flight and no other thread sends requests, e.g. before
+ * connecting.
+ *
+ * @param conn A pointer to a mio connection.
+ * @param capacity The number of requests, 0 for MIO_MAX_OPEN_REQUESTS. At most
+ * MIO_MAX_OPEN_REQUESTS_LIMIT.
+ * @returns MIO_OK on success, MIO_ERROR_TOO_MANY_OPEN_REQUESTS if capacity is
+ * too large or requests are in flight, or MIO_ERROR_MALLOC, in which case the
+ * previous table is kept.
+ */
+int mio_request_table_configure(mio_conn_t *conn, unsigned int capacity) {
+    mio_request_t *requests;
+    unsigned int i, len;
+    int err;
+
+    if (capacity == 0)
+        capacity = MIO_MAX_OPEN_REQUESTS;
+    if (capacity > MIO_MAX_OPEN_REQUESTS_LIMIT)
+        return MIO_ERROR_TOO_MANY_OPEN_REQUESTS;
+    if (capacity == conn->requests_len)
         return MIO_OK;
+    for (i = 0; i < conn->requests_len; i++)
+        if (__atomic_load_n(&conn->requests[i].token, __ATOMIC_ACQUIRE) != 0
+                || __atomic_load_n(&conn->requests[i].worker_jobs,
+                                   __ATOMIC_ACQUIRE) != 0)
+            return MIO_ERROR_TOO_MANY_OPEN_REQUESTS;
+    if (__atomic_load_n(&conn->requests_waiters, __ATOMIC_SEQ_CST) > 0)
+        return MIO_ERROR_TOO_MANY_OPEN_REQUESTS;
+
+    // Keep the old table until the new one is allocated
+    requests = conn->requests;
+    len = conn->requests_len;
+    pthread_mutex_destroy(&conn->requests_mutex);
+    pthread_cond_destroy(&conn->requests_cond);
+    err = _mio_request_table_init(conn, capacity);
+    if (err != MIO_OK) {
+        conn->requests = requests;
+        conn->requests_len = len;
+        pthread_mutex_init(&conn->requests_mutex, NULL );
+        pthread_cond_init(&conn->requests_cond, NULL );
+        return err;
+    }
+    for (i = 0; i < len; i++) {
+        if (conn->xmpp_conn != NULL)
+            xmpp_timer_del(conn->xmpp_conn->ctx, &requests[i].timer);
+        pthread_cond_destroy(&requests[i].cond);
+        pthread_mutex_destroy(&requests[i].mutex);
+    }
+    free(requests);
+    conn->requests_arm = 0;
+    return MIO_OK;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to take a free slot from the request table. The slot's
+ * id, which is to be used as the id of the request stanza, encodes the slot
+ * index and a generation that changes every time the slot is reused, so that
+ * late responses to completed requests are ignored. The slot becomes visible
+ * to the event loop once it is passed to _mio_request_start().
+ *
+ * @param conn A pointer to an active mio connection.
+ * @param wait Nonzero to block until a slot is free, otherwise return NULL if
+ * the request table is full, see mio_request_table_configure().
+ * @returns A pointer to the request slot, or NULL if the table is full.
+ */
+mio_request_t *_mio_request_acquire(mio_conn_t *conn, int wait) {
+    mio_request_t *request;
+
+    while ((request = _mio_request_pop(conn)) == NULL) {
+        if (!wait)
+            return NULL;
+        pthread_mutex_lock(&conn->requests_mutex);
+        __atomic_add_fetch(&conn->requests_waiters, 1, __ATOMIC_SEQ_CST);
+        while ((uint32_t) __atomic_load_n(&conn->requests_free,
+                                          __ATOMIC_SEQ_CST) == 0)
+            pthread_cond_wait(&conn->requests_cond, &conn->requests_mutex);
+        __atomic_sub_fetch(&conn->requests_waiters, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&conn->requests_mutex);
+    }
+
+    snprintf(request->id, sizeof(request->id), "mio%x",
+             (unsigned int) request->generation << 16
+             | (unsigned int) (request - conn->requests));
+    request->predicate = 0;
+    request->response = NULL;
+    request->completion = NULL;
+    request->completion_userdata = NULL;
+    request->deadline = 0;
+    return request;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to publish a request slot taken with
+ * _mio_request_acquire() once its handler, response, completion and deadline
+ * are set. From then on the request can be found by its id. Its deadline
+ * timer is armed by the event loop in _mio_request_timers_arm().
+ *
+ * @param conn A pointer to an active mio connection.
+ * @param request A pointer to the request slot.
+ */
+void _mio_request_start(mio_conn_t *conn, mio_request_t *request) {
+    __atomic_store_n(&request->token,
+                     (uint32_t) request->generation << 16
+                     | (uint32_t) (request - conn->requests), __ATOMIC_RELEASE);
+    _mio_request_arm_push(conn, request);
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to arm the deadline timers of requests started since the
+ * last call and to cancel those of requests that have been completed in the
+ * meantime. Each request is handled in O(1). Must be called from the event
+ * loop thread before it runs the event loop.
+ *
+ * @param conn A pointer to an active mio connection.
+ */
+void _mio_request_timers_arm(mio_conn_t *conn) {
+    mio_request_t *request;
+    uint32_t index, token;
+
+    index = __atomic_exchange_n(&conn->requests_arm, 0, __ATOMIC_ACQUIRE);
+    while (index != 0) {
+        request = &conn->requests[index - 1];
+        index = __atomic_load_n(&request->next_arm, __ATOMIC_RELAXED);
+        // A start after this point queues the slot again
+        __atomic_store_n(&request->arm_queued, 0, __ATOMIC_SEQ_CST);
+        token = __atomic_load_n(&request->token, __ATOMIC_ACQUIRE);
+        if (token != 0) {
+            request->timer_token = token;
+            request->timer_status = MIO_ERROR_TIMEOUT;
+            xmpp_timer_add(conn->xmpp_conn->ctx, &request->timer,
+                           request->deadline);
+        } else {
+            xmpp_timer_del(conn->xmpp_conn->ctx, &request->timer);
+        }
     }
-    pthread_rwlock_unlock(&conn->mio_hash_lock);
-    return MIO_ERROR_REQUEST_NOT_FOUND;
 }
 
 /**
  * @ingroup Internal
- * Internal function to get a mio request from a request hash table.
+ * Internal function to get an in-flight mio request by its stanza id. Does
+ * not take any locks.
  *
  * @param conn A pointer to an active mio connection from which the request should be fetched from.
- * @param id A string containing the UUID of the request to be fetched.
- * @returns A pointer to the mio request fetched from the request hash or NULL if the request could not be found.
+ * @param id A string containing the id of the request to be fetched.
+ * @returns A pointer to the mio request or NULL if no request with this id is in flight.
  */
-mio_request_t *_mio_request_get(mio_conn_t *conn, char *id) {
-    mio_request_t *r;
-    if (pthread_rwlock_rdlock(&conn->mio_hash_lock) != 0) {
-        mio_error("Can't get hash table rd lock");
-        return NULL ;
+mio_request_t *_mio_request_get(mio_conn_t *conn, const char *id) {
+    unsigned long token;
+    char *end;
+
+    if (id == NULL || strncmp(id, "mio", 3) != 0)
+        return NULL;
+    token = strtoul(id + 3, &end, 16);
+    if (*end != '\0' || token == 0 || token > 0xffffffffUL
+            || (token & 0xffff) >= conn->requests_len)
+        return NULL;
+    if (__atomic_load_n(&conn->requests[token & 0xffff].token,
+                        __ATOMIC_ACQUIRE) != token)
+        return NULL;
+    return &conn->requests[token & 0xffff];
+}
+
+// Takes ownership of the in-flight request identified by token. Whoever
+// clears the token owns the completion, so a request answered, timed out and
+// cancelled at the same time completes once.
+static int _mio_request_claim(mio_conn_t *conn, mio_request_t *request,
+                              uint32_t token) {
+    if (token == 0
+            || !__atomic_compare_exchange_n(&request->token, &token, 0, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        return MIO_ERROR_REQUEST_NOT_FOUND;
+    return MIO_OK;
+}
+
+// Returns a claimed request slot to the free list under a new generation
+static void _mio_request_release(mio_conn_t *conn, mio_request_t *request) {
+    if (++request->generation == 0)
+        request->generation = 1;
+    _mio_request_push(conn, request);
+}
+
+// Completes the request if it is still in flight as token
+static int _mio_request_complete_token(mio_conn_t *conn,
+                                       mio_request_t *request, uint32_t token, int status) {
+    if (_mio_request_claim(conn, request, token) != MIO_OK)
+        return MIO_ERROR_REQUEST_NOT_FOUND;
+
+    xmpp_timer_del(conn->xmpp_conn->ctx, &request->timer);
+    if (status == MIO_ERROR_TIMEOUT)
+        mio_error("Request with id %s timed out", request->id);
+    if (request->completion != NULL)
+        request->completion(conn, request->response, status,
+                            request->completion_userdata);
+    _mio_request_release(conn, request);
+    return MIO_OK;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to complete an in-flight mio request and call its
+ * completion. Must be called from the event loop thread. Requests that have
+ * already been completed are ignored.
+ *
+ * @param conn A pointer to an active mio connection containing the request.
+ * @param request A pointer to the mio request to be completed.
+ * @param status MIO_OK if the request's handler processed the response,
+ * otherwise the error the request completes with.
+ * @returns MIO_OK if the request was completed, otherwise an error.
+ */
+int _mio_request_complete(mio_conn_t *conn, mio_request_t *request,
+                          int status) {
+    return _mio_request_complete_token(conn, request,
+                                       __atomic_load_n(&request->token, __ATOMIC_ACQUIRE), status);
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to complete an in-flight mio request from a handler
+ * worker. The deadline timer is left to the event loop, where it finds the
+ * request completed.
+ *
+ * @param conn A pointer to an active mio connection containing the request.
+ * @param request A pointer to the mio request to be completed.
+ * @param token The token of the request when its response arrived.
+ * @param status The status the request completes with.
+ * @returns MIO_OK if the request was completed, otherwise an error.
+ */
+int _mio_request_complete_async(mio_conn_t *conn, mio_request_t *request,
+                                uint32_t token, int status) {
+    if (_mio_request_claim(conn, request, token) != MIO_OK)
+        return MIO_ERROR_REQUEST_NOT_FOUND;
+    if (request->completion != NULL)
+        request->completion(conn, request->response, status,
+                            request->completion_userdata);
+    _mio_request_release(conn, request);
+    return MIO_OK;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to drop an in-flight mio request without calling its
+ * completion, e.g. when its stanza could not be sent. A request whose response
+ * is being handled by a handler worker is left to the worker or its deadline.
+ *
+ * @param conn A pointer to an active mio connection containing the request.
+ * @param request A pointer to the mio request to be dropped.
+ * @returns MIO_OK if the request was dropped, MIO_ERROR_REQUEST_NOT_FOUND if it
+ * has already been completed or will still be completed.
+ */
+int _mio_request_cancel(mio_conn_t *conn, mio_request_t *request) {
+    // A worker may be writing to the response. No response can be handed to
+    // the workers once the check passed, the stanza of a cancelled request
+    // was never sent.
+    if (__atomic_load_n(&request->worker_jobs, __ATOMIC_ACQUIRE) > 0)
+        return MIO_ERROR_REQUEST_NOT_FOUND;
+    if (_mio_request_claim(conn, request,
+                           __atomic_load_n(&request->token, __ATOMIC_ACQUIRE)) != MIO_OK)
+        return MIO_ERROR_REQUEST_NOT_FOUND;
+    _mio_request_release(conn, request);
+    return MIO_OK;
+}
+
+// Completes all in-flight requests with status. Requests whose response is
+// being handled by a handler worker are completed by their timer once the
+// worker is done, unless the worker completes them first.
+static int _mio_request_complete_all(mio_conn_t *conn, int status) {
+    xmpp_ctx_t *ctx = conn->xmpp_conn->ctx;
+    mio_request_t *request;
+    uint32_t token;
+    int i, n = 0;
+
+    for (i = 0; i < conn->requests_len; i++) {
+        request = &conn->requests[i];
+        token = __atomic_load_n(&request->token, __ATOMIC_ACQUIRE);
+        if (token == 0)
+            continue;
+        // Responses are handed to the workers by this thread only, the count
+        // cannot go up behind our back
+        if (__atomic_load_n(&request->worker_jobs, __ATOMIC_ACQUIRE) > 0) {
+            request->timer_token = token;
+            request->timer_status = status;
+            xmpp_timer_add(ctx, &request->timer,
+                           xmpp_ctx_now(ctx) + MIO_REQUEST_WORKER_RETRY_MS);
+            continue;
+        }
+        if (_mio_request_complete_token(conn, request, token, status) == MIO_OK)
+            n++;
     }
-    HASH_FIND_STR(conn->mio_request_table, id, r);
-    pthread_rwlock_unlock(&conn->mio_hash_lock);
-    return r;
+    return n;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to complete all in-flight requests with an error, e.g.
+ * when the connection drops. Must be called from the event loop thread.
+ *
+ * @param conn A pointer to an active mio connection.
+ * @param status The error the requests complete with.
+ * @returns The number of requests that were completed. Requests whose
+ * response is being handled by a handler worker are completed once the
+ * worker is done and are not counted.
+ */
+int _mio_request_fail_all(mio_conn_t *conn, int status) {
+    return _mio_request_complete_all(conn, status);
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to generate a stanza id that is unique within a mio
+ * connection. Ids of requests are replaced by their slot id when sent.
+ *
+ * @param conn A pointer to an active mio connection.
+ * @param id A buffer of at least 37 bytes receiving the id.
+ */
+void _mio_stanza_id_new(mio_conn_t *conn, char *id) {
+    snprintf(id, 37, "s%x",
+             __atomic_add_fetch(&conn->stanza_ids, 1, __ATOMIC_RELAXED));
 }
 
 
@@ -471,15 +1456,18 @@ void _mio_response_error_free(mio_response_error_t* error) {
     free(error);
 }
 
-/**
- * @ingroup Core
- * Frees an allocated mio response.
- *
- * @param A pointer to the mio response to be freed.
- */
-void mio_response_free(mio_response_t *response) {
+// Frees everything a response points to, but not the response itself
+static void _mio_response_clear(mio_response_t *response) {
+    // Arena responses only hold a reference to their stanza outside the arena
+    if (response->arena != NULL) {
+        if (response->stanza != NULL)
+            xmpp_stanza_release(response->stanza->xmpp_stanza);
+        response->stanza = NULL;
+        mio_arena_reset(response->arena);
+        return;
+    }
+
 // TODO: free other response types
-    if (response == NULL) return;
     switch (response->response_type) {
     case MIO_RESPONSE_ERROR:
         _mio_response_error_free(response->response);
@@ -496,9 +1484,104 @@ void mio_response_free(mio_response_t *response) {
 
     if (response->stanza != NULL )
         mio_stanza_free(response->stanza);
+}
+
+/**
+ * @ingroup Core
+ * Frees an allocated mio response.
+ *
+ * @param A pointer to the mio response to be freed.
+ */
+void mio_response_free(mio_response_t *response) {
+    if (response == NULL) return;
+    _mio_response_clear(response);
+    mio_arena_free(response->arena);
     free(response);
 }
 
+/**
+ * @ingroup Internal
+ * Internal function to get an empty mio response from the connection's pool of
+ * released responses, or a newly allocated one if the pool is empty. Can be
+ * called from any thread.
+ *
+ * @param conn A pointer to an active mio connection.
+ * @returns A pointer to an initialized mio response.
+ */
+mio_response_t *_mio_response_pool_get(mio_conn_t *conn) {
+    mio_response_t *response, *next;
+    mio_arena_t *arena;
+
+    // Pops are serialized, so the head cannot be popped and pushed back
+    // between the load and the exchange
+    pthread_mutex_lock(&conn->response_pool_mutex);
+    response = __atomic_load_n(&conn->response_pool, __ATOMIC_ACQUIRE);
+    do {
+        if (response == NULL) {
+            pthread_mutex_unlock(&conn->response_pool_mutex);
+            return mio_response_new();
+        }
+        next = response->responses.tqe_next;
+    } while (!__atomic_compare_exchange_n(&conn->response_pool, &response, next,
+                                          1, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE));
+    pthread_mutex_unlock(&conn->response_pool_mutex);
+    __atomic_sub_fetch(&conn->response_pool_len, 1, __ATOMIC_RELAXED);
+
+    // The arena stays with the response, it was reset on release
+    arena = response->arena;
+    memset(response, 0, sizeof(mio_response_t));
+    response->response_type = MIO_RESPONSE_UNKNOWN;
+    response->arena = arena;
+    return response;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to free the contents of a mio response and keep the
+ * response itself for _mio_response_pool_get(). The response is freed if the
+ * pool already holds MIO_RESPONSE_POOL_MAX_LEN responses. Can be called from
+ * any thread.
+ *
+ * @param conn A pointer to a mio connection.
+ * @param response A pointer to the mio response to release.
+ */
+void _mio_response_pool_put(mio_conn_t *conn, mio_response_t *response) {
+    mio_response_t *head;
+
+    if (response == NULL)
+        return;
+    _mio_response_clear(response);
+    if (__atomic_add_fetch(&conn->response_pool_len, 1, __ATOMIC_RELAXED)
+            > MIO_RESPONSE_POOL_MAX_LEN) {
+        __atomic_sub_fetch(&conn->response_pool_len, 1, __ATOMIC_RELAXED);
+        mio_arena_free(response->arena);
+        free(response);
+        return;
+    }
+    head = __atomic_load_n(&conn->response_pool, __ATOMIC_RELAXED);
+    do {
+        response->responses.tqe_next = head;
+    } while (!__atomic_compare_exchange_n(&conn->response_pool, &head, response,
+                                          1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to free all responses in the connection's response pool.
+ *
+ * @param conn A pointer to a mio connection.
+ */
+void _mio_response_pool_free(mio_conn_t *conn) {
+    mio_response_t *response;
+
+    while ((response = conn->response_pool) != NULL) {
+        conn->response_pool = response->responses.tqe_next;
+        mio_arena_free(response->arena);
+        free(response);
+    }
+    conn->response_pool_len = 0;
+}
+
 /**
  * @ingroup Core
  * Allocates and initializes a new mio error response.
@@ -592,6 +1675,7 @@ int mio_response_print(mio_response_t *response) {
     mio_node_type_t *type;
     mio_event_t *event;
     mio_reference_t *ref;
+    mio_publish_result_t *result;
 
     switch (response->response_type) {
     case MIO_RESPONSE_OK:
@@ -861,6 +1945,23 @@ int mio_response_print(mio_response_t *response) {
                 ref = ref->next;
             }
             break;
+        case MIO_PACKET_PUBLISH_RESULTS:
+            result = (mio_publish_result_t*) packet->payload;
+            fprintf(stdout, "MIO Publish Results Packet:\n");
+            while (result != NULL ) {
+                fprintf(stdout, "\tTransducer: %s\n", result->name);
+                if (result->status == MIO_OK)
+                    fprintf(stdout, "\tStatus: Published\n\n");
+                else if (result->error != NULL )
+                    fprintf(stdout,
+                            "\tStatus: Rejected\n\tError code: %d\n\tError description: %s\n\n",
+                            result->error->err_num, result->error->description);
+                else
+                    fprintf(stdout, "\tStatus: Failed with error %d\n\n",
+                            result->status);
+                result = result->next;
+            }
+            break;
 
         default:
             mio_error("Unknown packet type");
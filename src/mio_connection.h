@@ -29,44 +29,72 @@
 #include <stdlib.h>
 #include <expat.h>
 #include <strophe.h>
+#include <common.h>
 #include <sys/queue.h>
 #include <uthash.h>
 
 #define KEEPALIVE_PERIOD 30000 // ms
+// Default capacity of the preallocated request table, see
+// mio_request_table_configure()
 #define MIO_MAX_OPEN_REQUESTS 	100
+// Largest request table, the slot index takes 16 bits of a request's id
+#define MIO_MAX_OPEN_REQUESTS_LIMIT (1 << 16)
 
 #define MIO_BLOCKING 1
 #define MIO_NON_BLOCKING 2
 
 #define MIO_REQUEST_TIMEOUT_S		1000
+// Backoff between reconnection attempts
 #define MIO_RECONNECTION_TIMEOUT_S	5
 //#define MIO_CONNECTION_RETRIES	3	// Comment out to retry indefinitely
 #define MIO_SEND_RETRIES			3
 
 #define MIO_RESPONSE_TIMEOUT 10000  //ms
-#define MIO_EVENT_LOOP_TIMEOUT 1 //ms
-#define MIO_SEND_REQUEST_TIMEOUT 1000 //µs
-#define MIO_PUBSUB_RX_QUEUE_MAX_LEN 100
+// Upper bound on how long the event loop blocks when there is no socket
+// activity, no timed handler due and no wakeup
+#define MIO_EVENT_LOOP_TIMEOUT 1000 //ms
+// Default capacity of the pubsub RX queue, see mio_pubsub_data_rx_queue_configure()
+#define MIO_PUBSUB_RX_QUEUE_DEFAULT_LEN 4096
+// Received pubsub responses kept for reuse, see mio_pubsub_data_response_release()
+#define MIO_RESPONSE_POOL_MAX_LEN 1024
+// Idle XML parsers kept for reuse, see mio_stanza_parse()
+#define MIO_PARSER_POOL_MAX_LEN 8
+// Delay before a request whose response a handler worker is still decoding
+// is checked again for its deadline, see mio_handler_workers_start()
+#define MIO_REQUEST_WORKER_RETRY_MS 10
 
 typedef enum {
     MIO_LEVEL_ERROR, MIO_LEVEL_WARN, MIO_LEVEL_INFO, MIO_LEVEL_DEBUG
 } mio_log_level_t;
 
+// Highest level compiled in, e.g. building with
+// -DMIO_LOG_MAX_LEVEL=MIO_LEVEL_INFO removes all mio_debug() calls
+#ifndef MIO_LOG_MAX_LEVEL
+#define MIO_LOG_MAX_LEVEL MIO_LEVEL_DEBUG
+#endif
+
+// Arguments are only evaluated and formatted if the level is enabled
+#define mio_log_enabled(level) \
+    ((level) <= MIO_LOG_MAX_LEVEL && _mio_log_level >= (level))
+
 #define mio_debug(...) \
-do { if(_mio_log_level == MIO_LEVEL_DEBUG){ fprintf(stderr, "MIO DEBUG: %s:%d:%s(): ", __FILE__, \
-                                                    __LINE__, __func__); fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); }} while (0)
+do { if (mio_log_enabled(MIO_LEVEL_DEBUG)) _mio_log(MIO_LEVEL_DEBUG, __FILE__, \
+                                                    __LINE__, __func__, __VA_ARGS__); } while (0)
 
 #define mio_info(...) \
-do { if(_mio_log_level >= MIO_LEVEL_INFO){ fprintf(stderr, "MIO INFO: %s:%d:%s(): ", __FILE__, \
-                                                   __LINE__, __func__); fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); }} while (0)
+do { if (mio_log_enabled(MIO_LEVEL_INFO)) _mio_log(MIO_LEVEL_INFO, __FILE__, \
+                                                   __LINE__, __func__, __VA_ARGS__); } while (0)
 
 #define mio_warn(...) \
-do { if(_mio_log_level >= MIO_LEVEL_WARN){ fprintf(stderr, "MIO WARNING: %s:%d:%s(): ", __FILE__, \
-                                                   __LINE__, __func__); fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n"); }} while (0)
+do { if (mio_log_enabled(MIO_LEVEL_WARN)) _mio_log(MIO_LEVEL_WARN, __FILE__, \
+                                                   __LINE__, __func__, __VA_ARGS__); } while (0)
 
 #define mio_error(...) \
-do { if(_mio_log_level >= MIO_LEVEL_ERROR){ fprintf(stderr, "MIO ERROR: %s:%d:%s(): ", __FILE__, \
-                                                    __LINE__, __func__); fprintf(stderr, __VA_ARGS__); fprintf(stderr, "\n");}} while (0)
+do { if (mio_log_enabled(MIO_LEVEL_ERROR)) _mio_log(MIO_LEVEL_ERROR, __FILE__, \
+                                                    __LINE__, __func__, __VA_ARGS__); } while (0)
+
+// Size of the log ring used by mio_log_async_start() when 0 is passed
+#define MIO_LOG_ASYNC_DEFAULT_SIZE (1 << 20)
 
 typedef enum {
     MIO_CONN_CONNECT, MIO_CONN_DISCONNECT, MIO_CONN_FAIL
@@ -96,6 +124,30 @@ typedef struct mio_stanza {
     struct mio_stanza * next;
 } mio_stanza_t;
 
+// Defined in mio_template.h
+typedef struct mio_template mio_template_t;
+
+// Defined in mio_publish_stream.h
+typedef struct mio_publish_stream mio_publish_stream_t;
+
+// Defined in mio_coalesce.h
+typedef struct mio_coalescer mio_coalescer_t;
+
+// Defined in mio_deadband.h
+typedef struct mio_deadband mio_deadband_t;
+
+// Defined in mio_arena.h
+typedef struct mio_arena mio_arena_t;
+
+// Defined in mio_workers.h
+typedef struct mio_workers mio_workers_t;
+
+// Defined in mio_pubsub_lanes.h
+typedef struct mio_pubsub_lanes mio_pubsub_lanes_t;
+
+// Defined in mio_pubsub_routes.h
+typedef struct mio_pubsub_routes mio_pubsub_routes_t;
+
 typedef struct mio_response {
     char id[37];
     char *ns;
@@ -106,25 +158,125 @@ typedef struct mio_response {
     TAILQ_ENTRY(mio_response)
     responses;
     mio_stanza_t *stanza;
+    // If set, everything the response points to was allocated from the arena,
+    // see mio_pubsub_data_receive_many()
+    mio_arena_t *arena;
 } mio_response_t;
 
 typedef struct mio_request mio_request_t;
 
+// What happens to a received pubsub response when the RX queue is full
+typedef enum {
+    MIO_RX_OVERFLOW_DROP_OLDEST, // Free the oldest queued response to make room
+    MIO_RX_OVERFLOW_DROP_NEWEST, // Free the response that did not fit
+    MIO_RX_OVERFLOW_BACKPRESSURE // Stop reading from the socket until there is room
+} mio_rx_overflow_policy_t;
+
+// Counters of the pubsub RX queue, see mio_pubsub_data_rx_queue_stats()
+typedef struct {
+    uint64_t enqueued; // Responses put on the queue
+    uint64_t dequeued; // Responses taken off the queue by the application
+    uint64_t dropped_oldest; // Responses dropped by MIO_RX_OVERFLOW_DROP_OLDEST
+    // Responses dropped on arrival by MIO_RX_OVERFLOW_DROP_NEWEST, or by
+    // MIO_RX_OVERFLOW_DROP_OLDEST when their pubsub lane is empty
+    uint64_t dropped_newest;
+    uint64_t read_pauses; // Times MIO_RX_OVERFLOW_BACKPRESSURE stopped reading
+    uint64_t routed; // Responses passed to a callback of mio_pubsub_on_node()
+    unsigned int length, capacity;
+} mio_pubsub_rx_stats_t;
+
+typedef struct {
+    uint64_t seq;
+    mio_response_t *response;
+} mio_rx_cell_t;
+
+// Bounded lock-free MPMC ring of received pubsub responses. The sequence
+// number of a cell tells producers and consumers whose turn it is, head and
+// tail are kept on separate cache lines.
+typedef struct {
+    mio_rx_cell_t *cells;
+    uint64_t mask;
+    char pad0[64];
+    uint64_t tail; // Next position to enqueue at
+    char pad1[64];
+    uint64_t head; // Next position to dequeue from
+    char pad2[64];
+} mio_rx_ring_t;
+
 
 typedef struct {
     xmpp_conn_t *xmpp_conn;
     mio_presence_status_t presence_status;
     pthread_mutex_t event_loop_mutex, send_request_mutex, conn_mutex,
                     pubsub_rx_queue_mutex;
-    pthread_cond_t send_request_cond, conn_cond;
-    TAILQ_HEAD(mio_pubsub_rx_queue, mio_response)
-    pubsub_rx_queue;
-    sem_t *mio_open_requests;
-    pthread_rwlock_t mio_hash_lock;
-    mio_request_t *mio_request_table;
-    int pubsub_rx_queue_len, pubsub_rx_listening, send_request_predicate,
+    pthread_cond_t send_request_cond, conn_cond, pubsub_rx_queue_cond;
+    // Received pubsub responses waiting for mio_pubsub_data_receive()
+    mio_rx_ring_t pubsub_rx_ring;
+    mio_rx_overflow_policy_t pubsub_rx_policy;
+    mio_pubsub_rx_stats_t pubsub_rx_stats;
+    // Threads blocked in _mio_pubsub_rx_queue_dequeue_timed()
+    int pubsub_rx_waiters;
+    // Set while socket reads are paused by MIO_RX_OVERFLOW_BACKPRESSURE.
+    // Responses that arrived after the ring filled up wait in the backlog,
+    // which is protected by pubsub_rx_backlog_mutex since handler workers
+    // enqueue as well.
+    int pubsub_rx_paused;
+    TAILQ_HEAD(mio_pubsub_rx_backlog, mio_response)
+    pubsub_rx_backlog;
+    pthread_mutex_t pubsub_rx_backlog_mutex;
+    // Lock-free LIFO of released responses linked through responses.tqe_next.
+    // Any thread pushes, pops are serialized by response_pool_mutex.
+    mio_response_t *response_pool;
+    int response_pool_len;
+    pthread_mutex_t response_pool_mutex;
+    // Preallocated request slots, indexed by the stanza id of a request
+    mio_request_t *requests;
+    unsigned int requests_len;
+    // Free request slots as a tagged LIFO: tag in the upper 32 bits, index + 1
+    // of the first free slot in the lower 32 bits, 0 when the table is full
+    uint64_t requests_free;
+    // Threads waiting in _mio_request_acquire() for a free slot
+    int requests_waiters;
+    pthread_mutex_t requests_mutex;
+    pthread_cond_t requests_cond;
+    // Lock-free LIFO of index + 1 of request slots whose deadline timer the
+    // event loop has to arm or cancel, see _mio_request_timers_arm()
+    uint32_t requests_arm;
+    // Fires mio_reconnect() once the reconnection backoff has passed
+    xmpp_timer_t reconnect_timer;
+    // Listener request of mio_pubsub_data_receive(), NULL if not listening
+    mio_request_t *pubsub_rx_request;
+    // Idle parsers of mio_stanza_parse()
+    struct mio_parser *parser_pool;
+    unsigned int parser_pool_len;
+    pthread_mutex_t parser_pool_mutex;
+    // Decode of the pubsub event being streamed from the socket, only
+    // touched by the event loop, see mio_pubsub_data_listen_start()
+    struct mio_xml_parser_data *pubsub_rx_decode;
+    // Publish streams of this connection, only touched with the event loop
+    // mutex held
+    mio_publish_stream_t *publish_streams;
+    unsigned int publish_stream_ids;
+    // Coalescers of this connection, only touched with the event loop mutex
+    // held
+    mio_coalescer_t *coalescers;
+    unsigned int stanza_ids;
+    int pubsub_rx_listening, event_loop_waiters,
         conn_predicate, retries, has_connected;
     pthread_t *mio_run_thread;
+    // Lock-free LIFO of pre-rendered buffers pushed by _mio_send_queue_push()
+    xmpp_send_queue_t *send_inbox;
+    // Threads running the handlers of received stanzas, NULL while they run
+    // in the event loop thread. Only changed with the event loop mutex held,
+    // see mio_handler_workers_start().
+    mio_workers_t *workers;
+    // Consumer threads of received pubsub responses, NULL while they are
+    // queued for mio_pubsub_data_receive(). Only changed with the event loop
+    // and RX backlog mutexes held, see mio_pubsub_data_lanes_start().
+    mio_pubsub_lanes_t *pubsub_lanes;
+    // Callbacks registered for the responses of pubsub nodes, see
+    // mio_pubsub_on_node()
+    mio_pubsub_routes_t *pubsub_routes;
 } mio_conn_t;
 
 typedef enum {
@@ -138,15 +290,37 @@ typedef void (*mio_handler_conn)(mio_conn_t * conn,
 typedef int (*mio_handler)(mio_conn_t * conn, mio_stanza_t * stanza,
                            const mio_response_t *response, const void *userdata);
 
+// Called exactly once per asynchronous request from the event loop thread, or
+// from a handler worker if the handler ran in one.
+// status is MIO_OK once the handler has processed the server's response,
+// MIO_ERROR_TIMEOUT if the deadline passed first or MIO_ERROR_DISCONNECTED if
+// the connection dropped while the request was pending.
+typedef void (*mio_completion)(mio_conn_t * conn, mio_response_t *response,
+                               int status, void *userdata);
+
 struct mio_request {
-    char id[37];    // UUID of sent stanza as key
+    char id[37];    // Stanza id of the request, see _mio_request_acquire()
+    uint32_t token; // Generation << 16 | slot while in flight, 0 when free
+    uint32_t next_free; // Index + 1 of the next free slot
+    uint16_t generation;
     pthread_cond_t cond;
     pthread_mutex_t mutex;
     int predicate;
     mio_handler handler; // Handler to be called when response is received
     mio_handler_type_t handler_type;
     mio_response_t *response;
-    UT_hash_handle hh;
+    mio_completion completion; // Set for requests sent with mio_send_async()
+    void *completion_userdata;
+    uint64_t deadline; // time_monotonic() in ms after which the request times out
+    // Deadline timer, only touched by the event loop thread
+    xmpp_timer_t timer;
+    uint32_t timer_token; // Token of the request the timer was armed for
+    int timer_status; // Status the request completes with when the timer fires
+    uint32_t next_arm; // Index + 1 of the next slot on the arm list
+    int arm_queued; // Nonzero while the slot is on the arm list
+    // Responses queued for or being handled by handler workers, the request
+    // does not time out while there are any
+    int worker_jobs;
 };
 
 
@@ -158,22 +332,41 @@ int mio_stanza_to_text(mio_stanza_t *stanza, char **buf, int *buflen);
 
 // response structure funcitons
 void mio_response_free(mio_response_t *response);
+mio_response_t *_mio_response_pool_get(mio_conn_t *conn);
+void _mio_response_pool_put(mio_conn_t *conn, mio_response_t *response);
+void _mio_response_pool_free(mio_conn_t *conn);
 void _mio_response_error_free(mio_response_error_t* error);
 mio_response_error_t* _mio_response_error_new();
 int mio_response_print(mio_response_t *response);
 
 // mio request functions
 mio_request_t *_mio_request_new();
-int _mio_request_delete(mio_conn_t *conn, char *id);
 void _mio_request_free(mio_request_t *request);
-int _mio_request_add(mio_conn_t *conn, const char *id,
-                     mio_handler handler, mio_handler_type_t handler_type,
-                     mio_response_t *response, mio_request_t *request);
-mio_request_t *_mio_request_get(mio_conn_t *conn, char *id);
+int _mio_request_table_init(mio_conn_t *conn, unsigned int capacity);
+void _mio_request_table_free(mio_conn_t *conn);
+int mio_request_table_configure(mio_conn_t *conn, unsigned int capacity);
+mio_request_t *_mio_request_acquire(mio_conn_t *conn, int wait);
+void _mio_request_start(mio_conn_t *conn, mio_request_t *request);
+mio_request_t *_mio_request_get(mio_conn_t *conn, const char *id);
+int _mio_request_complete(mio_conn_t *conn, mio_request_t *request, int status);
+int _mio_request_complete_async(mio_conn_t *conn, mio_request_t *request,
+                                uint32_t token, int status);
+int _mio_request_cancel(mio_conn_t *conn, mio_request_t *request);
+void _mio_request_timers_arm(mio_conn_t *conn);
+int _mio_request_fail_all(mio_conn_t *conn, int status);
+void _mio_stanza_id_new(mio_conn_t *conn, char *id);
+
+// logging
+void _mio_log(mio_log_level_t level, const char *file, int line,
+              const char *func, const char *fmt, ...)
+              __attribute__ ((format (printf, 5, 6)));
+int mio_log_async_start(size_t size);
+void mio_log_async_stop(void);
 
 // mio_connection settup
 mio_conn_t *mio_conn_new(mio_log_level_t log_level);
 void mio_conn_free(mio_conn_t *conn);
+void _mio_reconnect_schedule(mio_conn_t *conn);
 int mio_listen_start(mio_conn_t *conn);
 int mio_listen_stop(mio_conn_t *conn);
 
@@ -182,8 +375,21 @@ char *mio_get_server(const char *string);
 // rx queue functions
 int mio_response_print(mio_response_t *response);
 mio_response_t *_mio_response_get(mio_conn_t *conn, char *id);
+int _mio_pubsub_rx_queue_init(mio_conn_t *conn, unsigned int capacity);
+void _mio_pubsub_rx_queue_free(mio_conn_t *conn);
 mio_response_t *_mio_pubsub_rx_queue_dequeue(mio_conn_t *conn);
+int _mio_pubsub_rx_queue_dequeue_many(mio_conn_t *conn,
+                                      mio_response_t **responses, int max_responses);
+int _mio_pubsub_rx_queue_dequeue_timed(mio_conn_t *conn, int timeout_ms,
+                                       mio_response_t **response);
 void _mio_pubsub_rx_queue_enqueue(mio_conn_t *conn, mio_response_t *response);
+void _mio_pubsub_rx_queue_refill(mio_conn_t *conn);
+void _mio_pubsub_rx_queue_wake(mio_conn_t *conn);
+unsigned int _mio_pubsub_rx_queue_len(mio_conn_t *conn);
+int _mio_send_queue_push(mio_conn_t *conn, char *buf, size_t len);
+int _mio_send_queue_splice(mio_conn_t *conn);
+int _mio_event_loop_lock(mio_conn_t *conn);
+void _mio_event_loop_unlock(mio_conn_t *conn);
 int mio_cond_signal(pthread_cond_t *cond, pthread_mutex_t *mutex,
                     int *predicate);
 int mio_cond_broadcast(pthread_cond_t *cond, pthread_mutex_t *mutex,
@@ -0,0 +1,290 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+
+
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include "mio_deadband.h"
+
+extern mio_log_level_t _mio_log_level;
+
+// Relative slack when comparing a change against the deadband, so that a
+// change of exactly one resolution step is not lost to rounding
+#define MIO_DEADBAND_EPSILON 1e-9
+
+/**
+ * @ingroup PubSub
+ * Creates a deadband filter for transducer samples. A numeric sample is only
+ * let through if it differs from the last sample let through for the same
+ * node and transducer by at least the transducer's deadband, a non-numeric
+ * sample only if its value changed. The deadband of a transducer is taken,
+ * in order of precedence, from mio_deadband_set(), from its meta with
+ * mio_deadband_meta_apply() or from default_deadband. A sample that would be
+ * suppressed is let through anyway once no sample of its transducer was let
+ * through for heartbeat_ms, so subscribers can tell a quiet sensor from a
+ * dead one. The filter does not publish by itself and is safe to use from
+ * multiple threads.
+ *
+ * @param default_deadband Deadband of transducers without one, 0 to only suppress unchanged values.
+ * @param heartbeat_ms Maximum time in ms a transducer is kept silent, 0 to suppress indefinitely.
+ * @returns A newly allocated filter to be freed with mio_deadband_free(), or NULL on an error.
+ */
+mio_deadband_t *mio_deadband_new(double default_deadband,
+                                 unsigned int heartbeat_ms) {
+    mio_deadband_t *deadband = malloc(sizeof(mio_deadband_t));
+
+    if (deadband == NULL)
+        return NULL;
+    memset(deadband, 0, sizeof(mio_deadband_t));
+    deadband->default_deadband = default_deadband < 0 ? 0 : default_deadband;
+    deadband->heartbeat_ms = heartbeat_ms;
+    pthread_mutex_init(&deadband->mutex, NULL );
+    return deadband;
+}
+
+/**
+ * @ingroup PubSub
+ * Frees a deadband filter.
+ *
+ * @param deadband A pointer to the filter to be freed.
+ */
+void mio_deadband_free(mio_deadband_t *deadband) {
+    mio_deadband_entry_t *entry, *tmp;
+
+    HASH_ITER(key.hh, deadband->entries, entry, tmp) {
+        HASH_DELETE(key.hh, deadband->entries, entry);
+        if (entry->last_string != NULL)
+            free(entry->last_string);
+        free(entry->key.key);
+        free(entry);
+    }
+    pthread_mutex_destroy(&deadband->mutex);
+    free(deadband);
+}
+
+// Finds the entry of a node and transducer, creating it if there is none.
+// Must be called with the filter's mutex held.
+static mio_deadband_entry_t *_mio_deadband_entry_get(mio_deadband_t *deadband,
+        const char *node, const char *name) {
+    mio_deadband_entry_t *entry;
+    int created;
+
+    entry = _mio_transducer_key_get((mio_transducer_key_t **) &deadband->entries,
+                                    node, name, sizeof(mio_deadband_entry_t), &created);
+    if (entry != NULL && created)
+        entry->deadband = deadband->default_deadband;
+    return entry;
+}
+
+// Parses a transducer value as a number, returns 0 if it is not one
+static int _mio_deadband_parse(const char *value, double *number) {
+    char *end;
+
+    if (value == NULL || *value == '\0')
+        return 0;
+    *number = strtod(value, &end);
+    while (*end == ' ' || *end == '\t' || *end == '\n' || *end == '\r')
+        end++;
+    return end != value && *end == '\0' && isfinite(*number);
+}
+
+/**
+ * @ingroup PubSub
+ * Sets the deadband of a transducer explicitly. It takes precedence over the
+ * deadband derived from the transducer's meta.
+ *
+ * @param deadband A pointer to a deadband filter.
+ * @param node The event node's uuid.
+ * @param name The name of the transducer.
+ * @param value The smallest change of the transducer's value that is let through, 0 to only suppress unchanged values.
+ * @returns MIO_OK on success, otherwise an error.
+ */
+int mio_deadband_set(mio_deadband_t *deadband, const char *node,
+                     const char *name, double value) {
+    mio_deadband_entry_t *entry;
+
+    pthread_mutex_lock(&deadband->mutex);
+    entry = _mio_deadband_entry_get(deadband, node, name);
+    if (entry != NULL) {
+        entry->deadband = value < 0 ? 0 : value;
+        entry->explicit = 1;
+    }
+    pthread_mutex_unlock(&deadband->mutex);
+    return entry == NULL ? MIO_ERROR_MALLOC : MIO_OK;
+}
+
+/**
+ * @ingroup PubSub
+ * Derives the deadband of the transducers of an event node from their meta.
+ * The resolution of a transducer is used if it is a positive number, the
+ * precision otherwise. Transducers with neither or with a deadband set by
+ * mio_deadband_set() are left alone. Call it again whenever the cached meta
+ * of the node changes.
+ *
+ * @param deadband A pointer to a deadband filter.
+ * @param node The event node's uuid.
+ * @param meta The meta of the event node.
+ * @returns The number of transducers whose deadband was derived from the meta, or MIO_ERROR_MALLOC.
+ */
+int mio_deadband_meta_apply(mio_deadband_t *deadband, const char *node,
+                            mio_meta_t *meta) {
+    mio_transducer_meta_t *t_meta;
+    mio_deadband_entry_t *entry;
+    double value;
+    int applied = 0;
+
+    pthread_mutex_lock(&deadband->mutex);
+    for (t_meta = meta->transducers; t_meta != NULL; t_meta = t_meta->next) {
+        if (t_meta->name == NULL)
+            continue;
+        if (!(_mio_deadband_parse(t_meta->resolution, &value) && value > 0)
+                && !(_mio_deadband_parse(t_meta->precision, &value)
+                     && value > 0))
+            continue;
+        entry = _mio_deadband_entry_get(deadband, node, t_meta->name);
+        if (entry == NULL) {
+            pthread_mutex_unlock(&deadband->mutex);
+            return MIO_ERROR_MALLOC;
+        }
+        if (entry->explicit)
+            continue;
+        entry->deadband = value;
+        applied++;
+    }
+    pthread_mutex_unlock(&deadband->mutex);
+    return applied;
+}
+
+/**
+ * @ingroup PubSub
+ * Decides whether a transducer sample should be published. A sample that is
+ * let through becomes the reference for the following ones, so slow drift
+ * is published once it adds up to the deadband.
+ *
+ * @param deadband A pointer to a deadband filter.
+ * @param node The event node's uuid.
+ * @param name The name of the transducer.
+ * @param value The transducer value.
+ * @returns 1 if the sample should be published, 0 if it should be suppressed.
+ * Samples without a node or transducer name are always published.
+ */
+int mio_deadband_check(mio_deadband_t *deadband, const char *node,
+                       const char *name, const char *value) {
+    mio_deadband_entry_t *entry;
+    uint64_t now = time_monotonic();
+    double number, delta;
+    int numeric = _mio_deadband_parse(value, &number);
+    int pass, heartbeat = 0;
+    char *copy;
+
+    pthread_mutex_lock(&deadband->mutex);
+    // Without an entry there is nothing to compare with, do not lose data
+    entry = node == NULL || name == NULL ?
+            NULL : _mio_deadband_entry_get(deadband, node, name);
+    if (entry == NULL) {
+        deadband->stats.passed++;
+        pthread_mutex_unlock(&deadband->mutex);
+        return 1;
+    }
+
+    if (!entry->published)
+        pass = 1;
+    else if (numeric && entry->numeric) {
+        delta = number - entry->last_value;
+        if (delta < 0)
+            delta = -delta;
+        if (entry->deadband > 0)
+            pass = delta >= entry->deadband * (1 - MIO_DEADBAND_EPSILON);
+        else
+            pass = delta != 0;
+    } else
+        pass = entry->last_string == NULL || value == NULL
+               || strcmp(entry->last_string, value) != 0;
+
+    if (!pass && deadband->heartbeat_ms != 0
+            && now - entry->last_publish >= deadband->heartbeat_ms)
+        pass = heartbeat = 1;
+
+    if (pass) {
+        copy = NULL;
+        if (value != NULL && (entry->last_string == NULL
+                              || strcmp(entry->last_string, value) != 0))
+            copy = strdup(value);
+        if (copy != NULL) {
+            if (entry->last_string != NULL)
+                free(entry->last_string);
+            entry->last_string = copy;
+        }
+        entry->numeric = numeric;
+        entry->last_value = numeric ? number : 0;
+        entry->last_publish = now;
+        entry->published = 1;
+        deadband->stats.passed++;
+        if (heartbeat)
+            deadband->stats.heartbeats++;
+    } else
+        deadband->stats.suppressed++;
+    pthread_mutex_unlock(&deadband->mutex);
+    return pass;
+}
+
+/**
+ * @ingroup PubSub
+ * Removes the transducers of a mio data struct whose samples should not be
+ * published according to a deadband filter, see mio_deadband_check().
+ * Actuation samples are always kept. Pass the filtered data on to any of the
+ * publish functions if there are transducers left.
+ *
+ * @param deadband A pointer to a deadband filter.
+ * @param data The data to filter, data->event is the event node.
+ * @returns The number of transducers left in data.
+ */
+int mio_deadband_data_filter(mio_deadband_t *deadband, mio_data_t *data) {
+    mio_transducer_data_t **link = &data->transducers, *t;
+
+    while ((t = *link) != NULL) {
+        if (t->type == MIO_TRANSDUCER_SET_DATA
+                || mio_deadband_check(deadband, data->event, t->name, t->value)) {
+            link = &t->next;
+            continue;
+        }
+        *link = t->next;
+        mio_transducer_data_free(t);
+        data->num_transducers--;
+    }
+    return data->num_transducers;
+}
+
+/**
+ * @ingroup PubSub
+ * Reads the counters of a deadband filter.
+ *
+ * @param deadband A pointer to a deadband filter.
+ * @param stats Filled with the counters.
+ */
+void mio_deadband_stats(mio_deadband_t *deadband, mio_deadband_stats_t *stats) {
+    pthread_mutex_lock(&deadband->mutex);
+    *stats = deadband->stats;
+    pthread_mutex_unlock(&deadband->mutex);
+}
@@ -0,0 +1,71 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+
+#ifndef ____mio_deadband__
+#define ____mio_deadband__
+
+#include <mio.h>
+
+// Counters of a deadband filter, see mio_deadband_stats()
+typedef struct {
+    uint64_t passed; // Samples let through, heartbeats included
+    uint64_t suppressed; // Samples that changed less than the deadband
+    uint64_t heartbeats; // Samples let through only because of the heartbeat
+} mio_deadband_stats_t;
+
+typedef struct mio_deadband_entry mio_deadband_entry_t;
+
+// Last published sample of one (node, transducer) pair
+struct mio_deadband_entry {
+    mio_transducer_key_t key; // Must be first
+    double deadband;
+    int explicit; // Set by mio_deadband_set(), meta does not override it
+    int published; // Nonzero once a sample has been let through
+    int numeric; // Nonzero if the last published value is a number
+    double last_value;
+    char *last_string; // Last published value as sent
+    uint64_t last_publish; // time_monotonic() in ms of the last publish
+};
+
+// Suppresses transducer samples that did not change by more than a deadband
+// since the last published one, see mio_deadband_new()
+struct mio_deadband {
+    double default_deadband;
+    unsigned int heartbeat_ms;
+    pthread_mutex_t mutex;
+    mio_deadband_entry_t *entries; // Hash of all entries by key
+    mio_deadband_stats_t stats;
+};
+
+// mio_deadband_data_filter() is declared in mio_transducer.h and
+// mio_deadband_meta_apply() in mio_meta.h
+mio_deadband_t *mio_deadband_new(double default_deadband,
+                                 unsigned int heartbeat_ms);
+void mio_deadband_free(mio_deadband_t *deadband);
+int mio_deadband_set(mio_deadband_t *deadband, const char *node,
+                     const char *name, double value);
+int mio_deadband_check(mio_deadband_t *deadband, const char *node,
+                       const char *name, const char *value);
+void mio_deadband_stats(mio_deadband_t *deadband, mio_deadband_stats_t *stats);
+
+#endif /* defined(____mio_deadband__) */
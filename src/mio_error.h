@@ -67,6 +67,10 @@
 #define MIO_ERROR_PARSER -31;
 #define MIO_ERRROR_TRANSDUCER_NULL_NAME -32
 #define MIO_ERROR_TRANSDUCER_NULL_VALUE -33
+#define MIO_ERROR_MALLOC -34
+#define MIO_ERROR_RX_QUEUE_BUSY -35
+#define MIO_ERROR_PUBLISH_FAILED -36
+#define MIO_ERROR_WORKERS -37 // Handler workers already running or not startable
 
 int mio_handler_error(mio_conn_t * const conn, mio_stanza_t * const stanza,
                       mio_response_t *response, void *userdata);
@@ -55,6 +55,7 @@ mio_handler_data_t *_mio_handler_data_new() {
     mio_handler_data_t *shd = (mio_handler_data_t*) malloc(
                                   sizeof(mio_handler_data_t));
     memset(shd, 0, sizeof(mio_handler_data_t));
+    shd->refs = 1;
     return shd;
 }
 
@@ -68,6 +69,38 @@ void mio_handler_data_free(mio_handler_data_t *shd) {
     free(shd);
 }
 
+/**
+ * @ingroup Internal
+ * Internal function to drop a reference to a mio handler data struct, which
+ * is freed with the last one. Can be called from any thread.
+ *
+ * @param A pointer to the mio handler data struct.
+ */
+void _mio_handler_data_unref(mio_handler_data_t *shd) {
+    if (__atomic_sub_fetch(&shd->refs, 1, __ATOMIC_ACQ_REL) == 0)
+        mio_handler_data_free(shd);
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to remove an ID handler whose handler was run by a
+ * handler worker and returned MIO_OK. The handler is only removed once even
+ * if several workers get there.
+ *
+ * @param conn A pointer to the mio conn containing the handler.
+ * @param shd A pointer to the data of the handler.
+ * @param id A string containing the ID of the handler.
+ */
+void _mio_handler_id_remove(mio_conn_t *conn, mio_handler_data_t *shd,
+                            const char *id) {
+    _mio_event_loop_lock(conn);
+    if (!__atomic_exchange_n(&shd->removed, 1, __ATOMIC_ACQ_REL)) {
+        xmpp_id_handler_delete(conn->xmpp_conn, mio_handler_generic_id, id);
+        _mio_handler_data_unref(shd);
+    }
+    _mio_event_loop_unlock(conn);
+}
+
 /**
  * @ingroup Core
  * Add a handler to an active mio conn. The handler will be executed if a message matching the inputted namespace ns, type type or name name is received. Either a namespace, name or type must be passed as a parameter.
@@ -86,7 +119,6 @@ int mio_handler_add(mio_conn_t * conn, mio_handler handler, const char *ns,
                     void *userdata, mio_response_t *response) {
 
     int err = MIO_OK;
-    uuid_t uuid;
     mio_handler_data_t *handler_data = _mio_handler_data_new();
 
     if (ns == NULL && type == NULL && name == NULL) {
@@ -115,26 +147,18 @@ int mio_handler_add(mio_conn_t * conn, mio_handler handler, const char *ns,
         }
     }
 
+    handler_data->request = request;
     if (request != NULL) {
-// Create id for request so we can hash it
-        if (strcmp(request->id, "") == 0) {
-            uuid_generate(uuid);
-            uuid_unparse(uuid, request->id);
-        }
-        err = _mio_request_add(conn, request->id, handler, MIO_HANDLER,
-                               handler_data->response, request);
-    }
-
-    if (err == MIO_OK) {
-        // Lock the event loop mutex so that we don't interleave addition/deletion of handlers
-        pthread_mutex_lock(&conn->event_loop_mutex);
-        xmpp_handler_add(conn->xmpp_conn, mio_handler_generic, ns, name, type,
-                         handler_data);
-        pthread_mutex_unlock(&conn->event_loop_mutex);
+        request->handler = handler;
+        request->handler_type = MIO_HANDLER;
+        request->response = response;
     }
 
-    else
-        mio_error("Cannot add handler for id %s", request->id);
+    // Lock the event loop mutex so that we don't interleave addition/deletion of handlers
+    _mio_event_loop_lock(conn);
+    xmpp_handler_add(conn->xmpp_conn, mio_handler_generic, ns, name, type,
+                     handler_data);
+    _mio_event_loop_unlock(conn);
 
     return err;
 }
@@ -153,35 +177,27 @@ int mio_handler_add(mio_conn_t * conn, mio_handler handler, const char *ns,
 int mio_handler_id_add(mio_conn_t * conn, mio_handler handler, const char *id,
                        mio_request_t *request, void *userdata, mio_response_t *response) {
 
-    int err = MIO_OK;
     mio_handler_data_t *handler_data;
     handler_data = _mio_handler_data_new();
 
-    strcpy(request->id, id);
-
-    if (request != NULL)
-        err = _mio_request_add(conn, id, handler, MIO_HANDLER_ID, response,
-                               request);
-
     handler_data->conn = conn;
     handler_data->handler = handler;
     handler_data->userdata = userdata;
     handler_data->request = request;
     handler_data->response = response;
 
-    strcpy(handler_data->request->id, id);
-    strcpy(handler_data->response->id, id);
+    if (request != NULL)
+        strcpy(request->id, id);
+    if (response != NULL)
+        strcpy(response->id, id);
 
-    if (err == MIO_OK) {
-        // Lock the event loop mutex so that we don't interleve addition/deletion of handlers
-        pthread_mutex_lock(&conn->event_loop_mutex);
-        xmpp_id_handler_add(conn->xmpp_conn, mio_handler_generic_id, id,
-                            (void*) handler_data);
-        pthread_mutex_unlock(&conn->event_loop_mutex);
-    } else
-        mio_error("Cannot add id handler for id %s", id);
+    // Lock the event loop mutex so that we don't interleve addition/deletion of handlers
+    _mio_event_loop_lock(conn);
+    xmpp_id_handler_add(conn->xmpp_conn, mio_handler_generic_id, id,
+                        (void*) handler_data);
+    _mio_event_loop_unlock(conn);
 
-    return err;
+    return MIO_OK;
 }
 
 /**
@@ -200,11 +216,11 @@ int mio_handler_timed_add(mio_conn_t * conn, mio_handler handler, int period,
     handler_data->conn = conn;
     handler_data->userdata = userdata;
 // Lock the event loop mutex so that we don't interleve addition/deletion of handlers
-    pthread_mutex_lock(&conn->event_loop_mutex);
+    _mio_event_loop_lock(conn);
     xmpp_timed_handler_add(conn->xmpp_conn,
                            (xmpp_timed_handler) mio_handler_generic_timed, period,
                            handler_data);
-    pthread_mutex_unlock(&conn->event_loop_mutex);
+    _mio_event_loop_unlock(conn);
     return MIO_OK;
 }
 
@@ -221,9 +237,9 @@ int mio_handler_timed_add(mio_conn_t * conn, mio_handler handler, int period,
 void mio_handler_id_delete(mio_conn_t * conn, mio_handler handler,
                            const char *id) {
 // Lock the event loop mutex so that we don't interleve addition/deletion of handlers
-    pthread_mutex_lock(&conn->event_loop_mutex);
+    _mio_event_loop_lock(conn);
     xmpp_id_handler_delete(conn->xmpp_conn, mio_handler_generic_id, id);
-    pthread_mutex_unlock(&conn->event_loop_mutex);
+    _mio_event_loop_unlock(conn);
 }
 
 mio_xml_parser_data_t *mio_xml_parser_data_new() {
@@ -232,23 +248,43 @@ mio_xml_parser_data_t *mio_xml_parser_data_new() {
     return xml_data;
 }
 
+/**
+ * @ingroup Internal
+ * Internal function to release the stanza held by a parser. A document cut
+ * short leaves the parser inside the stanza tree, so the root is released.
+ *
+ * @param parser A pointer to the parser holding the stanza.
+ */
+static void _mio_parser_stanza_release(mio_parser_t *parser) {
+    xmpp_stanza_t *root;
+
+    if (parser->stanza == NULL)
+        return;
+    for (root = parser->stanza; root->parent != NULL; root = root->parent)
+        ;
+    xmpp_stanza_release(root);
+    parser->stanza = NULL;
+}
+
 /**
  * @ingroup Stanza
- * Internal function to reset the mio parser.
+ * Internal function to reset the mio parser so that it can parse the next
+ * document. Releases a partially parsed stanza.
  *
  * @param parser A pointer to the parser to be reset.
  * @returns MIO_OK on success, MIO_ERROR_PARSER otherwise.
  */
 int mio_parser_reset(mio_parser_t *parser) {
-    if (parser->expat)
-        XML_ParserFree(parser->expat);
-
-    if (parser->stanza)
-        xmpp_stanza_release(parser->stanza);
-
-    parser->expat = XML_ParserCreate(NULL);
-    if (!parser->expat)
-        return MIO_ERROR_PARSER;
+    _mio_parser_stanza_release(parser);
+
+    // Resetting keeps expat's buffers and hash salt, but drops the handlers
+    if (!parser->expat || XML_ParserReset(parser->expat, NULL) != XML_TRUE) {
+        if (parser->expat)
+            XML_ParserFree(parser->expat);
+        parser->expat = XML_ParserCreate(NULL);
+        if (!parser->expat)
+            return MIO_ERROR_PARSER;
+    }
 
     parser->depth = 0;
     parser->stanza = NULL;
@@ -352,13 +388,19 @@ void mio_handler_conn_generic(xmpp_conn_t * const conn,
                               const xmpp_conn_event_t status, const int error,
                               xmpp_stream_error_t * const stream_error, void * const mio_handler_data) {
  
-    mio_request_t *request, *request_tmp;
     mio_handler_data_t *shd = (mio_handler_data_t *) mio_handler_data;
     mio_conn_t *mio_conn = shd->conn;
     if (shd->response == NULL)
         shd->response = mio_response_new();
     mio_debug("In conn_handler");
 
+    // Requests sent before the connection dropped will never be answered
+    if (status != XMPP_CONN_CONNECT) {
+        _mio_request_fail_all(mio_conn, MIO_ERROR_DISCONNECTED);
+        _mio_publish_streams_fail_all(mio_conn, MIO_ERROR_DISCONNECTED);
+        _mio_coalescers_reset_all(mio_conn);
+    }
+
     if (status == XMPP_CONN_CONNECT) {
         shd->response->response_type = MIO_RESPONSE_OK;
         mio_debug("In conn_handler : Connected");
@@ -374,23 +416,8 @@ void mio_handler_conn_generic(xmpp_conn_t * const conn,
             // If we were listening before the reconnect, start listening again and wake listing thread if there is anything in the RX queue
             if (mio_conn->pubsub_rx_listening)
                 mio_listen_start(mio_conn);
-            if (mio_conn->pubsub_rx_queue_len > 0) {
-                request = _mio_request_get(mio_conn, "pubsub_data_rx");
-                if (request != NULL)
-                    mio_cond_signal(&request->cond, &request->mutex,
-                                    &request->predicate);
-            }
-
-            // Trigger all remaining requests
-            HASH_ITER(hh, mio_conn->mio_request_table, request, request_tmp)
-            {
-                if (strcmp(request->id, "pubsub_data_rx") == 0)
-                    continue;
-                mio_cond_signal(&request->cond, &request->mutex,
-                                &request->predicate);
-                HASH_DEL(mio_conn->mio_request_table, request);
-                _mio_request_free(request);
-            }
+            if (_mio_pubsub_rx_queue_len(mio_conn) > 0)
+                _mio_pubsub_rx_queue_wake(mio_conn);
         }
 
         mio_cond_broadcast(&shd->conn->conn_cond, &shd->conn->conn_mutex,
@@ -428,10 +455,11 @@ void mio_handler_conn_generic(xmpp_conn_t * const conn,
         mio_warn(
             "Disconnected from server, attempting to reconnect, attempt: %u",
             mio_conn->retries);
+        // Back off between attempts without blocking the event loop
         if (mio_conn->retries > 0)
-            usleep(1000000*MIO_RECONNECTION_TIMEOUT_S);
-
-        mio_reconnect(mio_conn);
+            _mio_reconnect_schedule(mio_conn);
+        else
+            mio_reconnect(mio_conn);
         //mio_disconnect(mio_conn);
 
         //mio_connect(mio_conn->xmpp_conn->jid, mio_conn->xmpp_conn->pass, NULL,
@@ -460,15 +488,27 @@ int mio_handler_generic(xmpp_conn_t * const conn, xmpp_stanza_t * const stanza,
 
     int err;
     mio_handler_data_t *shd = (mio_handler_data_t*) mio_handler_data;
-    mio_stanza_t *s = malloc(sizeof(mio_stanza_t));
-    s->xmpp_stanza = stanza;
-    err = shd->handler(shd->conn, s, shd->response, shd->userdata);
-    //mio_stanza_free(s);
+    mio_stanza_t s;
+
+    // A handler worker ran the handler and it asked to be removed
+    if (__atomic_load_n(&shd->removed, __ATOMIC_ACQUIRE)) {
+        _mio_handler_data_unref(shd);
+        return 0;
+    }
+    if (shd->conn->workers != NULL
+            && _mio_workers_submit_handler(shd->conn, stanza, shd, MIO_HANDLER)
+            == MIO_OK)
+        return 1;
+
+    // Handlers clone the stanza if they keep it
+    memset(&s, 0, sizeof(s));
+    s.xmpp_stanza = stanza;
+    err = shd->handler(shd->conn, &s, shd->response, shd->userdata);
     // Returning 0 removes the handler
     if (err == MIO_HANDLER_KEEP) {
         return 1;
     } else if (err == MIO_HANDLER_REMOVE) {
-        mio_handler_data_free(shd);
+        _mio_handler_data_unref(shd);
         return 0;
     }
     return 1;
@@ -479,21 +519,68 @@ int mio_handler_generic_id(xmpp_conn_t * const conn,
 
     int err;
     mio_handler_data_t *shd = (mio_handler_data_t*) mio_handler_data;
-    mio_stanza_t *s = malloc(sizeof(mio_stanza_t));
-    s->xmpp_stanza = stanza;
+    mio_stanza_t s;
 
-    err = shd->handler(shd->conn, s, shd->response, shd->userdata);
-    //mio_stanza_free(s);
+    // Workers remove the handler themselves once it returned MIO_OK
+    if (shd->conn->workers != NULL
+            && _mio_workers_submit_handler(shd->conn, stanza, shd,
+                                           MIO_HANDLER_ID) == MIO_OK)
+        return 1;
+
+    memset(&s, 0, sizeof(s));
+    s.xmpp_stanza = stanza;
+    err = shd->handler(shd->conn, &s, shd->response, shd->userdata);
 
     // Returning 0 removes the handler
     if (err != MIO_OK)
         return 1;
     else {
-        mio_handler_data_free(shd);
+        __atomic_store_n(&shd->removed, 1, __ATOMIC_RELEASE);
+        _mio_handler_data_unref(shd);
         return 0;
     }
 }
 
+/**
+ * @ingroup Internal
+ * Routes IQ results and errors to the request or publish stream they answer.
+ * Installed once per connection by mio_connect(), the request is found from
+ * the stanza id in constant time. Stanzas that do not answer an in-flight
+ * request are left to the other handlers.
+ */
+int mio_handler_iq_dispatch(xmpp_conn_t * const conn,
+                            xmpp_stanza_t * const stanza, void * const userdata) {
+
+    mio_conn_t *mio_conn = (mio_conn_t*) userdata;
+    mio_request_t *request;
+    const char *type, *id;
+    mio_stanza_t s;
+
+    type = xmpp_stanza_get_type(stanza);
+    if (type == NULL || (strcmp(type, "result") != 0 && strcmp(type, "error") != 0))
+        return 1;
+    id = xmpp_stanza_get_id(stanza);
+    // Publish stream acknowledgements need nothing but the id and type
+    if (id != NULL && _mio_publish_stream_ack(mio_conn, stanza, id, type))
+        return 1;
+    request = _mio_request_get(mio_conn, id);
+    if (request == NULL || request->handler == NULL)
+        return 1;
+
+    // Workers decode the response and complete the request
+    if (mio_conn->workers != NULL
+            && _mio_workers_submit_request(mio_conn, stanza, request,
+                                           __atomic_load_n(&request->token, __ATOMIC_ACQUIRE)) == MIO_OK)
+        return 1;
+
+    memset(&s, 0, sizeof(s));
+    s.xmpp_stanza = stanza;
+    // Completion only follows once the handler is done with the response
+    if (request->handler(mio_conn, &s, request->response, NULL) == MIO_OK)
+        _mio_request_complete(mio_conn, request, MIO_OK);
+    return 1;
+}
+
 int mio_handler_generic_timed(xmpp_conn_t * const conn,
                               void * const mio_handler_data) {
 
@@ -523,6 +610,15 @@ void XMLCALL endElement(void *data, const char *element_name) {
         _mio_xml_data_update_end_element(xml_data, element_name);
 }
 
+// Allocates a parent entry from the decode's arena if it has one
+static mio_xml_parser_parent_data_t *_mio_xml_parser_parent_data_new(
+    mio_xml_parser_data_t *xml_data) {
+    if (xml_data->arena == NULL)
+        return mio_xml_parser_parent_data_new();
+    return mio_arena_calloc(xml_data->arena,
+                            sizeof(mio_xml_parser_parent_data_t));
+}
+
 void _mio_xml_data_update_start_element(mio_xml_parser_data_t *xml_data,
                                         const char* element_name) {
     mio_xml_parser_parent_data_t *parent_data;
@@ -532,12 +628,12 @@ void _mio_xml_data_update_start_element(mio_xml_parser_data_t *xml_data,
     xml_data->curr_depth++;
     if (xml_data->prev_depth < xml_data->curr_depth) {
         if (xml_data->parent == NULL) {
-            xml_data->parent = mio_xml_parser_parent_data_new();
+            xml_data->parent = _mio_xml_parser_parent_data_new(xml_data);
             parent_data = xml_data->parent;
         } else {
-            if (xml_data->parent->next != NULL)
+            if (xml_data->parent->next != NULL && xml_data->arena == NULL)
                 mio_xml_parser_parent_data_free(xml_data->parent->next);
-            xml_data->parent->next = mio_xml_parser_parent_data_new();
+            xml_data->parent->next = _mio_xml_parser_parent_data_new(xml_data);
             parent_data = xml_data->parent->next;
             parent_data->prev = xml_data->parent;
         }
@@ -547,47 +643,120 @@ void _mio_xml_data_update_start_element(mio_xml_parser_data_t *xml_data,
     xml_data->prev_depth = xml_data->curr_depth;
 }
 
-int mio_xml_parse(mio_conn_t *conn, mio_stanza_t * const stanza,
-                  mio_xml_parser_data_t *xml_data, XML_StartElementHandler start,
-                  XML_CharacterDataHandler char_handler) {
-
-    XML_Parser p;
-    char *buf;
-    size_t buflen;
+/**
+ * @ingroup Internal
+ * Sets the character data handler that is called for text nodes encountered
+ * while decoding a stanza. Can be called from within a start element handler
+ * to switch the handler for the remainder of the decode.
+ *
+ * @param xml_data The parser data of the current decode.
+ * @param char_handler The new character data handler or NULL to ignore text.
+ */
+void mio_xml_parser_data_set_char_handler(mio_xml_parser_data_t *xml_data,
+        XML_CharacterDataHandler char_handler) {
+    xml_data->char_handler = char_handler;
+}
 
-    if (stanza == NULL) {
-        mio_error("XML Parser received NULL stanza");
-        return MIO_ERROR_XML_NULL_STANZA;
+/**
+ * @ingroup Internal
+ * Recursively walks an xmpp stanza tree and calls the expat style element and
+ * character data handlers for each node in document order.
+ *
+ * @param xmpp_stanza The root of the (sub)tree to walk.
+ * @param xml_data The parser data passed to the handlers.
+ * @param start The start element handler.
+ * @returns MIO_OK on success, MIO_ERROR_XML_PARSER_ALLOCATION if the attribute
+ * array could not be allocated.
+ */
+static int _mio_xml_walk(xmpp_stanza_t *xmpp_stanza,
+                         mio_xml_parser_data_t *xml_data, XML_StartElementHandler start) {
+    const char *attr_buf[MIO_XML_ATTRS_MAX_INLINE * 2 + 1];
+    const char **attrs = attr_buf;
+    xmpp_stanza_t *child;
+    char *name, *text;
+    int n_attrs, n, err;
+
+    if (xmpp_stanza_is_text(xmpp_stanza)) {
+        text = xmpp_stanza_get_text_ptr(xmpp_stanza);
+        if (xml_data->char_handler != NULL && text != NULL)
+            xml_data->char_handler(xml_data, text, strlen(text));
+        return MIO_OK;
     }
 
-//Convert received stanza to text for XML parser
-    xmpp_stanza_to_text(stanza->xmpp_stanza, &buf, &buflen);
+    name = xmpp_stanza_get_name(xmpp_stanza);
+    if (name == NULL)
+        return MIO_OK;
 
-//Creates an instance of the XML Parser to parse the event packet
-    p = XML_ParserCreate(NULL);
-    if (!p) {
-        mio_error("Could not allocate XML parser");
-        return MIO_ERROR_XML_PARSER_ALLOCATION;
+    n_attrs = xmpp_stanza_get_attribute_count(xmpp_stanza);
+    if (n_attrs > MIO_XML_ATTRS_MAX_INLINE) {
+        attrs = malloc((n_attrs * 2 + 1) * sizeof(char*));
+        if (attrs == NULL) {
+            mio_error("Could not allocate XML attribute array");
+            return MIO_ERROR_XML_PARSER_ALLOCATION;
+        }
     }
-//Sets the handlers to call when parsing the start and end of an XML element
-    XML_SetElementHandler(p, start, endElement);
-    if (char_handler != NULL)
-        XML_SetCharacterDataHandler(p, char_handler);
-    XML_SetUserData(p, xml_data);
-    xml_data->parser = &p;
-
-    if (XML_Parse(p, buf, strlen(buf), 1) == XML_STATUS_ERROR) {
-        mio_error("XML parse error at line %u:\n%s\n",
-                  (int ) XML_GetCurrentLineNumber(p),
-                  XML_ErrorString(XML_GetErrorCode(p)));
-        return MIO_ERROR_XML_PARSING;
+    n = xmpp_stanza_get_attributes(xmpp_stanza, attrs, n_attrs * 2);
+    attrs[n] = NULL;
+
+    start(xml_data, name, attrs);
+    if (attrs != attr_buf)
+        free(attrs);
+
+    for (child = xmpp_stanza_get_children(xmpp_stanza); child != NULL;
+            child = xmpp_stanza_get_next(child)) {
+        err = _mio_xml_walk(child, xml_data, start);
+        if (err != MIO_OK)
+            return err;
     }
 
-    XML_ParserFree(p);
-    xmpp_free(conn->xmpp_conn->ctx, buf);
+    endElement(xml_data, name);
+    return MIO_OK;
+}
+
+/**
+ * @ingroup Internal
+ * Decodes a received stanza by walking its parsed xmpp stanza tree and calling
+ * the supplied expat style handlers. The stanza is not re-serialized or
+ * re-parsed. Frees xml_data once the decode has been attempted.
+ *
+ * @param conn The active mio connection.
+ * @param stanza The stanza to decode.
+ * @param xml_data The parser data passed to the handlers.
+ * @param start The start element handler.
+ * @param char_handler The initial character data handler, can be NULL.
+ * @returns MIO_OK on success, an MIO_ERROR code on error.
+ */
+int mio_xml_parse(mio_conn_t *conn, mio_stanza_t * const stanza,
+                  mio_xml_parser_data_t *xml_data, XML_StartElementHandler start,
+                  XML_CharacterDataHandler char_handler) {
+    int err = _mio_xml_parse(conn, stanza, xml_data, start, char_handler);
+
     free(xml_data);
+    return err;
+}
 
-    return MIO_OK;
+/**
+ * @ingroup Internal
+ * Decodes a received stanza like mio_xml_parse(), but leaves xml_data to the
+ * caller, who may keep it on the stack.
+ *
+ * @param conn The active mio connection.
+ * @param stanza The stanza to decode.
+ * @param xml_data The parser data passed to the handlers.
+ * @param start The start element handler.
+ * @param char_handler The initial character data handler, can be NULL.
+ * @returns MIO_OK on success, an MIO_ERROR code on error.
+ */
+int _mio_xml_parse(mio_conn_t *conn, mio_stanza_t * const stanza,
+                   mio_xml_parser_data_t *xml_data, XML_StartElementHandler start,
+                   XML_CharacterDataHandler char_handler) {
+    if (stanza == NULL || stanza->xmpp_stanza == NULL) {
+        mio_error("XML Parser received NULL stanza");
+        return MIO_ERROR_XML_NULL_STANZA;
+    }
+
+    xml_data->char_handler = char_handler;
+    return _mio_xml_walk(stanza->xmpp_stanza, xml_data, start);
 }
 
 int mio_handler_item_recent_get(mio_conn_t * const conn,
@@ -646,6 +815,7 @@ mio_parser_t *mio_parser_new(mio_conn_t *conn) {
  * @param parser mio parser to be freed.
  */
 void mio_parser_free(mio_parser_t *parser) {
+    _mio_parser_stanza_release(parser);
     if (parser->expat)
         XML_ParserFree(parser->expat);
     free(parser);
@@ -675,14 +845,91 @@ void mio_parser_set_attributes(xmpp_stanza_t *stanza, const XML_Char **attrs) {
  *
  * @param parser mio parser to do the parsing.
  * @param string XML string to be parsed.
- * @returns The parsed XML string as a mio stanza.
+ * @returns The parsed XML string as a mio stanza, or NULL if it is not a single well-formed document.
  */
 mio_stanza_t *mio_parse(mio_parser_t *parser, char *string) {
-    mio_stanza_t *stanza = malloc(sizeof(mio_stanza_t));
-    XML_Parse(parser->expat, string, strlen(string), 0);
+    mio_stanza_t *stanza;
+
+    if (parser->expat == NULL && mio_parser_reset(parser) != MIO_OK)
+        return NULL;
+
+    if (XML_Parse(parser->expat, string, strlen(string), 1) != XML_STATUS_OK
+            || parser->stanza == NULL || parser->depth != 0) {
+        mio_warn("Could not parse XML string: %s",
+                 XML_ErrorString(XML_GetErrorCode(parser->expat)));
+        mio_parser_reset(parser);
+        return NULL;
+    }
+
+    stanza = malloc(sizeof(mio_stanza_t));
+    if (stanza == NULL) {
+        mio_parser_reset(parser);
+        return NULL;
+    }
+    memset(stanza, 0, sizeof(mio_stanza_t));
     stanza->xmpp_stanza = parser->stanza;
     parser->stanza = NULL;
-    parser->depth = 0;
+    // Ready for the next string
+    mio_parser_reset(parser);
     return stanza;
 }
 
+/**
+ * @ingroup Stanza
+ * Parses an XML string into a mio stanza with one of the connection's pooled
+ * parsers. Can be called from any thread.
+ *
+ * @param conn A mio connection whose context allocates the stanza. The connection does not need to be active.
+ * @param xml XML string to be parsed.
+ * @returns The parsed XML string as a mio stanza, or NULL on an error.
+ */
+mio_stanza_t *mio_stanza_parse(mio_conn_t *conn, const char *xml) {
+    mio_parser_t *parser;
+    mio_stanza_t *stanza;
+
+    pthread_mutex_lock(&conn->parser_pool_mutex);
+    parser = conn->parser_pool;
+    if (parser != NULL) {
+        conn->parser_pool = parser->next;
+        conn->parser_pool_len--;
+    }
+    pthread_mutex_unlock(&conn->parser_pool_mutex);
+    if (parser == NULL) {
+        parser = mio_parser_new(conn);
+        if (parser == NULL)
+            return NULL;
+    }
+
+    stanza = mio_parse(parser, (char*) xml);
+
+    // mio_parse() leaves the parser reset, even on an error
+    pthread_mutex_lock(&conn->parser_pool_mutex);
+    if (parser->expat != NULL
+            && conn->parser_pool_len < MIO_PARSER_POOL_MAX_LEN) {
+        parser->next = conn->parser_pool;
+        conn->parser_pool = parser;
+        conn->parser_pool_len++;
+        parser = NULL;
+    }
+    pthread_mutex_unlock(&conn->parser_pool_mutex);
+    if (parser != NULL)
+        mio_parser_free(parser);
+    return stanza;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to free all parsers in the connection's parser pool.
+ *
+ * @param conn A pointer to a mio connection.
+ */
+void _mio_parser_pool_free(mio_conn_t *conn) {
+    mio_parser_t *parser;
+
+    while ((parser = conn->parser_pool) != NULL) {
+        conn->parser_pool = parser->next;
+        mio_parser_free(parser);
+    }
+    conn->parser_pool_len = 0;
+}
+
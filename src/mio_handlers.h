@@ -25,6 +25,8 @@
 #define HANDLERS_H_
 
 #define NAME_MAX_CHARS 128
+// Attributes per element decoded without a heap allocation
+#define MIO_XML_ATTRS_MAX_INLINE 16
 
 #include <expat.h>
 #include <uuid/uuid.h>
@@ -43,6 +45,7 @@ typedef struct mio_parser {
     void *userdata;
     int depth;
     xmpp_stanza_t *stanza;
+    struct mio_parser *next; // Link in the connection's parser pool
 } mio_parser_t;
 
 struct mio_xml_parser_parent_data {
@@ -54,13 +57,15 @@ struct mio_xml_parser_parent_data {
 typedef struct mio_xml_parser_data {
     mio_response_t *response;
     void* payload;
-    XML_Parser *parser;
+    XML_CharacterDataHandler char_handler;
     const char* curr_element_name;
     const char* prev_element_name;
     const char* curr_attr_name;
     int curr_depth;
     int prev_depth;
     mio_xml_parser_parent_data_t *parent;
+    // If set, the decode allocates from this arena instead of the heap
+    mio_arena_t *arena;
 } mio_xml_parser_data_t;
 
 typedef struct mio_handler_data {
@@ -70,6 +75,11 @@ typedef struct mio_handler_data {
     mio_handler_conn conn_handler;
     mio_conn_t *conn;
     void *userdata;
+    // One reference for the registration and one per stanza queued for the
+    // handler workers, see _mio_handler_data_unref()
+    int refs;
+    // Set once a handler run by a worker asked to be removed
+    int removed;
 } mio_handler_data_t;
 // MIO HANDLER
 
@@ -90,6 +100,9 @@ int mio_handler_timed_add(mio_conn_t * conn, mio_handler handler, int period,
 void mio_handler_id_delete(mio_conn_t * conn, mio_handler handler,
                            const char *id);
 void mio_handler_data_free(mio_handler_data_t *shd);
+void _mio_handler_data_unref(mio_handler_data_t *shd);
+void _mio_handler_id_remove(mio_conn_t *conn, mio_handler_data_t *shd,
+                            const char *id);
 void mio_callback_set_publish_success(void *f);
 
 void mio_handler_conn_generic(xmpp_conn_t * const, const xmpp_conn_event_t,
@@ -99,6 +112,8 @@ int mio_handler_generic(xmpp_conn_t * const conn, xmpp_stanza_t * const stanza,
 
 int mio_handler_generic_id(xmpp_conn_t * const conn,
                            xmpp_stanza_t * const stanza, void * const mio_handler_data);
+int mio_handler_iq_dispatch(xmpp_conn_t * const conn,
+                            xmpp_stanza_t * const stanza, void * const userdata);
 int mio_handler_generic_timed(xmpp_conn_t * const conn,
                               void * const mio_handler_data);
 
@@ -130,8 +145,12 @@ void mio_parser_end_element(void *userdata, const XML_Char *name);
 void mio_parser_characters(void *userdata, const XML_Char *s, int len);
 
 mio_stanza_t *mio_parse(mio_parser_t *parser, char *string);
+mio_stanza_t *mio_stanza_parse(mio_conn_t *conn, const char *xml);
+void _mio_parser_pool_free(mio_conn_t *conn);
 void mio_parser_set_attributes(xmpp_stanza_t *stanza,
                                const XML_Char **attrs);
+void mio_xml_parser_data_set_char_handler(mio_xml_parser_data_t *xml_data,
+        XML_CharacterDataHandler char_handler);
 int mio_xml_parse(mio_conn_t *conn, mio_stanza_t * const stanza,
                   mio_xml_parser_data_t *xml_data, XML_StartElementHandler start,
                   XML_CharacterDataHandler char_handler);
@@ -937,15 +937,9 @@ mio_stanza_t *mio_meta_to_item(mio_conn_t* conn, mio_meta_t *meta) {
     return item;
 }
 
-/** Gets the meta information of an event node.
- *
- * @param conn Active MIO connection.
- * @param node Node id of node to query for meta.
- * @param response Pointer to response struct to store response in.
- *
- * @returns MIO_OK on success, MIO_ERROR_DISCONNECTED on disconnection.
- * */
-int mio_meta_query(mio_conn_t* conn, const char *node, mio_response_t *response) {
+static int _mio_meta_query(mio_conn_t* conn, const char *node,
+                           mio_response_t *response, mio_completion completion,
+                           void *userdata, unsigned int deadline_ms) {
     mio_stanza_t *iq = NULL;
     xmpp_stanza_t *items = NULL, *item = NULL;
     int err;
@@ -974,8 +968,10 @@ int mio_meta_query(mio_conn_t* conn, const char *node, mio_response_t *response)
     xmpp_stanza_add_child(iq->xmpp_stanza->children, items);
 
 // Send out the stanza
-    err = mio_send_blocking(conn, iq, (mio_handler) mio_handler_meta_query,
-                            response);
+    err = _mio_send_blocking_or_async(conn, iq,
+                                      (mio_handler) mio_handler_meta_query,
+                                      response, completion, userdata,
+                                      deadline_ms);
 
 // Release the stanzas
     xmpp_stanza_release(items);
@@ -985,6 +981,36 @@ int mio_meta_query(mio_conn_t* conn, const char *node, mio_response_t *response)
     return err;
 }
 
+/** Gets the meta information of an event node.
+ *
+ * @param conn Active MIO connection.
+ * @param node Node id of node to query for meta.
+ * @param response Pointer to response struct to store response in.
+ *
+ * @returns MIO_OK on success, MIO_ERROR_DISCONNECTED on disconnection.
+ * */
+int mio_meta_query(mio_conn_t* conn, const char *node, mio_response_t *response) {
+    return _mio_meta_query(conn, node, response, NULL, NULL, 0);
+}
+
+/** Gets the meta information of an event node and calls completion once the
+ *      response has been processed, the deadline passed or the connection
+ *      dropped, see mio_meta_query().
+ *
+ * @param conn Active MIO connection.
+ * @param node Node id of node to query for meta.
+ * @param completion Called with the parsed response, which the completion has to free.
+ * @param userdata Passed to completion.
+ * @param deadline_ms Time in ms after which the request completes with MIO_ERROR_TIMEOUT, 0 for the default.
+ *
+ * @returns MIO_OK if the request was sent, otherwise an error, in which case completion is never called.
+ * */
+int mio_meta_query_async(mio_conn_t* conn, const char *node,
+                         mio_completion completion, void *userdata,
+                         unsigned int deadline_ms) {
+    return _mio_meta_query(conn, node, NULL, completion, userdata, deadline_ms);
+}
+
 /** Publishes meta information to an event node.
  *
  * @param conn Active MIO connection.
@@ -1037,7 +1063,7 @@ void XMLCALL mio_XMLstart_pubsub_meta_receive(void *data,
     }
 
     if (strcmp(element_name, "meta") == 0) {
-        XML_SetCharacterDataHandler(*xml_data->parser, NULL );
+        mio_xml_parser_data_set_char_handler(xml_data, NULL );
         xml_data->payload = mio_meta;
         for (i = 0; attr[i]; i += 2) {
             xml_data->curr_attr_name = attr[i];
@@ -1059,7 +1085,7 @@ void XMLCALL mio_XMLstart_pubsub_meta_receive(void *data,
             }
         }
     } else if (strcmp(element_name, "transducer") == 0) {
-        XML_SetCharacterDataHandler(*xml_data->parser, NULL );
+        mio_xml_parser_data_set_char_handler(xml_data, NULL );
         xml_data->curr_attr_name = attr[i];
         t_meta = mio_transducer_meta_new();
         xml_data->payload = t_meta;
@@ -1109,7 +1135,7 @@ void XMLCALL mio_XMLstart_pubsub_meta_receive(void *data,
         if (mio_meta->meta_type != MIO_META_TYPE_UKNOWN)
             mio_transducer_meta_add(mio_meta, t_meta);
     } else if (strcmp(element_name, "map") == 0) {
-        XML_SetCharacterDataHandler(*xml_data->parser, NULL );
+        mio_xml_parser_data_set_char_handler(xml_data, NULL );
         xml_data->curr_attr_name = attr[i];
         t_meta = mio_transducer_meta_tail_get(mio_meta->transducers);
         if (t_meta->enumeration == NULL ) {
@@ -1131,7 +1157,7 @@ void XMLCALL mio_XMLstart_pubsub_meta_receive(void *data,
             }
         }
     } else if (strcmp(element_name, "property") == 0) {
-        XML_SetCharacterDataHandler(*xml_data->parser, NULL );
+        mio_xml_parser_data_set_char_handler(xml_data, NULL );
         p_meta = mio_property_meta_new();
         if (xml_data->parent != NULL ) {
             if (strcmp(xml_data->parent->parent, "transducer") == 0) {
@@ -1175,7 +1201,7 @@ void XMLCALL mio_XMLstart_pubsub_meta_receive(void *data,
             }
         }
         xml_data->payload = geoloc;
-        XML_SetCharacterDataHandler(*xml_data->parser, mio_XMLString_geoloc);
+        mio_xml_parser_data_set_char_handler(xml_data, mio_XMLString_geoloc);
     } else if (strcmp(element_name, "error") == 0)
         mio_XML_error_handler(element_name, attr, response);
 
@@ -207,6 +207,8 @@ void XMLCALL mio_XMLstart_pubsub_meta_receive(void *data,
 
 // mio meta functions
 mio_meta_t *mio_meta_new();
+int mio_deadband_meta_apply(mio_deadband_t *deadband, const char *node,
+                            mio_meta_t *meta);
 void mio_meta_merge(mio_meta_t *meta_to_update, mio_meta_t *meta);
 void mio_meta_free(mio_meta_t * meta);
 mio_stanza_t *mio_meta_to_item(mio_conn_t* conn, mio_meta_t *meta);
@@ -215,6 +217,9 @@ void mio_property_meta_free(mio_property_meta_t *p_meta);
 void mio_property_meta_add(mio_meta_t *meta, mio_property_meta_t *p_meta);
 mio_property_meta_t *mio_property_meta_tail_get(mio_property_meta_t *p_meta);
 int mio_meta_query(mio_conn_t* conn, const char *node, mio_response_t *response);
+int mio_meta_query_async(mio_conn_t* conn, const char *node,
+                         mio_completion completion, void *userdata,
+                         unsigned int deadline_ms);
 int mio_handler_node_type_query(mio_conn_t * const conn,
                                 mio_stanza_t * const stanza, mio_response_t *response, void *userdata);
 int mio_handler_meta_query(mio_conn_t * const conn, mio_stanza_t * const stanza,
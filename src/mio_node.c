@@ -126,6 +126,31 @@ mio_event_t *mio_event_tail_get(mio_event_t *event) {
     return tail;
 }
 
+/**
+ * @ingroup Internal
+ * Internal function to build the publish iq for item to node.
+ *
+ * @param conn A pointer to a mio connection.
+ * @param item The item to publish, it stays owned by the caller.
+ * @param node The target event node's uuid.
+ * @returns The newly allocated publish iq.
+ */
+mio_stanza_t *_mio_item_publish_stanza_new(mio_conn_t *conn,
+        mio_stanza_t *item, const char *node) {
+    mio_stanza_t *iq = mio_pubsub_set_stanza_new(conn, node);
+    xmpp_stanza_t *publish = xmpp_stanza_new(conn->xmpp_conn->ctx);
+
+    xmpp_stanza_set_name(publish, "publish");
+    xmpp_stanza_set_attribute(publish, "node", node);
+
+// Build xmpp message
+    xmpp_stanza_add_child(publish, item->xmpp_stanza);
+    xmpp_stanza_add_child(iq->xmpp_stanza->children, publish);
+    xmpp_stanza_release(publish);
+
+    return iq;
+}
+
 /** Publishes mio_stanza to event node over a mio connection.
  *
  * @param conn
@@ -137,7 +162,6 @@ int mio_item_publish(mio_conn_t *conn, mio_stanza_t *item, const char *node,
                      mio_response_t * response) {
 
     mio_stanza_t *iq = NULL;
-    xmpp_stanza_t *publish = NULL;
     int err;
 
 // Check if connection is active
@@ -147,21 +171,45 @@ int mio_item_publish(mio_conn_t *conn, mio_stanza_t *item, const char *node,
         return MIO_ERROR_DISCONNECTED;
     }
 
-    iq = mio_pubsub_set_stanza_new(conn, node);
-    publish = xmpp_stanza_new(conn->xmpp_conn->ctx);
-    xmpp_stanza_set_name(publish, "publish");
-    xmpp_stanza_set_attribute(publish, "node", node);
-
-// Build xmpp message
-    xmpp_stanza_add_child(publish, item->xmpp_stanza);
-    xmpp_stanza_add_child(iq->xmpp_stanza->children, publish);
+    iq = _mio_item_publish_stanza_new(conn, item, node);
 
 // Send out the stanza
     err = mio_send_blocking(conn, iq, (mio_handler) mio_handler_error,
                             response);
 
 // Release the stanza
-    xmpp_stanza_release(publish);
+    mio_stanza_free(iq);
+
+    return err;
+}
+
+/** Publishes an item to an event node and calls completion once the server
+ *      acknowledged the publish, the deadline passed or the connection dropped.
+ *
+ * @param conn Active mio connection.
+ * @param item Mio stanza that contains the item to send.
+ * @param node The target event node's uuid.
+ * @param completion Called with the server's response, which the completion has to free.
+ * @param userdata Passed to completion.
+ * @param deadline_ms Time in ms after which the publish completes with MIO_ERROR_TIMEOUT, 0 for the default.
+ * @returns MIO_OK if the publish was sent, otherwise an error, in which case completion is never called.
+ * */
+int mio_item_publish_async(mio_conn_t *conn, mio_stanza_t *item,
+                           const char *node, mio_completion completion, void *userdata,
+                           unsigned int deadline_ms) {
+    mio_stanza_t *iq = NULL;
+    int err;
+
+// Check if connection is active
+    if (!conn->xmpp_conn->authenticated) {
+        mio_error(
+            "Cannot process publish request since not connected to XMPP server");
+        return MIO_ERROR_DISCONNECTED;
+    }
+
+    iq = _mio_item_publish_stanza_new(conn, item, node);
+    err = mio_send_async(conn, iq, (mio_handler) mio_handler_error,
+                         completion, userdata, deadline_ms);
     mio_stanza_free(iq);
 
     return err;
@@ -176,7 +224,6 @@ int mio_item_publish(mio_conn_t *conn, mio_stanza_t *item, const char *node,
 int mio_item_publish_nonblocking(mio_conn_t *conn, mio_stanza_t *item,
                                  const char *node) {
     mio_stanza_t *iq = NULL;
-    xmpp_stanza_t *publish = NULL;
     int err;
 
 // Check if connection is active
@@ -186,21 +233,32 @@ int mio_item_publish_nonblocking(mio_conn_t *conn, mio_stanza_t *item,
         return MIO_ERROR_DISCONNECTED;
     }
 
-    iq = mio_pubsub_set_stanza_new(conn, node);
-
-    publish = xmpp_stanza_new(conn->xmpp_conn->ctx);
-    xmpp_stanza_set_name(publish, "publish");
-    xmpp_stanza_set_attribute(publish, "node", node);
-
-// Build xmpp message
-    xmpp_stanza_add_child(publish, item->xmpp_stanza);
-    xmpp_stanza_add_child(iq->xmpp_stanza->children, publish);
+    iq = _mio_item_publish_stanza_new(conn, item, node);
 
 // Send out the stanza
     err = mio_send_nonblocking(conn, iq);
 
 // Release the stanza
-    xmpp_stanza_release(publish);
+    mio_stanza_free(iq);
+
+    return err;
+}
+
+/** Publishes an item to an event node on a publish stream without waiting for
+ *      the server, see mio_publish_stream_new().
+ *
+ * @param stream Publish stream of an active mio connection.
+ * @param item Mio stanza that contains the item to send.
+ * @param node The target event node's uuid.
+ * @returns MIO_OK if the publish was queued, MIO_ERROR_TOO_MANY_OPEN_REQUESTS if the stream's window is full, otherwise an error.
+ * */
+int mio_item_publish_stream(mio_publish_stream_t *stream, mio_stanza_t *item,
+                            const char *node) {
+    mio_stanza_t *iq = NULL;
+    int err;
+
+    iq = _mio_item_publish_stanza_new(stream->conn, item, node);
+    err = mio_publish_stream_send(stream, iq);
     mio_stanza_free(iq);
 
     return err;
@@ -279,18 +337,11 @@ int mio_item_device_add(mio_stanza_t *item, const char *id, const char *type,
     return 0;
 }
 
-/** Creates a new event node.
- *
- * @param conn Active MIO connection
- * @param node The node id of the event node. Should be uuid.
- * @param title The title of the event node.
- * @param access The access model of the event node
- * @param [out] response The response to the create node request
- *
- * @returns MIO_OK on success, MIO_ERROR_DISCONNECTED on failed connection.
- * */
-int mio_node_create(mio_conn_t * conn, const char *node, const char* title,
-                    const char* access, mio_response_t * response) {
+static int _mio_node_create(mio_conn_t * conn, const char *node,
+                            const char* title, const char* access,
+                            mio_response_t * response,
+                            mio_completion completion, void *userdata,
+                            unsigned int deadline_ms) {
 
     mio_stanza_t *iq = NULL;
     xmpp_stanza_t *create = NULL;
@@ -435,8 +486,9 @@ int mio_node_create(mio_conn_t * conn, const char *node, const char* title,
     }
 
 // Send out the stanza
-    err = mio_send_blocking(conn, iq, (mio_handler) mio_handler_error,
-                            response);
+    err = _mio_send_blocking_or_async(conn, iq, (mio_handler) mio_handler_error,
+                                      response, completion, userdata,
+                                      deadline_ms);
 
     if (form_field != NULL )
         xmpp_stanza_release(form_field);
@@ -450,6 +502,43 @@ int mio_node_create(mio_conn_t * conn, const char *node, const char* title,
     return err;
 }
 
+/** Creates a new event node.
+ *
+ * @param conn Active MIO connection
+ * @param node The node id of the event node. Should be uuid.
+ * @param title The title of the event node.
+ * @param access The access model of the event node
+ * @param [out] response The response to the create node request
+ *
+ * @returns MIO_OK on success, MIO_ERROR_DISCONNECTED on failed connection.
+ * */
+int mio_node_create(mio_conn_t * conn, const char *node, const char* title,
+                    const char* access, mio_response_t * response) {
+    return _mio_node_create(conn, node, title, access, response, NULL, NULL, 0);
+}
+
+/** Creates a new event node and calls completion once the response has been
+ *      processed, the deadline passed or the connection dropped, see
+ *      mio_node_create().
+ *
+ * @param conn Active MIO connection
+ * @param node The node id of the event node. Should be uuid.
+ * @param title The title of the event node.
+ * @param access The access model of the event node
+ * @param completion Called with the parsed response, which the completion has to free.
+ * @param userdata Passed to completion.
+ * @param deadline_ms Time in ms after which the request completes with MIO_ERROR_TIMEOUT, 0 for the default.
+ *
+ * @returns MIO_OK if the request was sent, otherwise an error, in which case completion is never called.
+ * */
+int mio_node_create_async(mio_conn_t * conn, const char *node,
+                          const char* title, const char* access,
+                          mio_completion completion, void *userdata,
+                          unsigned int deadline_ms) {
+    return _mio_node_create(conn, node, title, access, NULL, completion,
+                            userdata, deadline_ms);
+}
+
 
 
 mio_stanza_t *mio_node_config_new(mio_conn_t * conn, const char *node,
@@ -514,8 +603,10 @@ mio_stanza_t *mio_node_config_new(mio_conn_t * conn, const char *node,
 
 
 
-int mio_node_type_query(mio_conn_t * conn, const char *node,
-                        mio_response_t * response) {
+static int _mio_node_type_query(mio_conn_t * conn, const char *node,
+                                mio_response_t * response,
+                                mio_completion completion, void *userdata,
+                                unsigned int deadline_ms) {
 
     mio_stanza_t *iq = NULL;
     xmpp_stanza_t *query = NULL;
@@ -540,8 +631,10 @@ int mio_node_type_query(mio_conn_t * conn, const char *node,
     xmpp_stanza_add_child(iq->xmpp_stanza, query);
 
 // Send out the stanza
-    err = mio_send_blocking(conn, iq,
-                            (mio_handler) mio_handler_node_type_query, response);
+    err = _mio_send_blocking_or_async(conn, iq,
+                                      (mio_handler) mio_handler_node_type_query,
+                                      response, completion, userdata,
+                                      deadline_ms);
 
 // Release the stanzas
     xmpp_stanza_release(query);
@@ -550,16 +643,34 @@ int mio_node_type_query(mio_conn_t * conn, const char *node,
     return err;
 }
 
-/** Delete an event node by the event node's id.
+int mio_node_type_query(mio_conn_t * conn, const char *node,
+                        mio_response_t * response) {
+    return _mio_node_type_query(conn, node, response, NULL, NULL, 0);
+}
+
+/** Queries for the type of an event node and calls completion once the response
+ *      has been processed, the deadline passed or the connection dropped, see
+ *      mio_node_type_query().
  *
- * @param conn Active MIO connection
- * @param node Event node id of node to delete.
- * @param response Response to deletion request.
+ * @param conn Active MIO connection.
+ * @param node The event node id.
+ * @param completion Called with the parsed response, which the completion has to free.
+ * @param userdata Passed to completion.
+ * @param deadline_ms Time in ms after which the request completes with MIO_ERROR_TIMEOUT, 0 for the default.
  *
- * @returns SOX_OK on success, SOX_ERROR_DISCONNECTED if connection disconnected.
+ * @returns MIO_OK if the request was sent, otherwise an error, in which case completion is never called.
  * */
-int mio_node_delete(mio_conn_t * conn, const char *node,
-                    mio_response_t * response) {
+int mio_node_type_query_async(mio_conn_t * conn, const char *node,
+                              mio_completion completion, void *userdata,
+                              unsigned int deadline_ms) {
+    return _mio_node_type_query(conn, node, NULL, completion, userdata,
+                                deadline_ms);
+}
+
+static int _mio_node_delete(mio_conn_t * conn, const char *node,
+                            mio_response_t * response,
+                            mio_completion completion, void *userdata,
+                            unsigned int deadline_ms) {
 
     mio_stanza_t *iq = NULL;
     xmpp_stanza_t *delete = NULL;
@@ -585,8 +696,9 @@ int mio_node_delete(mio_conn_t * conn, const char *node,
     xmpp_stanza_add_child(iq->xmpp_stanza->children, delete);
 
 // Send out the stanza
-    err = mio_send_blocking(conn, iq, (mio_handler) mio_handler_error,
-                            response);
+    err = _mio_send_blocking_or_async(conn, iq, (mio_handler) mio_handler_error,
+                                      response, completion, userdata,
+                                      deadline_ms);
 
 // Release the stanzas
     xmpp_stanza_release(delete);
@@ -595,16 +707,44 @@ int mio_node_delete(mio_conn_t * conn, const char *node,
     return err;
 }
 
+/** Delete an event node by the event node's id.
+ *
+ * @param conn Active MIO connection
+ * @param node Event node id of node to delete.
+ * @param response Response to deletion request.
+ *
+ * @returns SOX_OK on success, SOX_ERROR_DISCONNECTED if connection disconnected.
+ * */
+int mio_node_delete(mio_conn_t * conn, const char *node,
+                    mio_response_t * response) {
+    return _mio_node_delete(conn, node, response, NULL, NULL, 0);
+}
 
-/** Registers an event node.
+/** Deletes an event node and calls completion once the response has been
+ *      processed, the deadline passed or the connection dropped, see
+ *      mio_node_delete().
  *
- * @param conn An active MIO connection.
- * @param new_node The node id of the new event node. Should be a UUID.
- * @param creation_node The node id of the creation node listener.
- * @param response The response to the node registration request.
+ * @param conn Active MIO connection
+ * @param node Event node id of node to delete.
+ * @param completion Called with the parsed response, which the completion has to free.
+ * @param userdata Passed to completion.
+ * @param deadline_ms Time in ms after which the request completes with MIO_ERROR_TIMEOUT, 0 for the default.
+ *
+ * @returns MIO_OK if the request was sent, otherwise an error, in which case completion is never called.
  * */
-int mio_node_register(mio_conn_t *conn, const char *new_node,
-                      const char *creation_node, mio_response_t * response) {
+int mio_node_delete_async(mio_conn_t * conn, const char *node,
+                          mio_completion completion, void *userdata,
+                          unsigned int deadline_ms) {
+    return _mio_node_delete(conn, node, NULL, completion, userdata,
+                            deadline_ms);
+}
+
+
+static int _mio_node_register(mio_conn_t *conn, const char *new_node,
+                              const char *creation_node,
+                              mio_response_t * response,
+                              mio_completion completion, void *userdata,
+                              unsigned int deadline_ms) {
 
     mio_stanza_t *iq = NULL;
     xmpp_stanza_t *publish = NULL;
@@ -648,8 +788,9 @@ int mio_node_register(mio_conn_t *conn, const char *new_node,
     xmpp_stanza_add_child(iq->xmpp_stanza->children, publish);
 
 // Send out the stanza
-    err = mio_send_blocking(conn, iq, (mio_handler) mio_handler_error,
-                            response);
+    err = _mio_send_blocking_or_async(conn, iq, (mio_handler) mio_handler_error,
+                                      response, completion, userdata,
+                                      deadline_ms);
 
 // Release the stanzas
     xmpp_stanza_release(node_register);
@@ -661,3 +802,37 @@ int mio_node_register(mio_conn_t *conn, const char *new_node,
     return err;
 }
 
+/** Registers an event node.
+ *
+ * @param conn An active MIO connection.
+ * @param new_node The node id of the new event node. Should be a UUID.
+ * @param creation_node The node id of the creation node listener.
+ * @param response The response to the node registration request.
+ * */
+int mio_node_register(mio_conn_t *conn, const char *new_node,
+                      const char *creation_node, mio_response_t * response) {
+    return _mio_node_register(conn, new_node, creation_node, response, NULL,
+                              NULL, 0);
+}
+
+/** Registers an event node and calls completion once the response has been
+ *      processed, the deadline passed or the connection dropped, see
+ *      mio_node_register().
+ *
+ * @param conn An active MIO connection.
+ * @param new_node The node id of the new event node. Should be a UUID.
+ * @param creation_node The node id of the creation node listener.
+ * @param completion Called with the parsed response, which the completion has to free.
+ * @param userdata Passed to completion.
+ * @param deadline_ms Time in ms after which the request completes with MIO_ERROR_TIMEOUT, 0 for the default.
+ *
+ * @returns MIO_OK if the request was sent, otherwise an error, in which case completion is never called.
+ * */
+int mio_node_register_async(mio_conn_t *conn, const char *new_node,
+                            const char *creation_node,
+                            mio_completion completion, void *userdata,
+                            unsigned int deadline_ms) {
+    return _mio_node_register(conn, new_node, creation_node, NULL, completion,
+                              userdata, deadline_ms);
+}
+
@@ -44,21 +44,44 @@ char *mio_timestamp_create();
 
 int mio_node_create(mio_conn_t * conn, const char *node, const char* title,
                     const char* access, mio_response_t * response);
+int mio_node_create_async(mio_conn_t * conn, const char *node,
+                          const char* title, const char* access,
+                          mio_completion completion, void *userdata,
+                          unsigned int deadline_ms);
 int mio_node_info_query(mio_conn_t * conn, const char *node,
                         mio_response_t * response);
 int mio_node_delete(mio_conn_t * conn, const char *node,
                     mio_response_t * response);
+int mio_node_delete_async(mio_conn_t * conn, const char *node,
+                          mio_completion completion, void *userdata,
+                          unsigned int deadline_ms);
 
 int mio_node_register(mio_conn_t *conn, const char *new_node,
                       const char *creation_node, mio_response_t * response);
+int mio_node_register_async(mio_conn_t *conn, const char *new_node,
+                            const char *creation_node,
+                            mio_completion completion, void *userdata,
+                            unsigned int deadline_ms);
 
 int mio_node_type_query(mio_conn_t * conn, const char *node,
                         mio_response_t * response);
+int mio_node_type_query_async(mio_conn_t * conn, const char *node,
+                              mio_completion completion, void *userdata,
+                              unsigned int deadline_ms);
 
 
 mio_stanza_t *mio_node_config_new(mio_conn_t * conn, const char *node,
                                   mio_node_type_t type);
 
+mio_stanza_t *_mio_item_publish_stanza_new(mio_conn_t *conn,
+        mio_stanza_t *item, const char *node);
 int mio_item_publish(mio_conn_t *conn, mio_stanza_t *item, const char *node,
                      mio_response_t * response);
+int mio_item_publish_async(mio_conn_t *conn, mio_stanza_t *item,
+                           const char *node, mio_completion completion, void *userdata,
+                           unsigned int deadline_ms);
+int mio_item_publish_nonblocking(mio_conn_t *conn, mio_stanza_t *item,
+                                 const char *node);
+int mio_item_publish_stream(mio_publish_stream_t *stream, mio_stanza_t *item,
+                            const char *node);
 #endif /* defined(____mio_node__) */
@@ -45,6 +45,7 @@ void mio_packet_free(mio_packet_t* packet) {
     mio_collection_t *coll, *curr_coll;
     mio_event_t *event, *curr_event;
     mio_reference_t *ref, *curr_ref;
+    mio_publish_result_t *result, *curr_result;
     mio_meta_t *meta;
 
     if (packet->payload != NULL ) {
@@ -107,6 +108,15 @@ void mio_packet_free(mio_packet_t* packet) {
             }
             break;
 
+        case MIO_PACKET_PUBLISH_RESULTS:
+            curr_result = (mio_publish_result_t*) packet->payload;
+            while (curr_result != NULL ) {
+                result = curr_result->next;
+                mio_publish_result_free(curr_result);
+                curr_result = result;
+            }
+            break;
+
         default:
             mio_error("Cannot free packet of unknown type");
             return;
@@ -33,7 +33,8 @@ typedef enum {
     MIO_PACKET_COLLECTIONS,
     MIO_PACKET_NODE_TYPE,
     MIO_PACKET_SCHEDULE,
-    MIO_PACKET_REFERENCES
+    MIO_PACKET_REFERENCES,
+    MIO_PACKET_PUBLISH_RESULTS
 } mio_packet_type_t;
 
 typedef struct mio_packet {
@@ -0,0 +1,422 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/time.h>
+#include "mio_publish_stream.h"
+
+extern mio_log_level_t _mio_log_level;
+
+// Wakes up threads in mio_publish_stream_flush() once nothing is outstanding
+static void _mio_publish_stream_signal(mio_publish_stream_t *stream) {
+    if (__atomic_load_n(&stream->stats.outstanding, __ATOMIC_SEQ_CST) != 0
+            || __atomic_load_n(&stream->flush_waiters, __ATOMIC_SEQ_CST) == 0)
+        return;
+    pthread_mutex_lock(&stream->mutex);
+    pthread_cond_broadcast(&stream->cond);
+    pthread_mutex_unlock(&stream->mutex);
+}
+
+// Completes the publish with sequence number seq if it is still outstanding,
+// returns 0 if it already completed
+static int _mio_publish_stream_retire(mio_publish_stream_t *stream,
+                                      uint64_t seq, int status, const mio_response_error_t *error) {
+    uint64_t expected = seq + 1;
+
+    if (!__atomic_compare_exchange_n(&stream->slots[seq & stream->mask],
+                                     &expected, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        return 0;
+
+    switch (status) {
+    case MIO_OK:
+        __atomic_add_fetch(&stream->stats.acked, 1, __ATOMIC_RELAXED);
+        break;
+    case MIO_ERROR_PUBLISH_FAILED:
+        __atomic_add_fetch(&stream->stats.errors, 1, __ATOMIC_RELAXED);
+        break;
+    case MIO_ERROR_TIMEOUT:
+        __atomic_add_fetch(&stream->stats.timeouts, 1, __ATOMIC_RELAXED);
+        break;
+    default:
+        __atomic_add_fetch(&stream->stats.disconnects, 1, __ATOMIC_RELAXED);
+        break;
+    }
+    __atomic_sub_fetch(&stream->stats.outstanding, 1, __ATOMIC_SEQ_CST);
+
+    if (status != MIO_OK && stream->failure != NULL)
+        stream->failure(stream, seq, status, error, stream->userdata);
+    _mio_publish_stream_signal(stream);
+    return 1;
+}
+
+// Timeout sweep of a stream, runs in the event loop thread. Publishes time
+// out in the order they were sent, so the sweep stops at the first one that
+// has not expired yet and sleeps until its deadline.
+static void _mio_publish_stream_expire(xmpp_ctx_t * const ctx,
+                                       xmpp_timer_t * const timer) {
+    mio_publish_stream_t *stream = (mio_publish_stream_t*) timer->userdata;
+    uint64_t seq, tail, now = xmpp_ctx_now(ctx), next;
+
+    tail = __atomic_load_n(&stream->tail, __ATOMIC_ACQUIRE);
+    next = now + stream->timeout_ms / 4 + 1;
+    for (; stream->expired != tail; stream->expired++) {
+        seq = stream->expired;
+        if (__atomic_load_n(&stream->slots[seq & stream->mask], __ATOMIC_ACQUIRE)
+                != seq + 1)
+            continue;
+        if (stream->deadlines[seq & stream->mask] > now) {
+            next = stream->deadlines[seq & stream->mask];
+            break;
+        }
+        _mio_publish_stream_retire(stream, seq, MIO_ERROR_TIMEOUT, NULL);
+    }
+    // Publishes sent later have a deadline at least timeout_ms from now, so
+    // looking again after a quarter of it bounds how late they time out
+    xmpp_timer_add(ctx, timer, next);
+}
+
+/**
+ * @ingroup PubSub
+ * Creates a stream for publishing without waiting for the server. Up to
+ * window publishes are outstanding at a time. The server's acknowledgements
+ * are matched by their stanza id alone and counted, publishes the server
+ * rejects or does not acknowledge within timeout_ms are counted and passed to
+ * failure. Publishes of a stream must be sent from one thread at a time.
+ * Streams must be freed before their connection.
+ *
+ * @param conn A pointer to a mio connection. It does not need to be active.
+ * @param window The number of outstanding publishes, rounded up to a power of two, 0 for MIO_PUBLISH_STREAM_DEFAULT_WINDOW.
+ * @param timeout_ms Time in ms after which an unacknowledged publish fails with MIO_ERROR_TIMEOUT, 0 for MIO_RESPONSE_TIMEOUT.
+ * @param failure Called for each failed publish, can be NULL.
+ * @param userdata Passed to failure.
+ * @returns A newly allocated publish stream to be freed with mio_publish_stream_free(), or NULL on an error.
+ */
+mio_publish_stream_t *mio_publish_stream_new(mio_conn_t *conn,
+        unsigned int window, unsigned int timeout_ms,
+        mio_publish_failure failure, void *userdata) {
+    mio_publish_stream_t *stream;
+    uint64_t size = 1;
+
+    if (window == 0)
+        window = MIO_PUBLISH_STREAM_DEFAULT_WINDOW;
+    while (size < window)
+        size <<= 1;
+
+    stream = malloc(sizeof(mio_publish_stream_t));
+    if (stream == NULL)
+        return NULL;
+    memset(stream, 0, sizeof(mio_publish_stream_t));
+    stream->slots = calloc(size, sizeof(uint64_t));
+    stream->deadlines = calloc(size, sizeof(uint64_t));
+    if (stream->slots == NULL || stream->deadlines == NULL) {
+        free(stream->slots);
+        free(stream->deadlines);
+        free(stream);
+        return NULL;
+    }
+    stream->conn = conn;
+    stream->mask = size - 1;
+    stream->stats.window = size;
+    stream->timeout_ms = timeout_ms == 0 ? MIO_RESPONSE_TIMEOUT : timeout_ms;
+    stream->failure = failure;
+    stream->userdata = userdata;
+    pthread_mutex_init(&stream->mutex, NULL );
+    pthread_cond_init(&stream->cond, NULL );
+    xmpp_timer_init(&stream->timer, _mio_publish_stream_expire, stream);
+
+    _mio_event_loop_lock(conn);
+    stream->id = ++conn->publish_stream_ids;
+    stream->next = conn->publish_streams;
+    conn->publish_streams = stream;
+    xmpp_timer_add(conn->xmpp_conn->ctx, &stream->timer,
+                   time_monotonic() + stream->timeout_ms / 4 + 1);
+    _mio_event_loop_unlock(conn);
+
+    return stream;
+}
+
+/**
+ * @ingroup PubSub
+ * Frees a publish stream. Acknowledgements of publishes that are still
+ * outstanding are ignored.
+ *
+ * @param stream A pointer to the publish stream to be freed.
+ */
+void mio_publish_stream_free(mio_publish_stream_t *stream) {
+    mio_publish_stream_t **s;
+    mio_conn_t *conn = stream->conn;
+
+    _mio_event_loop_lock(conn);
+    for (s = &conn->publish_streams; *s != NULL; s = &(*s)->next) {
+        if (*s == stream) {
+            *s = stream->next;
+            break;
+        }
+    }
+    xmpp_timer_del(conn->xmpp_conn->ctx, &stream->timer);
+    _mio_event_loop_unlock(conn);
+
+    pthread_mutex_destroy(&stream->mutex);
+    pthread_cond_destroy(&stream->cond);
+    free(stream->slots);
+    free(stream->deadlines);
+    free(stream);
+}
+
+// Takes the next sequence number if the window has room and writes the
+// stanza id of the publish to id
+static int _mio_publish_stream_claim(mio_publish_stream_t *stream,
+                                     uint64_t *seq, char *id) {
+    uint64_t head = stream->head, tail = stream->tail;
+
+    if (!stream->conn->xmpp_conn->authenticated) {
+        mio_error(
+            "Cannot process publish request since not connected to XMPP server");
+        return MIO_ERROR_DISCONNECTED;
+    }
+
+    // Skip over publishes that completed since the last send
+    while (head != tail
+            && __atomic_load_n(&stream->slots[head & stream->mask],
+                               __ATOMIC_ACQUIRE) != head + 1)
+        head++;
+    stream->head = head;
+    if (tail - head > stream->mask) {
+        __atomic_add_fetch(&stream->stats.window_full, 1, __ATOMIC_RELAXED);
+        return MIO_ERROR_TOO_MANY_OPEN_REQUESTS;
+    }
+
+    stream->deadlines[tail & stream->mask] = time_monotonic()
+            + stream->timeout_ms;
+    __atomic_add_fetch(&stream->stats.outstanding, 1, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&stream->stats.sent, 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&stream->slots[tail & stream->mask], tail + 1,
+                     __ATOMIC_RELEASE);
+    __atomic_store_n(&stream->tail, tail + 1, __ATOMIC_RELEASE);
+
+    *seq = tail;
+    snprintf(id, 37, "mps%x-%llx", stream->id, (unsigned long long) tail);
+    return MIO_OK;
+}
+
+// Takes back a publish that could not be sent, unless it already completed
+static void _mio_publish_stream_unclaim(mio_publish_stream_t *stream,
+                                        uint64_t seq) {
+    uint64_t expected = seq + 1;
+
+    if (!__atomic_compare_exchange_n(&stream->slots[seq & stream->mask],
+                                     &expected, 0, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+        return;
+    __atomic_sub_fetch(&stream->stats.sent, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&stream->stats.outstanding, 1, __ATOMIC_SEQ_CST);
+    _mio_publish_stream_signal(stream);
+}
+
+/**
+ * @ingroup PubSub
+ * Sends a publish iq on a publish stream without waiting for the server. The
+ * stanza's id is replaced by one that identifies the publish in the stream.
+ *
+ * @param stream A pointer to a publish stream.
+ * @param stanza The publish iq to send, see _mio_item_publish_stanza_new(). It can be freed once the function returns.
+ * @returns MIO_OK if the publish was queued, MIO_ERROR_TOO_MANY_OPEN_REQUESTS if the window is full, otherwise an error.
+ */
+int mio_publish_stream_send(mio_publish_stream_t *stream, mio_stanza_t *stanza) {
+    uint64_t seq;
+    int err;
+
+    err = _mio_publish_stream_claim(stream, &seq, stanza->id);
+    if (err != MIO_OK)
+        return err;
+    xmpp_stanza_set_id(stanza->xmpp_stanza, stanza->id);
+    err = mio_send_nonblocking(stream->conn, stanza);
+    if (err != MIO_OK)
+        _mio_publish_stream_unclaim(stream, seq);
+    return err;
+}
+
+/**
+ * @ingroup PubSub
+ * Fills a publish template and sends it on a publish stream without waiting
+ * for the server.
+ *
+ * @param stream A pointer to a publish stream.
+ * @param tmpl The template of a publish iq, see mio_transducer_data_template_new().
+ * @param values One string per value slot of the template.
+ * @returns MIO_OK if the publish was queued, MIO_ERROR_TOO_MANY_OPEN_REQUESTS if the window is full, otherwise an error.
+ */
+int mio_publish_stream_template_send(mio_publish_stream_t *stream,
+                                     mio_template_t *tmpl, const char **values) {
+    char id[37];
+    uint64_t seq;
+    int err;
+
+    err = _mio_publish_stream_claim(stream, &seq, id);
+    if (err != MIO_OK)
+        return err;
+    err = _mio_template_send(stream->conn, tmpl, id, values);
+    if (err != MIO_OK)
+        _mio_publish_stream_unclaim(stream, seq);
+    return err;
+}
+
+/**
+ * @ingroup PubSub
+ * Waits until every publish sent on a stream has been acknowledged, rejected
+ * or timed out.
+ *
+ * @param stream A pointer to a publish stream.
+ * @param timeout_ms Time in ms to wait at most, 0 to wait until done.
+ * @returns MIO_OK once nothing is outstanding, MIO_ERROR_TIMEOUT if timeout_ms passed first.
+ */
+int mio_publish_stream_flush(mio_publish_stream_t *stream, int timeout_ms) {
+    struct timespec ts;
+    struct timeval tp;
+    int err = MIO_OK, cond_err;
+
+    gettimeofday(&tp, NULL );
+    ts.tv_sec = tp.tv_sec + timeout_ms / 1000;
+    ts.tv_nsec = tp.tv_usec * 1000 + (timeout_ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&stream->mutex);
+    __atomic_add_fetch(&stream->flush_waiters, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&stream->stats.outstanding, __ATOMIC_SEQ_CST) != 0) {
+        if (timeout_ms == 0) {
+            pthread_cond_wait(&stream->cond, &stream->mutex);
+            continue;
+        }
+        cond_err = pthread_cond_timedwait(&stream->cond, &stream->mutex, &ts);
+        if (cond_err == ETIMEDOUT) {
+            err = MIO_ERROR_TIMEOUT;
+            break;
+        }
+    }
+    __atomic_sub_fetch(&stream->flush_waiters, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&stream->mutex);
+
+    return err;
+}
+
+/**
+ * @ingroup PubSub
+ * Reads the counters of a publish stream. Can be called from any thread.
+ *
+ * @param stream A pointer to a publish stream.
+ * @param stats Receives the counters.
+ */
+void mio_publish_stream_stats(mio_publish_stream_t *stream,
+                              mio_publish_stream_stats_t *stats) {
+    stats->sent = __atomic_load_n(&stream->stats.sent, __ATOMIC_RELAXED);
+    stats->acked = __atomic_load_n(&stream->stats.acked, __ATOMIC_RELAXED);
+    stats->errors = __atomic_load_n(&stream->stats.errors, __ATOMIC_RELAXED);
+    stats->timeouts = __atomic_load_n(&stream->stats.timeouts,
+                                      __ATOMIC_RELAXED);
+    stats->disconnects = __atomic_load_n(&stream->stats.disconnects,
+                                         __ATOMIC_RELAXED);
+    stats->window_full = __atomic_load_n(&stream->stats.window_full,
+                                         __ATOMIC_RELAXED);
+    stats->outstanding = __atomic_load_n(&stream->stats.outstanding,
+                                         __ATOMIC_RELAXED);
+    stats->window = stream->stats.window;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to complete the publish answered by an iq result or
+ * error, from its stanza id and the error's attributes alone. Must be called
+ * from the event loop thread.
+ *
+ * @param conn A pointer to an active mio connection.
+ * @param stanza The iq result or error.
+ * @param id The stanza id of the iq.
+ * @param type The type of the iq, "result" or "error".
+ * @returns 1 if the id belongs to a publish stream, 0 otherwise.
+ */
+int _mio_publish_stream_ack(mio_conn_t *conn, xmpp_stanza_t *stanza,
+                            const char *id, const char *type) {
+    mio_publish_stream_t *stream;
+    mio_response_error_t error;
+    xmpp_stanza_t *err_stanza;
+    unsigned long stream_id;
+    unsigned long long seq;
+    const char *code;
+    char *end;
+
+    if (strncmp(id, "mps", 3) != 0)
+        return 0;
+    stream_id = strtoul(id + 3, &end, 16);
+    if (*end != '-')
+        return 1;
+    seq = strtoull(end + 1, &end, 16);
+    if (*end != '\0')
+        return 1;
+
+    for (stream = conn->publish_streams; stream != NULL; stream = stream->next)
+        if (stream->id == stream_id)
+            break;
+    // Late acknowledgement of a publish whose stream is gone
+    if (stream == NULL || seq >= __atomic_load_n(&stream->tail, __ATOMIC_ACQUIRE))
+        return 1;
+
+    if (strcmp(type, "error") != 0) {
+        _mio_publish_stream_retire(stream, seq, MIO_OK, NULL);
+        return 1;
+    }
+
+    memset(&error, 0, sizeof(error));
+    err_stanza = xmpp_stanza_get_child_by_name(stanza, "error");
+    if (err_stanza != NULL) {
+        error.description = xmpp_stanza_get_attribute(err_stanza, "type");
+        code = xmpp_stanza_get_attribute(err_stanza, "code");
+        if (code != NULL)
+            error.err_num = atoi(code);
+    }
+    _mio_publish_stream_retire(stream, seq, MIO_ERROR_PUBLISH_FAILED, &error);
+    return 1;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to fail all outstanding publishes of a connection's
+ * streams, e.g. when the connection drops. Must be called from the event loop
+ * thread.
+ *
+ * @param conn A pointer to a mio connection.
+ * @param status The error the publishes fail with.
+ */
+void _mio_publish_streams_fail_all(mio_conn_t *conn, int status) {
+    mio_publish_stream_t *stream;
+    uint64_t tail;
+
+    for (stream = conn->publish_streams; stream != NULL; stream = stream->next) {
+        tail = __atomic_load_n(&stream->tail, __ATOMIC_ACQUIRE);
+        for (; stream->expired != tail; stream->expired++)
+            _mio_publish_stream_retire(stream, stream->expired, status, NULL);
+    }
+}
@@ -0,0 +1,96 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+
+#ifndef ____mio_publish_stream__
+#define ____mio_publish_stream__
+
+#include <mio.h>
+
+// Number of publishes a stream keeps outstanding unless told otherwise
+#define MIO_PUBLISH_STREAM_DEFAULT_WINDOW 1024
+
+// Called for every publish of a stream that the server rejected, that was not
+// acknowledged within the stream's timeout or that was outstanding when the
+// connection dropped. status is MIO_ERROR_PUBLISH_FAILED, MIO_ERROR_TIMEOUT or
+// MIO_ERROR_DISCONNECTED. error holds the server's error for rejected
+// publishes, NULL otherwise, and is only valid during the call. Runs in the
+// event loop thread and must not block.
+typedef void (*mio_publish_failure)(mio_publish_stream_t *stream, uint64_t seq,
+                                    int status, const mio_response_error_t *error, void *userdata);
+
+// Counters of a publish stream, see mio_publish_stream_stats()
+typedef struct {
+    uint64_t sent; // Publishes handed to the send queue
+    uint64_t acked; // Publishes the server acknowledged
+    uint64_t errors; // Publishes the server rejected
+    uint64_t timeouts; // Publishes not acknowledged within the timeout
+    uint64_t disconnects; // Publishes outstanding when the connection dropped
+    uint64_t window_full; // Sends refused because the window was full
+    unsigned int outstanding, window;
+} mio_publish_stream_stats_t;
+
+// Publishes sent without waiting for the server, whose acknowledgements are
+// matched against a window of outstanding sequence numbers, see
+// mio_publish_stream_new()
+struct mio_publish_stream {
+    mio_conn_t *conn;
+    unsigned int id; // Identifies the stream in the stanza ids of its publishes
+    // Sequence number + 1 of the publish outstanding in each slot of the
+    // window, 0 once it completed. Whoever clears a slot accounts for it.
+    uint64_t *slots;
+    // time_monotonic() in ms after which the publish in a slot times out
+    uint64_t *deadlines;
+    uint64_t mask;
+    unsigned int timeout_ms;
+    mio_publish_failure failure;
+    void *userdata;
+    char pad0[64];
+    // Oldest sequence number that may still be outstanding and the next one
+    // to be sent, only written by the sending thread
+    uint64_t head, tail;
+    char pad1[64];
+    // Next sequence number the timeout sweep looks at, event loop thread only
+    uint64_t expired;
+    xmpp_timer_t timer;
+    mio_publish_stream_stats_t stats; // Updated atomically
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int flush_waiters; // Threads waiting in mio_publish_stream_flush()
+    mio_publish_stream_t *next; // Next stream of the connection
+};
+
+mio_publish_stream_t *mio_publish_stream_new(mio_conn_t *conn,
+        unsigned int window, unsigned int timeout_ms,
+        mio_publish_failure failure, void *userdata);
+void mio_publish_stream_free(mio_publish_stream_t *stream);
+int mio_publish_stream_send(mio_publish_stream_t *stream, mio_stanza_t *stanza);
+int mio_publish_stream_template_send(mio_publish_stream_t *stream,
+                                     mio_template_t *tmpl, const char **values);
+int mio_publish_stream_flush(mio_publish_stream_t *stream, int timeout_ms);
+void mio_publish_stream_stats(mio_publish_stream_t *stream,
+                              mio_publish_stream_stats_t *stats);
+int _mio_publish_stream_ack(mio_conn_t *conn, xmpp_stanza_t *stanza,
+                            const char *id, const char *type);
+void _mio_publish_streams_fail_all(mio_conn_t *conn, int status);
+
+#endif /* defined(____mio_publish_stream__) */
@@ -43,7 +43,12 @@ int mio_handler_publish(mio_conn_t * const conn, mio_stanza_t * const stanza,
 mio_stanza_t *_mio_pubsub_get_stanza_new(mio_conn_t *conn,
         const char *node);
 mio_stanza_t *_mio_pubsub_stanza_new(mio_conn_t *conn, const char *node);
+static const xmpp_stream_decoder_t _mio_pubsub_event_decoder;
+
 /** Indicates to XMPP server that conn should receive pubsub data.
+ *  Pubsub events are decoded straight from the socket into pooled responses
+ *  while they are parsed, they do not reach other handlers registered for
+ *  the pubsub event namespace while listening.
  *
  *  @param conn Active MIO connection.
  *
@@ -62,11 +67,12 @@ int mio_pubsub_data_listen_start(mio_conn_t *conn) {
     if (conn->presence_status != MIO_PRESENCE_PRESENT)
         mio_listen_start(conn);
 
+    if (conn->pubsub_rx_request != NULL)
+        return MIO_OK;
+
     request = _mio_request_new();
     strcpy(request->id, "pubsub_data_rx");
-
-    // If we have too many open requests, wait
-    sem_wait(conn->mio_open_requests);
+    conn->pubsub_rx_request = request;
 
     err = mio_handler_add(conn, (mio_handler) mio_handler_pubsub_data_receive,
                           "http://jabber.org/protocol/pubsub#event", NULL, NULL, request,
@@ -74,6 +80,16 @@ int mio_pubsub_data_listen_start(mio_conn_t *conn) {
     if (err == MIO_OK)
         conn->pubsub_rx_listening = 1;
 
+    // The handler above only sees events the decoder turns down
+    if (err == MIO_OK && conn->pubsub_rx_decode == NULL)
+        conn->pubsub_rx_decode = mio_xml_parser_data_new();
+    if (err == MIO_OK && conn->pubsub_rx_decode != NULL) {
+        _mio_event_loop_lock(conn);
+        xmpp_conn_set_stream_decoder(conn->xmpp_conn,
+                                     &_mio_pubsub_event_decoder, conn);
+        _mio_event_loop_unlock(conn);
+    }
+
     return err;
 }
 
@@ -86,13 +102,16 @@ int mio_pubsub_data_listen_start(mio_conn_t *conn) {
 int mio_pubsub_data_listen_stop(mio_conn_t *conn) {
     mio_request_t *request;
 
-    // Signal mio_pubsub_data_receive if it is waiting and delete pubsub_data_rx request if we were listening
-    request = _mio_request_get(conn, "pubsub_data_rx");
+    // Wake up mio_pubsub_data_receive() if it is waiting and delete pubsub_data_rx request if we were listening
+    request = conn->pubsub_rx_request;
     if (request != NULL ) {
-        // FIXME: Potential deadlock on mio_pubsub_data_receive() function when condition signaled without function waiting
+        _mio_event_loop_lock(conn);
+        xmpp_conn_set_stream_decoder(conn->xmpp_conn, NULL, NULL);
+        _mio_event_loop_unlock(conn);
         conn->pubsub_rx_listening = 0;
-        mio_cond_signal(&request->cond, &request->mutex, &request->predicate);
-        _mio_request_delete(conn, "pubsub_data_rx");
+        _mio_pubsub_rx_queue_wake(conn);
+        conn->pubsub_rx_request = NULL;
+        _mio_request_free(request);
     }
     return MIO_OK;
 }
@@ -102,23 +121,98 @@ int mio_pubsub_data_listen_stop(mio_conn_t *conn) {
  * @param conn Active MIO connection.
  *  */
 void mio_pubsub_data_rx_queue_clear(mio_conn_t *conn) {
-    mio_response_t *response = _mio_pubsub_rx_queue_dequeue(conn);
-    while (response != NULL ) {
-        response = _mio_pubsub_rx_queue_dequeue(conn);
+    mio_response_t *response;
+
+    while ((response = _mio_pubsub_rx_queue_dequeue(conn)) != NULL)
         mio_response_free(response);
+}
+
+/** Sets the capacity and overflow policy of the pubsub packet receive queue.
+ *  The capacity can only be changed while not listening for pubsub data and
+ *  the queue is empty, the policy only while reads are not paused by
+ *  MIO_RX_OVERFLOW_BACKPRESSURE.
+ *
+ * @param conn MIO connection.
+ * @param capacity Number of packets the queue holds, rounded up to the next
+ * power of two, 0 for MIO_PUBSUB_RX_QUEUE_DEFAULT_LEN.
+ * @param policy What happens to packets received while the queue is full.
+ *
+ * @returns MIO_OK on success, MIO_ERROR_RX_QUEUE_BUSY if the queue is in use
+ * or MIO_ERROR_MALLOC.
+ *  */
+int mio_pubsub_data_rx_queue_configure(mio_conn_t *conn, unsigned int capacity,
+                                       mio_rx_overflow_policy_t policy) {
+    unsigned int size = 1;
+    int err;
+
+    if (capacity == 0)
+        capacity = MIO_PUBSUB_RX_QUEUE_DEFAULT_LEN;
+    while (size < capacity)
+        size <<= 1;
+
+    if (__atomic_load_n(&conn->pubsub_rx_paused, __ATOMIC_SEQ_CST))
+        return MIO_ERROR_RX_QUEUE_BUSY;
+    if (size != conn->pubsub_rx_stats.capacity) {
+        if (conn->pubsub_rx_listening || _mio_pubsub_rx_queue_len(conn) > 0)
+            return MIO_ERROR_RX_QUEUE_BUSY;
+        err = _mio_pubsub_rx_queue_init(conn, size);
+        if (err != MIO_OK)
+            return err;
     }
+    __atomic_store_n(&conn->pubsub_rx_policy, policy, __ATOMIC_RELAXED);
+    return MIO_OK;
 }
 
-/** Clears the packet receive queue for pubsub packets.
+/** Gets the counters of the pubsub packet receive queue.
+ *
+ * @param conn MIO connection.
+ * @param stats Receives the counters and the current length and capacity of
+ * the queue.
+ *  */
+void mio_pubsub_data_rx_queue_stats(mio_conn_t *conn,
+                                    mio_pubsub_rx_stats_t *stats) {
+    mio_pubsub_rx_stats_t *counters = &conn->pubsub_rx_stats;
+
+    stats->enqueued = __atomic_load_n(&counters->enqueued, __ATOMIC_RELAXED);
+    stats->dequeued = __atomic_load_n(&counters->dequeued, __ATOMIC_RELAXED);
+    stats->dropped_oldest = __atomic_load_n(&counters->dropped_oldest,
+                                            __ATOMIC_RELAXED);
+    stats->dropped_newest = __atomic_load_n(&counters->dropped_newest,
+                                            __ATOMIC_RELAXED);
+    stats->read_pauses = __atomic_load_n(&counters->read_pauses,
+                                         __ATOMIC_RELAXED);
+    stats->routed = __atomic_load_n(&counters->routed, __ATOMIC_RELAXED);
+    stats->length = _mio_pubsub_rx_queue_len(conn);
+    stats->capacity = counters->capacity;
+}
+
+/** Receives a pubsub packet, blocking until one arrives.
  *
  * @param conn Active MIO connection.
+ * @param response Response receiving the packet.
  *
  * @returns MIO_OK on sccuess, and MIO_ERROR_DISCONNECTED on failure.
  *  */
 int mio_pubsub_data_receive(mio_conn_t *conn, mio_response_t *response) {
+    return mio_pubsub_data_receive_timeout(conn, response, -1);
+}
+
+/** Receives a pubsub packet, waiting at most timeout_ms for one to arrive.
+ *
+ * @param conn Active MIO connection.
+ * @param response Response receiving the packet.
+ * @param timeout_ms Time in ms to wait at most, 0 to only check the queue
+ * and negative to wait indefinitely.
+ *
+ * @returns MIO_OK on sccuess, MIO_ERROR_TIMEOUT if no packet arrived in time,
+ * MIO_ERROR_NO_RESPONSE if listening was stopped and MIO_ERROR_DISCONNECTED on
+ * failure.
+ *  */
+int mio_pubsub_data_receive_timeout(mio_conn_t *conn, mio_response_t *response,
+                                    int timeout_ms) {
     int err;
-    mio_request_t *request;
     mio_response_t *rx_response = NULL;
+    mio_arena_t *arena;
 
     // Check if connection is active
     if (!conn->xmpp_conn->authenticated) {
@@ -127,53 +221,17 @@ int mio_pubsub_data_receive(mio_conn_t *conn, mio_response_t *response) {
         return MIO_ERROR_DISCONNECTED;
     }
 
-    // If there is a pubsub response waiting on the pubsub_rx_queue, return it. Else block until we receive one.
-    rx_response = _mio_pubsub_rx_queue_dequeue(conn);
-    if (rx_response != NULL ) {
-        strcpy(response->id, rx_response->id);
-        response->name = rx_response->name;
-        response->ns = rx_response->ns;
-        response->response_type = rx_response->response_type;
-        response->type = rx_response->type;
-        response->response = rx_response->response;
-        response->stanza = rx_response->stanza;
-        free(rx_response);
-        return MIO_OK;
-    }
-
     // Call mio_pubsub_data_listen_start() if we aren't listening yet
-    request = _mio_request_get(conn, "pubsub_data_rx");
-    if (request == NULL ) {
+    if (conn->pubsub_rx_request == NULL ) {
         err = mio_pubsub_data_listen_start(conn);
         if (err != MIO_OK)
             return err;
-        request = _mio_request_get(conn, "pubsub_data_rx");
-    }
-    while (rx_response == NULL && conn->pubsub_rx_queue_len <= 0
-            && conn->pubsub_rx_listening) {
-        while (!request->predicate) {
-            err = pthread_mutex_lock(&request->mutex);
-            if (err != 0) {
-                mio_error("Unable to lock mutex for request %s", request->id);
-                return MIO_ERROR_MUTEX;
-            }
-            // Wait for response from server
-            err = pthread_cond_wait(&request->cond, &request->mutex);
-            if (err != 0) {
-                mio_error("Conditional wait for request with id %s failed",
-                          request->id);
-                pthread_mutex_unlock(&request->mutex);
-                return MIO_ERROR_COND_WAIT;
-            } else {
-                mio_debug("Got response for request with id %s", request->id);
-                pthread_mutex_unlock(&request->mutex);
-            }
-        }
     }
-    request->predicate = 0;
-    rx_response = _mio_pubsub_rx_queue_dequeue(conn);
-    if (rx_response == NULL )
-        return MIO_ERROR_NO_RESPONSE;
+
+    // Return a pubsub response waiting on the pubsub RX queue, else block until we receive one
+    err = _mio_pubsub_rx_queue_dequeue_timed(conn, timeout_ms, &rx_response);
+    if (err != MIO_OK)
+        return err;
 
     strcpy(response->id, rx_response->id);
     response->name = rx_response->name;
@@ -182,10 +240,99 @@ int mio_pubsub_data_receive(mio_conn_t *conn, mio_response_t *response) {
     response->type = rx_response->type;
     response->response = rx_response->response;
     response->stanza = rx_response->stanza;
-    free(rx_response);
+    // The contents and the arena they live in now belong to response, keep
+    // the empty shell for reuse
+    arena = response->arena;
+    response->arena = rx_response->arena;
+    rx_response->arena = arena;
+    rx_response->ns = NULL;
+    rx_response->response_type = MIO_RESPONSE_UNKNOWN;
+    rx_response->response = NULL;
+    rx_response->stanza = NULL;
+    _mio_response_pool_put(conn, rx_response);
     return MIO_OK;
 }
 
+/** Receives up to max_responses pubsub packets at once. Blocks until at least
+ *  one packet arrives, then returns all packets that are ready without
+ *  waiting for more. The returned responses belong to the caller, who passes
+ *  them to mio_pubsub_data_response_release() when done so that they are
+ *  reused for later packets, or frees them with mio_response_free().
+ *  A response and everything it points to live in one arena that is recycled
+ *  on release, so once enough responses are in circulation receiving does not
+ *  allocate. The contents must therefore not be modified or freed one by one.
+ *  Packets of one node may be returned to concurrent callers out of order,
+ *  mio_pubsub_data_lanes_start() delivers them in order instead.
+ *
+ * @param conn Active MIO connection.
+ * @param responses Array receiving pointers to the responses, oldest first.
+ * @param max_responses Size of the responses array.
+ * @param timeout_ms Time in ms to wait at most for the first packet, 0 to only
+ * check the queue and negative to wait indefinitely.
+ *
+ * @returns The number of responses received, MIO_ERROR_TIMEOUT if no packet
+ * arrived in time, MIO_ERROR_NO_RESPONSE if listening was stopped and
+ * MIO_ERROR_DISCONNECTED on failure.
+ *  */
+int mio_pubsub_data_receive_many(mio_conn_t *conn, mio_response_t **responses,
+                                 int max_responses, int timeout_ms) {
+    int err, n;
+
+    if (max_responses <= 0)
+        return 0;
+
+    // Check if connection is active
+    if (!conn->xmpp_conn->authenticated) {
+        mio_error(
+            "Cannot process data_receive request since not connected to XMPP server");
+        return MIO_ERROR_DISCONNECTED;
+    }
+
+    // Call mio_pubsub_data_listen_start() if we aren't listening yet
+    if (conn->pubsub_rx_request == NULL ) {
+        err = mio_pubsub_data_listen_start(conn);
+        if (err != MIO_OK)
+            return err;
+    }
+
+    // Take whatever is ready, else block until the first response arrives and
+    // take whatever arrived with it
+    n = _mio_pubsub_rx_queue_dequeue_many(conn, responses, max_responses);
+    if (n > 0)
+        return n;
+    err = _mio_pubsub_rx_queue_dequeue_timed(conn, timeout_ms, &responses[0]);
+    if (err != MIO_OK)
+        return err;
+    return 1 + _mio_pubsub_rx_queue_dequeue_many(conn, responses + 1,
+            max_responses - 1);
+}
+
+/** Releases a response returned by mio_pubsub_data_receive_many(). Its
+ *  contents are released at once and the response is kept with its arena for
+ *  a later packet.
+ *
+ * @param conn MIO connection the response was received on.
+ * @param response Response to release.
+ *  */
+void mio_pubsub_data_response_release(mio_conn_t *conn,
+                                      mio_response_t *response) {
+    _mio_response_pool_put(conn, response);
+}
+
+// Copies a decoded string into the decode's arena if it has one
+static char *_mio_xml_strdup(mio_xml_parser_data_t *xml_data, const char *s) {
+    if (xml_data->arena == NULL)
+        return strdup(s);
+    return mio_arena_strdup(xml_data->arena, s);
+}
+
+static mio_transducer_data_t *_mio_xml_transducer_data_new(
+    mio_xml_parser_data_t *xml_data) {
+    if (xml_data->arena == NULL)
+        return mio_transducer_data_new();
+    return mio_arena_calloc(xml_data->arena, sizeof(mio_transducer_data_t));
+}
+
 void XMLCALL mio_XMLstart_pubsub_data_receive(void *data,
         const char *element_name, const char **attr) {
 
@@ -201,8 +348,7 @@ void XMLCALL mio_XMLstart_pubsub_data_receive(void *data,
         for (i = 0; attr[i]; i += 2) {
             const char* attr_name = attr[i];
             if (strcmp(attr_name, "node") == 0) {
-                mio_data->event = malloc(strlen(attr[i + 1]) + 1);
-                strcpy(mio_data->event, attr[i + 1]);
+                mio_data->event = _mio_xml_strdup(xml_data, attr[i + 1]);
                 // TODO: Support for multiple payloads
                 packet->num_payloads++;
             }
@@ -212,7 +358,7 @@ void XMLCALL mio_XMLstart_pubsub_data_receive(void *data,
                || strcmp(element_name, "transducerSetData") == 0) {
 
         if (xml_data->payload == NULL) {
-            parent = mio_transducer_data_new();
+            parent = _mio_xml_transducer_data_new(xml_data);
             xml_data->payload = parent;
             t = parent;
             response->response_type = MIO_RESPONSE_PACKET;
@@ -220,7 +366,7 @@ void XMLCALL mio_XMLstart_pubsub_data_receive(void *data,
             mio_data->num_transducers++;
         } else {
             parent = xml_data->payload;
-            t = mio_transducer_data_new();
+            t = _mio_xml_transducer_data_new(xml_data);
             mio_data->num_transducers++;
         }
 
@@ -232,11 +378,11 @@ void XMLCALL mio_XMLstart_pubsub_data_receive(void *data,
         for (i = 0; attr[i]; i += 2) {
             const char* attr_name = attr[i];
             if (strcmp(attr_name, "value") == 0)
-                t->value = strdup(attr[i + 1]);
+                t->value = _mio_xml_strdup(xml_data, attr[i + 1]);
             else if (strcmp(attr_name, "timestamp") == 0)
-                t->timestamp = strdup(attr[i + 1]);
+                t->timestamp = _mio_xml_strdup(xml_data, attr[i + 1]);
             else if (strcmp(attr_name, "name") == 0)
-                t->name = strdup(attr[i + 1]);
+                t->name = _mio_xml_strdup(xml_data, attr[i + 1]);
         }
         if (t != parent)
             mio_transducer_data_add(parent, t);
@@ -246,47 +392,186 @@ void XMLCALL mio_XMLstart_pubsub_data_receive(void *data,
 
 /**
  * @ingroup Internal
- * Internal function to send out an XMPP message in a blocking fashion. The function returns once the server's response has been processed or an error occurs.
+ * Internal function to send out a request without waiting for the server's
+ * response. The request is registered before the stanza is handed to the
+ * event loop, so completion may run before this function returns.
  *
  * @param conn A pointer to an active mio conn.
- * @param stanza A pointer to the mio stanza to be sent.
+ * @param stanza A pointer to the mio stanza to be sent, or NULL to send tmpl.
+ * @param tmpl A template to fill and send instead of a stanza, its id slot is filled with the request id.
+ * @param values The values for the template's slots.
  * @param handler A pointer to the mio handler which should parse the server's response.
  * @param response A pointer to an allocated mio response struct which will be populated with the server's response.
- * @returns MIO_OK on success, otherwise an error.
+ * @param completion The function called once the request completes.
+ * @param userdata A pointer to any user data, which is passed to completion.
+ * @param deadline_ms Time in ms after which the request completes with MIO_ERROR_TIMEOUT, 0 for MIO_REQUEST_TIMEOUT_S.
+ * @param wait_for_slot Nonzero to wait for a free slot if too many requests are open, otherwise fail with MIO_ERROR_TOO_MANY_OPEN_REQUESTS.
+ * @returns MIO_OK if the request was sent, otherwise an error, in which case completion is never called.
  */
-int mio_send_blocking(mio_conn_t *conn, mio_stanza_t *stanza,
-                      mio_handler handler, mio_response_t * response) {
+static int _mio_send_request(mio_conn_t *conn, mio_stanza_t *stanza,
+                             mio_template_t *tmpl, const char **values,
+                             mio_handler handler, mio_response_t *response,
+                             mio_completion completion, void *userdata,
+                             unsigned int deadline_ms, int wait_for_slot) {
 
     mio_request_t *request;
-    struct timespec ts, ts_reconnect;
-    struct timeval tp;
     int err;
-    int send_attempts = 0;
 
-    request = _mio_request_new();
+// If we have too many open requests, wait or give up
+    request = _mio_request_acquire(conn, wait_for_slot);
+    if (request == NULL) {
+        mio_error("Cannot send request, open request table full");
+        return MIO_ERROR_TOO_MANY_OPEN_REQUESTS;
+    }
+
+    if (deadline_ms == 0)
+        deadline_ms = MIO_REQUEST_TIMEOUT_S * 1000;
+    request->handler = handler;
+    request->handler_type = MIO_HANDLER_ID;
+    request->response = response;
+    request->completion = completion;
+    request->completion_userdata = userdata;
+    request->deadline = time_monotonic() + deadline_ms;
+
+// The slot id becomes the stanza id so that the response can be routed back
+    strcpy(response->id, request->id);
+    if (stanza != NULL) {
+        strcpy(stanza->id, request->id);
+        xmpp_stanza_set_id(stanza->xmpp_stanza, stanza->id);
+    }
+    _mio_request_start(conn, request);
+
+    if (stanza != NULL)
+        err = mio_send_nonblocking(conn, stanza);
+    else
+        err = _mio_template_send(conn, tmpl, request->id, values);
+    // If the event loop already completed the request, e.g. because the
+    // connection dropped, the completion has been called and owns the error
+    if (err != MIO_OK && _mio_request_cancel(conn, request) != MIO_OK)
+        return MIO_OK;
+    return err;
+}
+
+/**
+ * @ingroup Core
+ * Sends out an XMPP message without waiting for the server's response. Once
+ * the response has been processed by handler, the request's deadline passed or
+ * the connection dropped, completion is called exactly once from the event
+ * loop thread with MIO_OK, MIO_ERROR_TIMEOUT or MIO_ERROR_DISCONNECTED.
+ * Completions may send further requests but must not block.
+ *
+ * @param conn A pointer to an active mio conn.
+ * @param stanza A pointer to the mio stanza to be sent. It can be freed once the function returns.
+ * @param handler A pointer to the mio handler which should parse the server's response.
+ * @param completion The function called once the request completes. The response passed to it has to be freed by the completion using mio_response_free().
+ * @param userdata A pointer to any user data, which is passed to completion.
+ * @param deadline_ms Time in ms after which the request completes with MIO_ERROR_TIMEOUT, 0 for MIO_REQUEST_TIMEOUT_S.
+ * @returns MIO_OK if the request was sent, otherwise an error, in which case completion is never called. The error is MIO_ERROR_TOO_MANY_OPEN_REQUESTS while as many requests are in flight as the request table holds, MIO_MAX_OPEN_REQUESTS unless set with mio_request_table_configure().
+ */
+int mio_send_async(mio_conn_t *conn, mio_stanza_t *stanza,
+                   mio_handler handler, mio_completion completion, void *userdata,
+                   unsigned int deadline_ms) {
+    mio_response_t *response = mio_response_new();
+    int err;
+
+    err = _mio_send_request(conn, stanza, NULL, NULL, handler, response,
+                            completion, userdata, deadline_ms, 0);
+    if (err != MIO_OK)
+        mio_response_free(response);
+    return err;
+}
+
+/**
+ * @ingroup Core
+ * Fills a template and sends it out like mio_send_async(), without building
+ * a stanza tree.
+ *
+ * @param conn A pointer to an active mio conn.
+ * @param tmpl The template to send, see mio_template_compile().
+ * @param values One string per value slot of the template.
+ * @param handler A pointer to the mio handler which should parse the server's response.
+ * @param completion The function called once the request completes. The response passed to it has to be freed by the completion using mio_response_free().
+ * @param userdata A pointer to any user data, which is passed to completion.
+ * @param deadline_ms Time in ms after which the request completes with MIO_ERROR_TIMEOUT, 0 for MIO_REQUEST_TIMEOUT_S.
+ * @returns MIO_OK if the request was sent, otherwise an error, in which case completion is never called.
+ */
+int mio_template_send_async(mio_conn_t *conn, mio_template_t *tmpl,
+                            const char **values, mio_handler handler,
+                            mio_completion completion, void *userdata,
+                            unsigned int deadline_ms) {
+    mio_response_t *response = mio_response_new();
+    int err;
+
+    err = _mio_send_request(conn, NULL, tmpl, values, handler, response,
+                            completion, userdata, deadline_ms, 0);
+    if (err != MIO_OK)
+        mio_response_free(response);
+    return err;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to send out a request with mio_send_async() if completion
+ * is set, otherwise with mio_send_blocking(). Lets the blocking and the
+ * asynchronous form of a request share the code building its stanza.
+ *
+ * @param conn A pointer to an active mio conn.
+ * @param stanza A pointer to the mio stanza to be sent.
+ * @param handler A pointer to the mio handler which should parse the server's response.
+ * @param response The response to populate when sending blocking, unused otherwise.
+ * @param completion The completion of an asynchronous request, NULL to send blocking.
+ * @param userdata A pointer to any user data, which is passed to completion.
+ * @param deadline_ms The deadline of an asynchronous request, see mio_send_async().
+ * @returns MIO_OK on success, otherwise an error.
+ */
+int _mio_send_blocking_or_async(mio_conn_t *conn, mio_stanza_t *stanza,
+                                mio_handler handler, mio_response_t *response,
+                                mio_completion completion, void *userdata,
+                                unsigned int deadline_ms) {
+    if (completion != NULL)
+        return mio_send_async(conn, stanza, handler, completion, userdata,
+                              deadline_ms);
+    return mio_send_blocking(conn, stanza, handler, response);
+}
 
-// Set timeout
-    gettimeofday(&tp, NULL );
-    ts.tv_sec = tp.tv_sec;
-    ts.tv_nsec = tp.tv_usec * 1000;
-    ts.tv_sec += MIO_REQUEST_TIMEOUT_S;
+// State shared between mio_send_blocking() and its completion
+typedef struct {
+    pthread_cond_t cond;
+    pthread_mutex_t mutex;
+    int predicate;
+    int status;
+} mio_send_blocking_wait_t;
+
+static void _mio_send_blocking_complete(mio_conn_t *conn,
+                                        mio_response_t *response, int status, void *userdata) {
+    mio_send_blocking_wait_t *wait = (mio_send_blocking_wait_t*) userdata;
+    wait->status = status;
+    mio_cond_signal(&wait->cond, &wait->mutex, &wait->predicate);
+}
 
-// If we have too many open requests, wait
-    sem_wait(conn->mio_open_requests);
+// Sends stanza, or tmpl filled with values, and waits for the response
+static int _mio_send_blocking(mio_conn_t *conn, mio_stanza_t *stanza,
+                              mio_template_t *tmpl, const char **values,
+                              mio_handler handler, mio_response_t * response) {
 
-    mio_handler_id_add(conn, handler, stanza->id, request, NULL, response);
+    mio_send_blocking_wait_t wait;
+    struct timespec ts_reconnect;
+    struct timeval tp;
+    int err;
+    int send_attempts = 0;
 
+    memset(&wait, 0, sizeof(wait));
+    pthread_cond_init(&wait.cond, NULL );
+    pthread_mutex_init(&wait.mutex, NULL );
 
-// Send out the stanza, then wait for response
-    while (mio_send_nonblocking(conn, stanza) == MIO_ERROR_CONNECTION) {
+// Send out the stanza
+    while ((err = _mio_send_request(conn, stanza, tmpl, values, handler,
+                                    response, _mio_send_blocking_complete, &wait, 0, 1))
+            == MIO_ERROR_CONNECTION) {
         // If sending fails, wait for connection to be reestablished
         send_attempts++;
-        if (send_attempts >= MIO_SEND_RETRIES) {
-            xmpp_id_handler_delete(conn->xmpp_conn, mio_handler_generic_id,
-                                   request->id);
-            _mio_request_delete(conn, request->id);
-            return MIO_ERROR_CONNECTION;
-        }
+        if (send_attempts >= MIO_SEND_RETRIES)
+            break;
 
         // Set timeout
         gettimeofday(&tp, NULL );
@@ -295,63 +580,70 @@ int mio_send_blocking(mio_conn_t *conn, mio_stanza_t *stanza,
         ts_reconnect.tv_sec += MIO_RECONNECTION_TIMEOUT_S;
 
         pthread_mutex_lock(&conn->conn_mutex);
-        // Wait for connection to be established before returning
-        while (!conn->conn_predicate) {
-            err = pthread_cond_timedwait(&conn->conn_cond, &conn->conn_mutex,
-                                         &ts_reconnect);
-            if (err == ETIMEDOUT) {
-                pthread_mutex_unlock(&conn->conn_mutex);
-                xmpp_id_handler_delete(conn->xmpp_conn, mio_handler_generic_id,
-                                       request->id);
-                _mio_request_delete(conn, request->id);
+        // Wait for connection to be established before retrying
+        while (!conn->conn_predicate && err == MIO_ERROR_CONNECTION) {
+            int cond_err = pthread_cond_timedwait(&conn->conn_cond,
+                                                  &conn->conn_mutex, &ts_reconnect);
+            if (cond_err == ETIMEDOUT) {
                 mio_error("Sending attempt timed out");
-                return MIO_ERROR_TIMEOUT;
-            } else if (err != 0) {
-                pthread_mutex_unlock(&conn->conn_mutex);
-                xmpp_id_handler_delete(conn->xmpp_conn, mio_handler_generic_id,
-                                       request->id);
-                _mio_request_delete(conn, request->id);
+                err = MIO_ERROR_TIMEOUT;
+            } else if (cond_err != 0) {
                 mio_error("Conditional wait for connection attempt timed out");
-                return MIO_ERROR_COND_WAIT;
-            } else {
-                pthread_mutex_unlock(&conn->conn_mutex);
+                err = MIO_ERROR_COND_WAIT;
             }
         }
+        pthread_mutex_unlock(&conn->conn_mutex);
+        if (err != MIO_ERROR_CONNECTION)
+            break;
     }
 
-    while (!request->predicate) {
-        err = pthread_mutex_lock(&request->mutex);
-        if (err != 0) {
-            mio_error("Unable to lock mutex for request %s", request->id);
-            return MIO_ERROR_MUTEX;
-        }
-        // Wait for response from server
-        err = pthread_cond_timedwait(&request->cond, &request->mutex, &ts);
-        if (err == ETIMEDOUT) {
-            xmpp_id_handler_delete(conn->xmpp_conn, mio_handler_generic_id,
-                                   request->id);
-            pthread_mutex_unlock(&request->mutex);
-            _mio_request_delete(conn, request->id);
-            mio_error("Request with id %s timed out", request->id);
-            return MIO_ERROR_TIMEOUT;
-        } else if (err != 0) {
-            xmpp_id_handler_delete(conn->xmpp_conn, mio_handler_generic_id,
-                                   request->id);
-            pthread_mutex_unlock(&request->mutex);
-            _mio_request_delete(conn, request->id);
-            mio_error("Conditional wait for request with id %s failed",
-                      request->id);
-            return MIO_ERROR_COND_WAIT;
-        } else {
-            mio_debug("Got response for request with id %s", request->id);
-            response = request->response;
-            pthread_mutex_unlock(&request->mutex);
-            _mio_request_delete(conn, request->id);
-            return MIO_OK;
-        }
+// Wait for the request to complete
+    if (err == MIO_OK) {
+        pthread_mutex_lock(&wait.mutex);
+        while (!wait.predicate)
+            pthread_cond_wait(&wait.cond, &wait.mutex);
+        pthread_mutex_unlock(&wait.mutex);
+        err = wait.status;
+        if (err == MIO_OK)
+            mio_debug("Got response for request with id %s", response->id);
     }
-    mio_error("Predicate of request with ID %s == 0", request->id);
-    return MIO_ERROR_PREDICATE;
+
+    pthread_cond_destroy(&wait.cond);
+    pthread_mutex_destroy(&wait.mutex);
+    return err;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to send out an XMPP message in a blocking fashion. The function returns once the server's response has been processed or an error occurs.
+ *
+ * @param conn A pointer to an active mio conn.
+ * @param stanza A pointer to the mio stanza to be sent.
+ * @param handler A pointer to the mio handler which should parse the server's response.
+ * @param response A pointer to an allocated mio response struct which will be populated with the server's response.
+ * @returns MIO_OK on success, otherwise an error.
+ */
+int mio_send_blocking(mio_conn_t *conn, mio_stanza_t *stanza,
+                      mio_handler handler, mio_response_t * response) {
+    return _mio_send_blocking(conn, stanza, NULL, NULL, handler, response);
+}
+
+/**
+ * @ingroup Core
+ * Fills a template and sends it out like mio_send_blocking(), without
+ * building a stanza tree.
+ *
+ * @param conn A pointer to an active mio conn.
+ * @param tmpl The template to send, see mio_template_compile().
+ * @param values One string per value slot of the template.
+ * @param handler A pointer to the mio handler which should parse the server's response.
+ * @param response A pointer to an allocated mio response struct which will be populated with the server's response.
+ * @returns MIO_OK on success, otherwise an error.
+ */
+int mio_template_send_blocking(mio_conn_t *conn, mio_template_t *tmpl,
+                               const char **values, mio_handler handler,
+                               mio_response_t * response) {
+    return _mio_send_blocking(conn, NULL, tmpl, values, handler, response);
 }
 
 /**
@@ -375,24 +667,36 @@ int mio_send_nonblocking(mio_conn_t *conn, mio_stanza_t *stanza) {
             mio_error("Sending failed because not connected to server");
             return MIO_ERROR_CONNECTION;
         }
-        // Make sure we are the only one writing to the send queue
-        err = pthread_mutex_lock(&conn->event_loop_mutex);
-        if (err != 0) {
-            mio_error("Unable to lock event loop mutex");
-            return MIO_ERROR_MUTEX;
-        }
-        // Send request to server and forget it
-        xmpp_send_raw(conn->xmpp_conn, buf, len);
-        pthread_mutex_unlock(&conn->event_loop_mutex);
         xmpp_debug(conn->xmpp_conn->ctx, "conn", "SENT: %s", buf);
-        xmpp_free(conn->xmpp_conn->ctx, buf);
-        // Signal the _mio_run thread that it should run the event loop in case it is waiting
-        mio_cond_signal(&conn->send_request_cond, &conn->send_request_mutex,
-                        &conn->send_request_predicate);
+        // Hand the buffer to the _mio_run thread without taking the event
+        // loop mutex, it is spliced onto the send queue at the next tick
+        err = _mio_send_queue_push(conn, buf, len);
+        if (err != MIO_OK) {
+            mio_error("Unable to queue stanza for sending");
+            return err;
+        }
     }
     return MIO_OK;
 }
 
+/**
+ * @ingroup Core
+ * Fills a template with a new stanza id and sends it out without waiting for
+ * a response, without building a stanza tree. No handlers are added.
+ *
+ * @param conn A pointer to an active mio conn.
+ * @param tmpl The template to send, see mio_template_compile().
+ * @param values One string per value slot of the template.
+ * @returns MIO_OK on success, otherwise an error.
+ */
+int mio_template_send_nonblocking(mio_conn_t *conn, mio_template_t *tmpl,
+                                  const char **values) {
+    char id[37];
+
+    _mio_stanza_id_new(conn, id);
+    return _mio_template_send(conn, tmpl, id, values);
+}
+
 
 /**
  * @ingroup PubSub
@@ -462,7 +766,6 @@ mio_stanza_t *mio_pubsub_iq_get_stanza_new(mio_conn_t *conn,
 mio_stanza_t *mio_pubsub_iq_stanza_new(mio_conn_t *conn,
                                        const char *node) {
     char *pubsub_server, *pubsub_server_target = NULL;
-    uuid_t uuid;
     mio_stanza_t *iq = mio_stanza_new(conn);
 
 // Try to get server address from node, otherwise from JID
@@ -475,9 +778,8 @@ mio_stanza_t *mio_pubsub_iq_stanza_new(mio_conn_t *conn,
 
     sprintf(pubsub_server, "pubsub.%s", pubsub_server_target);
 
-// Create id for iq stanza using new UUID
-    uuid_generate(uuid);
-    uuid_unparse(uuid, iq->id);
+// Create id for iq stanza, requests replace it with their own when sent
+    _mio_stanza_id_new(conn, iq->id);
 
     xmpp_stanza_set_name(iq->xmpp_stanza, "iq");
     xmpp_stanza_set_attribute(iq->xmpp_stanza, "to", pubsub_server);
@@ -503,7 +805,6 @@ mio_stanza_t *mio_pubsub_get_stanza_new(mio_conn_t *conn,
 
 mio_stanza_t *mio_pubsub_stanza_new(mio_conn_t *conn, const char *node) {
     xmpp_stanza_t *pubsub = NULL;
-    uuid_t uuid;
     mio_stanza_t *iq = mio_stanza_new(conn);
     pubsub = xmpp_stanza_new(conn->xmpp_conn->ctx);
     char *pubsub_server, *pubsub_server_target = NULL;
@@ -518,9 +819,8 @@ mio_stanza_t *mio_pubsub_stanza_new(mio_conn_t *conn, const char *node) {
 
     sprintf(pubsub_server, "pubsub.%s", pubsub_server_target);
 
-// Create id for iq stanza using new UUID
-    uuid_generate(uuid);
-    uuid_unparse(uuid, iq->id);
+// Create id for iq stanza, requests replace it with their own when sent
+    _mio_stanza_id_new(conn, iq->id);
 
 // Create a new iq stanza
     xmpp_stanza_set_name(iq->xmpp_stanza, "iq");
@@ -538,33 +838,16 @@ mio_stanza_t *mio_pubsub_stanza_new(mio_conn_t *conn, const char *node) {
     return iq;
 }
 
-/** Gets n of the most recent published items.
- *
- * @param conn
- * @param node
- * @param response
- * @param max_items
- * @param item_id
- *
- * @returns MIO_OK on success, MIO_ERROR_DISCONNECTED on disconnect.
- * */
-int mio_item_recent_get(mio_conn_t* conn, const char *node,
-                        mio_response_t * response, int max_items, const char *item_id,
-                        mio_handler *handler) {
+// Builds the items get iq for node, asking either for item_id or for up to
+// max_items most recent items
+static mio_stanza_t *_mio_item_recent_get_stanza_new(mio_conn_t* conn,
+        const char *node, int max_items, const char *item_id) {
 
     mio_stanza_t *iq = NULL;
     xmpp_stanza_t *items = NULL;
     xmpp_stanza_t *item = NULL;
-    int err;
     char max_items_s[16];
 
-// Check if connection is active
-    if (!conn->xmpp_conn->authenticated) {
-        mio_error(
-            "Cannot process recent item get request since not connected to XMPP server");
-        return MIO_ERROR_DISCONNECTED;
-    }
-
     iq = mio_pubsub_get_stanza_new(conn, node);
 
 // Create items stanza
@@ -578,6 +861,7 @@ int mio_item_recent_get(mio_conn_t* conn, const char *node,
         xmpp_stanza_set_name(item, "item");
         xmpp_stanza_set_id(item, item_id);
         xmpp_stanza_add_child(items, item);
+        xmpp_stanza_release(item);
     } else {
         if (max_items != 0) {
             snprintf(max_items_s, 16, "%u", max_items);
@@ -587,6 +871,36 @@ int mio_item_recent_get(mio_conn_t* conn, const char *node,
 
 // Build xmpp message
     xmpp_stanza_add_child(iq->xmpp_stanza->children, items);
+    xmpp_stanza_release(items);
+
+    return iq;
+}
+
+/** Gets n of the most recent published items.
+ *
+ * @param conn
+ * @param node
+ * @param response
+ * @param max_items
+ * @param item_id
+ *
+ * @returns MIO_OK on success, MIO_ERROR_DISCONNECTED on disconnect.
+ * */
+int mio_item_recent_get(mio_conn_t* conn, const char *node,
+                        mio_response_t * response, int max_items, const char *item_id,
+                        mio_handler *handler) {
+
+    mio_stanza_t *iq = NULL;
+    int err;
+
+// Check if connection is active
+    if (!conn->xmpp_conn->authenticated) {
+        mio_error(
+            "Cannot process recent item get request since not connected to XMPP server");
+        return MIO_ERROR_DISCONNECTED;
+    }
+
+    iq = _mio_item_recent_get_stanza_new(conn, node, max_items, item_id);
 
 // If a handler is specified use it, otherwise use default handler
     if (handler == NULL )
@@ -597,15 +911,55 @@ int mio_item_recent_get(mio_conn_t* conn, const char *node,
         err = mio_send_blocking(conn, iq, (mio_handler) handler, response);
 
 // Release the stanzas
-    xmpp_stanza_release(items);
     mio_stanza_free(iq);
 
     return err;
 }
 
-int mio_items_recent_get(mio_conn_t* conn, const char *node,
-                         mio_response_t * response, int max_items, char **item_id, int n_items,
-                         mio_handler *handler) {
+/** Requests the most recent items published to a node and calls completion
+ *      once they have been received, the deadline passed or the connection
+ *      dropped.
+ *
+ * @param conn
+ * @param node
+ * @param max_items
+ * @param item_id
+ * @param handler The handler parsing the items, NULL for the default handler.
+ * @param completion Called with the parsed response, which the completion has to free.
+ * @param userdata Passed to completion.
+ * @param deadline_ms Time in ms after which the request completes with MIO_ERROR_TIMEOUT, 0 for the default.
+ *
+ * @returns MIO_OK if the request was sent, otherwise an error, in which case completion is never called.
+ * */
+int mio_item_recent_get_async(mio_conn_t* conn, const char *node,
+                              int max_items, const char *item_id, mio_handler *handler,
+                              mio_completion completion, void *userdata, unsigned int deadline_ms) {
+
+    mio_stanza_t *iq = NULL;
+    int err;
+
+// Check if connection is active
+    if (!conn->xmpp_conn->authenticated) {
+        mio_error(
+            "Cannot process recent item get request since not connected to XMPP server");
+        return MIO_ERROR_DISCONNECTED;
+    }
+
+    iq = _mio_item_recent_get_stanza_new(conn, node, max_items, item_id);
+    err = mio_send_async(conn, iq,
+                         handler == NULL ? (mio_handler) mio_handler_item_recent_get :
+                         (mio_handler) handler, completion, userdata, deadline_ms);
+    mio_stanza_free(iq);
+
+    return err;
+}
+
+static int _mio_items_recent_get(mio_conn_t* conn, const char *node,
+                                 mio_response_t * response, int max_items,
+                                 char **item_id, int n_items,
+                                 mio_handler *handler,
+                                 mio_completion completion, void *userdata,
+                                 unsigned int deadline_ms) {
 
     mio_stanza_t *iq = NULL;
     xmpp_stanza_t *items = NULL;
@@ -654,10 +1008,14 @@ int mio_items_recent_get(mio_conn_t* conn, const char *node,
 // If a handler is specified use it, otherwise use default handler
     if (handler == NULL )
 // Send out the stanza
-        err = mio_send_blocking(conn, iq,
-                                (mio_handler) mio_handler_item_recent_get, response);
+        err = _mio_send_blocking_or_async(conn, iq,
+                                          (mio_handler) mio_handler_item_recent_get,
+                                          response, completion, userdata,
+                                          deadline_ms);
     else
-        err = mio_send_blocking(conn, iq, (mio_handler) handler, response);
+        err = _mio_send_blocking_or_async(conn, iq, (mio_handler) handler,
+                                          response, completion, userdata,
+                                          deadline_ms);
 
 // Release the stanzas
     xmpp_stanza_release(items);
@@ -666,52 +1024,216 @@ int mio_items_recent_get(mio_conn_t* conn, const char *node,
     return err;
 }
 
+int mio_items_recent_get(mio_conn_t* conn, const char *node,
+                         mio_response_t * response, int max_items, char **item_id, int n_items,
+                         mio_handler *handler) {
+    return _mio_items_recent_get(conn, node, response, max_items, item_id,
+                                 n_items, handler, NULL, NULL, 0);
+}
+
+/** Requests published items of a node and calls completion once the response
+ *      has been processed, the deadline passed or the connection dropped, see
+ *      mio_items_recent_get().
+ *
+ * @param conn Active MIO connection.
+ * @param node The event node id.
+ * @param max_items Maximum number of items to get if no item ids are given, 0 for all.
+ * @param item_id The ids of the items to get.
+ * @param n_items The number of ids in item_id.
+ * @param handler The handler parsing the items, NULL for the default handler.
+ * @param completion Called with the parsed response, which the completion has to free.
+ * @param userdata Passed to completion.
+ * @param deadline_ms Time in ms after which the request completes with MIO_ERROR_TIMEOUT, 0 for the default.
+ *
+ * @returns MIO_OK if the request was sent, otherwise an error, in which case completion is never called.
+ * */
+int mio_items_recent_get_async(mio_conn_t* conn, const char *node,
+                               int max_items, char **item_id, int n_items,
+                               mio_handler *handler, mio_completion completion,
+                               void *userdata, unsigned int deadline_ms) {
+    return _mio_items_recent_get(conn, node, NULL, max_items, item_id, n_items,
+                                 handler, completion, userdata, deadline_ms);
+}
+
 int mio_handler_pubsub_data_receive(mio_conn_t * const conn,
                                     mio_stanza_t * const stanza, mio_response_t *response, void *userdata) {
     mio_stanza_t *stanza_copy;
-    mio_request_t *request = _mio_request_get(conn, "pubsub_data_rx");
+    mio_request_t *request = conn->pubsub_rx_request;
+    mio_xml_parser_data_t xml_data;
+    mio_packet_t *packet;
+    mio_data_t *data;
+    mio_arena_t *arena = NULL;
+    int pooled = 0, err;
 
     if (request == NULL ) {
         mio_error("Request with id %s not found, aborting handler",
                   response->id);
         return MIO_ERROR_REQUEST_NOT_FOUND;
     }
-    mio_packet_t *packet = mio_packet_new();
-    mio_data_t *data = mio_data_new();
-    mio_xml_parser_data_t *xml_data = mio_xml_parser_data_new();
 
-    if (response != NULL )
-        request = _mio_request_get(conn, response->id);
-    else
-        request = _mio_request_get(conn, "pubsub_data_rx");
+    if (response == NULL ) {
+        // Everything decoded into a pooled response lives in its arena, which
+        // is reset when the application releases the response
+        response = _mio_response_pool_get(conn);
+        pooled = 1;
+        if (response->arena == NULL)
+            response->arena = mio_arena_new();
+        arena = response->arena;
+    }
 
+    if (arena != NULL) {
+        packet = mio_arena_calloc(arena, sizeof(mio_packet_t));
+        data = mio_arena_calloc(arena, sizeof(mio_data_t));
+        if (packet == NULL || data == NULL) {
+            _mio_response_pool_put(conn, response);
+            return MIO_HANDLER_KEEP;
+        }
+        packet->type = MIO_PACKET_UNKNOWN;
+    } else {
+        packet = mio_packet_new();
+        data = mio_data_new();
+    }
     mio_packet_payload_add(packet, (void*) data, MIO_PACKET_DATA);
 
-    if (response == NULL ) {
-        response = mio_response_new();
+    if (pooled) {
         strcpy(response->id, "pubsub_data_rx");
-        response->ns = malloc(
-                           strlen("http://jabber.org/protocol/pubsub#event") + 1);
-        strcpy(response->ns, "http://jabber.org/protocol/pubsub#event");
+        response->ns = arena != NULL ?
+                       mio_arena_strdup(arena, "http://jabber.org/protocol/pubsub#event") :
+                       strdup("http://jabber.org/protocol/pubsub#event");
     }
     response->response = packet;
-    xml_data->response = response;
-
-    int err = mio_xml_parse(conn, stanza, xml_data,
-                            mio_XMLstart_pubsub_data_receive, NULL );
-
-    if (err != MIO_OK)
+    memset(&xml_data, 0, sizeof(xml_data));
+    xml_data.response = response;
+    xml_data.arena = arena;
+
+    err = _mio_xml_parse(conn, stanza, &xml_data,
+                         mio_XMLstart_pubsub_data_receive, NULL );
+
+    if (err != MIO_OK) {
+        if (pooled) {
+            if (arena == NULL)
+                mio_packet_free(packet);
+            response->response = NULL;
+            response->response_type = MIO_RESPONSE_UNKNOWN;
+            _mio_response_pool_put(conn, response);
+        }
         return err;
-    else if (response->response_type == MIO_RESPONSE_PACKET && request != NULL ) {
-        stanza_copy = mio_stanza_clone(conn, stanza);
+    } else if (response->response_type == MIO_RESPONSE_PACKET && request != NULL ) {
+        // Arena responses share the stanza instead of owning a copy
+        if (arena != NULL) {
+            stanza_copy = mio_arena_calloc(arena, sizeof(mio_stanza_t));
+            if (stanza_copy != NULL)
+                stanza_copy->xmpp_stanza = xmpp_stanza_clone(stanza->xmpp_stanza);
+        } else
+            stanza_copy = mio_stanza_clone(conn, stanza);
         response->stanza = stanza_copy;
         _mio_pubsub_rx_queue_enqueue(conn, response);
-        mio_cond_signal(&request->cond, &request->mutex, &request->predicate);
         return MIO_HANDLER_KEEP;
     } else {
-        mio_packet_free(packet);
+        if (arena == NULL)
+            mio_packet_free(packet);
+        if (pooled) {
+            if (response->response == packet)
+                response->response = NULL;
+            _mio_response_pool_put(conn, response);
+        }
         return MIO_HANDLER_KEEP;
     }
 }
 
+// Takes a pubsub event element out of a received message so that it is
+// decoded while it is parsed, see xmpp_conn_set_stream_decoder()
+static int _mio_pubsub_event_probe(xmpp_stanza_t * const stanza,
+                                   const char * const name, const char ** const attrs,
+                                   void * const userdata) {
+    mio_conn_t *conn = (mio_conn_t*) userdata;
+    mio_xml_parser_data_t *xml_data = conn->pubsub_rx_decode;
+    mio_response_t *response;
+    mio_packet_t *packet;
+    mio_data_t *data;
+    const char *stanza_name;
+    int i;
+
+    if (strcmp(name, "event") != 0 || conn->pubsub_rx_request == NULL)
+        return 0;
+    stanza_name = xmpp_stanza_get_name(stanza);
+    if (stanza_name == NULL || strcmp(stanza_name, "message") != 0)
+        return 0;
+    for (i = 0; attrs[i] != NULL; i += 2)
+        if (strcmp(attrs[i], "xmlns") == 0)
+            break;
+    if (attrs[i] == NULL
+            || strcmp(attrs[i + 1], "http://jabber.org/protocol/pubsub#event") != 0)
+        return 0;
+
+    // Only arena responses are streamed, anything else takes the stanza path
+    response = _mio_response_pool_get(conn);
+    if (response->arena == NULL)
+        response->arena = mio_arena_new();
+    if (response->arena == NULL) {
+        _mio_response_pool_put(conn, response);
+        return 0;
+    }
+    packet = mio_arena_calloc(response->arena, sizeof(mio_packet_t));
+    data = mio_arena_calloc(response->arena, sizeof(mio_data_t));
+    response->ns = mio_arena_strdup(response->arena,
+                                    "http://jabber.org/protocol/pubsub#event");
+    if (packet == NULL || data == NULL || response->ns == NULL) {
+        _mio_response_pool_put(conn, response);
+        return 0;
+    }
+    packet->type = MIO_PACKET_UNKNOWN;
+    mio_packet_payload_add(packet, (void*) data, MIO_PACKET_DATA);
+    strcpy(response->id, "pubsub_data_rx");
+    response->response = packet;
+
+    memset(xml_data, 0, sizeof(mio_xml_parser_data_t));
+    xml_data->response = response;
+    xml_data->arena = response->arena;
+    return 1;
+}
+
+static void _mio_pubsub_event_start(void * const userdata,
+                                    const char * const name, const char ** const attrs) {
+    mio_conn_t *conn = (mio_conn_t*) userdata;
+
+    mio_XMLstart_pubsub_data_receive(conn->pubsub_rx_decode, name, attrs);
+}
+
+static void _mio_pubsub_event_end(void * const userdata,
+                                  const char * const name) {
+    mio_conn_t *conn = (mio_conn_t*) userdata;
+
+    endElement(conn->pubsub_rx_decode, name);
+}
+
+// Queues the decoded event once its message has ended, stanza is NULL if the
+// stream was reset before
+static void _mio_pubsub_event_stanza(xmpp_stanza_t * const stanza,
+                                     void * const userdata) {
+    mio_conn_t *conn = (mio_conn_t*) userdata;
+    mio_response_t *response = conn->pubsub_rx_decode->response;
+    mio_stanza_t *message;
+
+    conn->pubsub_rx_decode->response = NULL;
+    if (stanza == NULL || response->response_type != MIO_RESPONSE_PACKET
+            || conn->pubsub_rx_request == NULL) {
+        _mio_response_pool_put(conn, response);
+        return;
+    }
+
+    // The message keeps its attributes, but not the decoded event
+    message = mio_arena_calloc(response->arena, sizeof(mio_stanza_t));
+    if (message != NULL)
+        message->xmpp_stanza = xmpp_stanza_clone(stanza);
+    response->stanza = message;
+    _mio_pubsub_rx_queue_enqueue(conn, response);
+}
 
+static const xmpp_stream_decoder_t _mio_pubsub_event_decoder = {
+    _mio_pubsub_event_probe,
+    _mio_pubsub_event_start,
+    _mio_pubsub_event_end,
+    NULL,
+    _mio_pubsub_event_stanza
+};
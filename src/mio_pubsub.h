@@ -37,9 +37,16 @@
 int mio_item_recent_get(mio_conn_t* conn, const char *node,
                         mio_response_t * response, int max_items, const char *item_id,
                         mio_handler *handler);
+int mio_item_recent_get_async(mio_conn_t* conn, const char *node,
+                              int max_items, const char *item_id, mio_handler *handler,
+                              mio_completion completion, void *userdata, unsigned int deadline_ms);
 int mio_items_recent_get(mio_conn_t* conn, const char *node,
                          mio_response_t * response, int max_items, char **item_ids,int item_count,
                          mio_handler *handler);
+int mio_items_recent_get_async(mio_conn_t* conn, const char *node,
+                               int max_items, char **item_ids, int item_count,
+                               mio_handler *handler, mio_completion completion,
+                               void *userdata, unsigned int deadline_ms);
 
 
 mio_stanza_t *mio_pubsub_item_new(mio_conn_t *conn, char* item_type);
@@ -58,6 +65,22 @@ mio_stanza_t *mio_pubsub_set_stanza_new(mio_conn_t *conn,
 int mio_send_nonblocking(mio_conn_t *conn, mio_stanza_t *stanza);
 int mio_send_blocking(mio_conn_t *conn, mio_stanza_t *stanza,
                       mio_handler handler, mio_response_t * response) ;
+int mio_send_async(mio_conn_t *conn, mio_stanza_t *stanza,
+                   mio_handler handler, mio_completion completion, void *userdata,
+                   unsigned int deadline_ms);
+int _mio_send_blocking_or_async(mio_conn_t *conn, mio_stanza_t *stanza,
+                                mio_handler handler, mio_response_t *response,
+                                mio_completion completion, void *userdata,
+                                unsigned int deadline_ms);
+int mio_template_send_nonblocking(mio_conn_t *conn, mio_template_t *tmpl,
+                                  const char **values);
+int mio_template_send_blocking(mio_conn_t *conn, mio_template_t *tmpl,
+                               const char **values, mio_handler handler,
+                               mio_response_t * response);
+int mio_template_send_async(mio_conn_t *conn, mio_template_t *tmpl,
+                            const char **values, mio_handler handler,
+                            mio_completion completion, void *userdata,
+                            unsigned int deadline_ms);
 
 void XMLCALL mio_XMLstart_pubsub_data_receive(void *data,
         const char *element_name, const char **attr);
@@ -0,0 +1,434 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+
+
+#include <string.h>
+#include <stdlib.h>
+#include <sched.h>
+#include "mio_pubsub_lanes.h"
+
+extern mio_log_level_t _mio_log_level;
+
+// FNV-1a of the event node of a response, all responses of a node land on the
+// same lane
+static unsigned int _mio_pubsub_lane_hash(mio_response_t *response) {
+    mio_packet_t *packet = (mio_packet_t*) response->response;
+    mio_data_t *data;
+    const unsigned char *p;
+    unsigned int hash = 2166136261u;
+
+    if (packet == NULL || packet->type != MIO_PACKET_DATA
+            || packet->payload == NULL)
+        return 0;
+    data = (mio_data_t*) packet->payload;
+    if (data->event == NULL)
+        return 0;
+    for (p = (const unsigned char*) data->event; *p != '\0'; p++)
+        hash = (hash ^ *p) * 16777619u;
+    return hash;
+}
+
+// Lets a sleeping consumer look for a claimable lane again
+static void _mio_pubsub_lanes_wake(mio_pubsub_lanes_t *lanes) {
+    __atomic_add_fetch(&lanes->epoch, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&lanes->sleepers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&lanes->sleep_mutex);
+        pthread_cond_signal(&lanes->sleep_cond);
+        pthread_mutex_unlock(&lanes->sleep_mutex);
+    }
+}
+
+// Makes the calling consumer the only one delivering from the lane if it has
+// responses waiting
+static int _mio_pubsub_lane_try_claim(mio_pubsub_lane_t *lane) {
+    int busy = 0;
+
+    if (__atomic_load_n(&lane->len, __ATOMIC_ACQUIRE) == 0
+            || __atomic_load_n(&lane->busy, __ATOMIC_RELAXED))
+        return 0;
+    if (!__atomic_compare_exchange_n(&lane->busy, &busy, 1, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+        return 0;
+    // Another consumer may have emptied the lane in the meantime
+    if (__atomic_load_n(&lane->len, __ATOMIC_ACQUIRE) == 0) {
+        __atomic_store_n(&lane->busy, 0, __ATOMIC_RELEASE);
+        return 0;
+    }
+    return 1;
+}
+
+// Claims a lane with responses waiting, the consumer's own lanes first
+static mio_pubsub_lane_t *_mio_pubsub_lane_claim(
+    mio_pubsub_lane_consumer_t *consumer) {
+    mio_pubsub_lanes_t *lanes = consumer->lanes;
+    unsigned int i, k;
+
+    for (i = consumer->index; i <= lanes->mask; i += lanes->n_threads)
+        if (_mio_pubsub_lane_try_claim(&lanes->lanes[i]))
+            return &lanes->lanes[i];
+    // Start next to the own lanes so that idle consumers spread out
+    for (k = 1; k <= lanes->mask; k++) {
+        i = (consumer->index + k) & lanes->mask;
+        if (i % lanes->n_threads == (unsigned int) consumer->index)
+            continue;
+        if (_mio_pubsub_lane_try_claim(&lanes->lanes[i])) {
+            __atomic_add_fetch(&lanes->stats.steals, 1, __ATOMIC_RELAXED);
+            return &lanes->lanes[i];
+        }
+    }
+    return NULL;
+}
+
+// Delivers a batch of a claimed lane and hands the lane back. The next batch
+// of the lane is only taken once this one has been delivered, which keeps the
+// responses of a node in order.
+static void _mio_pubsub_lane_deliver(mio_pubsub_lanes_t *lanes,
+                                     mio_pubsub_lane_t *lane) {
+    mio_conn_t *conn = lanes->conn;
+    mio_response_t *batch[MIO_PUBSUB_LANE_BATCH];
+    int i, n = 0;
+
+    pthread_mutex_lock(&lane->mutex);
+    while (n < MIO_PUBSUB_LANE_BATCH
+            && (batch[n] = TAILQ_FIRST(&lane->queue)) != NULL) {
+        TAILQ_REMOVE(&lane->queue, batch[n], responses);
+        n++;
+    }
+    __atomic_sub_fetch(&lane->len, n, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&lane->mutex);
+
+    for (i = 0; i < n; i++) {
+        lanes->handler(conn, batch[i], lanes->userdata);
+        _mio_response_pool_put(conn, batch[i]);
+    }
+
+    __atomic_store_n(&lane->busy, 0, __ATOMIC_RELEASE);
+    if (__atomic_load_n(&lane->len, __ATOMIC_ACQUIRE) > 0)
+        _mio_pubsub_lanes_wake(lanes);
+    __atomic_add_fetch(&lanes->stats.delivered, n, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&conn->pubsub_rx_stats.dequeued, n, __ATOMIC_RELAXED);
+    // Let the event loop resume reading once half of the capacity is free
+    if (__atomic_sub_fetch(&lanes->pending, n, __ATOMIC_ACQ_REL)
+            <= (int) conn->pubsub_rx_stats.capacity / 2
+            && __atomic_load_n(&conn->pubsub_rx_paused, __ATOMIC_RELAXED))
+        xmpp_ctx_wakeup(conn->xmpp_conn->ctx);
+}
+
+static void *_mio_pubsub_lane_consumer_run(void *arg) {
+    mio_pubsub_lane_consumer_t *consumer = (mio_pubsub_lane_consumer_t*) arg;
+    mio_pubsub_lanes_t *lanes = consumer->lanes;
+    mio_pubsub_lane_t *lane;
+    unsigned int epoch;
+
+    for (;;) {
+        epoch = __atomic_load_n(&lanes->epoch, __ATOMIC_SEQ_CST);
+        lane = _mio_pubsub_lane_claim(consumer);
+        if (lane != NULL) {
+            _mio_pubsub_lane_deliver(lanes, lane);
+            continue;
+        }
+        // Responses received before the stop are still delivered, the lanes
+        // left are busy with other consumers
+        if (__atomic_load_n(&lanes->stopping, __ATOMIC_ACQUIRE)) {
+            if (__atomic_load_n(&lanes->pending, __ATOMIC_ACQUIRE) == 0)
+                break;
+            sched_yield();
+            continue;
+        }
+        pthread_mutex_lock(&lanes->sleep_mutex);
+        __atomic_add_fetch(&lanes->sleepers, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&lanes->epoch, __ATOMIC_SEQ_CST) == epoch
+                && !__atomic_load_n(&lanes->stopping, __ATOMIC_ACQUIRE))
+            pthread_cond_wait(&lanes->sleep_cond, &lanes->sleep_mutex);
+        __atomic_sub_fetch(&lanes->sleepers, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_unlock(&lanes->sleep_mutex);
+    }
+    return NULL;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to put a received pubsub response on the lane of its
+ * node. If the lanes hold as many responses as the RX queue's capacity, the
+ * connection's mio_rx_overflow_policy_t decides what happens, where
+ * MIO_RX_OVERFLOW_DROP_OLDEST drops the oldest response of the same lane, or
+ * the new response if that lane is empty.
+ * Called with the RX backlog mutex held.
+ *
+ * @param lanes A pointer to the running lanes of a mio connection.
+ * @param response A pointer to the mio response, which is owned by the lanes
+ * from then on.
+ */
+void _mio_pubsub_lanes_push(mio_pubsub_lanes_t *lanes,
+                            mio_response_t *response) {
+    mio_conn_t *conn = lanes->conn;
+    mio_pubsub_lane_t *lane = &lanes->lanes[_mio_pubsub_lane_hash(response)
+                              & lanes->mask];
+    mio_response_t *dropped = NULL;
+
+    if (__atomic_load_n(&lanes->pending, __ATOMIC_ACQUIRE)
+            >= (int) conn->pubsub_rx_stats.capacity) {
+        switch (__atomic_load_n(&conn->pubsub_rx_policy, __ATOMIC_RELAXED)) {
+        case MIO_RX_OVERFLOW_DROP_NEWEST:
+            __atomic_add_fetch(&conn->pubsub_rx_stats.dropped_newest, 1,
+                               __ATOMIC_RELAXED);
+            _mio_response_pool_put(conn, response);
+            return;
+        case MIO_RX_OVERFLOW_BACKPRESSURE:
+            if (!__atomic_exchange_n(&conn->pubsub_rx_paused, 1,
+                                     __ATOMIC_SEQ_CST)) {
+                mio_warn("Pubsub lanes full, pausing reads from the server");
+                __atomic_add_fetch(&conn->pubsub_rx_stats.read_pauses, 1,
+                                   __ATOMIC_RELAXED);
+                xmpp_conn_set_read_paused(conn->xmpp_conn, 1);
+            }
+            break;
+        case MIO_RX_OVERFLOW_DROP_OLDEST:
+        default:
+            // Drop in place of the next response to be delivered, if the
+            // lane's consumer has not taken them all
+            pthread_mutex_lock(&lane->mutex);
+            dropped = TAILQ_FIRST(&lane->queue);
+            if (dropped != NULL) {
+                TAILQ_REMOVE(&lane->queue, dropped, responses);
+                TAILQ_INSERT_TAIL(&lane->queue, response, responses);
+                __atomic_add_fetch(&conn->pubsub_rx_stats.enqueued, 1,
+                                   __ATOMIC_RELAXED);
+            }
+            pthread_mutex_unlock(&lane->mutex);
+            if (dropped != NULL)
+                __atomic_add_fetch(&conn->pubsub_rx_stats.dropped_oldest, 1,
+                                   __ATOMIC_RELAXED);
+            else {
+                dropped = response;
+                __atomic_add_fetch(&conn->pubsub_rx_stats.dropped_newest, 1,
+                                   __ATOMIC_RELAXED);
+            }
+            _mio_response_pool_put(conn, dropped);
+            return;
+        }
+    }
+
+    pthread_mutex_lock(&lane->mutex);
+    TAILQ_INSERT_TAIL(&lane->queue, response, responses);
+    __atomic_add_fetch(&lane->len, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&lane->mutex);
+    __atomic_add_fetch(&lanes->pending, 1, __ATOMIC_ACQ_REL);
+    __atomic_add_fetch(&conn->pubsub_rx_stats.enqueued, 1, __ATOMIC_RELAXED);
+    _mio_pubsub_lanes_wake(lanes);
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to get the number of responses waiting in the lanes.
+ *
+ * @param lanes A pointer to the running lanes of a mio connection.
+ * @returns The number of responses not yet passed to the callback.
+ */
+unsigned int _mio_pubsub_lanes_pending(mio_pubsub_lanes_t *lanes) {
+    return __atomic_load_n(&lanes->pending, __ATOMIC_ACQUIRE);
+}
+
+static void _mio_pubsub_lanes_free(mio_pubsub_lanes_t *lanes) {
+    unsigned int i;
+
+    for (i = 0; i <= lanes->mask; i++)
+        pthread_mutex_destroy(&lanes->lanes[i].mutex);
+    pthread_mutex_destroy(&lanes->sleep_mutex);
+    pthread_cond_destroy(&lanes->sleep_cond);
+    free(lanes->lanes);
+    free(lanes->consumers);
+    free(lanes);
+}
+
+// Lets the consumers deliver what is left and waits for them to exit
+static void _mio_pubsub_lanes_join(mio_pubsub_lanes_t *lanes, int n_threads) {
+    int i;
+
+    __atomic_store_n(&lanes->stopping, 1, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&lanes->sleep_mutex);
+    pthread_cond_broadcast(&lanes->sleep_cond);
+    pthread_mutex_unlock(&lanes->sleep_mutex);
+    for (i = 0; i < n_threads; i++)
+        pthread_join(lanes->consumers[i].thread, NULL );
+}
+
+/**
+ * @ingroup PubSub
+ * Delivers received pubsub responses to a callback from n_threads consumer
+ * threads instead of queueing them for mio_pubsub_data_receive(). Responses
+ * are spread over lanes by the hash of their event node. A lane is delivered
+ * by one consumer at a time in the order its responses were received, so the
+ * responses of a node reach the callback one after the other and in order,
+ * while different nodes are delivered in parallel. Consumers prefer their own
+ * lanes and take over lanes of other consumers when theirs are empty.
+ *
+ * Responses already waiting for mio_pubsub_data_receive() are moved onto the
+ * lanes. Responses are only in order as received if their handler ran in the
+ * event loop thread or in a single handler worker, see
+ * mio_handler_workers_start(). The capacity and overflow policy of the RX
+ * queue apply to all lanes together, see mio_pubsub_data_rx_queue_configure().
+ *
+ * @param conn A pointer to a mio connection. It does not need to be active.
+ * @param n_threads The number of consumer threads, at least 1.
+ * @param n_lanes The number of lanes, rounded up to the next power of two, 0
+ * for MIO_PUBSUB_LANES_PER_THREAD per consumer.
+ * @param handler The callback, the response passed to it is released once it
+ * returns.
+ * @param userdata A pointer to any user data, which is passed to handler.
+ * @returns MIO_OK on success, MIO_ERROR_RX_QUEUE_BUSY if lanes are already
+ * running, MIO_ERROR_RUN_THREAD if n_threads is less than 1 or the consumers
+ * could not be started, or MIO_ERROR_MALLOC.
+ */
+int mio_pubsub_data_lanes_start(mio_conn_t *conn, int n_threads,
+                                unsigned int n_lanes, mio_pubsub_lane_handler handler,
+                                void *userdata) {
+    mio_pubsub_lanes_t *lanes;
+    mio_response_t *response;
+    unsigned int size = 1, i;
+    int started, err = MIO_OK;
+
+    if (n_threads < 1 || handler == NULL)
+        return MIO_ERROR_RUN_THREAD;
+    if (conn->pubsub_lanes != NULL)
+        return MIO_ERROR_RX_QUEUE_BUSY;
+    if (n_lanes == 0)
+        n_lanes = MIO_PUBSUB_LANES_PER_THREAD * n_threads;
+    while (size < n_lanes)
+        size <<= 1;
+
+    lanes = malloc(sizeof(mio_pubsub_lanes_t));
+    if (lanes == NULL)
+        return MIO_ERROR_MALLOC;
+    memset(lanes, 0, sizeof(mio_pubsub_lanes_t));
+    lanes->lanes = malloc(size * sizeof(mio_pubsub_lane_t));
+    lanes->consumers = malloc(n_threads * sizeof(mio_pubsub_lane_consumer_t));
+    if (lanes->lanes == NULL || lanes->consumers == NULL) {
+        free(lanes->lanes);
+        free(lanes->consumers);
+        free(lanes);
+        return MIO_ERROR_MALLOC;
+    }
+    memset(lanes->lanes, 0, size * sizeof(mio_pubsub_lane_t));
+    for (i = 0; i < size; i++) {
+        pthread_mutex_init(&lanes->lanes[i].mutex, NULL );
+        TAILQ_INIT(&lanes->lanes[i].queue);
+    }
+    pthread_mutex_init(&lanes->sleep_mutex, NULL );
+    pthread_cond_init(&lanes->sleep_cond, NULL );
+    lanes->conn = conn;
+    lanes->handler = handler;
+    lanes->userdata = userdata;
+    lanes->mask = size - 1;
+    lanes->n_threads = n_threads;
+    lanes->stats.lanes = size;
+    lanes->stats.threads = n_threads;
+
+    for (started = 0; started < n_threads; started++) {
+        lanes->consumers[started].lanes = lanes;
+        lanes->consumers[started].index = started;
+        if (pthread_create(&lanes->consumers[started].thread, NULL,
+                           _mio_pubsub_lane_consumer_run, &lanes->consumers[started])
+                != 0) {
+            mio_error("Could not start pubsub lane consumer %d", started);
+            err = MIO_ERROR_RUN_THREAD;
+            break;
+        }
+    }
+
+    _mio_event_loop_lock(conn);
+    pthread_mutex_lock(&conn->pubsub_rx_backlog_mutex);
+    if (err == MIO_OK && conn->pubsub_lanes == NULL) {
+        // Keep the order of what has been received so far
+        while ((response = _mio_pubsub_rx_queue_dequeue(conn)) != NULL)
+            _mio_pubsub_lanes_push(lanes, response);
+        while ((response = TAILQ_FIRST(&conn->pubsub_rx_backlog)) != NULL) {
+            TAILQ_REMOVE(&conn->pubsub_rx_backlog, response, responses);
+            _mio_pubsub_lanes_push(lanes, response);
+        }
+        conn->pubsub_lanes = lanes;
+    } else if (err == MIO_OK)
+        err = MIO_ERROR_RX_QUEUE_BUSY;
+    pthread_mutex_unlock(&conn->pubsub_rx_backlog_mutex);
+    _mio_event_loop_unlock(conn);
+    if (err == MIO_OK)
+        return MIO_OK;
+
+    _mio_pubsub_lanes_join(lanes, started);
+    _mio_pubsub_lanes_free(lanes);
+    return err;
+}
+
+/**
+ * @ingroup PubSub
+ * Stops the consumer threads started by mio_pubsub_data_lanes_start() once
+ * they have delivered the responses waiting in the lanes. Responses received
+ * from then on are queued for mio_pubsub_data_receive() again. Must not be
+ * called with the event loop mutex held or from the callback.
+ *
+ * @param conn A pointer to a mio connection.
+ * @returns MIO_OK, also if no lanes were running.
+ */
+int mio_pubsub_data_lanes_stop(mio_conn_t *conn) {
+    mio_pubsub_lanes_t *lanes;
+
+    _mio_event_loop_lock(conn);
+    pthread_mutex_lock(&conn->pubsub_rx_backlog_mutex);
+    lanes = conn->pubsub_lanes;
+    conn->pubsub_lanes = NULL;
+    pthread_mutex_unlock(&conn->pubsub_rx_backlog_mutex);
+    _mio_event_loop_unlock(conn);
+    if (lanes == NULL)
+        return MIO_OK;
+
+    _mio_pubsub_lanes_join(lanes, lanes->n_threads);
+    _mio_pubsub_lanes_free(lanes);
+    return MIO_OK;
+}
+
+/**
+ * @ingroup PubSub
+ * Reads the counters of the pubsub lanes of a mio connection.
+ *
+ * @param conn A pointer to a mio connection.
+ * @param stats A pointer to the struct that receives the counters, all zero
+ * if no lanes are running.
+ */
+void mio_pubsub_data_lanes_stats(mio_conn_t *conn,
+                                 mio_pubsub_lanes_stats_t *stats) {
+    mio_pubsub_lanes_t *lanes;
+
+    memset(stats, 0, sizeof(mio_pubsub_lanes_stats_t));
+    // mio_pubsub_data_lanes_stop() detaches the lanes under the same mutex
+    pthread_mutex_lock(&conn->pubsub_rx_backlog_mutex);
+    lanes = conn->pubsub_lanes;
+    if (lanes != NULL) {
+        stats->delivered = __atomic_load_n(&lanes->stats.delivered,
+                                           __ATOMIC_RELAXED);
+        stats->steals = __atomic_load_n(&lanes->stats.steals, __ATOMIC_RELAXED);
+        stats->pending = _mio_pubsub_lanes_pending(lanes);
+        stats->lanes = lanes->stats.lanes;
+        stats->threads = lanes->stats.threads;
+    }
+    pthread_mutex_unlock(&conn->pubsub_rx_backlog_mutex);
+}
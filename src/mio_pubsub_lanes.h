@@ -0,0 +1,97 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+
+
+#ifndef ____mio_pubsub_lanes__
+#define ____mio_pubsub_lanes__
+
+#include <mio.h>
+
+// Lanes per consumer thread unless told otherwise, more lanes than threads
+// let idle consumers take over lanes of busy ones
+#define MIO_PUBSUB_LANES_PER_THREAD 4
+// Responses a consumer takes off a lane at once
+#define MIO_PUBSUB_LANE_BATCH 32
+
+// Called by a consumer thread for each received pubsub response. The response
+// is released once the callback returns, see mio_pubsub_data_lanes_start().
+typedef void (*mio_pubsub_lane_handler)(mio_conn_t *conn,
+                                        mio_response_t *response, void *userdata);
+
+// Counters of the pubsub lanes, see mio_pubsub_data_lanes_stats()
+typedef struct {
+    uint64_t delivered; // Responses passed to the callback
+    uint64_t steals; // Batches taken from a lane of another consumer
+    unsigned int pending; // Responses waiting in the lanes
+    unsigned int lanes, threads;
+} mio_pubsub_lanes_stats_t;
+
+// Received responses of the nodes hashed to one lane, in the order they were
+// received. A lane is delivered by one consumer at a time.
+typedef struct {
+    pthread_mutex_t mutex; // Protects queue
+    TAILQ_HEAD(mio_pubsub_lane_queue, mio_response)
+    queue;
+    unsigned int len;
+    int busy; // Nonzero while a consumer delivers from the lane
+    char pad[64];
+} mio_pubsub_lane_t;
+
+// A consumer thread, it prefers the lanes whose index is its own modulo the
+// number of consumers
+typedef struct {
+    struct mio_pubsub_lanes *lanes;
+    pthread_t thread;
+    int index;
+} mio_pubsub_lane_consumer_t;
+
+// Consumer threads and their lanes, see mio_pubsub_data_lanes_start()
+struct mio_pubsub_lanes {
+    mio_conn_t *conn;
+    mio_pubsub_lane_handler handler;
+    void *userdata;
+    mio_pubsub_lane_t *lanes;
+    unsigned int mask; // Number of lanes - 1
+    mio_pubsub_lane_consumer_t *consumers;
+    int n_threads;
+    int pending; // Responses in all lanes
+    // Bumped whenever a lane may have become claimable, consumers sleep until
+    // it changes
+    unsigned int epoch;
+    int sleepers, stopping;
+    pthread_mutex_t sleep_mutex;
+    pthread_cond_t sleep_cond;
+    mio_pubsub_lanes_stats_t stats;
+};
+
+int mio_pubsub_data_lanes_start(mio_conn_t *conn, int n_threads,
+                                unsigned int n_lanes, mio_pubsub_lane_handler handler,
+                                void *userdata);
+int mio_pubsub_data_lanes_stop(mio_conn_t *conn);
+void mio_pubsub_data_lanes_stats(mio_conn_t *conn,
+                                 mio_pubsub_lanes_stats_t *stats);
+void _mio_pubsub_lanes_push(mio_pubsub_lanes_t *lanes,
+                            mio_response_t *response);
+unsigned int _mio_pubsub_lanes_pending(mio_pubsub_lanes_t *lanes);
+
+#endif /* defined(____mio_pubsub_lanes__) */
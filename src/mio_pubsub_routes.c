@@ -0,0 +1,327 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+
+
+#include <string.h>
+#include <stdlib.h>
+#include "mio_pubsub_routes.h"
+
+// Nonzero while a callback runs on this thread, removals made from callbacks
+// do not wait for running calls, see _mio_pubsub_route_set()
+static __thread int _mio_pubsub_routes_delivering;
+
+/**
+ * @ingroup Internal
+ * Internal function to allocate the empty callback registry of a mio
+ * connection.
+ *
+ * @returns A pointer to the registry, or NULL on an error.
+ */
+mio_pubsub_routes_t *_mio_pubsub_routes_new() {
+    mio_pubsub_routes_t *routes = malloc(sizeof(mio_pubsub_routes_t));
+
+    if (routes == NULL)
+        return NULL;
+    memset(routes, 0, sizeof(mio_pubsub_routes_t));
+    pthread_rwlock_init(&routes->lock, NULL );
+    pthread_mutex_init(&routes->mutex, NULL );
+    pthread_cond_init(&routes->cond, NULL );
+    return routes;
+}
+
+static void _mio_pubsub_route_free(mio_pubsub_route_t *route) {
+    free(route->key);
+    free(route);
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to free the callback registry of a mio connection and
+ * all registrations in it.
+ *
+ * @param routes A pointer to the registry.
+ */
+void _mio_pubsub_routes_free(mio_pubsub_routes_t *routes) {
+    mio_pubsub_route_t *route, *tmp;
+
+    if (routes == NULL)
+        return;
+    HASH_ITER(hh, routes->nodes, route, tmp) {
+        HASH_DEL(routes->nodes, route);
+        _mio_pubsub_route_free(route);
+    }
+    HASH_ITER(hh, routes->prefixes, route, tmp) {
+        HASH_DEL(routes->prefixes, route);
+        _mio_pubsub_route_free(route);
+    }
+    free(routes->prefix_lens);
+    pthread_rwlock_destroy(&routes->lock);
+    pthread_mutex_destroy(&routes->mutex);
+    pthread_cond_destroy(&routes->cond);
+    free(routes);
+}
+
+// Counts a prefix of len more or less, keeping the lengths longest first
+static int _mio_pubsub_prefix_len_update(mio_pubsub_routes_t *routes,
+        size_t len, int delta) {
+    mio_pubsub_prefix_len_t *lens;
+    unsigned int i;
+
+    for (i = 0; i < routes->n_prefix_lens && routes->prefix_lens[i].len > len;
+            i++)
+        ;
+    if (i < routes->n_prefix_lens && routes->prefix_lens[i].len == len) {
+        routes->prefix_lens[i].count += delta;
+        if (routes->prefix_lens[i].count == 0) {
+            memmove(&routes->prefix_lens[i], &routes->prefix_lens[i + 1],
+                    (routes->n_prefix_lens - i - 1)
+                    * sizeof(mio_pubsub_prefix_len_t));
+            routes->n_prefix_lens--;
+        }
+        return MIO_OK;
+    }
+
+    if (routes->n_prefix_lens == routes->prefix_lens_size) {
+        lens = realloc(routes->prefix_lens, (routes->prefix_lens_size * 2 + 4)
+                       * sizeof(mio_pubsub_prefix_len_t));
+        if (lens == NULL)
+            return MIO_ERROR_MALLOC;
+        routes->prefix_lens = lens;
+        routes->prefix_lens_size = routes->prefix_lens_size * 2 + 4;
+    }
+    memmove(&routes->prefix_lens[i + 1], &routes->prefix_lens[i],
+            (routes->n_prefix_lens - i) * sizeof(mio_pubsub_prefix_len_t));
+    routes->prefix_lens[i].len = len;
+    routes->prefix_lens[i].count = 1;
+    routes->n_prefix_lens++;
+    return MIO_OK;
+}
+
+// Drops a reference to a route, freeing it with the last one
+static void _mio_pubsub_route_unref(mio_pubsub_routes_t *routes,
+                                    mio_pubsub_route_t *route) {
+    int refs = __atomic_sub_fetch(&route->refs, 1, __ATOMIC_SEQ_CST);
+
+    // The route may be freed by a waiting release as soon as refs dropped
+    if (refs == 0) {
+        _mio_pubsub_route_free(route);
+    } else if (__atomic_load_n(&routes->releasing, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&routes->mutex);
+        pthread_cond_broadcast(&routes->cond);
+        pthread_mutex_unlock(&routes->mutex);
+    }
+}
+
+// Takes a route out of the registry's hashes, called with the write lock held
+static void _mio_pubsub_route_unlink(mio_pubsub_routes_t *routes, int prefix,
+                                     mio_pubsub_route_t **head, mio_pubsub_route_t *route) {
+    HASH_DEL(*head, route);
+    if (prefix)
+        _mio_pubsub_prefix_len_update(routes, route->key_len, -1);
+}
+
+// Drops the registration of a route taken out of the registry. Unless called
+// from a callback or the event loop thread, which a running callback may be
+// waiting for, waits for the running calls of its callback to return first,
+// so that its userdata can be freed afterwards.
+static void _mio_pubsub_route_release(mio_conn_t *conn,
+                                      mio_pubsub_routes_t *routes, mio_pubsub_route_t *route) {
+    if (!_mio_pubsub_routes_delivering
+            && (conn->mio_run_thread == NULL
+                || !pthread_equal(*conn->mio_run_thread, pthread_self()))) {
+        __atomic_add_fetch(&routes->releasing, 1, __ATOMIC_SEQ_CST);
+        pthread_mutex_lock(&routes->mutex);
+        while (__atomic_load_n(&route->refs, __ATOMIC_SEQ_CST) > 1)
+            pthread_cond_wait(&routes->cond, &routes->mutex);
+        pthread_mutex_unlock(&routes->mutex);
+        __atomic_sub_fetch(&routes->releasing, 1, __ATOMIC_SEQ_CST);
+    }
+    _mio_pubsub_route_unref(routes, route);
+}
+
+// Adds, replaces or removes the registration of key in one of the hashes.
+// A replaced or removed registration is released once the running calls of
+// its callback have returned.
+static int _mio_pubsub_route_set(mio_conn_t *conn, int prefix,
+                                 const char *key, mio_pubsub_node_callback callback, void *userdata) {
+    mio_pubsub_routes_t *routes = conn->pubsub_routes;
+    mio_pubsub_route_t **head, *route, *old;
+    size_t key_len;
+
+    if (routes == NULL)
+        return MIO_ERROR_MALLOC;
+    head = prefix ? &routes->prefixes : &routes->nodes;
+    key_len = strlen(key);
+
+    // Replacing swaps in a new route, so that calls still running keep the
+    // old userdata
+    route = NULL;
+    if (callback != NULL) {
+        route = malloc(sizeof(mio_pubsub_route_t));
+        if (route == NULL)
+            return MIO_ERROR_MALLOC;
+        memset(route, 0, sizeof(mio_pubsub_route_t));
+        route->key = malloc(key_len + 1);
+        if (route->key == NULL) {
+            free(route);
+            return MIO_ERROR_MALLOC;
+        }
+        memcpy(route->key, key, key_len + 1);
+        route->key_len = key_len;
+        route->callback = callback;
+        route->userdata = userdata;
+        route->refs = 1;
+    }
+
+    pthread_rwlock_wrlock(&routes->lock);
+    // Count the new prefix first, a failure leaves the old registration
+    if (route != NULL && prefix
+            && _mio_pubsub_prefix_len_update(routes, key_len, 1) != MIO_OK) {
+        pthread_rwlock_unlock(&routes->lock);
+        _mio_pubsub_route_free(route);
+        return MIO_ERROR_MALLOC;
+    }
+    HASH_FIND(hh, *head, key, key_len, old);
+    if (old != NULL) {
+        _mio_pubsub_route_unlink(routes, prefix, head, old);
+        __atomic_sub_fetch(&routes->count, 1, __ATOMIC_RELEASE);
+    }
+    if (route != NULL) {
+        HASH_ADD_KEYPTR(hh, *head, route->key, route->key_len, route);
+        __atomic_add_fetch(&routes->count, 1, __ATOMIC_RELEASE);
+    }
+    pthread_rwlock_unlock(&routes->lock);
+
+    if (old != NULL)
+        _mio_pubsub_route_release(conn, routes, old);
+    return MIO_OK;
+}
+
+/**
+ * @ingroup PubSub
+ * Registers a callback for the pubsub events of a node. Events of a node with
+ * a callback are passed to it as soon as they are decoded, instead of being
+ * queued for mio_pubsub_data_receive() or the lanes of
+ * mio_pubsub_data_lanes_start(). A node registration takes precedence over
+ * prefix registrations, see mio_pubsub_on_prefix(). Events no registration
+ * matches are queued as before.
+ *
+ * The callback runs in the event loop thread, or in a handler worker if the
+ * event was decoded by one, see mio_handler_workers_start(). It should return
+ * quickly, it may register and unregister callbacks.
+ *
+ * Replacing or removing a registration waits for running calls of the old
+ * callback to return, so that its userdata can be freed once this function
+ * returns. Called from within a callback or a handler running in the event
+ * loop thread, it returns right away instead and the old registration is
+ * released once its last running call returns.
+ *
+ * @param conn A pointer to a mio connection. It does not need to be active.
+ * @param node The node ID, NULL for events that no other registration
+ * matches.
+ * @param callback The callback, NULL to remove the registration of the node.
+ * @param userdata A pointer to any user data, which is passed to callback.
+ * @returns MIO_OK on success or MIO_ERROR_MALLOC, also if the registry of
+ * the connection could not be allocated.
+ */
+int mio_pubsub_on_node(mio_conn_t *conn, const char *node,
+                       mio_pubsub_node_callback callback, void *userdata) {
+    // The empty prefix matches every node, but is the last one to be tried
+    if (node == NULL)
+        return _mio_pubsub_route_set(conn, 1, "", callback, userdata);
+    return _mio_pubsub_route_set(conn, 0, node, callback, userdata);
+}
+
+/**
+ * @ingroup PubSub
+ * Registers a callback for the pubsub events of all nodes whose ID starts
+ * with prefix, see mio_pubsub_on_node(). If several registered prefixes match
+ * a node, the longest one is used. The empty prefix matches every node.
+ *
+ * @param conn A pointer to a mio connection. It does not need to be active.
+ * @param prefix The start of the node IDs.
+ * @param callback The callback, NULL to remove the registration of the
+ * prefix.
+ * @param userdata A pointer to any user data, which is passed to callback.
+ * @returns MIO_OK on success or MIO_ERROR_MALLOC, also if the registry of
+ * the connection could not be allocated.
+ */
+int mio_pubsub_on_prefix(mio_conn_t *conn, const char *prefix,
+                         mio_pubsub_node_callback callback, void *userdata) {
+    return _mio_pubsub_route_set(conn, 1, prefix == NULL ? "" : prefix,
+                                 callback, userdata);
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to pass a received pubsub response to the callback
+ * registered for its node. The callback is called without the registry
+ * locked, removals of its registration wait for it to return.
+ *
+ * @param conn A pointer to a mio connection.
+ * @param response A pointer to the received mio response.
+ * @returns 1 if the response was passed to a callback and released, 0 if no
+ * registration matches its node.
+ */
+int _mio_pubsub_routes_deliver(mio_conn_t *conn, mio_response_t *response) {
+    mio_pubsub_routes_t *routes = conn->pubsub_routes;
+    mio_packet_t *packet = (mio_packet_t*) response->response;
+    mio_pubsub_route_t *route = NULL;
+    mio_pubsub_node_callback callback = NULL;
+    void *userdata = NULL;
+    const char *node;
+    size_t node_len;
+    unsigned int i;
+
+    if (routes == NULL || __atomic_load_n(&routes->count, __ATOMIC_ACQUIRE) == 0)
+        return 0;
+    if (packet == NULL || packet->type != MIO_PACKET_DATA
+            || packet->payload == NULL
+            || ((mio_data_t*) packet->payload)->event == NULL)
+        return 0;
+    node = ((mio_data_t*) packet->payload)->event;
+    node_len = strlen(node);
+
+    pthread_rwlock_rdlock(&routes->lock);
+    HASH_FIND(hh, routes->nodes, node, node_len, route);
+    for (i = 0; route == NULL && i < routes->n_prefix_lens; i++)
+        if (routes->prefix_lens[i].len <= node_len)
+            HASH_FIND(hh, routes->prefixes, node, routes->prefix_lens[i].len,
+                      route);
+    if (route != NULL) {
+        callback = route->callback;
+        userdata = route->userdata;
+        __atomic_add_fetch(&route->refs, 1, __ATOMIC_SEQ_CST);
+    }
+    pthread_rwlock_unlock(&routes->lock);
+    if (callback == NULL)
+        return 0;
+
+    _mio_pubsub_routes_delivering++;
+    callback(conn, response, userdata);
+    _mio_pubsub_routes_delivering--;
+    _mio_pubsub_route_unref(routes, route);
+    __atomic_add_fetch(&conn->pubsub_rx_stats.routed, 1, __ATOMIC_RELAXED);
+    _mio_response_pool_put(conn, response);
+    return 1;
+}
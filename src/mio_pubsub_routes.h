@@ -0,0 +1,79 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+
+
+#ifndef ____mio_pubsub_routes__
+#define ____mio_pubsub_routes__
+
+#include <mio.h>
+
+// Called for each received pubsub response of a registered node or prefix,
+// see mio_pubsub_on_node(). The response is released once it returns.
+typedef void (*mio_pubsub_node_callback)(mio_conn_t *conn,
+        mio_response_t *response, void *userdata);
+
+typedef struct mio_pubsub_route mio_pubsub_route_t;
+
+// Registration of a node or node prefix
+struct mio_pubsub_route {
+    char *key;
+    size_t key_len;
+    mio_pubsub_node_callback callback;
+    void *userdata;
+    // Running calls of callback plus one while registered, the route is freed
+    // when it drops to 0
+    int refs;
+    UT_hash_handle hh;
+};
+
+// Number of registered prefixes of one length
+typedef struct {
+    size_t len;
+    unsigned int count;
+} mio_pubsub_prefix_len_t;
+
+// Callbacks of received pubsub responses by node, see mio_pubsub_on_node()
+struct mio_pubsub_routes {
+    pthread_rwlock_t lock; // Protects everything but count
+    mio_pubsub_route_t *nodes; // Hash of node registrations by node
+    mio_pubsub_route_t *prefixes; // Hash of prefix registrations by prefix
+    // Distinct prefix lengths, longest first, so that the longest registered
+    // prefix of a node is found with one lookup per length
+    mio_pubsub_prefix_len_t *prefix_lens;
+    unsigned int n_prefix_lens, prefix_lens_size;
+    int count; // Registrations, checked without the lock
+    // Broadcast under mutex when a callback returns while releases wait
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int releasing; // Releases waiting for running callbacks
+};
+
+int mio_pubsub_on_node(mio_conn_t *conn, const char *node,
+                       mio_pubsub_node_callback callback, void *userdata);
+int mio_pubsub_on_prefix(mio_conn_t *conn, const char *prefix,
+                         mio_pubsub_node_callback callback, void *userdata);
+mio_pubsub_routes_t *_mio_pubsub_routes_new();
+void _mio_pubsub_routes_free(mio_pubsub_routes_t *routes);
+int _mio_pubsub_routes_deliver(mio_conn_t *conn, mio_response_t *response);
+
+#endif /* defined(____mio_pubsub_routes__) */
@@ -498,7 +498,7 @@ static void XMLCALL mio_XMLstart_schedule_query(void *data,
         packet->type = MIO_PACKET_SCHEDULE;
     }
     if (strcmp(element_name, "event") == 0) {
-        XML_SetCharacterDataHandler(*xml_data->parser, NULL );
+        mio_xml_parser_data_set_char_handler(xml_data, NULL );
         if (packet->payload == NULL ) {
             packet->payload = mio_event_new();
             event = (mio_event_t*) packet->payload;
@@ -530,7 +530,7 @@ static void XMLCALL mio_XMLstart_schedule_query(void *data,
         event = (mio_event_t*) xml_data->payload;
         recurrence = mio_recurrence_new();
         event->recurrence = recurrence;
-        XML_SetCharacterDataHandler(*xml_data->parser,
+        mio_xml_parser_data_set_char_handler(xml_data,
                                     mio_XMLString_recurrence);
     } else if (strcmp(element_name, "error") == 0)
         mio_XML_error_handler(element_name, attr, response);
@@ -0,0 +1,280 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+#include <string.h>
+#include <stdlib.h>
+#include "mio_template.h"
+
+extern mio_log_level_t _mio_log_level;
+
+// Placeholders are a control character that never occurs in valid XML and
+// is not escaped by the renderer, followed by the slot letter. Slot 0 is the
+// stanza id, slot n + 1 is value n.
+static const char *_mio_template_placeholders[MIO_TEMPLATE_MAX_SLOTS + 1] = {
+    "\001A", "\001B", "\001C", "\001D", "\001E", "\001F", "\001G", "\001H",
+    "\001I"
+};
+
+#define MIO_TEMPLATE_PLACEHOLDER_LEN 2
+
+// Length of s once escaped for an XML attribute or text node
+static size_t _mio_template_escaped_len(const char *s) {
+    size_t len = 0, run;
+
+    for (;;) {
+        run = strcspn(s, "<>&\"");
+        len += run;
+        s += run;
+        switch (*s) {
+        case '<':
+        case '>':
+            len += 4;
+            break;
+        case '&':
+            len += 5;
+            break;
+        case '"':
+            len += 6;
+            break;
+        default:
+            return len;
+        }
+        s++;
+    }
+}
+
+// Copies s escaped to dst and returns the end of the copy
+static char *_mio_template_escape(char *dst, const char *s) {
+    size_t run;
+
+    for (;;) {
+        run = strcspn(s, "<>&\"");
+        memcpy(dst, s, run);
+        dst += run;
+        s += run;
+        switch (*s) {
+        case '<':
+            memcpy(dst, "&lt;", 4);
+            dst += 4;
+            break;
+        case '>':
+            memcpy(dst, "&gt;", 4);
+            dst += 4;
+            break;
+        case '&':
+            memcpy(dst, "&amp;", 5);
+            dst += 5;
+            break;
+        case '"':
+            memcpy(dst, "&quot;", 6);
+            dst += 6;
+            break;
+        default:
+            return dst;
+        }
+        s++;
+    }
+}
+
+/**
+ * @ingroup Core
+ * Returns the placeholder for a value slot of a template. Set it as an
+ * attribute value or text of the stanza passed to mio_template_compile()
+ * wherever the value should go.
+ *
+ * @param value The index of the value, from 0 to MIO_TEMPLATE_MAX_SLOTS - 1.
+ * @returns The placeholder string, or NULL if value is out of range.
+ */
+const char *mio_template_slot(int value) {
+    if (value < 0 || value >= MIO_TEMPLATE_MAX_SLOTS)
+        return NULL;
+    return _mio_template_placeholders[value + 1];
+}
+
+/**
+ * @ingroup Core
+ * Compiles a stanza into a template. The stanza is rendered once, the bytes
+ * between its placeholders become the template's skeleton. Filling the
+ * template with values then produces the same bytes as rendering the stanza
+ * with the values in place of the placeholders, without building a stanza
+ * tree. The stanza's id is replaced by the id slot, which is filled with the
+ * request id when the template is sent.
+ *
+ * @param stanza The stanza to compile, with placeholders from
+ * mio_template_slot(). It still belongs to the caller afterwards.
+ * @returns A newly allocated template, or NULL on an error.
+ */
+mio_template_t *mio_template_compile(mio_stanza_t *stanza) {
+    xmpp_ctx_t *ctx = stanza->xmpp_stanza->ctx;
+    mio_template_t *tmpl;
+    mio_template_segment_t *seg;
+    char *buf, *p, *end, *lit;
+    size_t buflen;
+    int slot, n;
+
+    xmpp_stanza_set_id(stanza->xmpp_stanza, _mio_template_placeholders[0]);
+    if (xmpp_stanza_to_text(stanza->xmpp_stanza, &buf, &buflen) != 0) {
+        mio_error("Cannot render stanza for template");
+        return NULL;
+    }
+
+    // Each placeholder ends a segment, plus one for the trailing literal
+    n = 1;
+    for (p = buf; (p = memchr(p, '\001', buf + buflen - p)) != NULL; p++)
+        n++;
+
+    tmpl = calloc(1, sizeof(mio_template_t));
+    if (tmpl != NULL) {
+        tmpl->skeleton = malloc(buflen + 1);
+        tmpl->segments = calloc(n, sizeof(mio_template_segment_t));
+    }
+    if (tmpl == NULL || tmpl->skeleton == NULL || tmpl->segments == NULL) {
+        xmpp_free(ctx, buf);
+        mio_template_free(tmpl);
+        return NULL;
+    }
+
+    lit = buf;
+    end = buf + buflen;
+    for (;;) {
+        p = memchr(lit, '\001', end - lit);
+        seg = &tmpl->segments[tmpl->num_segments++];
+        seg->offset = tmpl->skeleton_len;
+        seg->len = (p != NULL ? p : end) - lit;
+        memcpy(tmpl->skeleton + tmpl->skeleton_len, lit, seg->len);
+        tmpl->skeleton_len += seg->len;
+        if (p == NULL) {
+            seg->slot = -1;
+            break;
+        }
+        slot = p + 1 < end ? p[1] - 'A' : -1;
+        if (slot < 0 || slot > MIO_TEMPLATE_MAX_SLOTS) {
+            mio_error("Invalid placeholder in template");
+            xmpp_free(ctx, buf);
+            mio_template_free(tmpl);
+            return NULL;
+        }
+        seg->slot = slot;
+        if (slot > tmpl->num_values)
+            tmpl->num_values = slot;
+        lit = p + MIO_TEMPLATE_PLACEHOLDER_LEN;
+    }
+    tmpl->skeleton[tmpl->skeleton_len] = '\0';
+
+    xmpp_free(ctx, buf);
+    return tmpl;
+}
+
+/**
+ * @ingroup Core
+ * Frees a template.
+ *
+ * @param tmpl The template to free.
+ */
+void mio_template_free(mio_template_t *tmpl) {
+    if (tmpl == NULL)
+        return;
+    if (tmpl->skeleton != NULL)
+        free(tmpl->skeleton);
+    if (tmpl->segments != NULL)
+        free(tmpl->segments);
+    free(tmpl);
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to fill a template into a newly allocated buffer, which
+ * is sized exactly and can be handed to _mio_send_queue_push().
+ *
+ * @param conn A pointer to a mio connection whose xmpp context allocates the buffer.
+ * @param tmpl The template to fill.
+ * @param id The stanza id.
+ * @param values One string per value slot of the template, they are escaped.
+ * @param buf Returns the NUL terminated buffer, which must be freed with xmpp_free().
+ * @param len Returns the length of the buffer without the NUL.
+ * @returns MIO_OK on success, MIO_ERROR_MALLOC if the buffer could not be allocated.
+ */
+int _mio_template_fill(mio_conn_t *conn, mio_template_t *tmpl, const char *id,
+                       const char **values, char **buf, size_t *len) {
+    const char *slot_values[MIO_TEMPLATE_MAX_SLOTS + 1];
+    size_t slot_lens[MIO_TEMPLATE_MAX_SLOTS + 1];
+    mio_template_segment_t *seg;
+    char *p;
+    int i;
+
+    slot_values[0] = id;
+    for (i = 0; i < tmpl->num_values; i++)
+        slot_values[i + 1] = values[i] != NULL ? values[i] : "";
+
+    for (i = 0; i <= tmpl->num_values; i++)
+        slot_lens[i] = _mio_template_escaped_len(slot_values[i]);
+    *len = tmpl->skeleton_len;
+    for (seg = tmpl->segments; seg < tmpl->segments + tmpl->num_segments; seg++)
+        if (seg->slot >= 0)
+            *len += slot_lens[seg->slot];
+
+    *buf = xmpp_alloc(conn->xmpp_conn->ctx, *len + 1);
+    if (*buf == NULL)
+        return MIO_ERROR_MALLOC;
+
+    p = *buf;
+    for (seg = tmpl->segments; seg < tmpl->segments + tmpl->num_segments; seg++) {
+        memcpy(p, tmpl->skeleton + seg->offset, seg->len);
+        p += seg->len;
+        if (seg->slot >= 0)
+            p = _mio_template_escape(p, slot_values[seg->slot]);
+    }
+    *p = '\0';
+
+    return MIO_OK;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to fill a template and queue it for sending without
+ * building a stanza tree. No handlers are added.
+ *
+ * @param conn A pointer to an active mio connection.
+ * @param tmpl The template to send.
+ * @param id The stanza id.
+ * @param values One string per value slot of the template.
+ * @returns MIO_OK on success, otherwise an error.
+ */
+int _mio_template_send(mio_conn_t *conn, mio_template_t *tmpl, const char *id,
+                       const char **values) {
+    char *buf;
+    size_t len;
+    int err;
+
+    if (!conn->xmpp_conn->authenticated) {
+        mio_error("Sending failed because not connected to server");
+        return MIO_ERROR_CONNECTION;
+    }
+    err = _mio_template_fill(conn, tmpl, id, values, &buf, &len);
+    if (err != MIO_OK)
+        return err;
+    xmpp_debug(conn->xmpp_conn->ctx, "conn", "SENT: %s", buf);
+    err = _mio_send_queue_push(conn, buf, len);
+    if (err != MIO_OK)
+        mio_error("Unable to queue stanza for sending");
+    return err;
+}
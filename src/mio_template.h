@@ -0,0 +1,55 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+#ifndef ____mio_template__
+#define ____mio_template__
+
+#include <mio.h>
+
+// Number of value slots a template can have besides the stanza id
+#define MIO_TEMPLATE_MAX_SLOTS 8
+
+// A run of literal skeleton bytes followed by a slot
+typedef struct mio_template_segment {
+    size_t offset; // Start of the literal bytes in the skeleton
+    size_t len; // Number of literal bytes
+    int slot; // Slot following the literal bytes, 0 for the stanza id, -1 for none
+} mio_template_segment_t;
+
+// A stanza rendered once with placeholders, see mio_template_compile()
+struct mio_template {
+    char *skeleton; // Rendered stanza without the placeholders
+    size_t skeleton_len;
+    mio_template_segment_t *segments;
+    int num_segments;
+    int num_values; // Number of value slots, the id slot not included
+};
+
+const char *mio_template_slot(int value);
+mio_template_t *mio_template_compile(mio_stanza_t *stanza);
+void mio_template_free(mio_template_t *tmpl);
+int _mio_template_fill(mio_conn_t *conn, mio_template_t *tmpl, const char *id,
+                       const char **values, char **buf, size_t *len);
+int _mio_template_send(mio_conn_t *conn, mio_template_t *tmpl, const char *id,
+                       const char **values);
+
+#endif /* defined(____mio_template__) */
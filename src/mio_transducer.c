@@ -64,85 +64,291 @@ void mio_data_free(mio_data_t *data) {
     free(data);
 }
 
-int mio_publish_data(mio_conn_t *conn, mio_data_t *data, mio_response_t *response) {
-    int i, err;
-    mio_transducer_data_t *tran_tmp;
-    mio_stanza_t *data_item;
-    mio_response_t *response_tmp = NULL;
-    tran_tmp = data->transducers;
-
-    for (i = 0; i < data->num_transducers; i++) {
-        if (i == (data->num_transducers-1) ) {
-            if (response_tmp != NULL) mio_response_free(response_tmp);
-            response_tmp = response;
-        } else {
-            if(response_tmp != NULL)mio_response_free(response_tmp);
-            response_tmp = mio_response_new();
-        }
-        data_item = mio_transducer_data_to_item(conn,tran_tmp);
-        err = mio_item_publish_data(conn, data_item, data->event,response_tmp);
-        if (err != MIO_OK) {
-            mio_response_free(response);
-            response = response_tmp;
-            return err;
-        }
-        mio_stanza_free(data_item);
-        tran_tmp = tran_tmp->next;
+/**
+ * @ingroup PubSub
+ * Allocates and initializes a new mio publish result struct.
+ *
+ * @returns The newly allocated and initialized mio publish result struct.
+ */
+mio_publish_result_t *mio_publish_result_new() {
+    mio_publish_result_t *result = malloc(sizeof(mio_publish_result_t));
+    memset(result, 0, sizeof(mio_publish_result_t));
+    return result;
+}
+
+/**
+ * @ingroup PubSub
+ * Frees a mio publish result struct. Does not free any successive members in the linked list.
+ *
+ * @param result A pointer to the allocated mio publish result struct to be freed.
+ */
+void mio_publish_result_free(mio_publish_result_t *result) {
+    if (result->name != NULL)
+        free(result->name);
+    if (result->error != NULL)
+        _mio_response_error_free(result->error);
+    free(result);
+}
+
+typedef struct mio_publish_batch mio_publish_batch_t;
+
+// Ties the completion of a single transducer's publish to its result
+typedef struct {
+    mio_publish_batch_t *batch;
+    mio_publish_result_t *result;
+} mio_publish_slot_t;
+
+// State shared between the publishes of all transducers of a mio data struct
+struct mio_publish_batch {
+    mio_response_t *response; // Handed to completion, holds the results
+    mio_publish_result_t *results;
+    int num_results;
+    mio_completion completion;
+    void *userdata;
+    int pending; // Publishes in flight, plus one while still sending
+    int failed;
+    mio_publish_slot_t slots[];
+};
+
+static void _mio_publish_batch_done(mio_conn_t *conn,
+                                    mio_publish_batch_t *batch) {
+    mio_packet_t *packet = mio_packet_new();
+    int failed = __atomic_load_n(&batch->failed, __ATOMIC_RELAXED);
+
+    mio_packet_payload_add(packet, batch->results, MIO_PACKET_PUBLISH_RESULTS);
+    packet->num_payloads = batch->num_results;
+    batch->response->response_type = MIO_RESPONSE_PACKET;
+    batch->response->response = packet;
+
+    batch->completion(conn, batch->response,
+                      failed ? MIO_ERROR_PUBLISH_FAILED : MIO_OK, batch->userdata);
+    free(batch);
+}
+
+// Drops one reference to the batch and completes it once all are gone
+static void _mio_publish_batch_put(mio_conn_t *conn,
+                                   mio_publish_batch_t *batch) {
+    if (__atomic_sub_fetch(&batch->pending, 1, __ATOMIC_ACQ_REL) == 0)
+        _mio_publish_batch_done(conn, batch);
+}
+
+static void _mio_publish_data_item_complete(mio_conn_t *conn,
+        mio_response_t *response, int status, void *userdata) {
+    mio_publish_slot_t *slot = (mio_publish_slot_t*) userdata;
+    mio_publish_result_t *result = slot->result;
+
+    result->status = status;
+    // Keep the server's error with the result of the rejected transducer
+    if (status == MIO_OK && response->response_type == MIO_RESPONSE_ERROR) {
+        result->error = response->response;
+        result->status = MIO_ERROR_PUBLISH_FAILED;
+        response->response = NULL;
+        response->response_type = MIO_RESPONSE_UNKNOWN;
     }
-    return MIO_OK;
+    if (result->status != MIO_OK)
+        __atomic_add_fetch(&slot->batch->failed, 1, __ATOMIC_RELAXED);
+    mio_response_free(response);
+
+    _mio_publish_batch_put(conn, slot->batch);
 }
 
-mio_stanza_t* mio_transducer_data_to_item(mio_conn_t *conn, mio_transducer_data_t* transducer) {
-    xmpp_stanza_t *t = NULL, *head_item = NULL, *tail_item = NULL, *item = NULL;
-    mio_stanza_t *items;
-    mio_transducer_data_t *curr;
-    char *t_string;
+// Publishes each transducer of data as its own item without waiting for the
+// server in between and completes once all of them got a response
+static int _mio_publish_data(mio_conn_t *conn, mio_data_t *data,
+                             mio_response_t *response, mio_completion completion,
+                             void *userdata, unsigned int deadline_ms) {
+    mio_publish_batch_t *batch;
+    mio_publish_result_t *result, *tail = NULL;
+    mio_transducer_data_t *t;
+    mio_stanza_t *item;
+    int i, err, first_err = MIO_OK, sent = 0;
 
-    if(transducer == NULL)
-        return NULL;
+    if (!conn->xmpp_conn->authenticated) {
+        mio_error(
+            "Cannot process publish request since not connected to XMPP server");
+        return MIO_ERROR_DISCONNECTED;
+    }
 
-    // Iterate over linked list of transducers, converting them to stanzas
-    for(curr = transducer; curr != NULL; curr = curr->next) {
-        // Create a new item of type transducer_transducername
-        t_string = malloc(sizeof(char)*strlen(curr->name) + 2);
-        sprintf(t_string, "_%s", curr->name);
-        item = xmpp_stanza_new(conn->xmpp_conn->ctx);
-        xmpp_stanza_set_name(item, "item");
-        xmpp_stanza_set_id(item, t_string);
-        xmpp_stanza_set_ns(item, "http://jabber.org/protocol/mio");
-
-        // Populate transducer stanza
-        t = xmpp_stanza_new(conn->xmpp_conn->ctx);
-        if(curr->type == MIO_TRANSDUCER_DATA)
-            xmpp_stanza_set_name(t, "transducerData");
+    batch = malloc(sizeof(mio_publish_batch_t)
+                   + data->num_transducers * sizeof(mio_publish_slot_t));
+    if (batch == NULL)
+        return MIO_ERROR_MALLOC;
+    memset(batch, 0, sizeof(mio_publish_batch_t));
+    batch->response = response;
+    batch->completion = completion;
+    batch->userdata = userdata;
+    batch->pending = 1;
+
+    // Build the complete result list first, completions may already run
+    // while later transducers are still being sent
+    for (i = 0, t = data->transducers; i < data->num_transducers && t != NULL;
+            i++, t = t->next) {
+        result = mio_publish_result_new();
+        if (t->name != NULL) {
+            result->name = malloc(strlen(t->name) + 1);
+            strcpy(result->name, t->name);
+        }
+        if (tail == NULL)
+            batch->results = result;
         else
-            xmpp_stanza_set_name(t, "transducerSetData");
-        xmpp_stanza_set_attribute(t, "name", curr->name);
-        xmpp_stanza_set_attribute(t, "value", curr->value);
-        xmpp_stanza_set_attribute(t, "timestamp", curr->timestamp);
-
-        // Add child stanzas and clean up
-        xmpp_stanza_add_child(item, t);
+            tail->next = result;
+        tail = result;
+        batch->num_results++;
+        batch->slots[i].batch = batch;
+        batch->slots[i].result = result;
+    }
 
-        if(tail_item == NULL) {
-            tail_item = item;
-            head_item = item;
+    for (i = 0, t = data->transducers, result = batch->results; result != NULL;
+            i++, t = t->next, result = result->next) {
+        __atomic_add_fetch(&batch->pending, 1, __ATOMIC_RELAXED);
+        item = mio_transducer_data_to_item(conn, t);
+        err = mio_item_publish_async(conn, item, data->event,
+                                     _mio_publish_data_item_complete, &batch->slots[i],
+                                     deadline_ms);
+        mio_stanza_free(item);
+        if (err == MIO_OK) {
+            sent++;
+            continue;
         }
-        else {
-            tail_item->next = item;
-            tail_item = item;
+        // No completion will come for this transducer
+        result->status = err;
+        __atomic_add_fetch(&batch->failed, 1, __ATOMIC_RELAXED);
+        __atomic_sub_fetch(&batch->pending, 1, __ATOMIC_RELAXED);
+        if (first_err == MIO_OK)
+            first_err = err;
+    }
+
+    // Nothing went out, so report the error instead of completing
+    if (sent == 0 && first_err != MIO_OK) {
+        while ((result = batch->results) != NULL) {
+            batch->results = result->next;
+            mio_publish_result_free(result);
         }
+        free(batch);
+        return first_err;
+    }
+
+    _mio_publish_batch_put(conn, batch);
+    return MIO_OK;
+}
+
+// State shared between mio_publish_data() and its completion
+typedef struct {
+    pthread_cond_t cond;
+    pthread_mutex_t mutex;
+    int predicate;
+    int status;
+} mio_publish_data_wait_t;
+
+static void _mio_publish_data_complete(mio_conn_t *conn,
+                                       mio_response_t *response, int status, void *userdata) {
+    mio_publish_data_wait_t *wait = (mio_publish_data_wait_t*) userdata;
+    wait->status = status;
+    mio_cond_signal(&wait->cond, &wait->mutex, &wait->predicate);
+}
+
+/**
+ * @ingroup PubSub
+ * Publishes all transducers of a mio data struct to its event node and waits
+ * for the server's responses. Each transducer is published as its own item,
+ * but the publishes are pipelined rather than sent one after the other.
+ *
+ * @param conn A pointer to an active mio connection.
+ * @param data The data to publish, data->event is the target event node.
+ * @param response A pointer to an allocated mio response struct. On return it holds a MIO_PACKET_PUBLISH_RESULTS packet with one mio publish result per transducer.
+ * @returns MIO_OK if all transducers were published, MIO_ERROR_PUBLISH_FAILED if any of them failed, otherwise an error.
+ */
+int mio_publish_data(mio_conn_t *conn, mio_data_t *data, mio_response_t *response) {
+    mio_publish_data_wait_t wait;
+    int err;
 
-        free(t_string);
-        xmpp_stanza_release(t);
-        // todo: fix iteration as only one data item sent at a time
-        break;
+    memset(&wait, 0, sizeof(wait));
+    pthread_cond_init(&wait.cond, NULL );
+    pthread_mutex_init(&wait.mutex, NULL );
+
+    err = _mio_publish_data(conn, data, response, _mio_publish_data_complete,
+                            &wait, 0);
+    if (err == MIO_OK) {
+        pthread_mutex_lock(&wait.mutex);
+        while (!wait.predicate)
+            pthread_cond_wait(&wait.cond, &wait.mutex);
+        pthread_mutex_unlock(&wait.mutex);
+        err = wait.status;
     }
-    items = mio_stanza_new(conn);
-    xmpp_stanza_release(items->xmpp_stanza);
-    items->xmpp_stanza = head_item;
 
-    return items;
+    pthread_cond_destroy(&wait.cond);
+    pthread_mutex_destroy(&wait.mutex);
+    return err;
+}
+
+/**
+ * @ingroup PubSub
+ * Publishes all transducers of a mio data struct to its event node like
+ * mio_publish_data(), but returns right away and calls completion once every
+ * transducer was acknowledged, timed out or failed.
+ *
+ * @param conn A pointer to an active mio connection.
+ * @param data The data to publish, data->event is the target event node. It is not needed after the function returns.
+ * @param completion Called with a response holding a MIO_PACKET_PUBLISH_RESULTS packet, which the completion has to free. status is MIO_OK if all transducers were published and MIO_ERROR_PUBLISH_FAILED otherwise.
+ * @param userdata Passed to completion.
+ * @param deadline_ms Time in ms after which a transducer's publish fails with MIO_ERROR_TIMEOUT, 0 for the default.
+ * @returns MIO_OK if at least one publish was sent, otherwise an error, in which case completion is never called.
+ */
+int mio_publish_data_async(mio_conn_t *conn, mio_data_t *data,
+                           mio_completion completion, void *userdata,
+                           unsigned int deadline_ms) {
+    mio_response_t *response = mio_response_new();
+    int err;
+
+    err = _mio_publish_data(conn, data, response, completion, userdata,
+                            deadline_ms);
+    if (err != MIO_OK)
+        mio_response_free(response);
+    return err;
+}
+
+/**
+ * @ingroup PubSub
+ * Converts a single transducer into an item for publishing. Successive members
+ * of the transducer's linked list are ignored, since every transducer is
+ * published as its own item, see mio_publish_data().
+ *
+ * @param conn A pointer to a mio connection.
+ * @param transducer The transducer to convert.
+ * @returns A newly allocated mio stanza containing the item, or NULL if transducer is NULL.
+ */
+mio_stanza_t* mio_transducer_data_to_item(mio_conn_t *conn, mio_transducer_data_t* transducer) {
+    xmpp_stanza_t *t = NULL;
+    mio_stanza_t *item;
+    char *t_string;
+
+    if(transducer == NULL)
+        return NULL;
+
+    // Create a new item of type transducer_transducername
+    t_string = malloc(sizeof(char)*strlen(transducer->name) + 2);
+    sprintf(t_string, "_%s", transducer->name);
+    item = mio_stanza_new(conn);
+    xmpp_stanza_set_name(item->xmpp_stanza, "item");
+    xmpp_stanza_set_id(item->xmpp_stanza, t_string);
+    xmpp_stanza_set_ns(item->xmpp_stanza, "http://jabber.org/protocol/mio");
+
+    // Populate transducer stanza
+    t = xmpp_stanza_new(conn->xmpp_conn->ctx);
+    if(transducer->type == MIO_TRANSDUCER_DATA)
+        xmpp_stanza_set_name(t, "transducerData");
+    else
+        xmpp_stanza_set_name(t, "transducerSetData");
+    xmpp_stanza_set_attribute(t, "name", transducer->name);
+    xmpp_stanza_set_attribute(t, "value", transducer->value);
+    xmpp_stanza_set_attribute(t, "timestamp", transducer->timestamp);
+
+    // Add child stanzas and clean up
+    xmpp_stanza_add_child(item->xmpp_stanza, t);
+    free(t_string);
+    xmpp_stanza_release(t);
+
+    return item;
 }
 
 /** Adds transducer value to data item. Can specify the value type
@@ -198,6 +404,138 @@ int mio_item_publish_data(mio_conn_t *conn, mio_stanza_t *item,
     err = mio_item_publish(conn, item, node, response);
     return err;
 }
+
+/**
+ * @ingroup PubSub
+ * Compiles a template for publishing the samples of a single transducer to an
+ * event node. Publishing from the template produces the same stanza as
+ * mio_publish_data() would, but only fills in the value, timestamp and
+ * stanza id instead of building and rendering a stanza tree for each sample.
+ *
+ * @param conn A pointer to a mio connection. It does not need to be active.
+ * @param node The target event node's uuid.
+ * @param name The name of the transducer.
+ * @param type MIO_TRANSDUCER_DATA for sensor data, MIO_TRANSDUCER_SET_DATA for actuation.
+ * @returns A newly allocated template to be freed with mio_template_free(), or NULL on an error.
+ */
+mio_template_t *mio_transducer_data_template_new(mio_conn_t *conn,
+        const char *node, const char *name, mio_transducer_data_type_t type) {
+    mio_transducer_data_t transducer;
+    mio_stanza_t *item, *iq;
+    mio_template_t *tmpl;
+
+    memset(&transducer, 0, sizeof(transducer));
+    transducer.type = type;
+    transducer.name = (char*) name;
+    transducer.value = (char*) mio_template_slot(0);
+    transducer.timestamp = (char*) mio_template_slot(1);
+
+    item = mio_transducer_data_to_item(conn, &transducer);
+    iq = _mio_item_publish_stanza_new(conn, item, node);
+    tmpl = mio_template_compile(iq);
+    mio_stanza_free(iq);
+    mio_stanza_free(item);
+
+    return tmpl;
+}
+
+/**
+ * @ingroup PubSub
+ * Publishes a transducer sample from a template and waits for the server's
+ * response.
+ *
+ * @param conn A pointer to an active mio connection.
+ * @param tmpl A template from mio_transducer_data_template_new().
+ * @param value The transducer value.
+ * @param timestamp The timestamp of the value.
+ * @param response A pointer to an allocated mio response struct which will be populated with the server's response.
+ * @returns MIO_OK on success, otherwise an error.
+ */
+int mio_publish_data_template(mio_conn_t *conn, mio_template_t *tmpl,
+                              const char *value, const char *timestamp,
+                              mio_response_t *response) {
+    const char *values[2] = { value, timestamp };
+
+    if (!conn->xmpp_conn->authenticated) {
+        mio_error(
+            "Cannot process publish request since not connected to XMPP server");
+        return MIO_ERROR_DISCONNECTED;
+    }
+    return mio_template_send_blocking(conn, tmpl, values,
+                                      (mio_handler) mio_handler_error, response);
+}
+
+/**
+ * @ingroup PubSub
+ * Publishes a transducer sample from a template and calls completion once the
+ * server acknowledged the publish, the deadline passed or the connection
+ * dropped.
+ *
+ * @param conn A pointer to an active mio connection.
+ * @param tmpl A template from mio_transducer_data_template_new().
+ * @param value The transducer value.
+ * @param timestamp The timestamp of the value.
+ * @param completion Called with the server's response, which the completion has to free.
+ * @param userdata Passed to completion.
+ * @param deadline_ms Time in ms after which the publish completes with MIO_ERROR_TIMEOUT, 0 for the default.
+ * @returns MIO_OK if the publish was sent, otherwise an error, in which case completion is never called.
+ */
+int mio_publish_data_template_async(mio_conn_t *conn, mio_template_t *tmpl,
+                                    const char *value, const char *timestamp,
+                                    mio_completion completion, void *userdata,
+                                    unsigned int deadline_ms) {
+    const char *values[2] = { value, timestamp };
+
+    if (!conn->xmpp_conn->authenticated) {
+        mio_error(
+            "Cannot process publish request since not connected to XMPP server");
+        return MIO_ERROR_DISCONNECTED;
+    }
+    return mio_template_send_async(conn, tmpl, values,
+                                   (mio_handler) mio_handler_error, completion, userdata,
+                                   deadline_ms);
+}
+
+/**
+ * @ingroup PubSub
+ * Publishes a transducer sample from a template without waiting for a
+ * response.
+ *
+ * @param conn A pointer to an active mio connection.
+ * @param tmpl A template from mio_transducer_data_template_new().
+ * @param value The transducer value.
+ * @param timestamp The timestamp of the value.
+ * @returns MIO_OK if the publish was queued, otherwise an error.
+ */
+int mio_publish_data_template_nonblocking(mio_conn_t *conn,
+        mio_template_t *tmpl, const char *value, const char *timestamp) {
+    const char *values[2] = { value, timestamp };
+
+    if (!conn->xmpp_conn->authenticated) {
+        mio_error(
+            "Cannot process publish request since not connected to XMPP server");
+        return MIO_ERROR_DISCONNECTED;
+    }
+    return mio_template_send_nonblocking(conn, tmpl, values);
+}
+
+/**
+ * @ingroup PubSub
+ * Publishes a transducer sample from a template on a publish stream without
+ * waiting for the server, see mio_publish_stream_new().
+ *
+ * @param stream Publish stream of an active mio connection.
+ * @param tmpl A template from mio_transducer_data_template_new().
+ * @param value The transducer value.
+ * @param timestamp The timestamp of the value.
+ * @returns MIO_OK if the publish was queued, MIO_ERROR_TOO_MANY_OPEN_REQUESTS if the stream's window is full, otherwise an error.
+ */
+int mio_publish_data_template_stream(mio_publish_stream_t *stream,
+                                     mio_template_t *tmpl, const char *value, const char *timestamp) {
+    const char *values[2] = { value, timestamp };
+
+    return mio_publish_stream_template_send(stream, tmpl, values);
+}
 /**
  * @ingroup PubSub
  * Allocates and initializes a new mio transducer value struct.
@@ -246,13 +584,60 @@ mio_transducer_data_t *_mio_transducer_data_tail_get(
 
 
 
+/**
+ * @ingroup Internal
+ * Finds the entry of a node and transducer in a hash keyed by
+ * mio_transducer_key_t, creating a zeroed one if there is none.
+ *
+ * @param entries The head of the hash. Its entries must start with a
+ * mio_transducer_key_t.
+ * @param node The event node's uuid.
+ * @param name The name of the transducer.
+ * @param entry_size The size of an entry.
+ * @param created Set to 1 if the entry was created, 0 if it was found.
+ * @returns The entry or NULL if it could not be allocated.
+ */
+void *_mio_transducer_key_get(mio_transducer_key_t **entries,
+                              const char *node, const char *name,
+                              size_t entry_size, int *created) {
+    mio_transducer_key_t *entry;
+    size_t node_len = strlen(node), key_len = node_len + 1 + strlen(name);
+    char *key = malloc(key_len + 1);
+
+    *created = 0;
+    if (key == NULL)
+        return NULL;
+    memcpy(key, node, node_len + 1);
+    strcpy(key + node_len + 1, name);
+
+    HASH_FIND(hh, *entries, key, key_len, entry);
+    if (entry != NULL) {
+        free(key);
+        return entry;
+    }
+
+    entry = malloc(entry_size);
+    if (entry == NULL) {
+        free(key);
+        return NULL;
+    }
+    memset(entry, 0, entry_size);
+    entry->key = key;
+    entry->key_len = key_len;
+    HASH_ADD_KEYPTR(hh, *entries, entry->key, entry->key_len, entry);
+    *created = 1;
+    return entry;
+}
+
 void _mio_xml_data_update_end_element(mio_xml_parser_data_t *xml_data,
                                       const char* element_name) {
     if (xml_data->prev_depth > xml_data->curr_depth) {
         xml_data->parent = xml_data->parent->prev;
-        mio_xml_parser_parent_data_free(xml_data->parent->next);
+        // Arena entries go away with the arena
+        if (xml_data->arena == NULL)
+            mio_xml_parser_parent_data_free(xml_data->parent->next);
         xml_data->parent->next = NULL;
-        if(xml_data->parent->parent == NULL)
+        if(xml_data->parent->parent == NULL && xml_data->arena == NULL)
             mio_xml_parser_parent_data_free(xml_data->parent);
     }
     xml_data->prev_depth = xml_data->curr_depth;
@@ -29,6 +29,19 @@
 //#include <mio_packet.h>
 //#include "mio_connection.h"
 //#include <mio_packet.h>
+#include <uthash.h>
+
+// Defined ahead of mio.h, which pulls in the coalescer and deadband headers
+typedef struct mio_transducer_key mio_transducer_key_t;
+
+// Hash key of one (node, transducer) pair. It is the first member of the
+// entries of coalescers and deadband filters, see _mio_transducer_key_get()
+struct mio_transducer_key {
+    char *key; // Node and transducer name separated by a NUL
+    size_t key_len;
+    UT_hash_handle hh;
+};
+
 #include <mio.h>
 
 typedef enum {
@@ -51,6 +64,18 @@ typedef struct mio_data {
     mio_transducer_data_t *transducers;
 } mio_data_t;
 
+typedef struct mio_publish_result mio_publish_result_t;
+
+// Outcome of publishing a single transducer with mio_publish_data()
+struct mio_publish_result {
+    char *name; // Name of the transducer
+    // MIO_OK if the server accepted the item, MIO_ERROR_PUBLISH_FAILED if it
+    // rejected it, otherwise the error that kept the item from being published
+    int status;
+    mio_response_error_t *error; // The server's error if it rejected the item
+    mio_publish_result_t *next;
+};
+
 //stanza
 int mio_handler_node_register(mio_conn_t * const conn,
                               mio_stanza_t * const stanza, mio_data_t * const mio_data);
@@ -66,9 +91,17 @@ mio_transducer_data_t *_mio_transducer_data_tail_get(
 
 mio_transducer_data_t *_mio_transducer_data_tail_get(
     mio_transducer_data_t *t_value);
+void *_mio_transducer_key_get(mio_transducer_key_t **entries,
+                              const char *node, const char *name,
+                              size_t entry_size, int *created);
 
 int mio_publish_data(mio_conn_t *conn, mio_data_t *data,
                      mio_response_t *response);
+int mio_publish_data_async(mio_conn_t *conn, mio_data_t *data,
+                           mio_completion completion, void *userdata,
+                           unsigned int deadline_ms);
+mio_publish_result_t *mio_publish_result_new();
+void mio_publish_result_free(mio_publish_result_t *result);
 int mio_item_transducer_data_actuate_add(mio_stanza_t *item,
         const char *deviceID, const char *value, const char *timestamp);
 int mio_item_transducer_data_add(mio_stanza_t *item, const char *deviceID,
@@ -76,6 +109,24 @@ int mio_item_transducer_data_add(mio_stanza_t *item, const char *deviceID,
                                  const char *timestamp);
 int mio_item_publish_data(mio_conn_t *conn, mio_stanza_t *item,
                           const char *node, mio_response_t * response);
+mio_template_t *mio_transducer_data_template_new(mio_conn_t *conn,
+        const char *node, const char *name, mio_transducer_data_type_t type);
+int mio_publish_data_template(mio_conn_t *conn, mio_template_t *tmpl,
+                              const char *value, const char *timestamp,
+                              mio_response_t *response);
+int mio_publish_data_template_async(mio_conn_t *conn, mio_template_t *tmpl,
+                                    const char *value, const char *timestamp,
+                                    mio_completion completion, void *userdata,
+                                    unsigned int deadline_ms);
+int mio_publish_data_template_nonblocking(mio_conn_t *conn,
+        mio_template_t *tmpl, const char *value, const char *timestamp);
+int mio_publish_data_template_stream(mio_publish_stream_t *stream,
+                                     mio_template_t *tmpl, const char *value, const char *timestamp);
+int mio_coalescer_publish(mio_coalescer_t *coalescer, const char *node,
+                          const char *name, mio_transducer_data_type_t type,
+                          const char *value, const char *timestamp);
+int mio_publish_data_coalesced(mio_coalescer_t *coalescer, mio_data_t *data);
+int mio_deadband_data_filter(mio_deadband_t *deadband, mio_data_t *data);
 
 void _mio_subscription_add(mio_packet_t *pkt, char *subscription, char *sub_id);
 
@@ -83,9 +134,19 @@ mio_transducer_data_t * mio_transducer_data_new();
 void mio_transducer_data_free(mio_transducer_data_t *t_value);
 
 int mio_pubsub_data_receive(mio_conn_t *conn, mio_response_t *response);
+int mio_pubsub_data_receive_timeout(mio_conn_t *conn, mio_response_t *response,
+                                    int timeout_ms);
+int mio_pubsub_data_receive_many(mio_conn_t *conn, mio_response_t **responses,
+                                 int max_responses, int timeout_ms);
+void mio_pubsub_data_response_release(mio_conn_t *conn,
+                                      mio_response_t *response);
 int mio_pubsub_data_listen_start(mio_conn_t *conn);
 int mio_pubsub_data_listen_stop(mio_conn_t *conn);
 void mio_pubsub_data_rx_queue_clear(mio_conn_t *conn);
+int mio_pubsub_data_rx_queue_configure(mio_conn_t *conn, unsigned int capacity,
+                                       mio_rx_overflow_policy_t policy);
+void mio_pubsub_data_rx_queue_stats(mio_conn_t *conn,
+                                    mio_pubsub_rx_stats_t *stats);
 mio_stanza_t* mio_transducer_data_to_item(mio_conn_t *conn, mio_transducer_data_t* transducer);
 int mio_transducer_data_add(mio_transducer_data_t *target, mio_transducer_data_t *transducer);
 
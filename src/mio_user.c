@@ -52,16 +52,10 @@ extern mio_log_level_t _mio_log_level;
 
 int mio_handler_password_change(mio_conn_t * const conn,
                                 mio_stanza_t * const stanza, mio_data_t * const mio_data);
-/** Allows user to change passowrd for connected jid.
- *
- * @param conn Active MIO connection.
- * @param new_pass The new password to connect via the jid logged in with.
- * @param response The response to the change password request.
- *
- * @returns MIO_OK on success, MIO_ERROR_DISCONNECTED on disconnect.
- * */
-int mio_password_change(mio_conn_t * conn, const char *new_pass,
-                        mio_response_t * response) {
+static int _mio_password_change(mio_conn_t * conn, const char *new_pass,
+                                mio_response_t * response,
+                                mio_completion completion, void *userdata,
+                                unsigned int deadline_ms) {
 
     xmpp_stanza_t *iq = NULL, *query = NULL, *username = NULL, *username_tag =
                                            NULL, *password = NULL, *password_tag = NULL;
@@ -122,8 +116,9 @@ int mio_password_change(mio_conn_t * conn, const char *new_pass,
     free(user);
 
 // Send out the stanza
-    err = mio_send_blocking(conn, stanza, (mio_handler) mio_handler_error,
-                            response);
+    err = _mio_send_blocking_or_async(conn, stanza,
+                                      (mio_handler) mio_handler_error, response,
+                                      completion, userdata, deadline_ms);
 
 // Release the stanzas
     mio_stanza_free(stanza);
@@ -131,6 +126,38 @@ int mio_password_change(mio_conn_t * conn, const char *new_pass,
     return err;
 }
 
+/** Allows user to change passowrd for connected jid.
+ *
+ * @param conn Active MIO connection.
+ * @param new_pass The new password to connect via the jid logged in with.
+ * @param response The response to the change password request.
+ *
+ * @returns MIO_OK on success, MIO_ERROR_DISCONNECTED on disconnect.
+ * */
+int mio_password_change(mio_conn_t * conn, const char *new_pass,
+                        mio_response_t * response) {
+    return _mio_password_change(conn, new_pass, response, NULL, NULL, 0);
+}
+
+/** Changes the password of the connected jid and calls completion once the
+ *      response has been processed, the deadline passed or the connection
+ *      dropped, see mio_password_change().
+ *
+ * @param conn Active MIO connection.
+ * @param new_pass The new password to connect via the jid logged in with.
+ * @param completion Called with the parsed response, which the completion has to free.
+ * @param userdata Passed to completion.
+ * @param deadline_ms Time in ms after which the request completes with MIO_ERROR_TIMEOUT, 0 for the default.
+ *
+ * @returns MIO_OK if the request was sent, otherwise an error, in which case completion is never called.
+ * */
+int mio_password_change_async(mio_conn_t * conn, const char *new_pass,
+                              mio_completion completion, void *userdata,
+                              unsigned int deadline_ms) {
+    return _mio_password_change(conn, new_pass, NULL, completion, userdata,
+                                deadline_ms);
+}
+
 /**
  * @ingroup Internal
  * Main event loop thread which connects to the XMPP server passed into mio_connect() and processes incoming and outgoing communication.
@@ -139,16 +166,10 @@ int mio_password_change(mio_conn_t * conn, const char *new_pass,
  */
 static void *_mio_run(mio_handler_data_t *mio_handler_data) {
 
-    struct timespec ts;
-    struct timeval tp, tp_add;
     int err;
     mio_conn_t *conn = mio_handler_data->conn;
     xmpp_ctx_t *ctx = conn->xmpp_conn->ctx;
 
-    tp_add.tv_sec = 0;
-    tp_add.tv_usec = MIO_SEND_REQUEST_TIMEOUT;
-
-
     ctx->loop_status = XMPP_LOOP_RUNNING;
     while (ctx->loop_status == XMPP_LOOP_RUNNING) {
         // Only run the event loop if we have locked down the mutex
@@ -159,32 +180,27 @@ static void *_mio_run(mio_handler_data_t *mio_handler_data) {
             pthread_exit((void*) MIO_ERROR_MUTEX);
         }
 
+        // Move stanzas queued by other threads onto the send queue
+        _mio_send_queue_splice(conn);
+        // Arm the deadline timers of requests started by other threads
+        _mio_request_timers_arm(conn);
+        // Hand responses held back by backpressure to the RX queue
+        _mio_pubsub_rx_queue_refill(conn);
+        // Blocks until socket activity, the next timed handler is due or
+        // another thread calls _mio_event_loop_lock()
         xmpp_run_once(ctx, MIO_EVENT_LOOP_TIMEOUT);
         pthread_mutex_unlock(&conn->event_loop_mutex);
 
-        // Set timeout
-        gettimeofday(&tp, NULL);
-        ts.tv_sec = tp.tv_sec;
-        timeradd(&tp, &tp_add, &tp);
-        ts.tv_nsec = tp.tv_usec * 1000;
-
         err = pthread_mutex_lock(&conn->send_request_mutex);
         if (err != 0) {
             mio_error("Unable to lock send request mutex");
             pthread_exit((void*) MIO_ERROR_MUTEX);
         }
-        // Wait for MIO_SEND_REQUEST_TIMEOUT or until new send request comes in (whichever is first) to run event loop again
-        while (!conn->send_request_predicate) {
-            err = pthread_cond_timedwait(&conn->send_request_cond,
-                                         &conn->send_request_mutex, &ts);
-            // If we time out, run the event loop
-            if (err == ETIMEDOUT)
-                conn->send_request_predicate = 1;
-            // If waiting for the condition fails other than for a timeout, sleep instead
-            else if (err != 0)
-                usleep(MIO_SEND_REQUEST_TIMEOUT);
-        }
-        conn->send_request_predicate = 0;
+        // Let threads that woke up the event loop use the send queue and
+        // handler lists before running the event loop again
+        while (conn->event_loop_waiters > 0)
+            pthread_cond_wait(&conn->send_request_cond,
+                              &conn->send_request_mutex);
         pthread_mutex_unlock(&conn->send_request_mutex);
     }
     mio_debug("Event loop completed");
@@ -221,10 +237,6 @@ int mio_connect(char *jid, char *pass, mio_handler_conn conn_handler,
     shd->conn_handler = conn_handler;
     shd->response = mio_response_new();
 
-    sem_unlink(jid);
-    conn->mio_open_requests = sem_open(jid, O_CREAT, S_IROTH | S_IWOTH,
-                                       MIO_MAX_OPEN_REQUESTS);
-
 // Initialize libstrophe
     xmpp_initialize();
 
@@ -250,6 +262,12 @@ int mio_connect(char *jid, char *pass, mio_handler_conn conn_handler,
         return MIO_ERROR_CONNECTION;
     }
 
+// Route IQ results to the requests waiting for them
+    _mio_event_loop_lock(shd->conn);
+    xmpp_handler_add(shd->conn->xmpp_conn, mio_handler_iq_dispatch, NULL, "iq",
+                     NULL, shd->conn);
+    _mio_event_loop_unlock(shd->conn);
+
 // Add keepalive handler
     mio_handler_timed_add(shd->conn,
                           (mio_handler) mio_handler_keepalive, KEEPALIVE_PERIOD, NULL);
@@ -331,94 +349,96 @@ int mio_reconnect(mio_conn_t *conn) {
     if (conn->xmpp_conn->state == XMPP_STATE_CONNECTED)
         return MIO_OK;
 
-    do {
-        // Free unneeded elements in connection
-        if (conn->xmpp_conn->tls) {
-            tls_stop(conn->xmpp_conn->tls);
-            tls_free(conn->xmpp_conn->tls);
-        }
+    // Free unneeded elements in connection
+    if (conn->xmpp_conn->tls) {
+        tls_stop(conn->xmpp_conn->tls);
+        tls_free(conn->xmpp_conn->tls);
+    }
 
-        if (conn->xmpp_conn->stream_error) {
-            xmpp_stanza_release(conn->xmpp_conn->stream_error->stanza);
-            if (conn->xmpp_conn->stream_error->text)
-                xmpp_free(conn->xmpp_conn->ctx,
-                          conn->xmpp_conn->stream_error->text);
-            xmpp_free(conn->xmpp_conn->ctx, conn->xmpp_conn->stream_error);
-            conn->xmpp_conn->stream_error = NULL;
-        }
+    if (conn->xmpp_conn->stream_error) {
+        xmpp_stanza_release(conn->xmpp_conn->stream_error->stanza);
+        if (conn->xmpp_conn->stream_error->text)
+            xmpp_free(conn->xmpp_conn->ctx,
+                      conn->xmpp_conn->stream_error->text);
+        xmpp_free(conn->xmpp_conn->ctx, conn->xmpp_conn->stream_error);
+        conn->xmpp_conn->stream_error = NULL;
+    }
 
-        parser_free(conn->xmpp_conn->parser);
+    parser_free(conn->xmpp_conn->parser);
 
-        if (conn->xmpp_conn->domain) {
-            xmpp_free(conn->xmpp_conn->ctx, conn->xmpp_conn->domain);
-            conn->xmpp_conn->domain = NULL;
-        }
-        if (conn->xmpp_conn->bound_jid) {
-            xmpp_free(conn->xmpp_conn->ctx, conn->xmpp_conn->bound_jid);
-            conn->xmpp_conn->bound_jid = NULL;
-        }
-        if (conn->xmpp_conn->stream_id) {
-            xmpp_free(conn->xmpp_conn->ctx, conn->xmpp_conn->stream_id);
-            conn->xmpp_conn->stream_id = NULL;
+    if (conn->xmpp_conn->domain) {
+        xmpp_free(conn->xmpp_conn->ctx, conn->xmpp_conn->domain);
+        conn->xmpp_conn->domain = NULL;
+    }
+    if (conn->xmpp_conn->bound_jid) {
+        xmpp_free(conn->xmpp_conn->ctx, conn->xmpp_conn->bound_jid);
+        conn->xmpp_conn->bound_jid = NULL;
+    }
+    if (conn->xmpp_conn->stream_id) {
+        xmpp_free(conn->xmpp_conn->ctx, conn->xmpp_conn->stream_id);
+        conn->xmpp_conn->stream_id = NULL;
+    }
+
+    // Drop the old socket from the event backend and remove the old
+    // connection from context's connlist
+    event_conn_unwatch(conn->xmpp_conn);
+    if (conn->xmpp_conn->ctx->connlist->conn == conn->xmpp_conn) {
+        item = conn->xmpp_conn->ctx->connlist;
+        conn->xmpp_conn->ctx->connlist = item->next;
+        xmpp_free(conn->xmpp_conn->ctx, item);
+    } else {
+        prev = NULL;
+        item = conn->xmpp_conn->ctx->connlist;
+        while (item && item->conn != conn->xmpp_conn) {
+            prev = item;
+            item = item->next;
         }
 
-        // Remove old connection from context's connlist
-        if (conn->xmpp_conn->ctx->connlist->conn == conn->xmpp_conn) {
-            item = conn->xmpp_conn->ctx->connlist;
-            conn->xmpp_conn->ctx->connlist = item->next;
-            xmpp_free(conn->xmpp_conn->ctx, item);
+        if (!item) {
+            xmpp_error(conn->xmpp_conn->ctx, "xmpp",
+                       "Connection not in context's list\n");
         } else {
-            prev = NULL;
-            item = conn->xmpp_conn->ctx->connlist;
-            while (item && item->conn != conn->xmpp_conn) {
-                prev = item;
-                item = item->next;
-            }
-
-            if (!item) {
-                xmpp_error(conn->xmpp_conn->ctx, "xmpp",
-                           "Connection not in context's list\n");
-            } else {
-                prev->next = item->next;
-                xmpp_free(conn->xmpp_conn->ctx, item);
-            }
-        }
-        // Setup new connection and copy handlers and send queue from old one
-        new_conn = xmpp_conn_new(conn->xmpp_conn->ctx);
-        xmpp_conn_set_jid(new_conn, conn->xmpp_conn->jid);
-        xmpp_conn_set_pass(new_conn, conn->xmpp_conn->pass);
-        new_conn->send_queue_head = conn->xmpp_conn->send_queue_head;
-        new_conn->send_queue_tail = conn->xmpp_conn->send_queue_tail;
-        new_conn->send_queue_len = conn->xmpp_conn->send_queue_len;
-        new_conn->send_queue_max = conn->xmpp_conn->send_queue_max;
-        new_conn->handlers = conn->xmpp_conn->handlers;
-        new_conn->id_handlers = conn->xmpp_conn->id_handlers;
-        new_conn->timed_handlers = conn->xmpp_conn->timed_handlers;
-        xmpp_free(conn->xmpp_conn->ctx, conn->xmpp_conn);
-
-        conn->xmpp_conn = new_conn;
-        shd = _mio_handler_data_new();
-        shd->conn = conn;
-
-        // Try to reconnect
-        mio_info("Attempting to reconnect to XMPP server %s using JID %s",
-                 shd->conn->xmpp_conn->domain, shd->conn->xmpp_conn->jid);
-        err = xmpp_connect_client(conn->xmpp_conn, NULL, 0,
-                                  mio_handler_conn_generic, shd);
-        conn->retries++;
-        if (err < 0) {
-            mio_error(
-                "Error connecting to XMPP server %s using JID %s, retry %d\n",
-                shd->conn->xmpp_conn->domain, shd->conn->xmpp_conn->jid,
-                conn->retries);
-            usleep(1000000 * MIO_RECONNECTION_TIMEOUT_S);
+            prev->next = item->next;
+            xmpp_free(conn->xmpp_conn->ctx, item);
         }
-#ifdef MIO_CONNECTION_RETRIES
-    } while(err < 0 && conn->retries < MIO_CONNECTION_RETRIES);
-#else
     }
-    while (err < 0);
-#endif
+    // Setup new connection and copy handlers and send queue from old one
+    new_conn = xmpp_conn_new(conn->xmpp_conn->ctx);
+    xmpp_conn_set_jid(new_conn, conn->xmpp_conn->jid);
+    xmpp_conn_set_pass(new_conn, conn->xmpp_conn->pass);
+    new_conn->send_queue_head = conn->xmpp_conn->send_queue_head;
+    new_conn->send_queue_tail = conn->xmpp_conn->send_queue_tail;
+    new_conn->send_queue_len = conn->xmpp_conn->send_queue_len;
+    new_conn->send_queue_max = conn->xmpp_conn->send_queue_max;
+    new_conn->send_queue_free = conn->xmpp_conn->send_queue_free;
+    new_conn->send_queue_free_len = conn->xmpp_conn->send_queue_free_len;
+    // Keep numbering the moved items, see conn_send_queue_replace()
+    new_conn->send_queue_done = conn->xmpp_conn->send_queue_done;
+    // Stay paused while responses held back by backpressure are pending
+    new_conn->read_paused = conn->xmpp_conn->read_paused;
+    if (conn->xmpp_conn->send_coalesce != NULL)
+        xmpp_free(conn->xmpp_conn->ctx, conn->xmpp_conn->send_coalesce);
+    handler_move(conn->xmpp_conn, new_conn);
+    hash_release(conn->xmpp_conn->id_handlers);
+    xmpp_free(conn->xmpp_conn->ctx, conn->xmpp_conn);
+
+    conn->xmpp_conn = new_conn;
+    shd = _mio_handler_data_new();
+    shd->conn = conn;
+
+    // Try to reconnect
+    mio_info("Attempting to reconnect to XMPP server %s using JID %s",
+             shd->conn->xmpp_conn->domain, shd->conn->xmpp_conn->jid);
+    err = xmpp_connect_client(conn->xmpp_conn, NULL, 0,
+                              mio_handler_conn_generic, shd);
+    conn->retries++;
+    if (err < 0) {
+        mio_error(
+            "Error connecting to XMPP server %s using JID %s, retry %d\n",
+            shd->conn->xmpp_conn->domain, shd->conn->xmpp_conn->jid,
+            conn->retries);
+        _mio_reconnect_schedule(conn);
+    }
     return MIO_OK;
 }
 
@@ -451,8 +471,6 @@ int mio_disconnect(mio_conn_t *conn) {
         mio_info("Disconnected");
     }
     xmpp_shutdown();
-    sem_close(conn->mio_open_requests);
-    sem_unlink(conn->xmpp_conn->jid);
     pthread_mutex_unlock(&conn->event_loop_mutex);
     return MIO_OK;
 }
@@ -30,5 +30,8 @@ int mio_connect(char *jid, char *pass, mio_handler_conn conn_handler,
 int mio_disconnect(mio_conn_t *conn);
 int mio_password_change(mio_conn_t * conn, const char *new_pass,
                         mio_response_t * response);
+int mio_password_change_async(mio_conn_t * conn, const char *new_pass,
+                              mio_completion completion, void *userdata,
+                              unsigned int deadline_ms);
 int mio_reconnect(mio_conn_t *conn);
 #endif
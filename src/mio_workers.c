@@ -0,0 +1,368 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+
+
+#include <string.h>
+#include <stdlib.h>
+#include "mio_workers.h"
+
+extern mio_log_level_t _mio_log_level;
+
+// Runs the handler of a received stanza, runs in a worker thread
+static void _mio_worker_job_run(mio_conn_t *conn, mio_worker_job_t *job) {
+    mio_handler_data_t *shd = job->handler_data;
+    mio_stanza_t s;
+    int err;
+
+    memset(&s, 0, sizeof(s));
+    s.xmpp_stanza = job->stanza;
+    if (job->request != NULL) {
+        // The request may have been cancelled while the job was queued, it
+        // cannot time out before the job is done
+        if (__atomic_load_n(&job->request->token, __ATOMIC_ACQUIRE) == job->token
+                && job->handler(conn, &s, job->response, NULL) == MIO_OK)
+            _mio_request_complete_async(conn, job->request, job->token, MIO_OK);
+        __atomic_sub_fetch(&job->request->worker_jobs, 1, __ATOMIC_RELEASE);
+    } else {
+        // Later stanzas may have been queued before the handler asked to be
+        // removed
+        if (!__atomic_load_n(&shd->removed, __ATOMIC_ACQUIRE)) {
+            err = shd->handler(conn, &s, shd->response, shd->userdata);
+            if (job->type == MIO_HANDLER_ID && err == MIO_OK)
+                _mio_handler_id_remove(conn, shd,
+                                       xmpp_stanza_get_id(job->stanza));
+            else if (job->type == MIO_HANDLER && err == MIO_HANDLER_REMOVE)
+                __atomic_store_n(&shd->removed, 1, __ATOMIC_RELEASE);
+        }
+        _mio_handler_data_unref(shd);
+    }
+    xmpp_stanza_release(job->stanza);
+}
+
+static void *_mio_worker_run(void *arg) {
+    mio_workers_t *workers = (mio_workers_t*) arg;
+    mio_worker_job_t *job;
+
+    pthread_mutex_lock(&workers->mutex);
+    for (;;) {
+        while (workers->head == NULL && !workers->stopping)
+            pthread_cond_wait(&workers->cond, &workers->mutex);
+        // Jobs queued before the stop still run
+        job = workers->head;
+        if (job == NULL)
+            break;
+        workers->head = job->next;
+        if (workers->head == NULL)
+            workers->tail = NULL;
+        workers->stats.queued--;
+        workers->running++;
+        pthread_mutex_unlock(&workers->mutex);
+
+        _mio_worker_job_run(workers->conn, job);
+
+        pthread_mutex_lock(&workers->mutex);
+        workers->running--;
+        workers->stats.done++;
+        if (workers->free_jobs_len < MIO_WORKERS_FREE_JOBS_MAX_LEN) {
+            job->next = workers->free_jobs;
+            workers->free_jobs = job;
+            workers->free_jobs_len++;
+        } else
+            free(job);
+        if (workers->head == NULL && workers->running == 0)
+            pthread_cond_broadcast(&workers->idle_cond);
+    }
+    pthread_mutex_unlock(&workers->mutex);
+    return NULL;
+}
+
+// Queues a copy of job holding its own reference to the stanza, runs in the
+// event loop thread
+static int _mio_workers_submit(mio_conn_t *conn, const mio_worker_job_t *job) {
+    mio_workers_t *workers = conn->workers;
+    mio_worker_job_t *queued;
+
+    pthread_mutex_lock(&workers->mutex);
+    queued = workers->free_jobs;
+    if (queued != NULL) {
+        workers->free_jobs = queued->next;
+        workers->free_jobs_len--;
+    } else if ((queued = malloc(sizeof(mio_worker_job_t))) == NULL) {
+        pthread_mutex_unlock(&workers->mutex);
+        return MIO_ERROR_MALLOC;
+    }
+    *queued = *job;
+    queued->next = NULL;
+    queued->stanza = xmpp_stanza_clone(job->stanza);
+    if (workers->tail != NULL)
+        workers->tail->next = queued;
+    else
+        workers->head = queued;
+    workers->tail = queued;
+    workers->stats.jobs++;
+    if (++workers->stats.queued > workers->stats.max_queued)
+        workers->stats.max_queued = workers->stats.queued;
+    pthread_cond_signal(&workers->cond);
+    pthread_mutex_unlock(&workers->mutex);
+    return MIO_OK;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to hand the response to an in-flight request to the
+ * handler workers. The request cannot time out until the workers are done
+ * with the response. Must be called from the event loop thread while workers
+ * are running.
+ *
+ * @param conn A pointer to an active mio connection with handler workers.
+ * @param stanza A pointer to the received response stanza.
+ * @param request A pointer to the request the stanza answers.
+ * @param token The token of the request.
+ * @returns MIO_OK if a worker will run the request's handler, otherwise an
+ * error and the handler has to run in the event loop thread.
+ */
+int _mio_workers_submit_request(mio_conn_t *conn, xmpp_stanza_t *stanza,
+                                mio_request_t *request, uint32_t token) {
+    mio_worker_job_t job;
+    int err;
+
+    memset(&job, 0, sizeof(job));
+    job.stanza = stanza;
+    job.type = request->handler_type;
+    job.request = request;
+    job.token = token;
+    job.handler = request->handler;
+    job.response = request->response;
+    __atomic_add_fetch(&request->worker_jobs, 1, __ATOMIC_ACQ_REL);
+    err = _mio_workers_submit(conn, &job);
+    if (err != MIO_OK)
+        __atomic_sub_fetch(&request->worker_jobs, 1, __ATOMIC_RELEASE);
+    return err;
+}
+
+/**
+ * @ingroup Internal
+ * Internal function to hand a stanza matched by a handler added with
+ * mio_handler_add() or mio_handler_id_add() to the handler workers. The job
+ * holds a reference to the handler data. Must be called from the event loop
+ * thread while workers are running.
+ *
+ * @param conn A pointer to an active mio connection with handler workers.
+ * @param stanza A pointer to the received stanza.
+ * @param handler_data A pointer to the data of the matching handler.
+ * @param type MIO_HANDLER or MIO_HANDLER_ID.
+ * @returns MIO_OK if a worker will run the handler, otherwise an error and the
+ * handler has to run in the event loop thread.
+ */
+int _mio_workers_submit_handler(mio_conn_t *conn, xmpp_stanza_t *stanza,
+                                mio_handler_data_t *handler_data, mio_handler_type_t type) {
+    mio_worker_job_t job;
+    int err;
+
+    memset(&job, 0, sizeof(job));
+    job.stanza = stanza;
+    job.type = type;
+    job.handler_data = handler_data;
+    __atomic_add_fetch(&handler_data->refs, 1, __ATOMIC_ACQ_REL);
+    err = _mio_workers_submit(conn, &job);
+    if (err != MIO_OK)
+        __atomic_sub_fetch(&handler_data->refs, 1, __ATOMIC_RELEASE);
+    return err;
+}
+
+/**
+ * @ingroup Core
+ * Starts threads that run the handlers of received stanzas, so that the event
+ * loop thread only reads and parses stanzas. Responses to requests and
+ * stanzas matched by mio_handler_add() and mio_handler_id_add() handlers are
+ * decoded by the workers. Completions of asynchronous requests are called
+ * from the worker that ran the request's handler. Pubsub events received
+ * after mio_pubsub_data_listen_start() are still decoded while they are
+ * parsed, which takes the event loop less time than building their stanza.
+ *
+ * With more than one worker, handlers run concurrently and stanzas are not
+ * necessarily handled in the order they were received, so handlers must be
+ * thread safe.
+ *
+ * @param conn A pointer to a mio connection. It does not need to be active.
+ * @param n_workers The number of worker threads, at least 1.
+ * @returns MIO_OK on success, MIO_ERROR_WORKERS if workers are already running
+ * or n_workers is less than 1, MIO_ERROR_RUN_THREAD or MIO_ERROR_MALLOC if the
+ * workers could not be started.
+ */
+int mio_handler_workers_start(mio_conn_t *conn, int n_workers) {
+    mio_workers_t *workers;
+    int i, err = MIO_OK;
+
+    if (n_workers < 1 || conn->workers != NULL)
+        return MIO_ERROR_WORKERS;
+    workers = malloc(sizeof(mio_workers_t));
+    if (workers == NULL)
+        return MIO_ERROR_MALLOC;
+    memset(workers, 0, sizeof(mio_workers_t));
+    workers->conn = conn;
+    workers->threads = malloc(n_workers * sizeof(pthread_t));
+    if (workers->threads == NULL) {
+        free(workers);
+        return MIO_ERROR_MALLOC;
+    }
+    pthread_mutex_init(&workers->mutex, NULL );
+    pthread_cond_init(&workers->cond, NULL );
+    pthread_cond_init(&workers->idle_cond, NULL );
+    workers->stats.workers = n_workers;
+
+    for (i = 0; i < n_workers; i++) {
+        if (pthread_create(&workers->threads[i], NULL, _mio_worker_run,
+                           workers) != 0) {
+            mio_error("Could not start handler worker %d", i);
+            err = MIO_ERROR_RUN_THREAD;
+            break;
+        }
+        workers->n_threads++;
+    }
+
+    _mio_event_loop_lock(conn);
+    if (err == MIO_OK && conn->workers == NULL)
+        conn->workers = workers;
+    else if (err == MIO_OK)
+        err = MIO_ERROR_WORKERS;
+    _mio_event_loop_unlock(conn);
+    if (err == MIO_OK)
+        return MIO_OK;
+
+    // Nothing has been queued, so the threads exit right away
+    pthread_mutex_lock(&workers->mutex);
+    workers->stopping = 1;
+    pthread_cond_broadcast(&workers->cond);
+    pthread_mutex_unlock(&workers->mutex);
+    for (i = 0; i < workers->n_threads; i++)
+        pthread_join(workers->threads[i], NULL );
+    pthread_mutex_destroy(&workers->mutex);
+    pthread_cond_destroy(&workers->cond);
+    pthread_cond_destroy(&workers->idle_cond);
+    free(workers->threads);
+    free(workers);
+    return err;
+}
+
+/**
+ * @ingroup Core
+ * Stops the handler workers of a mio connection once they have run the
+ * handlers of all stanzas handed to them. Handlers run in the event loop
+ * thread again from then on. Must not be called with the event loop mutex
+ * held or from a handler.
+ *
+ * @param conn A pointer to a mio connection.
+ * @returns MIO_OK, also if no workers were running.
+ */
+int mio_handler_workers_stop(mio_conn_t *conn) {
+    mio_workers_t *workers;
+    mio_worker_job_t *job;
+    int i;
+
+    _mio_event_loop_lock(conn);
+    workers = conn->workers;
+    conn->workers = NULL;
+    _mio_event_loop_unlock(conn);
+    if (workers == NULL)
+        return MIO_OK;
+
+    pthread_mutex_lock(&workers->mutex);
+    workers->stopping = 1;
+    pthread_cond_broadcast(&workers->cond);
+    pthread_mutex_unlock(&workers->mutex);
+    for (i = 0; i < workers->n_threads; i++)
+        pthread_join(workers->threads[i], NULL );
+    // Threads that picked up the pool before it was detached are still
+    // returning from mio_handler_workers_drain()
+    pthread_mutex_lock(&workers->mutex);
+    while (workers->draining > 0)
+        pthread_cond_wait(&workers->idle_cond, &workers->mutex);
+    pthread_mutex_unlock(&workers->mutex);
+
+    while ((job = workers->free_jobs) != NULL) {
+        workers->free_jobs = job->next;
+        free(job);
+    }
+    pthread_mutex_destroy(&workers->mutex);
+    pthread_cond_destroy(&workers->cond);
+    pthread_cond_destroy(&workers->idle_cond);
+    free(workers->threads);
+    free(workers);
+    return MIO_OK;
+}
+
+/**
+ * @ingroup Core
+ * Waits until the handler workers of a mio connection have run the handlers
+ * of all stanzas handed to them so far. Returns right away if no workers are
+ * running. Must not be called from a handler.
+ *
+ * @param conn A pointer to a mio connection.
+ */
+void mio_handler_workers_drain(mio_conn_t *conn) {
+    mio_workers_t *workers;
+
+    // mio_handler_workers_stop() detaches the pool under the event loop mutex
+    // and frees it once no thread is draining it
+    _mio_event_loop_lock(conn);
+    workers = conn->workers;
+    if (workers != NULL) {
+        pthread_mutex_lock(&workers->mutex);
+        workers->draining++;
+        pthread_mutex_unlock(&workers->mutex);
+    }
+    _mio_event_loop_unlock(conn);
+    if (workers == NULL)
+        return;
+
+    pthread_mutex_lock(&workers->mutex);
+    while (workers->head != NULL || workers->running > 0)
+        pthread_cond_wait(&workers->idle_cond, &workers->mutex);
+    workers->draining--;
+    pthread_cond_broadcast(&workers->idle_cond);
+    pthread_mutex_unlock(&workers->mutex);
+}
+
+/**
+ * @ingroup Core
+ * Reads the counters of the handler workers of a mio connection.
+ *
+ * @param conn A pointer to a mio connection.
+ * @param stats A pointer to the struct that receives the counters, all zero
+ * if no workers are running.
+ */
+void mio_handler_workers_stats(mio_conn_t *conn, mio_workers_stats_t *stats) {
+    mio_workers_t *workers;
+
+    memset(stats, 0, sizeof(mio_workers_stats_t));
+    // The pool cannot be freed while the event loop mutex is held
+    _mio_event_loop_lock(conn);
+    workers = conn->workers;
+    if (workers != NULL) {
+        pthread_mutex_lock(&workers->mutex);
+        *stats = workers->stats;
+        pthread_mutex_unlock(&workers->mutex);
+    }
+    _mio_event_loop_unlock(conn);
+}
@@ -0,0 +1,88 @@
+/******************************************************************************
+ *  Mortar IO (MIO) Library
+ *  C Strophe Implementation
+ *  Copyright (C) 2014, Carnegie Mellon University
+ *  All rights reserved.
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, version 2.0 of the License.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  Contributing Authors (specific to this file):
+ *  Patrick Lazik
+ *******************************************************************************/
+
+
+
+#ifndef ____mio_workers__
+#define ____mio_workers__
+
+#include <mio.h>
+
+// Finished jobs a worker pool keeps for reuse
+#define MIO_WORKERS_FREE_JOBS_MAX_LEN 256
+
+// Counters of the handler workers, see mio_handler_workers_stats()
+typedef struct {
+    uint64_t jobs; // Stanzas handed to the workers
+    uint64_t done; // Stanzas the workers are done with
+    unsigned int queued; // Stanzas waiting for a worker
+    unsigned int max_queued; // Most stanzas that waited at once
+    int workers;
+} mio_workers_stats_t;
+
+typedef struct mio_worker_job mio_worker_job_t;
+
+// A received stanza waiting for a worker to run its handler. The job holds a
+// reference to the stanza, so the event loop can go on parsing.
+struct mio_worker_job {
+    mio_worker_job_t *next;
+    xmpp_stanza_t *stanza;
+    mio_handler_type_t type;
+    // Request answered by the stanza, and its token, handler and response at
+    // the time the stanza arrived
+    mio_request_t *request;
+    uint32_t token;
+    mio_handler handler;
+    mio_response_t *response;
+    // Handler added by mio_handler_add() or mio_handler_id_add() if there is
+    // no request
+    struct mio_handler_data *handler_data;
+};
+
+// Threads that run stanza handlers off the event loop thread, see
+// mio_handler_workers_start()
+struct mio_workers {
+    mio_conn_t *conn;
+    pthread_t *threads;
+    int n_threads;
+    pthread_mutex_t mutex; // Protects everything but conn and threads
+    pthread_cond_t cond; // Signalled when a job is queued or on stop
+    // Broadcast when no job is queued or running and when a drain returns
+    pthread_cond_t idle_cond;
+    mio_worker_job_t *head, *tail; // FIFO of queued jobs
+    mio_worker_job_t *free_jobs;
+    unsigned int free_jobs_len, running;
+    int stopping;
+    int draining; // Threads in mio_handler_workers_drain(), stop waits for them
+    mio_workers_stats_t stats;
+};
+
+int mio_handler_workers_start(mio_conn_t *conn, int n_workers);
+int mio_handler_workers_stop(mio_conn_t *conn);
+void mio_handler_workers_drain(mio_conn_t *conn);
+void mio_handler_workers_stats(mio_conn_t *conn, mio_workers_stats_t *stats);
+int _mio_workers_submit_request(mio_conn_t *conn, xmpp_stanza_t *stanza,
+                                mio_request_t *request, uint32_t token);
+int _mio_workers_submit_handler(mio_conn_t *conn, xmpp_stanza_t *stanza,
+                                struct mio_handler_data *handler_data, mio_handler_type_t type);
+
+#endif /* defined(____mio_workers__) */